@@ -80,7 +80,9 @@ Only the two ET boards have been tested.
  #define GPIOSPI_SD_MOSI          GPIO7
  #define RCC_SPI                  RCC_APB2ENR
  #define RCC_SPI_SD               RCC_APB2ENR_SPI1EN
-/* - for SPI1 and full-speed APB2: 72MHz/4 */
+/* - for SPI1 and full-speed APB2: 72MHz/4. The fast prescaler is the fastest
+     allowed; a slower one is chosen if the card CSD requires it. */
+ #define SPI_SD_PCLK              rcc_apb2_frequency
  #define SPI_BaudRatePrescaler_fast    SPI_CR1_BR_FPCLK_DIV_4
  #define SPI_BaudRatePrescaler_slow    SPI_CR1_BR_FPCLK_DIV_256
 
@@ -112,8 +114,10 @@ Only the two ET boards have been tested.
  #define RCC_SPI                  RCC_APB1ENR
  #define RCC_SPI_SD               RCC_APB1ENR_SPI2EN
 
-/* - for SPI2 and full-speed APB1: 36MHz/2 */
- #define SPI_BaudRatePrescaler_fast    SPI_CR1_BR_FPCLK_DIV_4
+/* - for SPI2 and full-speed APB1: 36MHz/2. The fast prescaler is the fastest
+     allowed; a slower one is chosen if the card CSD requires it. */
+ #define SPI_SD_PCLK              rcc_apb1_frequency
+ #define SPI_BaudRatePrescaler_fast    SPI_CR1_BR_FPCLK_DIV_2
  #define SPI_BaudRatePrescaler_slow    SPI_CR1_BR_FPCLK_DIV_256
 
 #elif defined USE_EK_STM32F
@@ -0,0 +1,84 @@
+/*-----------------------------------------------------------------------*/
+/* Unicode conversion for ChaN FatFs long file names, code page 437       */
+/*-----------------------------------------------------------------------*/
+
+/* LFN entries hold UTF-16 names, so FatFs needs the OEM to Unicode conversion
+and a case conversion for name matching. This replaces option/ccsbcs.c with
+code page 437 only, to keep the flash small. Case conversion covers ASCII,
+Latin-1 and the Greek letters of the code page; other characters compare as
+they are.
+
+Copyright (c) 2013 Ken Sarkies
+*/
+
+#include "ff.h"
+
+#if _USE_LFN != 0
+
+#if _CODE_PAGE != 437
+#error cc437.c supports only code page 437
+#endif
+
+/* Unicode of OEM characters 0x80-0xFF */
+static const WCHAR oemToUnicode[128] =
+{
+    0x00C7, 0x00FC, 0x00E9, 0x00E2, 0x00E4, 0x00E0, 0x00E5, 0x00E7,
+    0x00EA, 0x00EB, 0x00E8, 0x00EF, 0x00EE, 0x00EC, 0x00C4, 0x00C5,
+    0x00C9, 0x00E6, 0x00C6, 0x00F4, 0x00F6, 0x00F2, 0x00FB, 0x00F9,
+    0x00FF, 0x00D6, 0x00DC, 0x00A2, 0x00A3, 0x00A5, 0x20A7, 0x0192,
+    0x00E1, 0x00ED, 0x00F3, 0x00FA, 0x00F1, 0x00D1, 0x00AA, 0x00BA,
+    0x00BF, 0x2310, 0x00AC, 0x00BD, 0x00BC, 0x00A1, 0x00AB, 0x00BB,
+    0x2591, 0x2592, 0x2593, 0x2502, 0x2524, 0x2561, 0x2562, 0x2556,
+    0x2555, 0x2563, 0x2551, 0x2557, 0x255D, 0x255C, 0x255B, 0x2510,
+    0x2514, 0x2534, 0x252C, 0x251C, 0x2500, 0x253C, 0x255E, 0x255F,
+    0x255A, 0x2554, 0x2569, 0x2566, 0x2560, 0x2550, 0x256C, 0x2567,
+    0x2568, 0x2564, 0x2565, 0x2559, 0x2558, 0x2552, 0x2553, 0x256B,
+    0x256A, 0x2518, 0x250C, 0x2588, 0x2584, 0x258C, 0x2590, 0x2580,
+    0x03B1, 0x00DF, 0x0393, 0x03C0, 0x03A3, 0x03C3, 0x00B5, 0x03C4,
+    0x03A6, 0x0398, 0x03A9, 0x03B4, 0x221E, 0x03C6, 0x03B5, 0x2229,
+    0x2261, 0x00B1, 0x2265, 0x2264, 0x2320, 0x2321, 0x00F7, 0x2248,
+    0x00B0, 0x2219, 0x00B7, 0x221A, 0x207F, 0x00B2, 0x25A0, 0x00A0
+};
+
+/*---------------------------------------------------------------------------*/
+/** @brief Convert between OEM and Unicode
+
+@param[in] chr: WCHAR character to convert.
+@param[in] dir: UINT 0: Unicode to OEM, 1: OEM to Unicode.
+@returns WCHAR converted character, or zero if there is no equivalent.
+*/
+
+WCHAR ff_convert(WCHAR chr, UINT dir)
+{
+    WCHAR c;
+
+    if (chr < 0x80) return chr;             /* ASCII */
+    if (dir)                                /* OEM to Unicode */
+    {
+        return (chr < 0x100) ? oemToUnicode[chr - 0x80] : 0;
+    }
+    for (c = 0; c < 0x80; c++)              /* Unicode to OEM */
+    {
+        if (chr == oemToUnicode[c]) return c + 0x80;
+    }
+    return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Convert a Unicode Character to Upper Case
+
+@param[in] chr: WCHAR character.
+@returns WCHAR upper case character.
+*/
+
+WCHAR ff_wtoupper(WCHAR chr)
+{
+    if ((chr >= 'a') && (chr <= 'z')) return chr - 0x20;
+    if ((chr >= 0xE0) && (chr <= 0xFE) && (chr != 0xF7)) return chr - 0x20;
+    if (chr == 0xFF) return 0x178;
+    if (chr == 0x192) return 0x191;
+    if ((chr >= 0x3B1) && (chr <= 0x3C9) && (chr != 0x3C2)) return chr - 0x20;
+    return chr;
+}
+
+#endif
@@ -38,7 +38,7 @@
 
 /* Reentrancy related */
 #if _FS_REENTRANT
-#if _USE_LFN == 1
+#if _USE_LFN == 1 && _VOLUMES > 1	/* The buffer is only used with the volume locked */
 #error Static LFN work area cannot be used at thread-safe configuration
 #endif
 #define	ENTER_FF(fs)		{ if (!lock_fs(fs)) return FR_TIMEOUT; }
@@ -525,6 +525,22 @@ typedef struct {
 static FATFS *FatFs[_VOLUMES];	/* Pointer to the file system objects (logical drives) */
 static WORD Fsid;				/* File system mount ID */
 
+#if _DIR_INDEX_CACHE
+typedef struct {
+	DWORD	sclust;		/* Start cluster of the directory (0:root on FAT12/16) */
+	DWORD	ofs;		/* Offset of the first entry of the object in the directory */
+	WORD	id;			/* Mount ID of the volume */
+	WORD	hash;		/* Hash of the name looked up */
+} DIRIDX;
+static DIRIDX DirIndex[_DIR_INDEX_CACHE];	/* Directory index cache (not part of ChaN FatFs) */
+static BYTE DirIndexNext;					/* Next entry to be replaced */
+#if _USE_LFN != 0
+#define DIR_INDEX_SPAN	((_MAX_LFN + 12) / 13 + 1)	/* Most entries used by a name */
+#else
+#define DIR_INDEX_SPAN	1
+#endif
+#endif
+
 #if _FS_RPATH != 0 && _VOLUMES >= 2
 static BYTE CurrVol;			/* Current drive */
 #endif
@@ -2162,9 +2178,13 @@ FRESULT dir_read (
 /* Directory handling - Find an object in the directory                  */
 /*-----------------------------------------------------------------------*/
 
+/* Compare directory entries with the name, starting at the current entry. At
+most n entries are examined, or all to the end of the directory if n is 0. */
+
 static
-FRESULT dir_find (	/* FR_OK(0):succeeded, !=0:error */
-	DIR* dp			/* Pointer to the directory object with the file name */
+FRESULT dir_match (	/* FR_OK(0):succeeded, !=0:error */
+	DIR* dp,		/* Pointer to the directory object with the file name */
+	UINT n			/* Number of entries to examine, 0:no limit */
 )
 {
 	FRESULT res;
@@ -2174,26 +2194,6 @@ FRESULT dir_find (	/* FR_OK(0):succeeded, !=0:error */
 	BYTE a, ord, sum;
 #endif
 
-	res = dir_sdi(dp, 0);			/* Rewind directory object */
-	if (res != FR_OK) return res;
-#if _FS_EXFAT
-	if (fs->fs_type == FS_EXFAT) {	/* On the exFAT volume */
-		BYTE nc;
-		UINT di, ni;
-		WORD hash = xname_sum(fs->lfnbuf);		/* Hash value of the name to find */
-
-		while ((res = dir_read(dp, 0)) == FR_OK) {	/* Read an item */
-			if (ld_word(fs->dirbuf + XDIR_NameHash) != hash) continue;	/* Skip the comparison if hash value mismatched */
-			for (nc = fs->dirbuf[XDIR_NumName], di = SZDIRE * 2, ni = 0; nc; nc--, di += 2, ni++) {	/* Compare the name */
-				if ((di % SZDIRE) == 0) di += 2;
-				if (ff_wtoupper(ld_word(fs->dirbuf + di)) != ff_wtoupper(fs->lfnbuf[ni])) break;
-			}
-			if (nc == 0 && !fs->lfnbuf[ni]) break;	/* Name matched? */
-		}
-		return res;
-	}
-#endif
-	/* On the FAT12/16/32 volume */
 #if _USE_LFN != 0
 	ord = sum = 0xFF; dp->blk_ofs = 0xFFFFFFFF;	/* Reset LFN sequence */
 #endif
@@ -2227,6 +2227,7 @@ FRESULT dir_find (	/* FR_OK(0):succeeded, !=0:error */
 		dp->obj.attr = dp->dir[DIR_Attr] & AM_MASK;
 		if (!(dp->dir[DIR_Attr] & AM_VOL) && !mem_cmp(dp->dir, dp->fn, 11)) break;	/* Is it a valid entry? */
 #endif
+		if (n && --n == 0) { res = FR_NO_FILE; break; }	/* Examined all that were asked for */
 		res = dir_next(dp, 0);	/* Next entry */
 	} while (res == FR_OK);
 
@@ -2234,6 +2235,99 @@ FRESULT dir_find (	/* FR_OK(0):succeeded, !=0:error */
 }
 
 
+#if _DIR_INDEX_CACHE
+/* Hash of the name being looked up: the LFN in upper case, or the SFN when
+only the SFN is compared. */
+
+static
+WORD dir_index_hash (
+	DIR* dp			/* Pointer to the directory object with the file name */
+)
+{
+	WORD hash = 0;
+	UINT i;
+
+#if _USE_LFN != 0
+	if (!(dp->fn[NSFLAG] & NS_NOLFN)) {
+		for (i = 0; dp->obj.fs->lfnbuf[i]; i++) hash = (WORD)(hash * 31 + ff_wtoupper(dp->obj.fs->lfnbuf[i]));
+		return hash;
+	}
+#endif
+	for (i = 0; i < 11; i++) hash = (WORD)(hash * 31 + dp->fn[i]);
+	return hash;
+}
+#endif
+
+
+static
+FRESULT dir_find (	/* FR_OK(0):succeeded, !=0:error */
+	DIR* dp			/* Pointer to the directory object with the file name */
+)
+{
+	FRESULT res;
+#if _FS_EXFAT || _DIR_INDEX_CACHE
+	FATFS *fs = dp->obj.fs;
+#endif
+#if _DIR_INDEX_CACHE
+	DIRIDX *idx;
+	WORD hash;
+	UINT i;
+#endif
+
+	res = dir_sdi(dp, 0);			/* Rewind directory object */
+	if (res != FR_OK) return res;
+#if _FS_EXFAT
+	if (fs->fs_type == FS_EXFAT) {	/* On the exFAT volume */
+		BYTE nc;
+		UINT di, ni;
+		WORD hash = xname_sum(fs->lfnbuf);		/* Hash value of the name to find */
+
+		while ((res = dir_read(dp, 0)) == FR_OK) {	/* Read an item */
+			if (ld_word(fs->dirbuf + XDIR_NameHash) != hash) continue;	/* Skip the comparison if hash value mismatched */
+			for (nc = fs->dirbuf[XDIR_NumName], di = SZDIRE * 2, ni = 0; nc; nc--, di += 2, ni++) {	/* Compare the name */
+				if ((di % SZDIRE) == 0) di += 2;
+				if (ff_wtoupper(ld_word(fs->dirbuf + di)) != ff_wtoupper(fs->lfnbuf[ni])) break;
+			}
+			if (nc == 0 && !fs->lfnbuf[ni]) break;	/* Name matched? */
+		}
+		return res;
+	}
+#endif
+	/* On the FAT12/16/32 volume */
+#if _DIR_INDEX_CACHE
+	/* Try where the name was last found in this directory */
+	hash = dir_index_hash(dp);
+	for (i = 0, idx = DirIndex; i < _DIR_INDEX_CACHE; i++, idx++) {
+		if (idx->id == fs->id && idx->sclust == dp->obj.sclust && idx->hash == hash) break;
+	}
+	if (i < _DIR_INDEX_CACHE) {
+		res = dir_sdi(dp, idx->ofs);
+		if (res == FR_OK) res = dir_match(dp, DIR_INDEX_SPAN);
+		if (res == FR_OK) return res;
+		res = dir_sdi(dp, 0);		/* Moved or removed: scan the directory */
+		if (res != FR_OK) return res;
+	} else {
+		idx = &DirIndex[DirIndexNext];	/* Replace the oldest entry */
+		if (++DirIndexNext >= _DIR_INDEX_CACHE) DirIndexNext = 0;
+	}
+	res = dir_match(dp, 0);
+	if (res == FR_OK) {				/* Remember where it was found */
+		idx->id = fs->id;
+		idx->sclust = dp->obj.sclust;
+		idx->hash = hash;
+#if _USE_LFN != 0
+		idx->ofs = (dp->blk_ofs != 0xFFFFFFFF) ? dp->blk_ofs : dp->dptr;
+#else
+		idx->ofs = dp->dptr;
+#endif
+	}
+	return res;
+#else
+	return dir_match(dp, 0);
+#endif
+}
+
+
 
 
 #if !_FS_READONLY
@@ -4410,7 +4504,8 @@ FRESULT f_truncate (
 	if (res != FR_OK || (res = (FRESULT)fp->err) != FR_OK) LEAVE_FF(fs, res);
 	if (!(fp->flag & FA_WRITE)) LEAVE_FF(fs, FR_DENIED);	/* Check access mode */
 
-	if (fp->obj.objsize > fp->fptr) {
+	/* Also free clusters allocated beyond the end of the file by f_expand option 2 */
+	if (fp->obj.objsize > fp->fptr || fp->obj.sclust != 0) {
 		if (fp->fptr == 0) {	/* When set file size to zero, remove entire cluster chain */
 			res = remove_chain(&fp->obj, fp->obj.sclust, 0);
 			fp->obj.sclust = 0;
@@ -4421,6 +4516,8 @@ FRESULT f_truncate (
 			if (ncl == 1) res = FR_INT_ERR;
 			if (res == FR_OK && ncl < fs->n_fatent) {
 				res = remove_chain(&fp->obj, ncl, fp->clust);
+			} else if (res == FR_OK && fp->obj.objsize == fp->fptr) {
+				LEAVE_FF(fs, FR_OK);	/* Nothing beyond the end, so leave the file unmodified */
 			}
 		}
 		fp->obj.objsize = fp->fptr;	/* Set file size to current R/W point */
@@ -5050,23 +5147,37 @@ FRESULT f_setlabel (
 FRESULT f_expand (
 	FIL* fp,		/* Pointer to the file object */
 	FSIZE_t fsz,	/* File size to be expanded to */
-	BYTE opt		/* Operation mode 0:Find and prepare or 1:Find and allocate */
+	BYTE opt		/* Operation mode 0:Find and prepare, 1:Find and allocate or 2:Allocate and keep size */
 )
 {
 	FRESULT res;
 	FATFS *fs;
-	DWORD n, clst, stcl, scl, ncl, tcl, lclst;
+	DWORD n, clst, stcl, scl, ncl, tcl, lclst, ecl;
 
 
 	res = validate(&fp->obj, &fs);		/* Check validity of the file object */
 	if (res != FR_OK || (res = (FRESULT)fp->err) != FR_OK) LEAVE_FF(fs, res);
-	if (fsz == 0 || fp->obj.objsize != 0 || !(fp->flag & FA_WRITE)) LEAVE_FF(fs, FR_DENIED);
+	if (fsz == 0 || (fp->obj.objsize != 0 && opt != 2) || !(fp->flag & FA_WRITE)) LEAVE_FF(fs, FR_DENIED);
 #if _FS_EXFAT
 	if (fs->fs_type != FS_EXFAT && fsz >= 0x100000000) LEAVE_FF(fs, FR_DENIED);	/* Check if in size limit */
 #endif
 	n = (DWORD)fs->csize * SS(fs);	/* Cluster size */
 	tcl = (DWORD)(fsz / n) + ((fsz & (n - 1)) ? 1 : 0);	/* Number of clusters required */
-	stcl = fs->last_clst; lclst = 0;
+	stcl = fs->last_clst; lclst = 0; ecl = 0;
+	if (opt == 2 && fp->obj.sclust != 0) {	/* Option 2 adds the block to the end of an existing chain */
+#if _FS_EXFAT
+		if (fs->fs_type == FS_EXFAT) LEAVE_FF(fs, FR_DENIED);
+#endif
+		ecl = fp->clust ? fp->clust : fp->obj.sclust;
+		for (;;) {	/* Find the last cluster, searching from the R/W point */
+			n = get_fat(&fp->obj, ecl);
+			if (n == 1) LEAVE_FF(fs, FR_INT_ERR);
+			if (n == 0xFFFFFFFF) LEAVE_FF(fs, FR_DISK_ERR);
+			if (n >= fs->n_fatent) break;
+			ecl = n;
+		}
+		stcl = ecl + 1;	/* Keep the block after it if possible */
+	}
 	if (stcl < 2 || stcl >= fs->n_fatent) stcl = 2;
 
 #if _FS_EXFAT
@@ -5105,6 +5216,7 @@ FRESULT f_expand (
 					if (res != FR_OK) break;
 					lclst = clst;
 				}
+				if (res == FR_OK && ecl) res = put_fat(fs, ecl, scl);	/* Link the block to the chain */
 			} else {
 				lclst = scl - 1;
 			}
@@ -5114,8 +5226,8 @@ FRESULT f_expand (
 	if (res == FR_OK) {
 		fs->last_clst = lclst;		/* Set suggested start cluster to start next */
 		if (opt) {
-			fp->obj.sclust = scl;		/* Update object allocation information */
-			fp->obj.objsize = fsz;
+			if (!ecl) fp->obj.sclust = scl;		/* Update object allocation information */
+			if (!(opt & 2)) fp->obj.objsize = fsz;	/* Option 2 leaves the size at zero for writes to fill */
 			if (_FS_EXFAT) fp->obj.stat = 2;	/* Set status 'contiguous chain' */
 			fp->flag |= FA_MODIFIED;
 			if (fs->free_clst  < fs->n_fatent - 2) {	/* Update FSINFO */
@@ -47,8 +47,10 @@
 /* This option switches fast seek function. (0:Disable or 1:Enable) */
 
 
-#define	_USE_EXPAND		0
-/* This option switches f_expand function. (0:Disable or 1:Enable) */
+#define	_USE_EXPAND		1
+/* This option switches f_expand function. (0:Disable or 1:Enable)
+/  The local option value 2 allocates the block without extending the file
+/  size, so that later writes fill it. f_truncate frees what is left unused. */
 
 
 #define _USE_CHMOD		0
@@ -69,7 +71,7 @@
 / Locale and Namespace Configurations
 /---------------------------------------------------------------------------*/
 
-#define _CODE_PAGE	932
+#define _CODE_PAGE	437
 /* This option specifies the OEM code page to be used on the target system.
 /  Incorrect setting of the code page can cause a file open failure.
 /
@@ -98,8 +100,8 @@
 */
 
 
-#define	_USE_LFN	0
-#define	_MAX_LFN	255
+#define	_USE_LFN	1
+#define	_MAX_LFN	64
 /* The _USE_LFN switches the support of long file name (LFN).
 /
 /   0: Disable support of LFN. _MAX_LFN has no effect.
@@ -115,6 +117,12 @@
 /  memory for the working buffer, memory management functions, ff_memalloc() and
 /  ff_memfree(), must be added to the project. */
 
+/* This project uses the static buffer with _FS_REENTRANT, which ff.c allows for a
+/  single volume since the buffer is only used with the volume locked. _MAX_LFN
+/  is reduced to save RAM (the buffer and each FILINFO); longer names found in a
+/  directory are reported by their short name. cc437.c provides the conversions
+/  for code page 437. */
+
 
 #define	_LFN_UNICODE	0
 /* This option switches character encoding on the API. (0:ANSI/OEM or 1:UTF-16)
@@ -241,9 +249,11 @@
 /      lock control is independent of re-entrancy. */
 
 
-#define _FS_REENTRANT	0
+#ifndef _FS_REENTRANT
+#define _FS_REENTRANT	1
+#endif
 #define _FS_TIMEOUT		1000
-#define	_SYNC_t			HANDLE
+#define	_SYNC_t			xSemaphoreHandle
 /* The option _FS_REENTRANT switches the re-entrancy (thread safe) of the FatFs
 /  module itself. Note that regardless of this option, file access to different
 /  volume is always re-entrant and volume control functions, f_mount(), f_mkfs()
@@ -261,7 +271,62 @@
 /  SemaphoreHandle_t and etc.. A header file for O/S definitions needs to be
 /  included somewhere in the scope of ff.h. */
 
-/* #include <windows.h>	// O/S definitions  */
+/* The sync objects are FreeRTOS mutexes (freertos.c), so a low priority task
+/  holding the volume inherits the priority of a higher one waiting for it. Host
+/  builds without FreeRTOS define _FS_REENTRANT as 0. */
+
+#if _FS_REENTRANT
+#include "FreeRTOS.h"	/* O/S definitions */
+#include "semphr.h"
+#endif
+
+
+
+/*---------------------------------------------------------------------------/
+/ Sector Cache Configurations (sector_cache.c, not part of ChaN FatFs)
+/---------------------------------------------------------------------------*/
+
+#ifndef _SECTOR_CACHE
+#define _SECTOR_CACHE		0
+#endif
+/* The option _SECTOR_CACHE sets the number of sectors held in the write-back
+/  cache between FatFs and the card driver. Each sector costs 512 bytes of RAM
+/  plus 12 bytes of housekeeping. Single sector writes (FAT, directory and file
+/  buffer) are held until evicted or synced; adjacent dirty sectors are then
+/  written as one multiple block write. The firmware syncs after every record,
+/  so the cache only pays for its RAM with _SECTOR_CACHE_SYNC above 0, and it is
+/  disabled by default.
+/
+/   0: Disable the cache. The card driver is called directly. */
+
+
+#ifndef _SECTOR_CACHE_SYNC
+#define _SECTOR_CACHE_SYNC	0
+#endif
+/* The option _SECTOR_CACHE_SYNC sets how many consecutive CTRL_SYNC requests
+/  the cache may absorb before writing back its dirty sectors. f_sync() and
+/  f_close() both end in CTRL_SYNC, so this bounds the number of syncs whose
+/  data can be lost on power failure. An explicit CTRL_CACHE_FLUSH request is
+/  never deferred.
+/
+/   0: Write back on every CTRL_SYNC. */
+
+
+/*---------------------------------------------------------------------------/
+/ Directory Index Cache Configurations (added to ff.c, not part of ChaN FatFs)
+/---------------------------------------------------------------------------*/
+
+#ifndef _DIR_INDEX_CACHE
+#define _DIR_INDEX_CACHE	16
+#endif
+/* The option _DIR_INDEX_CACHE sets the number of directory entries whose
+/  position is remembered by ff.c, keyed by the directory, the mount and a hash
+/  of the name. A path lookup first checks the remembered position of each
+/  component and only scans the directory if the entry there no longer matches,
+/  so reopening a file in a deep directory tree takes one read per level. Each
+/  entry costs 12 bytes of RAM.
+/
+/   0: Disable the cache. Every lookup scans the directory. */
 
 
 /*--- End of configuration options ---*/
@@ -1,5 +1,14 @@
 /*  FreeRTOS semaphore locking for Chan FAT
 
+Each volume is guarded by a mutex rather than a binary semaphore so that a low
+priority task reading a file inherits the priority of a recording task waiting
+for the volume. FatFs holds the volume for one API call, so a reader that
+transfers no more than a sector per call delays the recorder by at most one
+sector transfer.
+
+The mutexes are created once and reused when a volume is remounted, as the
+firmware heap (heap_1) cannot free memory.
+
 Copyright K Sarkies 30 September 2013
 */
 
@@ -11,21 +20,25 @@ Copyright K Sarkies 30 September 2013
 #include "FreeRTOS.h"
 #include "semphr.h"
 
+static _SYNC_t volumeMutex[_VOLUMES];
+
 /*---------------------------------------------------------------------------*/
 /** @brief Create a Sync Object
 
-Create a sync object. For FreeRTOS this is a semaphore to lock out access while
-another access is happening to the same volume.
+Create a sync object. For FreeRTOS this is a mutex to lock out access while
+another access is happening to the same volume. The mutex for the volume is
+created on the first mount only.
 
-@param[in] BYTE vol: The volume being accessed. An index to an array of semaphores.
-@param[in] _SYNC_t* sobj: pointer to an external semaphore array.
-@returns true if the semaphore was successfully created.
+@param[in] BYTE vol: The volume being accessed. An index to the mutex array.
+@param[out] _SYNC_t* sobj: pointer to the sync object of the volume.
+@returns true if the mutex was successfully created.
 */
 
 int ff_cre_syncobj(BYTE vol, _SYNC_t* sobj)
 {
-    vSemaphoreCreateBinary(sobj[vol]);
-    return (sobj[vol] != NULL);
+    if (volumeMutex[vol] == NULL) volumeMutex[vol] = xSemaphoreCreateMutex();
+    *sobj = volumeMutex[vol];
+    return (*sobj != NULL);
 }
 
 /*---------------------------------------------------------------------------*/
@@ -33,7 +46,7 @@ int ff_cre_syncobj(BYTE vol, _SYNC_t* sobj)
 
 Lock the sync object.
 
-@param[in] _SYNC_t sobj: The semaphore.
+@param[in] _SYNC_t sobj: The mutex.
 @returns true if the grant was successful.
 */
 
@@ -43,11 +56,11 @@ int ff_req_grant(_SYNC_t sobj)
 }
 
 /*---------------------------------------------------------------------------*/
-/** @brief Grant a Sync Request
+/** @brief Release a Sync Request
 
 Unlock the sync object.
 
-@param[in] _SYNC_t sobj: The semaphore.
+@param[in] _SYNC_t sobj: The mutex.
 */
 
 void ff_rel_grant(_SYNC_t sobj)
@@ -58,19 +71,18 @@ void ff_rel_grant(_SYNC_t sobj)
 /*---------------------------------------------------------------------------*/
 /** @brief Delete a Sync Object
 
-A semaphore shouldn't be deleted while in use. Solve this by grabbing it then
-releasing. There is no 100% reliable way to do this in FreeRTOS.
+The mutex is kept for the next mount. Wait until any access in progress has
+finished so that the volume is not unmounted from under it.
 
-@param[in] _SYNC_t sobj: The semaphore.
-@returns true if the delete was successful.
+@param[in] _SYNC_t sobj: The mutex.
+@returns true if the volume was released in time.
 */
 
 int ff_del_syncobj(_SYNC_t sobj)
 {
-    xSemaphoreTake(sobj,portMAX_DELAY);
+    if (! xSemaphoreTake(sobj,_FS_TIMEOUT)) return 0;
     xSemaphoreGive(sobj);
-    vSemaphoreDelete(sobj);
-    return (sobj == NULL);
+    return 1;
 }
 
 #endif
@@ -0,0 +1,390 @@
+/*-----------------------------------------------------------------------*/
+/* Host disk image backend for ChaN FatFs                                */
+/*-----------------------------------------------------------------------*/
+
+/* This provides the ChaN FAT low level disk interface on a Linux host so that
+ff.c can be run unchanged against a disk image for testing and benchmarking.
+
+The image is a plain file of 512 byte sectors with no partition table. It can
+be accessed with pread/pwrite or mapped into memory, in which case a sync
+flushes the map.
+
+Each read, write and ioctl is optionally traced to a file as a line of comma
+separated values:
+
+time (us), operation (R, W or I), sector (or ioctl code), count, busy (us)
+
+The busy time is computed from a model of an SD card in SPI mode driven by
+sd_spi_loc3_stm32_freertos.c: each command costs a fixed overhead, each sector
+costs its transfer time, reads wait for the data token and writes wait for the
+card to finish programming. In a multiple block write the programming of each
+block overlaps the transfer of the next, so a lower per block figure applies.
+*/
+
+/* Copyright (c) 2013 Ken Sarkies
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions are met:
+
+   * Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in
+     the documentation and/or other materials provided with the
+     distribution.
+   * Neither the name of the copyright holders nor the names of
+     contributors may be used to endorse or promote products derived
+     from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE. */
+
+#define _FILE_OFFSET_BITS 64
+
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "ffconf.h"
+#include "diskio.h"
+#define SECTOR_CACHE_DRIVER
+#include "sector_cache.h"
+#include "diskio_host.h"
+
+#define SECTOR_SIZE     512
+
+static DSTATUS Stat = STA_NOINIT;   /* Disk status */
+static int imageFile = -1;          /* Image file descriptor */
+static BYTE *imageMap = 0;          /* Memory map of the image if used */
+static DWORD imageSectors = 0;      /* Size of image in sectors */
+static FILE *traceFile = 0;
+static diskObserver observer = 0;
+static struct diskModel model;
+static struct diskStatistics statistics;
+static QWORD now = 0;               /* Simulated time in microseconds */
+
+/*---------------------------------------------------------------------------*/
+/** @brief Default Card Model
+
+Sets typical figures for an SD card clocked at the given SPI rate. The transfer
+time covers the data token, 512 data bytes and two CRC bytes.
+
+@param[out] *model: struct diskModel model to fill.
+@param[in] spiClock: DWORD SPI clock in Hz.
+*/
+
+void host_disk_default_model(struct diskModel *model, DWORD spiClock)
+{
+    model->commandTime = (8*8*1000000UL)/spiClock + 10;
+    model->transferTime = (515*8*1000000ULL)/spiClock;
+    model->accessTime = 100;
+    model->programTime = 800;
+    model->multiProgramTime = 250;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Open a Disk Image
+
+The image is created if it does not exist and is extended (sparse) to the
+requested size.
+
+@param[in] *path: char name of the image file.
+@param[in] sectors: DWORD size of the image in sectors, or zero to use the
+size of an existing file.
+@param[in] useMmap: int nonzero to access the image through a memory map.
+@returns int 0 on success, -1 on failure.
+*/
+
+int host_disk_open(const char *path, DWORD sectors, int useMmap)
+{
+    imageFile = open(path, O_RDWR | O_CREAT, 0644);
+    if (imageFile < 0) return -1;
+    off_t size = lseek(imageFile, 0, SEEK_END);
+    if (sectors == 0) sectors = size/SECTOR_SIZE;
+    if ((sectors == 0) ||
+        (((off_t)sectors*SECTOR_SIZE > size) &&
+         (ftruncate(imageFile, (off_t)sectors*SECTOR_SIZE) != 0)))
+    {
+        close(imageFile);
+        imageFile = -1;
+        return -1;
+    }
+    imageSectors = sectors;
+    if (useMmap)
+    {
+        void *map = mmap(0, (size_t)sectors*SECTOR_SIZE, PROT_READ | PROT_WRITE,
+                         MAP_SHARED, imageFile, 0);
+        if (map == MAP_FAILED)
+        {
+            close(imageFile);
+            imageFile = -1;
+            return -1;
+        }
+        imageMap = map;
+    }
+    if (model.transferTime == 0) host_disk_default_model(&model, 18000000);
+    Stat = STA_NOINIT;
+    return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Close the Disk Image
+
+*/
+
+void host_disk_close(void)
+{
+    if (imageMap)
+    {
+        msync(imageMap, (size_t)imageSectors*SECTOR_SIZE, MS_SYNC);
+        munmap(imageMap, (size_t)imageSectors*SECTOR_SIZE);
+        imageMap = 0;
+    }
+    if (imageFile >= 0) close(imageFile);
+    imageFile = -1;
+    Stat = STA_NOINIT;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Set the Card Timing Model
+
+@param[in] *newModel: struct diskModel model to use.
+*/
+
+void host_disk_set_model(const struct diskModel *newModel)
+{
+    model = *newModel;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Set the Trace File
+
+@param[in] *trace: FILE open trace file, or null to stop tracing.
+*/
+
+void host_disk_trace(FILE *trace)
+{
+    traceFile = trace;
+    if (traceFile) fprintf(traceFile, "time,op,sector,count,busy\n");
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Set the Operation Observer
+
+@param[in] newObserver: diskObserver function called after each read and
+write, or null.
+*/
+
+void host_disk_observer(diskObserver newObserver)
+{
+    observer = newObserver;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Advance the Simulated Clock
+
+The clock is never moved backwards, so if the card was still busy at the
+requested time the clock is left where it is.
+
+@param[in] time: QWORD time in microseconds.
+*/
+
+void host_disk_advance_to(QWORD time)
+{
+    if (time > now) now = time;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Simulated Clock
+
+@returns QWORD time in microseconds.
+*/
+
+QWORD host_disk_time(void)
+{
+    return now;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Operation Statistics
+
+Resetting the statistics also returns the simulated clock to zero.
+*/
+
+const struct diskStatistics *host_disk_statistics(void)
+{
+    return &statistics;
+}
+
+void host_disk_reset_statistics(void)
+{
+    memset(&statistics, 0, sizeof(statistics));
+    now = 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Account for an Operation
+
+Advances the clock by the busy time, records it in the statistics and writes
+the trace line.
+*/
+
+static void account(char op, DWORD sector, UINT count, DWORD busy)
+{
+    if (traceFile)
+        fprintf(traceFile, "%llu,%c,%u,%u,%u\n",
+                (unsigned long long)now, op, sector, count, busy);
+    now += busy;
+    statistics.busyTime += busy;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Initialize the Disk
+
+@param[in] drv: BYTE Physical drive number (only 0 allowed)
+@returns DSTATUS disk status.
+*/
+
+DSTATUS disk_initialize(BYTE drv)
+{
+    if (drv) return STA_NOINIT;
+    if (imageFile >= 0) Stat &= ~STA_NOINIT;
+    else Stat = STA_NODISK | STA_NOINIT;
+    return Stat;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Get the Disk Status
+
+@param[in] drv: BYTE Physical drive number (only 0 allowed)
+@returns DSTATUS disk status.
+*/
+
+DSTATUS disk_status(BYTE drv)
+{
+    if (drv) return STA_NOINIT;
+    return Stat;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Read Sector(s)
+
+@param[in] drv: BYTE Physical drive number (only 0 allowed)
+@param[out] *buff: BYTE Pointer to buffer
+@param[in] sector: DWORD starting sector number
+@param[in] count: UINT number of sectors to read
+@returns DRESULT success (RES_OK) or fail.
+*/
+
+DRESULT disk_read(BYTE drv, BYTE *buff, DWORD sector, UINT count)
+{
+    if (drv || !count) return RES_PARERR;
+    if (Stat & STA_NOINIT) return RES_NOTRDY;
+    if ((QWORD)sector + count > imageSectors) return RES_PARERR;
+    size_t length = (size_t)count*SECTOR_SIZE;
+    off_t offset = (off_t)sector*SECTOR_SIZE;
+    if (imageMap) memcpy(buff, imageMap + offset, length);
+    else if (pread(imageFile, buff, length, offset) != (ssize_t)length)
+        return RES_ERROR;
+/* Multiple block reads end with a STOP_TRANSMISSION command */
+    DWORD busy = model.commandTime +
+                 count*(model.accessTime + model.transferTime);
+    if (count > 1) busy += model.commandTime;
+    statistics.reads++;
+    statistics.readSectors += count;
+    account('R', sector, count, busy);
+    if (observer) observer('R', sector, count);
+    return RES_OK;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Write Sector(s)
+
+@param[in] drv: BYTE Physical drive number (only 0 allowed)
+@param[in] *buff: BYTE Pointer to buffer
+@param[in] sector: DWORD starting sector number
+@param[in] count: UINT number of sectors to write
+@returns DRESULT success (RES_OK) or fail.
+*/
+
+#if _FS_READONLY == 0
+
+DRESULT disk_write(BYTE drv, const BYTE *buff, DWORD sector, UINT count)
+{
+    if (drv || !count) return RES_PARERR;
+    if (Stat & STA_NOINIT) return RES_NOTRDY;
+    if (Stat & STA_PROTECT) return RES_WRPRT;
+    if ((QWORD)sector + count > imageSectors) return RES_PARERR;
+    size_t length = (size_t)count*SECTOR_SIZE;
+    off_t offset = (off_t)sector*SECTOR_SIZE;
+    if (imageMap) memcpy(imageMap + offset, buff, length);
+    else if (pwrite(imageFile, buff, length, offset) != (ssize_t)length)
+        return RES_ERROR;
+/* Multiple block writes are preceded by ACMD23 and end with a STOP_TRAN
+token that the card holds busy until programming is complete. */
+    DWORD busy;
+    if (count == 1)
+        busy = model.commandTime + model.transferTime + model.programTime;
+    else
+        busy = 2*model.commandTime +
+               count*(model.transferTime + model.multiProgramTime) +
+               model.programTime;
+    statistics.writes++;
+    statistics.writtenSectors += count;
+    account('W', sector, count, busy);
+    if (observer) observer('W', sector, count);
+    return RES_OK;
+}
+
+#endif
+
+/*---------------------------------------------------------------------------*/
+/** @brief Miscellaneous Functions
+
+@param[in] drv: BYTE Physical drive number (only 0 allowed)
+@param[in] ctrl: BYTE Control code
+@param[in] *buff: void Buffer to send/receive control data
+@returns DRESULT success (RES_OK) or fail.
+*/
+
+DRESULT disk_ioctl(BYTE drv, BYTE ctrl, void *buff)
+{
+    DRESULT res = RES_PARERR;
+    if (drv) return RES_PARERR;
+    if (Stat & STA_NOINIT) return RES_NOTRDY;
+    switch (ctrl)
+    {
+/* Writes are already complete in the model; the card is only polled */
+    case CTRL_SYNC :
+        if (imageMap) msync(imageMap, (size_t)imageSectors*SECTOR_SIZE, MS_ASYNC);
+        statistics.syncs++;
+        res = RES_OK;
+        break;
+    case GET_SECTOR_COUNT :
+        *(DWORD*)buff = imageSectors;
+        res = RES_OK;
+        break;
+    case GET_SECTOR_SIZE :
+        *(WORD*)buff = SECTOR_SIZE;
+        res = RES_OK;
+        break;
+    case GET_BLOCK_SIZE :
+        *(DWORD*)buff = 1;
+        res = RES_OK;
+        break;
+    }
+    statistics.ioctls++;
+    account('I', ctrl, 0, model.commandTime);
+    return res;
+}
+
@@ -0,0 +1,59 @@
+/*-----------------------------------------------------------------------*/
+/* Host disk image backend for ChaN FatFs                                */
+/*-----------------------------------------------------------------------*/
+
+/* Provides disk_initialize, disk_status, disk_read, disk_write and disk_ioctl
+on a Linux host, backed by an image file accessed either with pread/pwrite or
+through a shared memory map. Every sector operation can be traced with a
+timestamp, and a simple model of an SD card on the SPI bus accumulates the
+time the card would have been busy.
+
+Time is simulated. The clock advances by the modelled busy time of each
+operation and is moved forward explicitly by the caller between operations.
+
+Copyright (c) 2013 Ken Sarkies
+*/
+
+#ifndef DISKIO_HOST_H_
+#define DISKIO_HOST_H_
+
+#include <stdio.h>
+#include "integer.h"
+
+/* Timing model of the card, all times in microseconds */
+struct diskModel
+{
+    DWORD commandTime;          /* Command, response and select overhead */
+    DWORD transferTime;         /* Transfer of one sector with token and CRC */
+    DWORD accessTime;           /* Wait for the read data token */
+    DWORD programTime;          /* Busy after a single block write */
+    DWORD multiProgramTime;     /* Busy per block in a multiple block write */
+};
+
+/* Operation counts and modelled busy time */
+struct diskStatistics
+{
+    DWORD reads;
+    DWORD writes;
+    DWORD readSectors;
+    DWORD writtenSectors;
+    DWORD syncs;
+    DWORD ioctls;
+    QWORD busyTime;
+};
+
+/* Called for every read ('R') and write ('W') after it completes */
+typedef void (*diskObserver)(char op, DWORD sector, UINT count);
+
+int host_disk_open(const char *path, DWORD sectors, int useMmap);
+void host_disk_close(void);
+void host_disk_set_model(const struct diskModel *model);
+void host_disk_default_model(struct diskModel *model, DWORD spiClock);
+void host_disk_trace(FILE *trace);
+void host_disk_observer(diskObserver observer);
+void host_disk_advance_to(QWORD time);
+QWORD host_disk_time(void);
+const struct diskStatistics *host_disk_statistics(void);
+void host_disk_reset_statistics(void);
+
+#endif
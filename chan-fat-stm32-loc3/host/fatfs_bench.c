@@ -0,0 +1,471 @@
+/*-----------------------------------------------------------------------*/
+/* Recording workload benchmark for ChaN FatFs on a host disk image      */
+/*-----------------------------------------------------------------------*/
+
+/* Replays the power management recording workload through ff.c onto a disk
+image provided by diskio_host.c, and reports how the card is used.
+
+The monitor task records one block of records every 500ms: a time record, then
+for each battery its current and voltage (dual), state of charge and
+operational status, then the load and panel currents and voltages (dual), and
+finally temperature, controls, switches, decisions and indicators. Each record
+is a separate f_write of an ASCII line, and the file task follows every write
+with f_sync, as in the 'P' command of power-management-file.c.
+
+A fresh FAT32 volume is created on the image before each run. ffconf.h has
+_USE_MKFS disabled so a minimal formatter is provided here.
+
+The report covers the sectors touched and how often, writes to the FAT, the
+directory and the data area, write amplification (bytes written to the card
+per byte of record data) and the modelled busy time of the card.
+
+The sector cache (sector_cache.c) is built in with up to _SECTOR_CACHE sectors
+and is off unless -C is given, so that runs with and without it can be
+compared. Its report shows the writes FatFs asked for against the writes that
+reached the card.
+
+Usage: fatfs_bench [-d seconds] [-c cluster sectors] [-s r|c|n] [-m]
+                   [-i image] [-t trace] [-k spi clock]
+                   [-C cache sectors] [-S syncs deferred]
+
+-s selects when f_sync is called: after every record (r, the firmware's
+behaviour), once per cycle (c) or only on close (n).
+*/
+
+/* Copyright (c) 2013 Ken Sarkies
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions are met:
+
+   * Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in
+     the documentation and/or other materials provided with the
+     distribution.
+   * Neither the name of the copyright holders nor the names of
+     contributors may be used to endorse or promote products derived
+     from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "ff.h"
+#include "diskio.h"
+#include "fattime.h"
+#include "sector_cache.h"
+#include "diskio_host.h"
+
+#define NUM_BATS            3
+#define NUM_LOADS           2
+#define NUM_PANELS          1
+#define CYCLE_PERIOD        500000      /* Monitor cycle in microseconds */
+#define MIN_CLUSTERS        65526       /* Fewest clusters for FAT32 */
+#define RESERVED_SECTORS    32
+#define START_TIME          1481328000  /* 10 December 2016 00:00 UTC */
+
+enum syncPolicy { SYNC_RECORD, SYNC_CYCLE, SYNC_NONE };
+
+static FATFS fileSystem;
+static BYTE *touched;                   /* One bit per sector written */
+static DWORD uniqueSectors;
+static DWORD fatWrites, directoryWrites, systemWrites, dataWrites;
+static DWORD cycleWrites, maxCycleWrites;
+
+/*---------------------------------------------------------------------------*/
+/** @brief Time for FAT Timestamps
+
+Taken from the simulated clock of the disk backend.
+*/
+
+DWORD get_fattime (void)
+{
+    time_t currentTime = START_TIME + (time_t)(host_disk_time()/1000000);
+    struct tm *rtc = gmtime(&currentTime);
+
+    return  (((DWORD)rtc->tm_year - 80) << 25)
+            | ((DWORD)(rtc->tm_mon + 1) << 21)
+            | ((DWORD)rtc->tm_mday << 16)
+            | (WORD)(rtc->tm_hour << 11)
+            | (WORD)(rtc->tm_min << 5)
+            | (WORD)(rtc->tm_sec >> 1);
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Classify Each Written Sector
+
+The volume layout is taken from the mounted file system. The root directory is
+the only directory used, and it occupies its first cluster.
+*/
+
+static void observeWrite(char op, DWORD sector, UINT count)
+{
+    if (op != 'W') return;
+    DWORD fatEnd = fileSystem.fatbase + fileSystem.fsize*fileSystem.n_fats;
+    DWORD rootSector = fileSystem.database +
+                       (fileSystem.dirbase - 2)*fileSystem.csize;
+    for (; count > 0; count--, sector++)
+    {
+        if (!(touched[sector >> 3] & (1 << (sector & 7))))
+        {
+            touched[sector >> 3] |= 1 << (sector & 7);
+            uniqueSectors++;
+        }
+        if (sector < fileSystem.fatbase) systemWrites++;
+        else if (sector < fatEnd) fatWrites++;
+        else if ((sector >= rootSector) &&
+                 (sector < rootSector + fileSystem.csize)) directoryWrites++;
+        else dataWrites++;
+        cycleWrites++;
+    }
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Store a Little Endian Word and Double Word
+
+*/
+
+static void putWord(BYTE *p, WORD value)
+{
+    p[0] = (BYTE)value;
+    p[1] = (BYTE)(value >> 8);
+}
+
+static void putDword(BYTE *p, DWORD value)
+{
+    putWord(p, (WORD)value);
+    putWord(p+2, (WORD)(value >> 16));
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Create a FAT32 Volume
+
+The volume starts at sector zero without a partition table. Only the boot
+sector, FSInfo, the backup boot sector and the first sector of each FAT are
+written; the rest of a freshly created image is already zero, which includes
+the root directory cluster.
+
+@param[in] sectors: DWORD size of the volume in sectors.
+@param[in] clusterSize: WORD sectors per cluster.
+@returns int 0 on success, -1 if the volume is too small for FAT32.
+*/
+
+static int formatVolume(DWORD sectors, WORD clusterSize)
+{
+    BYTE sector[512];
+    DWORD fatSize = 1;
+    DWORD clusters = 0;
+/* Iterate the FAT size until the number of clusters fits */
+    while (1)
+    {
+        clusters = (sectors - RESERVED_SECTORS - 2*fatSize)/clusterSize;
+        DWORD needed = ((clusters + 2)*4 + 511)/512;
+        if (needed <= fatSize) break;
+        fatSize = needed;
+    }
+    if (clusters < MIN_CLUSTERS) return -1;
+
+    memset(sector, 0, sizeof(sector));
+    sector[0] = 0xEB; sector[1] = 0x58; sector[2] = 0x90;
+    memcpy(sector+3, "MSDOS5.0", 8);
+    putWord(sector+11, 512);                /* Bytes per sector */
+    sector[13] = (BYTE)clusterSize;
+    putWord(sector+14, RESERVED_SECTORS);
+    sector[16] = 2;                         /* Number of FATs */
+    sector[21] = 0xF8;                      /* Media */
+    putWord(sector+24, 63);                 /* Sectors per track */
+    putWord(sector+26, 255);                /* Heads */
+    putDword(sector+32, sectors);
+    putDword(sector+36, fatSize);
+    putDword(sector+44, 2);                 /* Root directory cluster */
+    putWord(sector+48, 1);                  /* FSInfo sector */
+    putWord(sector+50, 6);                  /* Backup boot sector */
+    sector[64] = 0x80;                      /* Drive number */
+    sector[66] = 0x29;                      /* Extended boot signature */
+    putDword(sector+67, 0x20161210);        /* Volume serial number */
+    memcpy(sector+71, "NO NAME    ", 11);
+    memcpy(sector+82, "FAT32   ", 8);
+    sector[510] = 0x55; sector[511] = 0xAA;
+    if (disk_write(0, sector, 0, 1) != RES_OK) return -1;
+    if (disk_write(0, sector, 6, 1) != RES_OK) return -1;
+
+    memset(sector, 0, sizeof(sector));
+    putDword(sector, 0x41615252);
+    putDword(sector+484, 0x61417272);
+    putDword(sector+488, clusters - 1);     /* Free clusters */
+    putDword(sector+492, 3);                /* Next free cluster */
+    putDword(sector+508, 0xAA550000);
+    if (disk_write(0, sector, 1, 1) != RES_OK) return -1;
+
+    memset(sector, 0, sizeof(sector));
+    putDword(sector, 0x0FFFFFF8);
+    putDword(sector+4, 0x0FFFFFFF);
+    putDword(sector+8, 0x0FFFFFFF);         /* Root directory, one cluster */
+    if (disk_write(0, sector, RESERVED_SECTORS, 1) != RES_OK) return -1;
+    if (disk_write(0, sector, RESERVED_SECTORS + fatSize, 1) != RES_OK)
+        return -1;
+    return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Write One Record
+
+@param[in] *file: FIL open file.
+@param[in] *record: char record line.
+@param[in] sync: int nonzero to sync the file after writing.
+@returns int number of bytes written, -1 on error.
+*/
+
+static int writeRecord(FIL *file, const char *record, int sync)
+{
+    UINT length = strlen(record);
+    UINT numWritten = 0;
+    if (f_write(file, record, length, &numWritten) != FR_OK) return -1;
+    if (numWritten != length) return -1;
+    if (sync && (f_sync(file) != FR_OK)) return -1;
+    return numWritten;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Record One Monitor Cycle
+
+The values drift slowly so that line lengths vary as they do in practice.
+
+@param[in] *file: FIL open file.
+@param[in] cycle: DWORD cycle number.
+@param[in] sync: int nonzero to sync after each record.
+@returns long payload bytes written, -1 on error.
+*/
+
+static long recordCycle(FIL *file, DWORD cycle, int sync)
+{
+    char record[80];
+    long total = 0;
+    int length, i;
+    time_t currentTime = START_TIME + (time_t)(cycle/2);
+    strftime(record, sizeof(record), "pH,%Y-%m-%dT%H:%M:%S\r\n",
+             gmtime(&currentTime));
+    if ((length = writeRecord(file, record, sync)) < 0) return -1;
+    total += length;
+    for (i=0; i<NUM_BATS; i++)
+    {
+        int current = (int)((cycle*37 + i*1000) % 4000) - 2000;
+        snprintf(record, sizeof(record), "dB%d,%d,%d\r\n", i+1, current,
+                 3200 + (int)((cycle + i*7) % 200));
+        if ((length = writeRecord(file, record, sync)) < 0) return -1;
+        total += length;
+        snprintf(record, sizeof(record), "dC%d,%d\r\n", i+1,
+                 20000 + (int)((cycle*3 + i) % 5600));
+        if ((length = writeRecord(file, record, sync)) < 0) return -1;
+        total += length;
+        snprintf(record, sizeof(record), "dO%d,%d\r\n", i+1, (i == 1) ? 1 : 0);
+        if ((length = writeRecord(file, record, sync)) < 0) return -1;
+        total += length;
+    }
+    for (i=0; i<NUM_LOADS; i++)
+    {
+        snprintf(record, sizeof(record), "dL%d,%d,%d\r\n", i+1,
+                 300 + (int)((cycle*11 + i) % 900), 3190);
+        if ((length = writeRecord(file, record, sync)) < 0) return -1;
+        total += length;
+    }
+    for (i=0; i<NUM_PANELS; i++)
+    {
+        snprintf(record, sizeof(record), "dM%d,%d,%d\r\n", i+1,
+                 (int)((cycle*5) % 2600), 4500);
+        if ((length = writeRecord(file, record, sync)) < 0) return -1;
+        total += length;
+    }
+    const char *singles[] = {"dT", "dD", "ds", "dd", "dI"};
+    const int values[] = {6400 + (int)(cycle % 256), 11, 0x19, 0x280, 0x11};
+    for (i=0; i<5; i++)
+    {
+        snprintf(record, sizeof(record), "%s,%d\r\n", singles[i], values[i]);
+        if ((length = writeRecord(file, record, sync)) < 0) return -1;
+        total += length;
+    }
+    return total;
+}
+
+/*---------------------------------------------------------------------------*/
+
+int main(int argc, char **argv)
+{
+    long duration = 3600;
+    WORD clusterSize = 8;
+    int useMmap = 0;
+    enum syncPolicy policy = SYNC_RECORD;
+    const char *imageName = "bench.img";
+    const char *traceName = 0;
+    DWORD spiClock = 18000000;
+    UINT cacheSectors = 0;
+    UINT cacheSyncs = 0;
+    int option;
+
+    while ((option = getopt(argc, argv, "d:c:s:mi:t:k:C:S:")) != -1)
+    {
+        switch (option)
+        {
+        case 'd': duration = atol(optarg); break;
+        case 'c': clusterSize = (WORD)atoi(optarg); break;
+        case 'm': useMmap = 1; break;
+        case 'i': imageName = optarg; break;
+        case 't': traceName = optarg; break;
+        case 'k': spiClock = (DWORD)atol(optarg); break;
+        case 'C': cacheSectors = (UINT)atoi(optarg); break;
+        case 'S': cacheSyncs = (UINT)atoi(optarg); break;
+        case 's':
+            if (optarg[0] == 'c') policy = SYNC_CYCLE;
+            else if (optarg[0] == 'n') policy = SYNC_NONE;
+            else policy = SYNC_RECORD;
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-d seconds] [-c cluster sectors] "
+                    "[-s r|c|n] [-m] [-i image] [-t trace] [-k spi clock] "
+                    "[-C cache sectors] [-S syncs deferred]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+    if ((clusterSize == 0) || (clusterSize > 128) ||
+        (clusterSize & (clusterSize - 1)))
+    {
+        fprintf(stderr, "Cluster size must be a power of two up to 128\n");
+        return 1;
+    }
+
+/* Size the image so that the volume is FAT32 with room to spare */
+    DWORD sectors = (MIN_CLUSTERS + 1024)*clusterSize + 2*2048 +
+                    RESERVED_SECTORS;
+    unlink(imageName);
+    if (host_disk_open(imageName, sectors, useMmap) != 0)
+    {
+        fprintf(stderr, "Cannot open image %s\n", imageName);
+        return 1;
+    }
+    struct diskModel model;
+    host_disk_default_model(&model, spiClock);
+    host_disk_set_model(&model);
+    sector_cache_configure(0, 0);
+    disk_initialize(0);
+    if (formatVolume(sectors, clusterSize) != 0)
+    {
+        fprintf(stderr, "Cannot create the volume\n");
+        host_disk_close();
+        return 1;
+    }
+    touched = calloc((sectors + 7)/8, 1);
+
+    FILE *trace = 0;
+    if (traceName) trace = fopen(traceName, "w");
+    host_disk_reset_statistics();
+    if (cacheSectors > _SECTOR_CACHE) cacheSectors = _SECTOR_CACHE;
+    sector_cache_configure(cacheSectors, cacheSyncs);
+    host_disk_trace(trace);
+    host_disk_observer(observeWrite);
+
+    FIL file;
+    if ((f_mount(&fileSystem, "", 1) != FR_OK) ||
+        (f_open(&file, "bench.dat", FA_OPEN_ALWAYS | FA_WRITE) != FR_OK))
+    {
+        fprintf(stderr, "Cannot mount the volume\n");
+        host_disk_close();
+        return 1;
+    }
+
+    DWORD cycles = (DWORD)(duration*1000000/CYCLE_PERIOD);
+    DWORD cycle;
+    long long payload = 0;
+    QWORD maxCycleBusy = 0;
+    DWORD overruns = 0;
+    for (cycle = 0; cycle < cycles; cycle++)
+    {
+        QWORD start = (QWORD)cycle*CYCLE_PERIOD;
+        host_disk_advance_to(start);
+        QWORD busyStart = host_disk_statistics()->busyTime;
+        cycleWrites = 0;
+        long length = recordCycle(&file, cycle, policy == SYNC_RECORD);
+        if ((length >= 0) && (policy == SYNC_CYCLE) &&
+            (f_sync(&file) != FR_OK)) length = -1;
+        if (length < 0)
+        {
+            fprintf(stderr, "Write failed at cycle %u\n", cycle);
+            break;
+        }
+        payload += length;
+        QWORD cycleBusy = host_disk_statistics()->busyTime - busyStart;
+        if (cycleBusy > maxCycleBusy) maxCycleBusy = cycleBusy;
+        if (cycleBusy > CYCLE_PERIOD) overruns++;
+        if (cycleWrites > maxCycleWrites) maxCycleWrites = cycleWrites;
+    }
+    f_close(&file);
+    disk_ioctl(0, CTRL_CACHE_FLUSH, 0);
+    f_mount(0, "", 0);
+
+    const struct diskStatistics *stats = host_disk_statistics();
+    double seconds = (double)cycles*CYCLE_PERIOD/1000000;
+    printf("Cycles %u (%.0f s), cluster %u sectors, sync %s, %s\n",
+           cycles, seconds, clusterSize,
+           (policy == SYNC_RECORD) ? "per record" :
+           (policy == SYNC_CYCLE) ? "per cycle" : "on close",
+           useMmap ? "mmap" : "pread/pwrite");
+    printf("Payload bytes          %lld\n", payload);
+    printf("Read commands          %u (%u sectors)\n",
+           stats->reads, stats->readSectors);
+    printf("Write commands         %u (%u sectors)\n",
+           stats->writes, stats->writtenSectors);
+    printf("Sync ioctls            %u\n", stats->syncs);
+    printf("Distinct sectors       %u\n", uniqueSectors);
+    printf("FAT sector writes      %u\n", fatWrites);
+    printf("Directory writes       %u\n", directoryWrites);
+    printf("Boot/FSInfo writes     %u\n", systemWrites);
+    printf("Data sector writes     %u\n", dataWrites);
+    printf("Most writes per cycle  %u\n", maxCycleWrites);
+    if (payload > 0)
+        printf("Write amplification    %.2f\n",
+               (double)stats->writtenSectors*512/payload);
+    printf("Card busy              %.3f s (%.2f%%)\n",
+           (double)stats->busyTime/1000000,
+           100.0*stats->busyTime/(seconds*1000000));
+    printf("Longest cycle busy     %.2f ms, %u overruns\n",
+           (double)maxCycleBusy/1000, overruns);
+    if (cacheSectors > 0)
+    {
+        const struct sectorCacheStatistics *cache = sector_cache_statistics();
+        printf("Cache %u sectors, %u syncs deferred at most\n",
+               cacheSectors, cacheSyncs);
+        printf("FatFs write requests   %u (%u sectors)\n",
+               cache->writeRequests, cache->writeSectors);
+        printf("Card writes            %u (%u sectors)\n",
+               cache->cardWrites, cache->cardSectors);
+        printf("Card writes saved      %u (%.1f%%)\n",
+               cache->writeRequests - cache->cardWrites,
+               (cache->writeRequests > 0) ?
+               100.0*(cache->writeRequests - cache->cardWrites)/
+               cache->writeRequests : 0.0);
+        printf("Rewrites absorbed      %u\n", cache->absorbed);
+        printf("Syncs deferred         %u\n", cache->syncsDeferred);
+        printf("Read hits/misses       %u/%u\n",
+               cache->readHits, cache->readMisses);
+    }
+
+    if (trace) fclose(trace);
+    host_disk_close();
+    free(touched);
+    return 0;
+}
@@ -12,6 +12,19 @@
 typedef unsigned __int64 QWORD;
 
 
+#elif defined(__LP64__)	/* 64 bit host (host disk image tools) */
+
+typedef int				INT;
+typedef unsigned int	UINT;
+typedef unsigned char	BYTE;
+typedef short			SHORT;
+typedef unsigned short	WORD;
+typedef unsigned short	WCHAR;
+typedef int				LONG;
+typedef unsigned int	DWORD;
+typedef unsigned long long QWORD;
+
+
 #else			/* Embedded platform */
 
 /* These types MUST be 16-bit or 32-bit */
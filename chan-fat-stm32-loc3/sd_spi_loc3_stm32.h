@@ -0,0 +1,30 @@
+/*-----------------------------------------------------------------------*/
+/* MMC/SDSC/SDHC (in SPI mode) control module for STM32                  */
+/*-----------------------------------------------------------------------*/
+
+/* Driver functions outside the ChaN FAT disk interface. These do not touch
+the SPI bus and may be called from any task. A clock step down is applied when
+the volume is next mounted.
+
+Copyright (c) 2013 Ken Sarkies
+*/
+
+#ifndef _SD_SPI_LOC3_STM32_DEFINED
+#define _SD_SPI_LOC3_STM32_DEFINED
+
+#include "integer.h"
+
+/* Data block transfer error counts since power on */
+struct sdErrorCounts
+{
+    DWORD crcReadErrors;        /* Read data blocks failing the CRC16 check */
+    DWORD crcWriteErrors;       /* Written data blocks rejected by the card */
+    DWORD retries;              /* Transfers repeated after a CRC error */
+    DWORD failures;             /* Transfers abandoned after all retries */
+};
+
+void sd_get_error_counts(struct sdErrorCounts *counts);
+DWORD sd_get_clock(DWORD *card);
+int sd_step_clock_down(void);
+
+#endif
@@ -29,6 +29,11 @@ the ISR as a timing counter. This doesn't affect re-entrancy.
 FreeRTOS calls are used to insert delays that relinquish a calling task rather
 than wasting time in loops.
 
+With _FS_REENTRANT set in ffconf.h, FatFs holds the volume mutex (freertos.c)
+around every call into this driver, so the SPI bus, DMA and the CRC state are
+only used by one task at a time. Code outside FatFs that calls disk_ioctl()
+directly must hold the same mutex.
+
 */
 
 /* Copyright (c) 2010, Martin Thomas, ChaN
@@ -74,16 +79,14 @@ typedef bool BOOL;
 #include <libopencm3/stm32/dma.h>
 #include "ffconf.h"
 #include "diskio.h"
+/* The sector cache, if enabled, provides disk_* and calls the card_* below */
+#define SECTOR_CACHE_DRIVER
+#include "sector_cache.h"
+#include "sd_spi_loc3_stm32.h"
 #include "board.h"
 
 #include "power-management-comms.h"
 
-/* Regardless of the FreeRtos config, force re-entrancy for this file.*/
-#ifdef _FS_REENTRANT
-#undef _FS_REENTRANT
-#endif
-#define _FS_REENTRANT       1
-
 #include "FreeRTOS.h"
 #include "task.h"
 
@@ -95,6 +98,14 @@ typedef bool BOOL;
 #pragma message "*** Using DMA for MMC Card Access ***"
 #endif
 
+/* Check the CRC16 of data blocks (turned on in the card with CMD59). With DMA
+the SPI CRC unit computes it for received blocks, otherwise it is computed in
+software. */
+#define STM32_SD_USE_CRC
+
+/* Number of times a transfer is repeated after a CRC error */
+#define SD_CRC_RETRIES      3
+
 /* Definitions for MMC/SDC command */
 #define CMD0    (0x40+0)    /* GO_IDLE_STATE */
 #define CMD1    (0x40+1)    /* SEND_OP_COND (MMC) */
@@ -113,6 +124,7 @@ typedef bool BOOL;
 #define CMD25    (0x40+25)    /* WRITE_MULTIPLE_BLOCK */
 #define CMD55    (0x40+55)    /* APP_CMD */
 #define CMD58    (0x40+58)    /* READ_OCR */
+#define CMD59    (0x40+59)    /* CRC_ON_OFF */
 
 /* Card-Select Controls  (Platform dependent) */
 #define SELECT()        gpio_clear(GPIO_PORT_CS, GPIOCS)    /* MMC CS = L */
@@ -152,6 +164,24 @@ DWORD Timer1 = 0;
 static
 BYTE CardType;            /* Card type flags */
 
+static
+BOOL crcEnabled;          /* Card accepted CMD59 and checks CRCs */
+
+static
+BOOL crcFailed;           /* Last data block failed its CRC check */
+
+static
+struct sdErrorCounts errorCounts;
+
+static
+BYTE cardPrescaler;       /* Fastest prescaler allowed by the CSD TRAN_SPEED */
+
+static
+BYTE minimumPrescaler = SPI_BaudRatePrescaler_fast; /* Raised by step down */
+
+static
+DWORD cardClock;          /* TRAN_SPEED of the card in Hz */
+
 /*---------------------------------------------------------------------------*/
 /** @brief Check for timeout
 
@@ -177,10 +207,12 @@ BOOL timeout(DWORD timer, DWORD delay)
 /*---------------------------------------------------------------------------*/
 /** @brief Set the SPI Interface Speed
 
-Sets the SPI baudrate prescaler value to either divide by 4 or divide by 256.
+Sets the SPI baudrate prescaler to divide by 256 for initialisation, or to the
+prescaler negotiated from the card CSD.
 
 @param[in] speed_setting: INTERFACE_SLOW, INTERFACE_FAST
 
+Globals cardPrescaler: BYTE prescaler set by card_clock_select().
 */
 
 enum speed_setting { INTERFACE_SLOW, INTERFACE_FAST };
@@ -195,9 +227,63 @@ static void interface_speed( enum speed_setting speed )
     else
     {
 /* Set fast clock (depends on the CSD) */
-        spi_set_baudrate_prescaler(SPI_SD,SPI_BaudRatePrescaler_fast);
+        spi_set_baudrate_prescaler(SPI_SD,cardPrescaler);
     }
 }
+
+/*---------------------------------------------------------------------------*/
+/** @brief Decode the Maximum Transfer Rate from the CSD
+
+The TRAN_SPEED byte (CSD bits 103:96) holds a rate unit in bits 2:0 (100kbit/s
+times a power of ten) and a multiplier of 1.0 to 8.0 in bits 6:3. It has the
+same layout in CSD versions 1 and 2 and in MMC. SD cards report 25MHz (0x32) or
+50MHz (0x5A) in high speed mode.
+
+@param[in] *csd: BYTE 16 byte CSD register.
+@returns DWORD maximum clock in Hz, or zero if the field is invalid.
+*/
+
+static DWORD csd_tran_speed(const BYTE *csd)
+{
+/* Multipliers times 10 */
+    static const BYTE multiplier[16] =
+        { 0, 10, 12, 13, 15, 20, 25, 30, 35, 40, 45, 50, 55, 60, 70, 80 };
+    BYTE unit = csd[3] & 7;
+    DWORD rate = multiplier[(csd[3] >> 3) & 15] * 10000UL;
+
+    if (unit > 3) return 0;                 /* Reserved units */
+    while (unit--) rate *= 10;
+    return rate;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Select the SPI Prescaler for the Card
+
+The SPI clock is the peripheral clock divided by 2 to 256 in powers of two. The
+fastest prescaler is chosen that keeps the SPI clock within the card rating,
+limited by the board fastest prescaler (the SPI itself is rated to 18MHz) and by
+any step down after errors. If the CSD rate is not known the board setting is
+used.
+
+@param[in] rate: DWORD maximum card clock in Hz, zero if unknown.
+
+Globals cardPrescaler: BYTE SPI baudrate prescaler for INTERFACE_FAST.
+        minimumPrescaler: BYTE fastest prescaler permitted.
+*/
+
+static void card_clock_select(DWORD rate)
+{
+    BYTE prescaler = minimumPrescaler;
+
+    if (rate > 0)
+    {
+        while ((prescaler < SPI_BaudRatePrescaler_slow) &&
+               ((SPI_SD_PCLK >> (prescaler + 1)) > rate)) prescaler++;
+    }
+    cardPrescaler = prescaler;
+    cardClock = rate;
+}
+
 /*---------------------------------------------------------------------------*/
 /** @brief Initialise GPIO to Read Write Protect Pin
 
@@ -424,17 +510,84 @@ static void release_spi(void)
     rcvr_spi();
 }
 
+/*---------------------------------------------------------------------------*/
+/** @brief Compute the CRC7 of a Command
+
+The CRC is always sent so that commands remain valid once the card has been
+told to check them with CMD59.
+
+@param[in] *data: BYTE command index and argument.
+@param[in] n: UINT number of bytes.
+@returns BYTE CRC7 shifted left with the stop bit set.
+*/
+
+static BYTE crc7(const BYTE *data, UINT n)
+{
+    BYTE crc = 0;
+    while (n--)
+    {
+        BYTE d = *data++;
+        BYTE i;
+        for (i = 0; i < 8; i++)
+        {
+            crc <<= 1;
+            if ((d ^ crc) & 0x80) crc ^= 0x09;
+            d <<= 1;
+        }
+    }
+    return (BYTE)((crc << 1) | 1);
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Compute the CRC16 of a Data Block in Software
+
+CRC16-CCITT (polynomial 0x1021, zero initial value) as used by the card. A
+nibble table keeps the flash cost to 32 bytes. This is used for all blocks sent,
+and for blocks received when the SPI CRC unit cannot be, that is without DMA or
+for a buffer that is not aligned to a halfword.
+
+@param[in] *data: BYTE data block.
+@param[in] n: UINT number of bytes.
+@returns WORD CRC16.
+*/
+
+static const WORD crc16Table[16] =
+{
+    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+    0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF
+};
+
+static WORD crc16(const BYTE *data, UINT n)
+{
+    WORD crc = 0;
+    while (n--)
+    {
+        crc = (WORD)((crc << 4) ^ crc16Table[((crc >> 12) ^ (*data >> 4)) & 0x0F]);
+        crc = (WORD)((crc << 4) ^ crc16Table[((crc >> 12) ^ *data) & 0x0F]);
+        data++;
+    }
+    return crc;
+}
+
 #ifdef STM32_SD_USE_DMA
 /*---------------------------------------------------------------------------*/
 /** @brief Transmit/Receive Block using DMA
 
+In wide mode the SPI is expected to be set to 16 bit frames and the buffer must
+be aligned to a halfword.
+
 @param[in] receive: Boolean false for sending to SPI, true for reading
 @param[in] *buff: Pointer to buffer of BYTE
 @param[in] btr: UINT byte count (multiple of 2 for send, 512 always for receive)
+@param[in] wide: Boolean true to transfer 16 bit frames
 */
 
-static void stm32_dma_transfer(BOOL receive, const BYTE *buff, UINT btr)
+static void stm32_dma_transfer(BOOL receive, const BYTE *buff, UINT btr,
+                               BOOL wide)
 {
+    DWORD size = wide ? DMA_CCR_PSIZE_16BIT : DMA_CCR_PSIZE_8BIT;
+    DWORD memorySize = wide ? DMA_CCR_MSIZE_16BIT : DMA_CCR_MSIZE_8BIT;
+    if (wide) btr /= 2;
     WORD rw_workbyte[] = { 0xffff };
 
 /* Enable DMA1 Clock */
@@ -447,8 +600,8 @@ static void stm32_dma_transfer(BOOL receive, const BYTE *buff, UINT btr)
 /* DMA1 read channel2 configuration SPI1 RX ---------------------------------------------*/
     dma_channel_reset(DMA1,DMA_CHANNEL_SPI_SD_RX);
     dma_set_peripheral_address(DMA1,DMA_CHANNEL_SPI_SD_RX,(DWORD) &SPI_DR(SPI_SD));
-    dma_set_peripheral_size(DMA1,DMA_CHANNEL_SPI_SD_RX,DMA_CCR_PSIZE_8BIT);
-    dma_set_memory_size(DMA1,DMA_CHANNEL_SPI_SD_RX,DMA_CCR_MSIZE_8BIT);
+    dma_set_peripheral_size(DMA1,DMA_CHANNEL_SPI_SD_RX,size);
+    dma_set_memory_size(DMA1,DMA_CHANNEL_SPI_SD_RX,memorySize);
     dma_disable_peripheral_increment_mode(DMA1,DMA_CHANNEL_SPI_SD_RX);
     dma_set_number_of_data(DMA1,DMA_CHANNEL_SPI_SD_RX,btr);
     dma_set_priority(DMA1,DMA_CHANNEL_SPI_SD_RX,DMA_CCR_PL_VERY_HIGH);
@@ -456,8 +609,8 @@ static void stm32_dma_transfer(BOOL receive, const BYTE *buff, UINT btr)
 /* DMA1 write channel3 configuration SPI1 TX ---------------------------------------------*/
     dma_channel_reset(DMA1,DMA_CHANNEL_SPI_SD_TX);
     dma_set_peripheral_address(DMA1,DMA_CHANNEL_SPI_SD_TX,(DWORD) &SPI_DR(SPI_SD));
-    dma_set_peripheral_size(DMA1,DMA_CHANNEL_SPI_SD_TX,DMA_CCR_PSIZE_8BIT);
-    dma_set_memory_size(DMA1,DMA_CHANNEL_SPI_SD_TX,DMA_CCR_MSIZE_8BIT);
+    dma_set_peripheral_size(DMA1,DMA_CHANNEL_SPI_SD_TX,size);
+    dma_set_memory_size(DMA1,DMA_CHANNEL_SPI_SD_TX,memorySize);
     dma_disable_peripheral_increment_mode(DMA1,DMA_CHANNEL_SPI_SD_TX);
     dma_set_number_of_data(DMA1,DMA_CHANNEL_SPI_SD_TX,btr);
     dma_set_priority(DMA1,DMA_CHANNEL_SPI_SD_TX,DMA_CCR_PL_VERY_HIGH);
@@ -508,6 +661,49 @@ static void stm32_dma_transfer(BOOL receive, const BYTE *buff, UINT btr)
     spi_disable_rx_dma(SPI_SD);
     spi_disable_tx_dma(SPI_SD);
 }
+
+/*---------------------------------------------------------------------------*/
+/** @brief Switch the SPI CRC Unit for a Data Block
+
+The STM32F1 SPI computes a CRC16 only with 16 bit frames, and both the frame
+size and CRC enable may only be changed with the SPI disabled. Enabling the
+CRC clears the CRC registers.
+
+@param[in] on: Boolean true for 16 bit frames with CRC, false to return to
+8 bit frames without.
+*/
+
+static void spi_crc_mode(BOOL on)
+{
+    while (!(SPI_SR(SPI_SD) & SPI_SR_TXE));
+    while (SPI_SR(SPI_SD) & SPI_SR_BSY);
+    spi_disable(SPI_SD);
+    spi_disable_crc(SPI_SD);
+    if (on)
+    {
+        spi_set_dff_16bit(SPI_SD);
+        spi_enable_crc(SPI_SD);
+    }
+    else spi_set_dff_8bit(SPI_SD);
+    spi_enable(SPI_SD);
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Swap the Bytes of each Halfword
+
+16 bit frames are received most significant byte first, while the buffer is
+held in little endian halfwords, so the bytes of each pair are exchanged after
+receiving.
+
+@param[in] *buff: BYTE buffer aligned to a halfword.
+@param[in] n: UINT number of bytes (even).
+*/
+
+static void swap_bytes(BYTE *buff, UINT n)
+{
+    WORD *word = (WORD*)buff;
+    for (n /= 2; n; n--, word++) *word = (WORD)((*word << 8) | (*word >> 8));
+}
 #endif /* STM32_SD_USE_DMA */
 
 /*---------------------------------------------------------------------------*/
@@ -572,6 +768,7 @@ static void power_on (void)
     spi_enable_software_slave_management(SPI_SD);
     spi_set_nss_high(SPI_SD);
     spi_disable_crc(SPI_SD);
+    SPI_CRCPR(SPI_SD) = 0x1021;     /* CRC16-CCITT polynomial for data blocks */
 
     spi_enable(SPI_SD);
 
@@ -620,14 +817,19 @@ static void power_off (void)
 Can be done with DMA or programmed.
 This is in response to a previously sent read command.
 
+If the card is checking CRCs, the CRC16 of a 512 byte data block is checked and
+crcFailed set on a mismatch. Register reads (CSD, CID, status) are not checked.
+
 @param *buff: BYTE 512 byte data block to store received data 
 @param numBytes: UINT Byte count (must be multiple of 4)
-@returns BOOL valid token received.
+@returns BOOL valid token and CRC received.
 */
 
 static BOOL rcvr_datablock (BYTE *buff,UINT numBytes)
 {
     BYTE token;
+    WORD crc = 0, received;
+    BOOL check = crcEnabled && (numBytes == 512);
 
     DWORD timer = Timer1;
 /* Wait for a valid data packet (token), timeout of 200ms */
@@ -642,20 +844,45 @@ static BOOL rcvr_datablock (BYTE *buff,UINT numBytes)
     if(token != 0xFE) return FALSE;    /* If not valid data token, return with error */
 
 #ifdef STM32_SD_USE_DMA
-    stm32_dma_transfer(TRUE, buff, numBytes);
+/* Use the SPI CRC unit, reading the CRC as one more 16 bit frame */
+    if (check && !((DWORD)buff & 1))
+    {
+        spi_crc_mode(TRUE);
+        stm32_dma_transfer(TRUE, buff, numBytes, TRUE);
+        crc = SPI_RXCRCR(SPI_SD);
+        received = spi_xfer(SPI_SD, 0xFFFF);
+        spi_crc_mode(FALSE);
+        swap_bytes(buff, numBytes);
+    }
+    else
+    {
+        stm32_dma_transfer(TRUE, buff, numBytes, FALSE);
+        received = (WORD)rcvr_spi() << 8;
+        received |= rcvr_spi();
+        if (check) crc = crc16(buff, numBytes);
+    }
 #else
+    BYTE *data = buff;
+    UINT count = numBytes;
     do
     {                           /* Receive the data block into buffer */
-        rcvr_spi_m(buff++);
-        rcvr_spi_m(buff++);
-        rcvr_spi_m(buff++);
-        rcvr_spi_m(buff++);
+        rcvr_spi_m(data++);
+        rcvr_spi_m(data++);
+        rcvr_spi_m(data++);
+        rcvr_spi_m(data++);
     }
-    while (numBytes -= 4);
+    while (count -= 4);
+    received = (WORD)rcvr_spi() << 8;
+    received |= rcvr_spi();
+    if (check) crc = crc16(buff, numBytes);
 #endif /* STM32_SD_USE_DMA */
 
-    rcvr_spi();                 /* Discard CRC */
-    rcvr_spi();
+    if (check && (crc != received))
+    {
+        crcFailed = TRUE;
+        errorCounts.crcReadErrors++;
+        return FALSE;
+    }
 
     return TRUE;                /* Return with success */
 }
@@ -665,6 +892,9 @@ static BOOL rcvr_datablock (BYTE *buff,UINT numBytes)
 
 Only compiled if the filesystem is writeable.
 
+If the card is checking CRCs, the CRC16 of the block is sent and a rejection
+by the card for a CRC error sets crcFailed.
+
 @param *buff: BYTE 512 byte data block to be transmitted
 @param token: BYTE Data/Stop token
 @returns BOOL system available and packet accepted.
@@ -674,6 +904,7 @@ Only compiled if the filesystem is writeable.
 static BOOL xmit_datablock (const BYTE *buff,BYTE token)
 {
     BYTE response;
+    WORD crc = 0xFFFF;          /* Dummy CRC if the card is not checking */
 #ifndef STM32_SD_USE_DMA
     BYTE wc;
 #endif
@@ -688,8 +919,13 @@ static BOOL xmit_datablock (const BYTE *buff,BYTE token)
     {                               /* Is data token */
 
 #ifdef STM32_SD_USE_DMA
-        stm32_dma_transfer( FALSE, buff, 512 );
+/* The CRC is computed in software. The SPI CRC unit would need the block byte
+swapped for 16 bit frames, and the buffer belongs to the caller: FatFs passes
+user buffers straight through, which may be constant or read by others. */
+        if (crcEnabled) crc = crc16(buff, 512);
+        stm32_dma_transfer(FALSE, buff, 512, FALSE);
 #else
+        if (crcEnabled) crc = crc16(buff, 512);
         wc = 0;
         do
         {                           /* transmit the 512 byte data block to MMC */
@@ -699,9 +935,16 @@ static BOOL xmit_datablock (const BYTE *buff,BYTE token)
         while (--wc);
 #endif /* STM32_SD_USE_DMA */
 
-        xmit_spi(0xFF);             /* CRC (Dummy) */
-        xmit_spi(0xFF);
+        xmit_spi((BYTE)(crc >> 8)); /* CRC */
+        xmit_spi((BYTE)crc);
         response = rcvr_spi();          /* Receive data response */
+/* Data rejected due to a CRC error */
+        if ((response & 0x1F) == 0x0B)
+        {
+            crcFailed = TRUE;
+            errorCounts.crcWriteErrors++;
+            return FALSE;
+        }
         if ((response & 0x1F) != 0x05)  /* If not accepted, return with error */
         {
             return FALSE;
@@ -741,15 +984,14 @@ static BYTE send_cmd (BYTE cmd,DWORD arg)
     }
 
 /* Send command packet */
-    xmit_spi(cmd);                      /* Start + Command index */
-    xmit_spi((BYTE)(arg >> 24));        /* Argument[31..24] */
-    xmit_spi((BYTE)(arg >> 16));        /* Argument[23..16] */
-    xmit_spi((BYTE)(arg >> 8));         /* Argument[15..8] */
-    xmit_spi((BYTE)arg);                /* Argument[7..0] */
-    n = 0x01;                           /* Dummy CRC + Stop */
-    if (cmd == CMD0) n = 0x95;          /* Valid CRC for CMD0(0) */
-    if (cmd == CMD8) n = 0x87;          /* Valid CRC for CMD8(0x1AA) */
-    xmit_spi(n);
+    BYTE packet[5];
+    packet[0] = cmd;                    /* Start + Command index */
+    packet[1] = (BYTE)(arg >> 24);      /* Argument[31..24] */
+    packet[2] = (BYTE)(arg >> 16);      /* Argument[23..16] */
+    packet[3] = (BYTE)(arg >> 8);       /* Argument[15..8] */
+    packet[4] = (BYTE)arg;              /* Argument[7..0] */
+    for (n = 0; n < 5; n++) xmit_spi(packet[n]);
+    xmit_spi(crc7(packet, 5));          /* CRC + Stop */
 
 /* Receive command response */
     if (cmd == CMD12) rcvr_spi();       /* Skip a stuff byte when stopping read */
@@ -799,6 +1041,7 @@ DSTATUS disk_initialize(BYTE drv)
     for (n = 10; n; n--) rcvr_spi();        /* 80 dummy clocks */
 
     ty = 0;
+    crcEnabled = FALSE;
 /* Enter Idle state */
     if (send_cmd(CMD0, 0) == 1)
     {
@@ -840,6 +1083,20 @@ DSTATUS disk_initialize(BYTE drv)
                 ty = 0;
         }
     }
+#ifdef STM32_SD_USE_CRC
+/* Have the card check and generate CRCs */
+    if (ty && (send_cmd(CMD59, 1) == 0)) crcEnabled = TRUE;
+#endif
+/* Read the CSD for the maximum clock rate. Data block CRCs are only checked for
+sectors, so this is read before the clock is raised. */
+    if (ty)
+    {
+        BYTE csd[16];
+        DWORD rate = 0;
+        if ((send_cmd(CMD9, 0) == 0) && rcvr_datablock(csd, 16))
+            rate = csd_tran_speed(csd);
+        card_clock_select(rate);
+    }
     CardType = ty;
     release_spi();
 
@@ -886,6 +1143,7 @@ Globals Stat: DSTATUS disk status.
 DRESULT disk_read(BYTE drv,BYTE *buff,DWORD sector,UINT count)
 {
     BYTE error = 0;             /* Error status for fine tracking */
+    BYTE attempts = 0;
     DRESULT res = RES_OK;
     if (drv || !count)          /* Zero count or non-zero drive number */
     {
@@ -898,35 +1156,53 @@ DRESULT disk_read(BYTE drv,BYTE *buff,DWORD sector,UINT count)
     if (res == RES_OK)
     {
 /* Convert to byte address if needed */
-        if (!(CardType & CT_BLOCK)) sector *= 512;
-/* Single block read */
-        if (count == 1)
+        DWORD step = 1;
+        if (!(CardType & CT_BLOCK))
         {
-/* If the response to the command is non-zero, the block is not read */
-            if ((error = send_cmd(CMD17, sector)) == 0)
+            sector *= 512;
+            step = 512;
+        }
+/* Repeat from the failed block after a CRC error */
+        while (count > 0)
+        {
+            crcFailed = FALSE;
+/* Single block read */
+            if (count == 1)
             {
-                if (rcvr_datablock(buff, 512))
+/* If the response to the command is non-zero, the block is not read */
+                if ((error = send_cmd(CMD17, sector)) == 0)
                 {
-                    count = 0;
+                    if (rcvr_datablock(buff, 512))
+                    {
+                        count = 0;
+                    }
                 }
             }
-        }
 /* Multiple block read */
-        else
-        {
-/* If the response to the command is non-zero, the block is not read */
-            if ((error = send_cmd(CMD18, sector)) == 0)
+            else
             {
-                do
+/* If the response to the command is non-zero, the block is not read */
+                if ((error = send_cmd(CMD18, sector)) == 0)
                 {
-                    if (!rcvr_datablock(buff, 512)) break;
-                    buff += 512;
+                    do
+                    {
+                        if (!rcvr_datablock(buff, 512)) break;
+                        buff += 512;
+                        sector += step;
+                    }
+                    while (--count);
+                    send_cmd(CMD12, 0); /* Stop transmission */
                 }
-                while (--count);
-                send_cmd(CMD12, 0); /* Stop transmission */
             }
+            release_spi();
+            if ((count == 0) || !crcFailed) break;
+            if (++attempts > SD_CRC_RETRIES)
+            {
+                errorCounts.failures++;
+                break;
+            }
+            errorCounts.retries++;
         }
-        release_spi();
         if (count > 0) res = RES_ERROR;
     }
 
@@ -950,6 +1226,7 @@ Globals Stat: DSTATUS disk status.
 DRESULT disk_write(BYTE drv,const BYTE *buff,DWORD sector,UINT count)
 {
     BYTE error = 0;             /* Error status for fine tracking */
+    BYTE attempts = 0;
     DRESULT res = RES_OK;
     if (drv || !count)          /* Zero count or non-zero drive number */
     {
@@ -966,37 +1243,61 @@ DRESULT disk_write(BYTE drv,const BYTE *buff,DWORD sector,UINT count)
     if (res == RES_OK)
     {
 /* Convert to byte address if needed */
-        if (!(CardType & CT_BLOCK)) sector *= 512;
-/* Single block write */
-        if (count == 1)
+        DWORD step = 1;
+        if (!(CardType & CT_BLOCK))
         {
-/* If the response to the command is non-zero, the block is not written */
-            if ((error = send_cmd(CMD24, sector)) == 0)
+            sector *= 512;
+            step = 512;
+        }
+/* Repeat from the rejected block after a CRC error. Blocks accepted before it
+need not be sent again. */
+        while (count > 0)
+        {
+            crcFailed = FALSE;
+/* Single block write */
+            if (count == 1)
             {
-                if (xmit_datablock(buff, 0xFE))
+/* If the response to the command is non-zero, the block is not written */
+                if ((error = send_cmd(CMD24, sector)) == 0)
                 {
-                    count = 0;
+                    if (xmit_datablock(buff, 0xFE))
+                    {
+                        count = 0;
+                    }
                 }
             }
-        }
 /* Multiple block write */
-        else
-        {
-            if (CardType & CT_SDC) send_cmd(ACMD23, count);
-/* If the response to the command is non-zero, the block is not written */
-            if ((error = send_cmd(CMD25, sector)) == 0)
+            else
             {
-                do
+                if (CardType & CT_SDC) send_cmd(ACMD23, count);
+/* If the response to the command is non-zero, the block is not written */
+                if ((error = send_cmd(CMD25, sector)) == 0)
                 {
-                    if (!xmit_datablock(buff, 0xFC)) break;
-                    buff += 512;
+                    do
+                    {
+                        if (!xmit_datablock(buff, 0xFC)) break;
+                        buff += 512;
+                        sector += step;
+                    }
+                    while (--count);
+/* STOP_TRAN token, also needed to abort after a rejected block */
+                    if (!xmit_datablock(0, 0xFD))
+                    {
+                        release_spi();
+                        if (count == 0) count = 1;
+                        break;
+                    }
                 }
-                while (--count);
-                if (!xmit_datablock(0, 0xFD))    /* STOP_TRAN token */
-                    count = 1;
             }
+            release_spi();
+            if ((count == 0) || !crcFailed) break;
+            if (++attempts > SD_CRC_RETRIES)
+            {
+                errorCounts.failures++;
+                break;
+            }
+            errorCounts.retries++;
         }
-        release_spi();
         if (count > 0) res = RES_ERROR;
     }
 //    if (res != RES_OK) dataMessageSend("DWRITE",res,error);
@@ -1183,6 +1484,57 @@ DRESULT disk_ioctl(BYTE drv,BYTE ctrl,void *buff)
 }
 #endif /* _USE_IOCTL != 0 */
 
+/*---------------------------------------------------------------------------*/
+/** @brief Get the Data Transfer Error Counts
+
+The counts are only written by the task using the file system. They are read
+a word at a time, so a copy may mix counts from either side of an update but
+each count is valid.
+
+@param[out] *counts: struct sdErrorCounts copy of the counts.
+*/
+
+void sd_get_error_counts(struct sdErrorCounts *counts)
+{
+    *counts = errorCounts;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Get the SPI Clock Rates
+
+@param[out] *card: DWORD maximum clock rated by the card CSD, zero if unknown.
+@returns DWORD SPI clock used for data transfers in Hz, zero if the card is not
+initialised.
+
+Globals Stat: DSTATUS disk status.
+*/
+
+DWORD sd_get_clock(DWORD *card)
+{
+    *card = cardClock;
+    if (Stat & STA_NOINIT) return 0;
+    return SPI_SD_PCLK >> (cardPrescaler + 1);
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Step Down the SPI Clock
+
+The fastest permitted prescaler is raised to one step below the present SPI
+clock. This takes effect at the next disk_initialize(), which FatFs calls when
+the volume is next mounted. The setting is kept until power off.
+
+@returns int 0 if the clock is already one step above the initialisation rate.
+
+Globals minimumPrescaler: BYTE fastest prescaler permitted.
+*/
+
+int sd_step_clock_down(void)
+{
+    if (cardPrescaler >= SPI_BaudRatePrescaler_slow - 1) return 0;
+    minimumPrescaler = cardPrescaler + 1;
+    return 1;
+}
+
 /*---------------------------------------------------------------------------*/
 /** @brief Device Timer Interrupt Procedure
 
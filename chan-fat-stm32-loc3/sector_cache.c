@@ -0,0 +1,431 @@
+/*-----------------------------------------------------------------------*/
+/* Write-back sector cache between ChaN FatFs and the card driver        */
+/*-----------------------------------------------------------------------*/
+
+/* FatFs keeps one sector buffer per file and one window per volume for the
+FAT and directory. When small records are appended and synced, the file
+buffer, the directory sector holding the file size and the FAT sector
+holding the cluster chain are written back again and again.
+
+This module sits beneath FatFs and holds up to _SECTOR_CACHE sectors. Single
+sector writes are kept dirty in the cache rather than written to the card.
+When a dirty sector must be evicted (least recently used first) or a sync is
+requested, it is written together with any dirty sectors adjacent to it as one
+multiple block write. Multiple sector transfers, which FatFs uses for whole
+sectors of file data, go directly to the card with any cached copies updated.
+
+To make a run of adjacent sectors contiguous in memory for the card driver,
+the cache slots are swapped in place, so no extra buffer is needed.
+
+A CTRL_SYNC writes back all dirty sectors before it is passed to the card,
+unless _SECTOR_CACHE_SYNC allows a number of syncs to be absorbed.
+
+This code is not reentrant. It relies on FatFs calls being made from a single
+task or being serialised by the FatFs volume lock.
+*/
+
+/* Copyright (c) 2013 Ken Sarkies
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions are met:
+
+   * Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in
+     the documentation and/or other materials provided with the
+     distribution.
+   * Neither the name of the copyright holders nor the names of
+     contributors may be used to endorse or promote products derived
+     from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE. */
+
+#include <string.h>
+#include "ffconf.h"
+#include "diskio.h"
+#include "sector_cache.h"
+
+#if _SECTOR_CACHE > 0
+
+#define SECTOR_SIZE     512
+#define NO_ENTRY        0xFF
+
+struct cacheEntry
+{
+    DWORD sector;
+    DWORD lastUse;              /* Value of useCount when last accessed */
+    BYTE valid;
+    BYTE dirty;
+};
+
+/* Sector data is held as words so that slots can be swapped a word at a time
+and remain aligned for DMA. */
+static DWORD cacheData[_SECTOR_CACHE][SECTOR_SIZE/4];
+static struct cacheEntry cacheEntry[_SECTOR_CACHE];
+static DWORD useCount = 0;
+static UINT cacheSize = _SECTOR_CACHE;
+static UINT syncLimit = _SECTOR_CACHE_SYNC;
+static UINT syncsPending = 0;
+static struct sectorCacheStatistics statistics;
+
+/*---------------------------------------------------------------------------*/
+/** @brief Find a Sector in the Cache
+
+@param[in] sector: DWORD sector number.
+@returns BYTE slot holding the sector, or NO_ENTRY.
+*/
+
+static BYTE find_entry(DWORD sector)
+{
+    UINT i;
+    for (i = 0; i < cacheSize; i++)
+    {
+        if (cacheEntry[i].valid && (cacheEntry[i].sector == sector)) return i;
+    }
+    return NO_ENTRY;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Exchange Two Cache Slots
+
+*/
+
+static void swap_entries(BYTE a, BYTE b)
+{
+    if (a == b) return;
+    struct cacheEntry entry = cacheEntry[a];
+    cacheEntry[a] = cacheEntry[b];
+    cacheEntry[b] = entry;
+    UINT i;
+    for (i = 0; i < SECTOR_SIZE/4; i++)
+    {
+        DWORD word = cacheData[a][i];
+        cacheData[a][i] = cacheData[b][i];
+        cacheData[b][i] = word;
+    }
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Write Back the Run of Dirty Sectors Containing a Slot
+
+The run is extended in both directions over adjacent dirty sectors. Its slots
+are then rearranged into slots 0 onwards in sector order so that the run can be
+written with a single multiple block write.
+
+@param[in] drv: BYTE Physical drive number.
+@param[in] slot: BYTE slot of a dirty sector.
+@returns DRESULT success (RES_OK) or fail.
+*/
+
+static DRESULT flush_run(BYTE drv, BYTE slot)
+{
+    DWORD first = cacheEntry[slot].sector;
+    UINT count = 1;
+    BYTE other;
+    while ((first > 0) && ((other = find_entry(first - 1)) != NO_ENTRY) &&
+           cacheEntry[other].dirty)
+    {
+        first--;
+        count++;
+    }
+    while (((other = find_entry(first + count)) != NO_ENTRY) &&
+           cacheEntry[other].dirty)
+        count++;
+    UINT i;
+    for (i = 0; i < count; i++) swap_entries(i, find_entry(first + i));
+    DRESULT res = card_write(drv, (BYTE*)cacheData[0], first, count);
+    statistics.cardWrites++;
+    statistics.cardSectors += count;
+    if (res == RES_OK)
+    {
+        for (i = 0; i < count; i++) cacheEntry[i].dirty = 0;
+    }
+    return res;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Write Back All Dirty Sectors
+
+Runs are written in ascending sector order.
+
+@param[in] drv: BYTE Physical drive number.
+@returns DRESULT success (RES_OK) or fail.
+*/
+
+static DRESULT flush_all(BYTE drv)
+{
+    while (1)
+    {
+        BYTE lowest = NO_ENTRY;
+        UINT i;
+        for (i = 0; i < cacheSize; i++)
+        {
+            if (cacheEntry[i].valid && cacheEntry[i].dirty &&
+                ((lowest == NO_ENTRY) ||
+                 (cacheEntry[i].sector < cacheEntry[lowest].sector)))
+                lowest = i;
+        }
+        if (lowest == NO_ENTRY) return RES_OK;
+        DRESULT res = flush_run(drv, lowest);
+        if (res != RES_OK) return res;
+    }
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Allocate a Slot for a Sector
+
+An empty slot is used if there is one, otherwise the least recently used slot
+is evicted, writing it back (with its run) if it is dirty.
+
+@param[in] drv: BYTE Physical drive number.
+@param[in] sector: DWORD sector to be held.
+@returns BYTE slot allocated, or NO_ENTRY if a write back failed.
+*/
+
+static BYTE allocate_entry(BYTE drv, DWORD sector)
+{
+    BYTE victim = 0;
+    UINT i;
+    for (i = 0; i < cacheSize; i++)
+    {
+        if (!cacheEntry[i].valid)
+        {
+            victim = i;
+            break;
+        }
+        if (cacheEntry[i].lastUse < cacheEntry[victim].lastUse) victim = i;
+    }
+    if (cacheEntry[victim].valid && cacheEntry[victim].dirty)
+    {
+        DWORD victimSector = cacheEntry[victim].sector;
+        if (flush_run(drv, victim) != RES_OK) return NO_ENTRY;
+/* The flush rearranges slots, so find the victim again */
+        victim = find_entry(victimSector);
+    }
+    cacheEntry[victim].sector = sector;
+    cacheEntry[victim].valid = 0;
+    cacheEntry[victim].dirty = 0;
+    cacheEntry[victim].lastUse = ++useCount;
+    return victim;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Set the Cache Size and Sync Deferral
+
+Any dirty sectors are written back and the cache emptied first. This allows
+the host benchmark to compare configurations in one build.
+
+@param[in] sectors: UINT number of slots to use, at most _SECTOR_CACHE. Zero
+passes all requests straight to the card.
+@param[in] syncs: UINT number of CTRL_SYNC requests that may be absorbed.
+*/
+
+void sector_cache_configure(UINT sectors, UINT syncs)
+{
+    flush_all(0);
+    memset(cacheEntry, 0, sizeof(cacheEntry));
+    cacheSize = (sectors > _SECTOR_CACHE) ? _SECTOR_CACHE : sectors;
+    syncLimit = syncs;
+    syncsPending = 0;
+    memset(&statistics, 0, sizeof(statistics));
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Cache Statistics
+
+*/
+
+const struct sectorCacheStatistics *sector_cache_statistics(void)
+{
+    return &statistics;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Initialize the Disk
+
+The card may have been changed, so the cache is emptied. Dirty sectors are
+written back first if the card is still initialised.
+
+@param[in] drv: BYTE Physical drive number (only 0 allowed)
+@returns DSTATUS disk status.
+*/
+
+DSTATUS disk_initialize(BYTE drv)
+{
+    if (!(disk_status(drv) & STA_NOINIT)) flush_all(drv);
+    memset(cacheEntry, 0, sizeof(cacheEntry));
+    syncsPending = 0;
+    return card_initialize(drv);
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Read Sector(s)
+
+Single sector reads are served from the cache or loaded into it. Multiple
+sector reads go to the card, then any cached sectors in the range are copied
+over the result since they may be newer.
+
+@param[in] drv: BYTE Physical drive number (only 0 allowed)
+@param[out] *buff: BYTE Pointer to buffer
+@param[in] sector: DWORD starting sector number
+@param[in] count: UINT number of sectors to read
+@returns DRESULT success (RES_OK) or fail.
+*/
+
+DRESULT disk_read(BYTE drv, BYTE *buff, DWORD sector, UINT count)
+{
+    if ((cacheSize == 0) || drv || !count)
+        return card_read(drv, buff, sector, count);
+    BYTE slot;
+    if (count == 1)
+    {
+        slot = find_entry(sector);
+        if (slot != NO_ENTRY)
+        {
+            statistics.readHits++;
+        }
+        else
+        {
+            statistics.readMisses++;
+            slot = allocate_entry(drv, sector);
+            if (slot == NO_ENTRY) return RES_ERROR;
+            DRESULT res = card_read(drv, (BYTE*)cacheData[slot], sector, 1);
+            if (res != RES_OK) return res;
+            cacheEntry[slot].valid = 1;
+        }
+        cacheEntry[slot].lastUse = ++useCount;
+        memcpy(buff, cacheData[slot], SECTOR_SIZE);
+        return RES_OK;
+    }
+    DRESULT res = card_read(drv, buff, sector, count);
+    if (res != RES_OK) return res;
+    UINT i;
+    for (i = 0; i < cacheSize; i++)
+    {
+        if (cacheEntry[i].valid && (cacheEntry[i].sector >= sector) &&
+            (cacheEntry[i].sector - sector < count))
+            memcpy(buff + (cacheEntry[i].sector - sector)*SECTOR_SIZE,
+                   cacheData[i], SECTOR_SIZE);
+    }
+    return RES_OK;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Write Sector(s)
+
+Single sector writes are held in the cache as dirty. Multiple sector writes go
+directly to the card and any cached copies in the range are refreshed and
+marked clean.
+
+@param[in] drv: BYTE Physical drive number (only 0 allowed)
+@param[in] *buff: BYTE Pointer to buffer
+@param[in] sector: DWORD starting sector number
+@param[in] count: UINT number of sectors to write
+@returns DRESULT success (RES_OK) or fail.
+*/
+
+#if _FS_READONLY == 0
+
+DRESULT disk_write(BYTE drv, const BYTE *buff, DWORD sector, UINT count)
+{
+    statistics.writeRequests++;
+    statistics.writeSectors += count;
+    if ((cacheSize == 0) || drv || !count)
+    {
+        statistics.cardWrites++;
+        statistics.cardSectors += count;
+        return card_write(drv, buff, sector, count);
+    }
+    DSTATUS status = disk_status(drv);
+    if (status & STA_NOINIT) return RES_NOTRDY;
+    if (status & STA_PROTECT) return RES_WRPRT;
+    BYTE slot;
+    if (count == 1)
+    {
+        slot = find_entry(sector);
+        if (slot == NO_ENTRY) slot = allocate_entry(drv, sector);
+        else if (cacheEntry[slot].dirty) statistics.absorbed++;
+        if (slot == NO_ENTRY) return RES_ERROR;
+        memcpy(cacheData[slot], buff, SECTOR_SIZE);
+        cacheEntry[slot].valid = 1;
+        cacheEntry[slot].dirty = 1;
+        cacheEntry[slot].lastUse = ++useCount;
+        return RES_OK;
+    }
+    statistics.cardWrites++;
+    statistics.cardSectors += count;
+    DRESULT res = card_write(drv, buff, sector, count);
+    if (res != RES_OK) return res;
+    UINT i;
+    for (i = 0; i < cacheSize; i++)
+    {
+        if (cacheEntry[i].valid && (cacheEntry[i].sector >= sector) &&
+            (cacheEntry[i].sector - sector < count))
+        {
+            memcpy(cacheData[i], buff + (cacheEntry[i].sector - sector)*SECTOR_SIZE,
+                   SECTOR_SIZE);
+            cacheEntry[i].dirty = 0;
+        }
+    }
+    return RES_OK;
+}
+
+#endif
+
+/*---------------------------------------------------------------------------*/
+/** @brief Miscellaneous Functions
+
+CTRL_SYNC writes back dirty sectors (subject to _SECTOR_CACHE_SYNC) and then
+syncs the card. CTRL_CACHE_FLUSH always does so. Powering the card off writes
+back first. All other requests are passed to the card.
+
+@param[in] drv: BYTE Physical drive number (only 0 allowed)
+@param[in] ctrl: BYTE Control code
+@param[in] *buff: void Buffer to send/receive control data
+@returns DRESULT success (RES_OK) or fail.
+*/
+
+DRESULT disk_ioctl(BYTE drv, BYTE ctrl, void *buff)
+{
+    if ((cacheSize == 0) || drv)
+    {
+        if (ctrl == CTRL_CACHE_FLUSH) ctrl = CTRL_SYNC;
+        return card_ioctl(drv, ctrl, buff);
+    }
+    DRESULT res;
+    switch (ctrl)
+    {
+/* Absorb the sync if allowed, otherwise write back as for a flush */
+    case CTRL_SYNC :
+        if (syncsPending < syncLimit)
+        {
+            syncsPending++;
+            statistics.syncsDeferred++;
+            return RES_OK;
+        }
+/* Fall through */
+    case CTRL_CACHE_FLUSH :
+        syncsPending = 0;
+        res = flush_all(drv);
+        if (res != RES_OK) return res;
+        return card_ioctl(drv, CTRL_SYNC, buff);
+    case CTRL_POWER :
+        if (*(BYTE*)buff == 0) flush_all(drv);
+        break;
+    }
+    return card_ioctl(drv, ctrl, buff);
+}
+
+#endif
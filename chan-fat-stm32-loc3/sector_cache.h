@@ -0,0 +1,54 @@
+/*-----------------------------------------------------------------------*/
+/* Write-back sector cache between ChaN FatFs and the card driver        */
+/*-----------------------------------------------------------------------*/
+
+/* The cache provides the diskio.h interface to FatFs and calls the card driver
+beneath it. A card driver includes this header after diskio.h with
+SECTOR_CACHE_DRIVER defined, which renames its disk_* functions to card_*.
+Other modules may include it for CTRL_CACHE_FLUSH and the statistics.
+
+Copyright (c) 2013 Ken Sarkies
+*/
+
+#ifndef _SECTOR_CACHE_DEFINED
+#define _SECTOR_CACHE_DEFINED
+
+#include "integer.h"
+#include "ffconf.h"
+#include "diskio.h"
+
+/* Write back all dirty sectors regardless of _SECTOR_CACHE_SYNC */
+#define CTRL_CACHE_FLUSH    9
+
+struct sectorCacheStatistics
+{
+    DWORD readHits;             /* Single sector reads served from the cache */
+    DWORD readMisses;
+    DWORD writeRequests;        /* disk_write calls from FatFs */
+    DWORD writeSectors;
+    DWORD absorbed;             /* Writes to a sector that was already dirty */
+    DWORD syncsDeferred;
+    DWORD cardWrites;           /* card_write calls made by the cache */
+    DWORD cardSectors;
+};
+
+#if _SECTOR_CACHE > 0
+
+DSTATUS card_initialize(BYTE drv);
+DRESULT card_read(BYTE drv, BYTE* buff, DWORD sector, UINT count);
+DRESULT card_write(BYTE drv, const BYTE* buff, DWORD sector, UINT count);
+DRESULT card_ioctl(BYTE drv, BYTE ctrl, void* buff);
+
+void sector_cache_configure(UINT sectors, UINT syncs);
+const struct sectorCacheStatistics *sector_cache_statistics(void);
+
+#ifdef SECTOR_CACHE_DRIVER
+#define disk_initialize     card_initialize
+#define disk_read           card_read
+#define disk_write          card_write
+#define disk_ioctl          card_ioctl
+#endif
+
+#endif
+
+#endif
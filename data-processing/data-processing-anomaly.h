@@ -0,0 +1,333 @@
+/*       Power Management Battery Anomaly Detection
+
+Streaming detection of unusual battery behaviour in one pass over the raw
+records, in constant memory. Baselines are kept for each battery and for each
+combination of operational state and charging phase, as the behaviour that is
+usual when charging in bulk is quite different to that when loaded.
+
+Two measures are watched:
+
+- Voltage sag. The voltage expected for the measured current is found from a
+  running linear fit of voltage against current. The residual is scored against
+  a baseline of residuals, so a sag much larger than usual for the current is
+  flagged.
+- Current noise. The mean change between successive current samples over a
+  block of samples is scored against a slow baseline of block values, so that
+  a rise in noise is flagged.
+
+Each baseline is started with exact running (Welford) statistics, then follows
+slow changes with an exponentially weighted mean and variance. Updates are
+clipped at a few deviations from the mean so that the anomalies themselves do
+not move the baseline.
+
+@date 18 October 2026
+*/
+
+/****************************************************************************
+ *   Copyright (C) 2013 by Ken Sarkies                                      *
+ *   ksarkies@internode.on.net                                              *
+ *                                                                          *
+ *   This file is part of Power Management                                  *
+ *                                                                          *
+ *   Power Management is free software; you can redistribute it and/or      *
+ *   modify it under the terms of the GNU General Public License as         *
+ *   published by the Free Software Foundation; either version 2 of the     *
+ *   License, or (at your option) any later version.                        *
+ *                                                                          *
+ *   Power Management is distributed in the hope that it will be useful,    *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the          *
+ *   GNU General Public License for more details.                           *
+ *                                                                          *
+ *   You should have received a copy of the GNU General Public License      *
+ *   along with Power Management if not, write to the                       *
+ *   Free Software Foundation, Inc.,                                        *
+ *   51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.              *
+ ***************************************************************************/
+
+#ifndef DATA_PROCESSING_ANOMALY_H
+#define DATA_PROCESSING_ANOMALY_H
+
+#include <math.h>
+#include <QtGlobal>
+#include "power-management-records.h"
+
+/* Samples taken with exact statistics before a baseline is used */
+#define ANOMALY_WARMUP      200
+/* Score beyond which a sample is anomalous, in deviations */
+#define ANOMALY_THRESHOLD   6.0
+/* Score below which an anomaly has ended */
+#define ANOMALY_RECOVERY    3.0
+/* Deviations at which baseline updates are clipped */
+#define ANOMALY_CLIP        3.0
+/* Baseline weight of each voltage sample, about a day of samples */
+#define ANOMALY_SAG_ALPHA   0.00001
+/* Samples in each current noise block, about five minutes */
+#define ANOMALY_NOISE_BLOCK 600
+/* Baseline weight of each noise block, about two weeks of blocks */
+#define ANOMALY_NOISE_ALPHA 0.0003
+/* Operational states and charging phases */
+#define ANOMALY_STATES      16
+/* Smallest deviation used in scores, one count of the fixed point values */
+#define ANOMALY_RESOLUTION  1.0
+
+typedef enum {anomalySag, anomalyNoise} AnomalyKind;
+
+//-----------------------------------------------------------------------------
+/** @brief Anomaly Event
+
+Voltages and currents are fixed point times 256 as in the records.
+*/
+
+struct AnomalyEvent
+{
+    qint64 time;
+    int battery;
+    AnomalyKind kind;
+    int opState;
+    int chargePhase;
+    double value;
+    double expected;
+    double score;
+};
+
+//-----------------------------------------------------------------------------
+/** @brief Robust Running Statistic
+
+Mean and variance of a stream, exact for the first samples then exponentially
+weighted with clipped updates.
+*/
+
+class RobustStatistic
+{
+public:
+    RobustStatistic() : count(0), mean(0), variance(0) {}
+    void add(double x, double alpha);
+    bool ready() const { return count >= ANOMALY_WARMUP; }
+    double expected() const { return mean; }
+    double score(double x) const { return (x - mean)/deviation(); }
+private:
+    double deviation() const
+    {
+        double d = sqrt(variance);
+        return (d < ANOMALY_RESOLUTION) ? ANOMALY_RESOLUTION : d;
+    }
+    long count;
+    double mean;
+    double variance;
+};
+
+inline void RobustStatistic::add(double x, double alpha)
+{
+    double delta = x - mean;
+    if (count < ANOMALY_WARMUP)
+    {
+        count++;
+        mean += delta/count;
+        variance += (delta*(x - mean) - variance)/count;
+        return;
+    }
+    double limit = ANOMALY_CLIP*deviation();
+    if (delta > limit) delta = limit;
+    if (delta < -limit) delta = -limit;
+    mean += alpha*delta;
+    variance = (1 - alpha)*(variance + alpha*delta*delta);
+}
+
+//-----------------------------------------------------------------------------
+/** @brief Running Linear Fit
+
+Voltage against current, with the means and co-moments kept in the same way
+as the robust statistic but without clipping.
+*/
+
+class LinearBaseline
+{
+public:
+    LinearBaseline() : count(0), meanI(0), meanV(0), varianceI(0),
+                       covariance(0) {}
+    void add(double current, double voltage, double alpha);
+    double predict(double current) const;
+    bool ready() const { return count >= ANOMALY_WARMUP; }
+private:
+    long count;
+    double meanI;
+    double meanV;
+    double varianceI;
+    double covariance;
+};
+
+inline void LinearBaseline::add(double current, double voltage, double alpha)
+{
+    double deltaI = current - meanI;
+    double deltaV = voltage - meanV;
+    if (count < ANOMALY_WARMUP)
+    {
+        count++;
+        meanI += deltaI/count;
+        meanV += deltaV/count;
+        varianceI += (deltaI*(current - meanI) - varianceI)/count;
+        covariance += (deltaI*(voltage - meanV) - covariance)/count;
+        return;
+    }
+    meanI += alpha*deltaI;
+    meanV += alpha*deltaV;
+    varianceI = (1 - alpha)*(varianceI + alpha*deltaI*deltaI);
+    covariance = (1 - alpha)*(covariance + alpha*deltaI*deltaV);
+}
+
+/* A current spread below one count gives no slope */
+inline double LinearBaseline::predict(double current) const
+{
+    double slope = 0;
+    if (varianceI > ANOMALY_RESOLUTION) slope = covariance/varianceI;
+    return meanV + slope*(current - meanI);
+}
+
+//-----------------------------------------------------------------------------
+/** @brief Anomaly Detector
+
+Operational status records set the state of each battery. Each battery record
+then updates the baselines for that state and may raise events. An anomaly
+raises one event, and no more are raised for that battery and measure until
+the score has returned below the recovery level.
+*/
+
+class AnomalyDetector
+{
+public:
+    AnomalyDetector();
+    void setState(int battery, int status);
+    int addBattery(qint64 time, int battery, int current, int voltage,
+                   AnomalyEvent *events);
+private:
+    struct Channel
+    {
+        LinearBaseline fit;
+        RobustStatistic residual;
+        RobustStatistic noise;
+    };
+    Channel channel[3][ANOMALY_STATES];
+    int state[3];
+    bool known[3];
+    int previousCurrent[3];
+    double noiseSum[3];
+    int noiseCount[3];
+    bool active[3][2];
+};
+
+inline AnomalyDetector::AnomalyDetector()
+{
+    for (int n = 0; n < 3; n++)
+    {
+        state[n] = 0;
+        known[n] = false;
+        previousCurrent[n] = 0;
+        noiseSum[n] = 0;
+        noiseCount[n] = 0;
+        active[n][anomalySag] = false;
+        active[n][anomalyNoise] = false;
+    }
+}
+
+//-----------------------------------------------------------------------------
+/** @brief Set the Operational State of a Battery
+
+A change of state or charging phase starts a new noise block.
+
+@param[in] battery: battery number 1-3.
+@param[in] status: operational status field of the dO record.
+*/
+
+inline void AnomalyDetector::setState(int battery, int status)
+{
+    if ((battery < 1) || (battery > 3)) return;
+    int n = battery-1;
+    int newState = bitField(status,operationalOp) +
+                   (bitField(status,operationalCharge) << operationalOp.width);
+    if (known[n] && (newState == state[n])) return;
+    state[n] = newState;
+    known[n] = true;
+    noiseCount[n] = 0;
+    noiseSum[n] = 0;
+}
+
+//-----------------------------------------------------------------------------
+/** @brief Add a Battery Measurement
+
+Measurements of a battery are ignored until its state is known, and while it
+is missing.
+
+@param[in] time: time of the measurement in seconds.
+@param[in] battery: battery number 1-3.
+@param[in] current: current times 256.
+@param[in] voltage: voltage times 256.
+@param[out] events: space for two events.
+@returns int number of events raised.
+*/
+
+inline int AnomalyDetector::addBattery(qint64 time, int battery, int current,
+                                       int voltage, AnomalyEvent *events)
+{
+    if ((battery < 1) || (battery > 3)) return 0;
+    int n = battery-1;
+    if (! known[n]) return 0;
+    int opState = bitField(state[n],operationalOp);
+    if (opState == 3) return 0;                 /* missing */
+    Channel &entry = channel[n][state[n]];
+    int raised = 0;
+    AnomalyEvent event;
+    event.time = time;
+    event.battery = battery;
+    event.opState = opState;
+    event.chargePhase = state[n] >> operationalOp.width;
+/* Voltage sag for the current */
+    double expected = entry.fit.predict(current);
+    double residual = voltage - expected;
+    bool anomalous = false;
+    if (entry.residual.ready())
+    {
+        double score = entry.residual.score(residual);
+        anomalous = (score < -ANOMALY_THRESHOLD);
+        if (anomalous && ! active[n][anomalySag])
+        {
+            event.kind = anomalySag;
+            event.value = voltage;
+            event.expected = expected;
+            event.score = score;
+            events[raised++] = event;
+        }
+        if (anomalous) active[n][anomalySag] = true;
+        else if (score > -ANOMALY_RECOVERY) active[n][anomalySag] = false;
+    }
+/* Residuals are only gathered once the fit has settled */
+    if (entry.fit.ready()) entry.residual.add(residual,ANOMALY_SAG_ALPHA);
+    if (! anomalous) entry.fit.add(current,voltage,ANOMALY_SAG_ALPHA);
+/* Current noise over a block of samples in the same state */
+    if (noiseCount[n] > 0) noiseSum[n] += qAbs(current - previousCurrent[n]);
+    previousCurrent[n] = current;
+    if (++noiseCount[n] > ANOMALY_NOISE_BLOCK)
+    {
+        double noise = noiseSum[n]/(noiseCount[n]-1);
+        noiseSum[n] = 0;
+        noiseCount[n] = 1;
+        if (entry.noise.ready())
+        {
+            double score = entry.noise.score(noise);
+            if ((score > ANOMALY_THRESHOLD) && ! active[n][anomalyNoise])
+            {
+                event.kind = anomalyNoise;
+                event.value = noise;
+                event.expected = entry.noise.expected();
+                event.score = score;
+                events[raised++] = event;
+            }
+            if (score > ANOMALY_THRESHOLD) active[n][anomalyNoise] = true;
+            else if (score < ANOMALY_RECOVERY) active[n][anomalyNoise] = false;
+        }
+        entry.noise.add(noise,ANOMALY_NOISE_ALPHA);
+    }
+    return raised;
+}
+
+#endif
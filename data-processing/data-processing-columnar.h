@@ -0,0 +1,358 @@
+/*       Power Management Columnar Binary Export
+
+Typed columnar file of the combined records, so that analysis tools can map it
+into memory rather than parse text. Rows are gathered into row groups and each
+column of a group is written as one contiguous little endian array, aligned to
+8 bytes from the start of the file. A footer holds the schema, dictionaries and
+the position of each column chunk with its minimum and maximum, so a reader can
+skip the groups outside a time range.
+
+Column types:
+
+- columnarTime: int64 milliseconds since the epoch (UTC).
+- columnarFloat: float32.
+- columnarInt: int32.
+- columnarDictionary: uint16 codes into the text dictionary of the column, with
+  0xFFFF for a missing value. Dictionaries may be given in advance, such as the
+  state texts so that codes match the record bit fields, and new texts are
+  added as they are met.
+
+File layout:
+
+    "BMSX" uint32 version
+    column chunks of each row group, each padded with zeros to 8 bytes
+    footer:
+      uint32 columns
+      for each column: uint16 name length, name, uint8 type,
+                       uint32 dictionary entries, each uint16 length and text
+      uint32 row groups
+      for each group: uint32 rows, then for each column:
+                      uint64 offset, uint64 bytes, float64 minimum, float64 maximum
+    uint32 footer length, not counting itself or the final marker
+    "BMSX"
+
+The marker differs from the "BMSC" of the configuration snapshots saved by the
+GUI, so that neither file can be taken for the other.
+
+Statistics of dictionary columns are of the codes, and missing values are left
+out of them. A chunk with no values has a minimum above its maximum.
+
+This is in the spirit of the Arrow and Parquet formats without needing their
+libraries, and is read directly with numpy.memmap or R readBin.
+
+@date 18 October 2026
+*/
+
+/****************************************************************************
+ *   Copyright (C) 2013 by Ken Sarkies                                      *
+ *   ksarkies@internode.on.net                                              *
+ *                                                                          *
+ *   This file is part of Power Management                                  *
+ *                                                                          *
+ *   Power Management is free software; you can redistribute it and/or      *
+ *   modify it under the terms of the GNU General Public License as         *
+ *   published by the Free Software Foundation; either version 2 of the     *
+ *   License, or (at your option) any later version.                        *
+ *                                                                          *
+ *   Power Management is distributed in the hope that it will be useful,    *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the          *
+ *   GNU General Public License for more details.                           *
+ *                                                                          *
+ *   You should have received a copy of the GNU General Public License      *
+ *   along with Power Management if not, write to the                       *
+ *   Free Software Foundation, Inc.,                                        *
+ *   51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.              *
+ ***************************************************************************/
+
+#ifndef DATA_PROCESSING_COLUMNAR_H
+#define DATA_PROCESSING_COLUMNAR_H
+
+#include <string.h>
+#include <QByteArray>
+#include <QHash>
+#include <QIODevice>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QtEndian>
+#include <QtGlobal>
+
+/* Rows in each row group, about 18 hours of records */
+#define COLUMNAR_GROUP_ROWS     65536
+#define COLUMNAR_VERSION        1
+#define COLUMNAR_MISSING        0xFFFF
+
+typedef enum {columnarTime, columnarFloat, columnarInt,
+              columnarDictionary} ColumnarType;
+
+//-----------------------------------------------------------------------------
+/** @brief Columnar File Writer
+
+Columns are declared with addColumn(), then each row is given by calling the add
+function for every column in order, followed by endRow(). The file is complete
+once finish() has been called.
+*/
+
+class ColumnarWriter
+{
+public:
+    ColumnarWriter(QIODevice *outDevice);
+    int addColumn(const QString &name, ColumnarType type);
+    void setDictionary(int column, const char* const *text, int texts);
+    void addTime(qint64 milliseconds) { addValue(milliseconds,milliseconds); }
+    void addFloat(float value);
+    void addInt(qint32 value) { addValue(value,value); }
+    void addText(const QString &text);
+    void endRow();
+    bool finish();
+    long rows() const { return totalRows; }
+private:
+    struct Chunk
+    {
+        quint64 offset;
+        quint64 bytes;
+        double minimum;
+        double maximum;
+    };
+    struct Column
+    {
+        QString name;
+        ColumnarType type;
+        QStringList dictionary;
+        QHash<QString,int> code;
+        QByteArray data;
+        double minimum;
+        double maximum;
+    };
+    template <typename T> void addValue(T value, double statistic);
+    void addStatistic(Column &entry, double statistic);
+    void start();
+    void writeGroup();
+    bool write(const QByteArray &bytes);
+    template <typename T> static void append(QByteArray &bytes, T value);
+    QIODevice *device;
+    QVector<Column> column;
+    QVector<quint32> groupRows;
+    QVector<Chunk> chunk;
+    int next;
+    int groupSize;
+    long totalRows;
+    quint64 position;
+    bool started;
+    bool failed;
+};
+
+inline ColumnarWriter::ColumnarWriter(QIODevice *outDevice)
+{
+    device = outDevice;
+    next = 0;
+    groupSize = 0;
+    totalRows = 0;
+    position = 0;
+    started = false;
+    failed = false;
+}
+
+/* Little endian bytes of an integer */
+template <typename T>
+inline void ColumnarWriter::append(QByteArray &bytes, T value)
+{
+    T little = qToLittleEndian(value);
+    bytes.append((const char*)&little,sizeof(T));
+}
+
+//-----------------------------------------------------------------------------
+/** @brief Declare a Column
+
+Columns can only be declared before the first row.
+
+@param[in] name: column name.
+@param[in] type: column type.
+@returns int column number, or -1 once rows have been added.
+*/
+
+inline int ColumnarWriter::addColumn(const QString &name, ColumnarType type)
+{
+    if (started) return -1;
+    Column entry;
+    entry.name = name;
+    entry.type = type;
+    entry.minimum = 1;
+    entry.maximum = 0;
+    column.append(entry);
+    return column.size()-1;
+}
+
+/* Texts given codes 0 onwards, before any others met */
+inline void ColumnarWriter::setDictionary(int columnNumber,
+                                          const char* const *text, int texts)
+{
+    if (started || (columnNumber < 0) || (columnNumber >= column.size())) return;
+    Column &entry = column[columnNumber];
+    for (int n = 0; n < texts; n++)
+    {
+        entry.code.insert(QString(text[n]),entry.dictionary.size());
+        entry.dictionary << QString(text[n]);
+    }
+}
+
+inline void ColumnarWriter::addStatistic(Column &entry, double statistic)
+{
+    if (entry.minimum > entry.maximum)
+    {
+        entry.minimum = statistic;
+        entry.maximum = statistic;
+    }
+    else if (statistic < entry.minimum) entry.minimum = statistic;
+    else if (statistic > entry.maximum) entry.maximum = statistic;
+}
+
+template <typename T>
+inline void ColumnarWriter::addValue(T value, double statistic)
+{
+    if (next >= column.size()) return;
+    Column &entry = column[next++];
+    append(entry.data,value);
+    addStatistic(entry,statistic);
+}
+
+/* Floats are written by their bit pattern */
+inline void ColumnarWriter::addFloat(float value)
+{
+    if (next >= column.size()) return;
+    Column &entry = column[next++];
+    quint32 bits;
+    memcpy(&bits,&value,sizeof(bits));
+    append(entry.data,bits);
+    if (value == value) addStatistic(entry,value);      /* not NaN */
+}
+
+/* Empty texts are missing values */
+inline void ColumnarWriter::addText(const QString &text)
+{
+    if (next >= column.size()) return;
+    Column &entry = column[next++];
+    quint16 code = COLUMNAR_MISSING;
+    if (! text.isEmpty())
+    {
+        QHash<QString,int>::const_iterator found = entry.code.constFind(text);
+        if (found != entry.code.constEnd()) code = found.value();
+        else if (entry.dictionary.size() < COLUMNAR_MISSING)
+        {
+            code = entry.dictionary.size();
+            entry.code.insert(text,code);
+            entry.dictionary << text;
+        }
+    }
+    append(entry.data,code);
+    if (code != COLUMNAR_MISSING) addStatistic(entry,code);
+}
+
+//-----------------------------------------------------------------------------
+/** @brief End a Row
+
+A full row group is written out.
+*/
+
+inline void ColumnarWriter::endRow()
+{
+    start();
+    next = 0;
+    groupSize++;
+    totalRows++;
+    if (groupSize >= COLUMNAR_GROUP_ROWS) writeGroup();
+}
+
+/* The header is written with the first row, as the schema is then fixed */
+inline void ColumnarWriter::start()
+{
+    if (started) return;
+    QByteArray header("BMSX");
+    append(header,(quint32)COLUMNAR_VERSION);
+    write(header);
+    started = true;
+}
+
+inline void ColumnarWriter::writeGroup()
+{
+    if (groupSize == 0) return;
+    groupRows.append(groupSize);
+    for (int n = 0; n < column.size(); n++)
+    {
+        Column &entry = column[n];
+        Chunk part;
+        part.offset = position;
+        part.bytes = entry.data.size();
+        part.minimum = entry.minimum;
+        part.maximum = entry.maximum;
+        chunk.append(part);
+        while (entry.data.size() % 8) entry.data.append('\0');
+        write(entry.data);
+        entry.data.clear();
+        entry.minimum = 1;
+        entry.maximum = 0;
+    }
+    groupSize = 0;
+}
+
+inline bool ColumnarWriter::write(const QByteArray &bytes)
+{
+    if (failed) return false;
+    if (device->write(bytes) != bytes.size()) failed = true;
+    position += bytes.size();
+    return ! failed;
+}
+
+//-----------------------------------------------------------------------------
+/** @brief Finish the File
+
+The last row group and the footer are written. A file with no rows has only
+the header and footer.
+
+@returns true if all writes succeeded.
+*/
+
+inline bool ColumnarWriter::finish()
+{
+    start();
+    writeGroup();
+    QByteArray footer;
+    append(footer,(quint32)column.size());
+    for (int n = 0; n < column.size(); n++)
+    {
+        const Column &entry = column[n];
+        QByteArray name = entry.name.toUtf8();
+        append(footer,(quint16)name.size());
+        footer.append(name);
+        footer.append((char)entry.type);
+        append(footer,(quint32)entry.dictionary.size());
+        for (int i = 0; i < entry.dictionary.size(); i++)
+        {
+            QByteArray text = entry.dictionary[i].toUtf8();
+            append(footer,(quint16)text.size());
+            footer.append(text);
+        }
+    }
+    append(footer,(quint32)groupRows.size());
+    for (int g = 0; g < groupRows.size(); g++)
+    {
+        append(footer,groupRows[g]);
+        for (int n = 0; n < column.size(); n++)
+        {
+            const Chunk &part = chunk[g*column.size() + n];
+            append(footer,part.offset);
+            append(footer,part.bytes);
+            quint64 bits;
+            memcpy(&bits,&part.minimum,sizeof(bits));
+            append(footer,bits);
+            memcpy(&bits,&part.maximum,sizeof(bits));
+            append(footer,bits);
+        }
+    }
+    append(footer,(quint32)footer.size());
+    footer.append("BMSX");
+    return write(footer);
+}
+
+#endif
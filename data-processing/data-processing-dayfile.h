@@ -0,0 +1,199 @@
+/*       Power Management Day File Rows
+
+The columns of the day files written by the split function, and the parsing of
+their rows in place. A row is split into fields by pointers into the text, and
+the fields are read without copying, so that the functions that go over many
+day files, the plot, energy and histogram, share one parser and one table of
+columns.
+
+@date 18 October 2026
+*/
+
+/****************************************************************************
+ *   Copyright (C) 2013 by Ken Sarkies                                      *
+ *   ksarkies@internode.on.net                                              *
+ *                                                                          *
+ *   This file is part of Power Management                                  *
+ *                                                                          *
+ *   Power Management is free software; you can redistribute it and/or      *
+ *   modify it under the terms of the GNU General Public License as         *
+ *   published by the Free Software Foundation; either version 2 of the     *
+ *   License, or (at your option) any later version.                        *
+ *                                                                          *
+ *   Power Management is distributed in the hope that it will be useful,    *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the          *
+ *   GNU General Public License for more details.                           *
+ *                                                                          *
+ *   You should have received a copy of the GNU General Public License      *
+ *   along with Power Management if not, write to the                       *
+ *   Free Software Foundation, Inc.,                                        *
+ *   51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.              *
+ ***************************************************************************/
+
+#ifndef DATA_PROCESSING_DAYFILE_H
+#define DATA_PROCESSING_DAYFILE_H
+
+#include <string.h>
+#include <QByteArray>
+#include <QDate>
+#include <QtGlobal>
+
+/* Columns of a day file row */
+#define DAY_COLUMNS             36
+
+/* Columns of the day files. Each battery has DAY_BATTERY_WIDTH columns from
+its first, in the order of DayBatteryField. */
+enum DayColumn
+{
+    dayTimeColumn = 0,
+    dayBattery1Column = 1,
+    dayBattery2Column = 7,
+    dayBattery3Column = 13,
+    dayLoad1CurrentColumn = 19,
+    dayLoad1VoltageColumn = 20,
+    dayLoad2CurrentColumn = 21,
+    dayLoad2VoltageColumn = 22,
+    dayModuleCurrentColumn = 23,
+    dayModuleVoltageColumn = 24,
+    dayTemperatureColumn = 25
+};
+#define DAY_BATTERY_WIDTH       6
+
+enum DayBatteryField
+{
+    dayBatteryCurrent = 0,
+    dayBatteryVoltage = 1,
+    dayBatteryCharge = 2,           /* state of charge, percent */
+    dayBatteryOpState = 3,
+    dayBatteryFillState = 4,
+    dayBatteryChargeState = 5
+};
+
+/* Names of the columns, as in the header of the day files */
+static const char* const dayColumnName[DAY_COLUMNS] = {
+    "Time",
+    "B1 I", "B1 V", "B1 Cap", "B1 Op", "B1 State", "B1 Charge",
+    "B2 I", "B2 V", "B2 Cap", "B2 Op", "B2 State", "B2 Charge",
+    "B3 I", "B3 V", "B3 Cap", "B3 Op", "B3 State", "B3 Charge",
+    "L1 I", "L1 V", "L2 I", "L2 V", "M1 I", "M1 V",
+    "Temp", "Controls", "Switches", "Decisions", "Indicators",
+    "Debug 1a", "Debug 1b", "Debug 2a", "Debug 2b", "Debug 3a", "Debug 3b"};
+
+/* First column of battery n, 0..2 */
+inline int dayBatteryColumn(int battery)
+{
+    return dayBattery1Column + battery*DAY_BATTERY_WIDTH;
+}
+
+//-----------------------------------------------------------------------------
+/** @brief Split a Day File Row into Fields
+
+The start of each field is given, and after the last field the position one
+past the end of the row, so that a field n runs from field[n] to field[n+1]-1.
+
+@param[in] text: start of the row.
+@param[in] end: end of the row, at the newline or the end of the contents.
+@param[out] field: space for maxFields+1 pointers.
+@param[in] maxFields: most fields taken.
+@returns int number of fields in the row, which is maxFields+1 if there are
+         more.
+*/
+
+inline int daySplitRow(const char *text, const char *end, const char **field,
+                       int maxFields)
+{
+    int fields = 0;
+    field[fields++] = text;
+    for (const char *c = text; c < end; c++)
+    {
+        if (*c != ',') continue;
+        if (fields == maxFields) return maxFields+1;
+        field[fields++] = c+1;
+    }
+    field[fields] = end+1;
+    return fields;
+}
+
+/* Trim the whitespace around a field, including line endings */
+inline void dayFieldTrim(const char *&start, const char *&end)
+{
+    while ((start < end) && ((unsigned char)*start <= ' ')) start++;
+    while ((end > start) && ((unsigned char)end[-1] <= ' ')) end--;
+}
+
+/* Numeric value of field n of a split row */
+inline double dayFieldValue(const char **field, int n)
+{
+    const char *start = field[n];
+    const char *end = field[n+1]-1;
+    dayFieldTrim(start,end);
+    return QByteArray::fromRawData(start,end-start).toDouble();
+}
+
+/* Test field n of a split row against a text */
+inline bool dayFieldIs(const char **field, int n, const char *text)
+{
+    const char *start = field[n];
+    const char *end = field[n+1]-1;
+    dayFieldTrim(start,end);
+    int length = strlen(text);
+    return (end - start == length) && (memcmp(start,text,length) == 0);
+}
+
+/* Index of field n of a split row in a table of texts, -1 if not found */
+inline int dayFieldText(const char **field, int n, const char* const *text,
+                        int texts)
+{
+    for (int i = 0; i < texts; i++)
+        if (dayFieldIs(field,n,text[i])) return i;
+    return -1;
+}
+
+//-----------------------------------------------------------------------------
+/** @brief Parse the ISO Time Field of a Day File Row
+
+Leading whitespace, including the carriage return that ends the previous row,
+is skipped.
+
+@param[in] text: start of the row.
+@param[in] end: pointer past the end of the time field.
+@param[out] julianDay: Julian day number of the date.
+@param[out] seconds: seconds since the start of the Julian day count.
+@returns true if the field is a valid date and time.
+*/
+
+inline bool dayParseTime(const char *text, const char *end,
+                         qint64 *julianDay, qint64 *seconds)
+{
+    while ((text < end) && (*text <= ' ')) text++;
+    if (end - text < 19) return false;
+    static const char separator[] = "--T::";
+    int value[6];
+    int width[6] = {4, 2, 2, 2, 2, 2};
+    for (int n = 0; n < 6; n++)
+    {
+        value[n] = 0;
+        for (int i = 0; i < width[n]; i++)
+        {
+            if ((*text < '0') || (*text > '9')) return false;
+            value[n] = value[n]*10 + (*text++ - '0');
+        }
+        if ((n < 5) && (*text++ != separator[n])) return false;
+    }
+    QDate date(value[0],value[1],value[2]);
+    if (! date.isValid() || (value[3] > 23) || (value[4] > 59) ||
+        (value[5] > 59)) return false;
+    *julianDay = date.toJulianDay();
+    *seconds = *julianDay*86400 + value[3]*3600 + value[4]*60 + value[5];
+    return true;
+}
+
+/* Time of a split row, false for a row without a valid time such as a header */
+inline bool dayRowTime(const char **field, qint64 *julianDay, qint64 *seconds)
+{
+    return dayParseTime(field[dayTimeColumn],field[dayTimeColumn+1]-1,
+                        julianDay,seconds);
+}
+
+#endif
@@ -0,0 +1,260 @@
+/*       Power Management Energy Aggregation over Day Files
+
+Energy balance over a set of day files written by the split function. Each file
+is mapped independently, so files can be read in parallel, to partial sums of
+ampere seconds for each date it holds. The partials are then reduced in time
+order into a single table with totals by week, month and year.
+
+A current is taken to flow over the interval since the previous row. The first
+row of a file is kept aside along with the last time of the file, so that the
+interval across the boundary between two files is counted in the reduction as
+if the files had been read one after the other. A day may therefore be spread
+over more than one file.
+
+@date 18 October 2026
+*/
+
+/****************************************************************************
+ *   Copyright (C) 2013 by Ken Sarkies                                      *
+ *   ksarkies@internode.on.net                                              *
+ *                                                                          *
+ *   This file is part of Power Management                                  *
+ *                                                                          *
+ *   Power Management is free software; you can redistribute it and/or      *
+ *   modify it under the terms of the GNU General Public License as         *
+ *   published by the Free Software Foundation; either version 2 of the     *
+ *   License, or (at your option) any later version.                        *
+ *                                                                          *
+ *   Power Management is distributed in the hope that it will be useful,    *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the          *
+ *   GNU General Public License for more details.                           *
+ *                                                                          *
+ *   You should have received a copy of the GNU General Public License      *
+ *   along with Power Management if not, write to the                       *
+ *   Free Software Foundation, Inc.,                                        *
+ *   51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.              *
+ ***************************************************************************/
+
+#ifndef DATA_PROCESSING_ENERGY_H
+#define DATA_PROCESSING_ENERGY_H
+
+#include <QByteArray>
+#include <QDate>
+#include <QFile>
+#include <QMap>
+#include <QtAlgorithms>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QtGlobal>
+#include "data-processing-dayfile.h"
+
+/* Battery 1-3, Load 1-2 and Panel currents */
+#define ENERGY_CHANNELS     6
+/* Channels from this one on count only positive currents */
+#define ENERGY_FIRST_MODULE 3
+
+/* Day file columns holding the currents of each channel, in amperes */
+static const int energyColumn[ENERGY_CHANNELS] = {
+    dayBattery1Column+dayBatteryCurrent, dayBattery2Column+dayBatteryCurrent,
+    dayBattery3Column+dayBatteryCurrent, dayLoad1CurrentColumn,
+    dayLoad2CurrentColumn, dayModuleCurrentColumn};
+#define ENERGY_LAST_COLUMN  dayModuleCurrentColumn
+
+//-----------------------------------------------------------------------------
+/** @brief Energy Sums
+
+Ampere seconds for each channel.
+*/
+
+struct EnergySums
+{
+    EnergySums() { for (int n = 0; n < ENERGY_CHANNELS; n++) charge[n] = 0; }
+    void add(const EnergySums &other)
+    {
+        for (int n = 0; n < ENERGY_CHANNELS; n++) charge[n] += other.charge[n];
+    }
+    double charge[ENERGY_CHANNELS];
+};
+
+//-----------------------------------------------------------------------------
+/** @brief Energy Partial Sums of One Day File
+
+The sums of each date are keyed by the Julian day number. The currents of the
+first row are not counted, as the interval preceding them is not known until
+the previous file has been seen.
+*/
+
+struct EnergyPartial
+{
+    EnergyPartial() : rows(0), firstTime(0), lastTime(0), firstDay(0) {}
+    QMap<qint64,EnergySums> day;
+    long rows;
+    qint64 firstTime;           /* seconds, from the Julian day number */
+    qint64 lastTime;
+    qint64 firstDay;
+    double head[ENERGY_CHANNELS];
+};
+
+//-----------------------------------------------------------------------------
+/** @brief Map a Day File to Partial Energy Sums
+
+This is safe to call from several threads at once. Rows without a valid time or
+without the current columns, such as the header, are skipped. Rows out of time
+order count no interval.
+
+@param[in] fileName: day file in the format written by the split function.
+@returns EnergyPartial sums for each date, empty if the file cannot be read.
+*/
+
+inline EnergyPartial mapEnergyFile(const QString &fileName)
+{
+    EnergyPartial partial;
+    QFile file(fileName);
+    if (! file.open(QIODevice::ReadOnly)) return partial;
+    qint64 previousTime = 0;
+    while (! file.atEnd())
+    {
+        QByteArray line = file.readLine();
+        const char *text = line.constData();
+        const char *field[DAY_COLUMNS+1];
+        if (daySplitRow(text,text+line.size(),field,DAY_COLUMNS) <=
+            ENERGY_LAST_COLUMN) continue;
+        qint64 julianDay;
+        qint64 seconds;
+        if (! dayRowTime(field,&julianDay,&seconds)) continue;
+        double current[ENERGY_CHANNELS];
+        for (int n = 0; n < ENERGY_CHANNELS; n++)
+        {
+            current[n] = dayFieldValue(field,energyColumn[n]);
+            if ((n >= ENERGY_FIRST_MODULE) && (current[n] < 0)) current[n] = 0;
+        }
+        if (partial.rows == 0)
+        {
+            partial.firstTime = seconds;
+            partial.firstDay = julianDay;
+            for (int n = 0; n < ENERGY_CHANNELS; n++) partial.head[n] = current[n];
+        }
+        else if (seconds > previousTime)
+        {
+            EnergySums &sums = partial.day[julianDay];
+            double interval = seconds - previousTime;
+            for (int n = 0; n < ENERGY_CHANNELS; n++)
+                sums.charge[n] += current[n]*interval;
+        }
+        if (seconds > previousTime) previousTime = seconds;
+        partial.rows++;
+    }
+    partial.lastTime = previousTime;
+    return partial;
+}
+
+//-----------------------------------------------------------------------------
+/** @brief Energy Table
+
+The reduction of the partial sums of a set of day files.
+*/
+
+class EnergyTable
+{
+public:
+    void reduce(QVector<EnergyPartial> partials);
+    void rows(QStringList &labels, QVector<EnergySums> &sums) const;
+    bool isEmpty() const { return day.isEmpty(); }
+private:
+    QMap<qint64,EnergySums> day;
+};
+
+/* Order of partials by their first time */
+inline bool energyPartialEarlier(const EnergyPartial &first,
+                                 const EnergyPartial &second)
+{
+    return first.firstTime < second.firstTime;
+}
+
+//-----------------------------------------------------------------------------
+/** @brief Reduce the Partial Sums of the Day Files
+
+The partials are put in time order, then the first row of each is counted over
+the interval from the end of the previous one. Overlapping files count no
+interval for that row.
+
+@param[in] partials: mapped day files in any order.
+*/
+
+inline void EnergyTable::reduce(QVector<EnergyPartial> partials)
+{
+    day.clear();
+    qSort(partials.begin(),partials.end(),energyPartialEarlier);
+    qint64 previousTime = 0;
+    bool started = false;
+    for (int f = 0; f < partials.size(); f++)
+    {
+        const EnergyPartial &partial = partials[f];
+        if (partial.rows == 0) continue;
+        if (started && (partial.firstTime > previousTime))
+        {
+            EnergySums &sums = day[partial.firstDay];
+            double interval = partial.firstTime - previousTime;
+            for (int n = 0; n < ENERGY_CHANNELS; n++)
+                sums.charge[n] += partial.head[n]*interval;
+        }
+        QMap<qint64,EnergySums>::const_iterator i;
+        for (i = partial.day.constBegin(); i != partial.day.constEnd(); ++i)
+            day[i.key()].add(i.value());
+        if (! started || (partial.lastTime > previousTime))
+            previousTime = partial.lastTime;
+        started = true;
+    }
+}
+
+//-----------------------------------------------------------------------------
+/** @brief Rows of the Energy Table
+
+The days are listed in order, followed by the totals of each week, month and
+year. Sums are in ampere seconds.
+
+@param[out] labels: date or period of each row.
+@param[out] sums: energy sums of each row.
+*/
+
+inline void EnergyTable::rows(QStringList &labels,
+                              QVector<EnergySums> &sums) const
+{
+    labels.clear();
+    sums.clear();
+    QMap<qint64,EnergySums> week;
+    QMap<qint64,EnergySums> month;
+    QMap<qint64,EnergySums> year;
+    QMap<qint64,EnergySums>::const_iterator i;
+    for (i = day.constBegin(); i != day.constEnd(); ++i)
+    {
+        QDate date = QDate::fromJulianDay(i.key());
+        labels << date.toString("dd/MM/yy");
+        sums << i.value();
+        int weekYear;
+        int weekNumber = date.weekNumber(&weekYear);
+        week[weekYear*100 + weekNumber].add(i.value());
+        month[date.year()*100 + date.month()].add(i.value());
+        year[date.year()].add(i.value());
+    }
+    for (i = week.constBegin(); i != week.constEnd(); ++i)
+    {
+        labels << QString("Week %1-%2").arg(i.key()/100)
+                                       .arg(i.key()%100,2,10,QChar('0'));
+        sums << i.value();
+    }
+    for (i = month.constBegin(); i != month.constEnd(); ++i)
+    {
+        labels << QDate(i.key()/100,i.key()%100,1).toString("MMM yyyy");
+        sums << i.value();
+    }
+    for (i = year.constBegin(); i != year.constEnd(); ++i)
+    {
+        labels << QString("Year %1").arg(i.key());
+        sums << i.value();
+    }
+}
+
+#endif
@@ -0,0 +1,265 @@
+/*       Power Management Record Extraction
+
+Column extraction for the data processing tool. The selected record codes are
+compiled into a bitmask with a bit for each record type and device number. A
+line is accepted or rejected from its first three characters, so only wanted
+records are decoded. Any number of columns may be selected, each being a record
+code such as dB1, optionally followed by a field number as in dB1.2.
+
+@date 18 October 2026
+*/
+
+/****************************************************************************
+ *   Copyright (C) 2013 by Ken Sarkies                                      *
+ *   ksarkies@internode.on.net                                              *
+ *                                                                          *
+ *   This file is part of Power Management                                  *
+ *                                                                          *
+ *   Power Management is free software; you can redistribute it and/or      *
+ *   modify it under the terms of the GNU General Public License as         *
+ *   published by the Free Software Foundation; either version 2 of the     *
+ *   License, or (at your option) any later version.                        *
+ *                                                                          *
+ *   Power Management is distributed in the hope that it will be useful,    *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the          *
+ *   GNU General Public License for more details.                           *
+ *                                                                          *
+ *   You should have received a copy of the GNU General Public License      *
+ *   along with Power Management if not, write to the                       *
+ *   Free Software Foundation, Inc.,                                        *
+ *   51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.              *
+ ***************************************************************************/
+
+#ifndef DATA_PROCESSING_EXTRACT_H
+#define DATA_PROCESSING_EXTRACT_H
+
+#include <stdint.h>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include "power-management-records.h"
+
+/* Slots for each schema entry: device numbers 1-3, or 0 if not indexed */
+#define EXTRACT_DEVICES     4
+#define EXTRACT_SCHEMAS     (int)(sizeof(recordSchema)/sizeof(recordSchema[0]))
+
+static_assert(EXTRACT_SCHEMAS*EXTRACT_DEVICES <= 64,
+              "Record slots do not fit the selection mask");
+
+//-----------------------------------------------------------------------------
+/** @brief Record Extractor
+
+Columns are added in output order. Each interval between time records builds
+a row holding the last value seen of each column, empty if none was seen.
+*/
+
+class RecordExtractor
+{
+public:
+    RecordExtractor();
+    bool addColumn(const QString &code, const QString &title);
+    int columns() const { return column.size(); }
+    QString header() const;
+    int slot(const char *line, int length) const;
+    void store(const PowerManagementRecord &record, int recordSlot);
+    QString takeRow();
+private:
+    struct Column
+    {
+        int slot;
+        int field;              /* 0 for all fields */
+        int fields;
+        QString title;
+    };
+    int lookup(const char *line, const char *end, const char **next) const;
+    uint64_t wanted;
+    int8_t prefixRow[128];      /* row of codeSchema for a first character */
+    int8_t codeSchema[3][128];  /* schema entry for the second character */
+    int8_t bareSchema[3];       /* schema entry with no code character */
+    QVector<Column> column;
+    QStringList cell;
+};
+
+//-----------------------------------------------------------------------------
+/** @brief Build the Code Tables from the Record Schema
+
+The time record is always wanted as it delimits the rows.
+*/
+
+inline RecordExtractor::RecordExtractor()
+{
+    wanted = 0;
+    for (int c = 0; c < 128; c++) prefixRow[c] = -1;
+    for (int row = 0; row < 3; row++)
+    {
+        bareSchema[row] = -1;
+        for (int c = 0; c < 128; c++) codeSchema[row][c] = -1;
+    }
+    int rows = 0;
+    for (int s = 0; s < EXTRACT_SCHEMAS; s++)
+    {
+        int c = recordSchema[s].prefix & 0x7F;
+        if (prefixRow[c] < 0)
+        {
+            Q_ASSERT(rows < 3);
+            prefixRow[c] = rows++;
+        }
+        if (recordSchema[s].code == ' ') bareSchema[prefixRow[c]] = s;
+        else codeSchema[prefixRow[c]][recordSchema[s].code & 0x7F] = s;
+        if (recordSchema[s].type == recordTime)
+            wanted |= (uint64_t)1 << (s*EXTRACT_DEVICES);
+    }
+}
+
+//-----------------------------------------------------------------------------
+/** @brief Find the Schema Entry and Slot of a Record Code
+
+@param[in] line: first character of the code.
+@param[in] end: pointer past the end of the text.
+@param[out] next: character following the code and device number.
+@returns int slot number, or -1 if the code is unknown.
+*/
+
+inline int RecordExtractor::lookup(const char *line, const char *end,
+                                   const char **next) const
+{
+    if ((line >= end) || ((unsigned char)*line >= 128)) return -1;
+    int row = prefixRow[(int)*line++];
+    if (row < 0) return -1;
+    int s = -1;
+    if ((line < end) && ((unsigned char)*line < 128))
+        s = codeSchema[row][(int)*line];
+    if (s >= 0) line++;
+    else s = bareSchema[row];
+    if (s < 0) return -1;
+    int device = 0;
+    if (recordSchema[s].indexed)
+    {
+        if ((line >= end) || (*line < '1') || (*line > '3')) return -1;
+        device = *line++ - '0';
+    }
+    *next = line;
+    return s*EXTRACT_DEVICES + device;
+}
+
+//-----------------------------------------------------------------------------
+/** @brief Add a Column
+
+@param[in] code: record code with device number, and optional field number
+           following a dot.
+@param[in] title: column heading.
+@returns true if the code is valid.
+*/
+
+inline bool RecordExtractor::addColumn(const QString &code,
+                                       const QString &title)
+{
+    QByteArray text = code.trimmed().toLatin1();
+    const char *end = text.constData() + text.size();
+    const char *next;
+    Column entry;
+    entry.slot = lookup(text.constData(),end,&next);
+    if (entry.slot < 0) return false;
+    entry.fields = recordSchema[entry.slot/EXTRACT_DEVICES].fields;
+    entry.field = 0;
+    if ((next < end) && (*next == '.'))
+    {
+        entry.field = QByteArray(next+1,end-next-1).toInt();
+        if ((entry.field < 1) || (entry.field > entry.fields)) return false;
+        next = end;
+    }
+    if (next != end) return false;
+    entry.title = title;
+    wanted |= (uint64_t)1 << entry.slot;
+    column.append(entry);
+    int cells = (entry.field > 0) ? 1 : entry.fields;
+    for (int n = 0; n < cells; n++) cell.append(QString());
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+/** @brief Header Line
+
+Records with two fields give a current and a voltage heading.
+*/
+
+inline QString RecordExtractor::header() const
+{
+    QStringList heading;
+    for (int n = 0; n < column.size(); n++)
+    {
+        const Column &entry = column[n];
+        if (entry.fields == 1) heading << entry.title;
+        else if (entry.field == 0)
+            heading << entry.title + " I" << entry.title + " V";
+        else heading << entry.title + ((entry.field == 1) ? " I" : " V");
+    }
+    return heading.join(",");
+}
+
+//-----------------------------------------------------------------------------
+/** @brief Slot of a Wanted Record
+
+Only the first characters are examined. Leading whitespace is skipped.
+
+@param[in] line: record text.
+@param[in] length: number of characters in the line.
+@returns int slot number, or -1 if the record is not wanted.
+*/
+
+inline int RecordExtractor::slot(const char *line, int length) const
+{
+    const char *end = line + length;
+    while ((line < end) && (*line <= ' ') && (*line > 0)) line++;
+    const char *next;
+    int recordSlot = lookup(line,end,&next);
+    if ((recordSlot < 0) || !((wanted >> recordSlot) & 1)) return -1;
+    return recordSlot;
+}
+
+//-----------------------------------------------------------------------------
+/** @brief Store the Fields of a Record in its Columns
+
+@param[in] record: record decoded from a line accepted by slot().
+@param[in] recordSlot: slot returned by slot().
+*/
+
+inline void RecordExtractor::store(const PowerManagementRecord &record,
+                                   int recordSlot)
+{
+    int position = 0;
+    for (int n = 0; n < column.size(); n++)
+    {
+        const Column &entry = column[n];
+        int cells = (entry.field > 0) ? 1 : entry.fields;
+        if (entry.slot == recordSlot)
+        {
+            for (int i = 0; i < cells; i++)
+            {
+                int field = (entry.field > 0) ? entry.field-1 : i;
+                if (field >= record.fields) cell[position+i] = QString();
+                else if (recordSchema[recordSlot/EXTRACT_DEVICES].text)
+                    cell[position+i] = QString::fromLatin1(record.text,
+                                                           record.textLength);
+                else cell[position+i] = QString::number(record.value[field]);
+            }
+        }
+        position += cells;
+    }
+}
+
+//-----------------------------------------------------------------------------
+/** @brief Take the Row Built so Far
+
+The cells are cleared for the next interval.
+*/
+
+inline QString RecordExtractor::takeRow()
+{
+    QString row = cell.join(",");
+    for (int n = 0; n < cell.size(); n++) cell[n] = QString();
+    return row;
+}
+
+#endif
@@ -0,0 +1,654 @@
+/*       Power Management Row Filter Expressions
+
+Row predicates over the named columns of the day files, used for fault rules.
+An expression such as
+
+    B1 V < 11.5 && B1 Op == "Loaded"
+
+is compiled to a postfix program that is run over a batch of rows at a time,
+each instruction acting on a whole column. The rows are held as columns, with
+only the columns named by some rule being converted. Numeric columns are held
+as floats and text columns as codes from a dictionary kept for each column, so
+that a text comparison is a comparison of integers.
+
+Operators in order of increasing precedence are || && == != < <= > >= + - * /
+and the unary ! and -. Parentheses group terms. Column names are taken from the
+file header and may contain spaces. Text is given in double quotes and may only
+be compared for equality with a column.
+
+@date 18 October 2026
+*/
+
+/****************************************************************************
+ *   Copyright (C) 2013 by Ken Sarkies                                      *
+ *   ksarkies@internode.on.net                                              *
+ *                                                                          *
+ *   This file is part of Power Management                                  *
+ *                                                                          *
+ *   Power Management is free software; you can redistribute it and/or      *
+ *   modify it under the terms of the GNU General Public License as         *
+ *   published by the Free Software Foundation; either version 2 of the     *
+ *   License, or (at your option) any later version.                        *
+ *                                                                          *
+ *   Power Management is distributed in the hope that it will be useful,    *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the          *
+ *   GNU General Public License for more details.                           *
+ *                                                                          *
+ *   You should have received a copy of the GNU General Public License      *
+ *   along with Power Management if not, write to the                       *
+ *   Free Software Foundation, Inc.,                                        *
+ *   51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.              *
+ ***************************************************************************/
+
+#ifndef DATA_PROCESSING_FILTER_H
+#define DATA_PROCESSING_FILTER_H
+
+#include <ctype.h>
+#include <string.h>
+#include <QByteArray>
+#include <QHash>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QtGlobal>
+#include "data-processing-dayfile.h"
+
+/* Rows converted and tested together */
+#define FILTER_BATCH_SIZE   1024
+
+//-----------------------------------------------------------------------------
+/** @brief Column Batch
+
+A batch of rows held as columns. The columns are named with setColumns(), then
+those used by the rules are marked with need() as the rules are compiled. Text
+dictionaries are kept from batch to batch. A time column may also be given,
+which is held in seconds from the Julian day count.
+*/
+
+class ColumnBatch
+{
+public:
+    ColumnBatch() : timeColumn(-1), count(0) {}
+    void setColumns(const QStringList &names);
+    int columnIndex(const QString &name) const;
+    void need(int column, bool isText);
+    void needTime(int column);
+    void clear() { count = 0; }
+    bool addRow(const QByteArray &line);
+    int rows() const { return count; }
+    bool full() const { return count >= FILTER_BATCH_SIZE; }
+    const QByteArray &line(int row) const { return lines[row]; }
+    const float *number(int column) const { return numbers[column].constData(); }
+    const int *text(int column) const { return texts[column].constData(); }
+    const qint64 *time() const { return times.constData(); }
+    int textCode(int column, const QByteArray &value) const
+        { return dictionary[column].value(value,-1); }
+private:
+    QStringList name;
+    QVector<bool> numberNeeded;
+    QVector<bool> textNeeded;
+    QVector<QVector<float> > numbers;
+    QVector<QVector<int> > texts;
+    QVector<QHash<QByteArray,int> > dictionary;
+    QVector<QByteArray> lines;
+    int timeColumn;
+    QVector<qint64> times;
+    int count;
+};
+
+//-----------------------------------------------------------------------------
+/** @brief Set the Column Names
+
+Leading and trailing whitespace of each name is removed.
+
+@param[in] names: one name for each field of a row.
+*/
+
+inline void ColumnBatch::setColumns(const QStringList &names)
+{
+    name.clear();
+    for (int n = 0; n < names.size(); n++) name << names[n].simplified();
+    int columns = name.size();
+    numberNeeded.fill(false,columns);
+    textNeeded.fill(false,columns);
+    numbers.resize(columns);
+    texts.resize(columns);
+    dictionary.resize(columns);
+    lines.resize(FILTER_BATCH_SIZE);
+    timeColumn = -1;
+    count = 0;
+}
+
+inline int ColumnBatch::columnIndex(const QString &columnName) const
+{
+    return name.indexOf(columnName.simplified());
+}
+
+//-----------------------------------------------------------------------------
+/** @brief Mark a Column as Used
+
+@param[in] column: column index.
+@param[in] isText: true if the column is compared as text, false if numeric.
+*/
+
+inline void ColumnBatch::need(int column, bool isText)
+{
+    if (isText)
+    {
+        textNeeded[column] = true;
+        texts[column].resize(FILTER_BATCH_SIZE);
+    }
+    else
+    {
+        numberNeeded[column] = true;
+        numbers[column].resize(FILTER_BATCH_SIZE);
+    }
+}
+
+/* Mark the column holding the row time in ISO format */
+inline void ColumnBatch::needTime(int column)
+{
+    timeColumn = column;
+    times.resize(FILTER_BATCH_SIZE);
+}
+
+//-----------------------------------------------------------------------------
+/** @brief Add a Row to the Batch
+
+The line is split at commas and the fields of the needed columns converted.
+Fields are stripped of surrounding whitespace, including the carriage return
+that ends the previous row. The line is kept for the report.
+
+@param[in] line: text of the row.
+@returns true if the row has one field for each column, and a valid time if a
+         time column is given, and was added.
+*/
+
+inline bool ColumnBatch::addRow(const QByteArray &line)
+{
+    if (full()) return false;
+    const char *text = line.constData();
+    const char *end = text + line.size();
+    int columns = name.size();
+    int fields = 1;
+    for (const char *c = text; c < end; c++) if (*c == ',') fields++;
+    if (fields != columns) return false;
+    const char *start = text;
+    for (int n = 0; n < columns; n++)
+    {
+        const char *stop = start;
+        while ((stop < end) && (*stop != ',')) stop++;
+        if (n == timeColumn)
+        {
+            qint64 julianDay;
+            if (! dayParseTime(start,stop,&julianDay,&times[count])) return false;
+        }
+        if (numberNeeded[n] || textNeeded[n])
+        {
+            const char *first = start;
+            const char *last = stop;
+            while ((first < last) && ((unsigned char)*first <= ' ')) first++;
+            while ((last > first) && ((unsigned char)last[-1] <= ' ')) last--;
+            QByteArray field = QByteArray::fromRawData(first,last-first);
+            if (numberNeeded[n]) numbers[n][count] = field.toFloat();
+            if (textNeeded[n])
+            {
+                QHash<QByteArray,int>::const_iterator i =
+                    dictionary[n].constFind(field);
+                if (i != dictionary[n].constEnd()) texts[n][count] = i.value();
+                else
+                {
+                    int code = dictionary[n].size();
+                    dictionary[n].insert(QByteArray(first,last-first),code);
+                    texts[n][count] = code;
+                }
+            }
+        }
+        start = stop + 1;
+    }
+    lines[count++] = line;
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+/** @brief Filter Expression
+
+An expression is compiled against the columns of a batch, then evaluated for
+all rows of each batch filled.
+*/
+
+class FilterExpression
+{
+public:
+    FilterExpression() : depth(0), position(0), columns(NULL) {}
+    bool compile(const QString &expression, ColumnBatch &batch);
+    QString error() const { return errorText; }
+    void evaluate(const ColumnBatch &batch, QVector<bool> &result) const;
+private:
+    enum Code {pushColumn, pushConstant, textEqual, textNotEqual,
+               add, subtract, multiply, divide, negate,
+               less, lessEqual, greater, greaterEqual, equal, notEqual,
+               logicalAnd, logicalOr, logicalNot};
+    struct Instruction
+    {
+        Code code;
+        int column;
+        float constant;
+        QByteArray text;
+    };
+    enum Kind {kindValue, kindColumn, kindText, kindError};
+    struct Operand
+    {
+        Kind kind;
+        int column;
+        QByteArray text;
+    };
+    Operand parseOr();
+    Operand parseAnd();
+    Operand parseComparison();
+    Operand parseSum();
+    Operand parseProduct();
+    Operand parseUnary();
+    Operand parsePrimary();
+    bool value(const Operand &operand);
+    bool match(const char *token);
+    void skipSpace();
+    Operand fail(const QString &message);
+    void generate(Code code, int column = -1, float constant = 0,
+              const QByteArray &text = QByteArray());
+    QVector<Instruction> program;
+    int depth;
+    QByteArray source;
+    int position;
+    ColumnBatch *columns;
+    QString errorText;
+    mutable QVector<QVector<float> > stack;
+};
+
+//-----------------------------------------------------------------------------
+/** @brief Compile an Expression
+
+@param[in] expression: expression text.
+@param[in] batch: batch with the column names set. Columns used are marked.
+@returns true if the expression is valid, otherwise error() gives the reason.
+*/
+
+inline bool FilterExpression::compile(const QString &expression,
+                                      ColumnBatch &batch)
+{
+    program.clear();
+    errorText.clear();
+    source = expression.toLatin1();
+    position = 0;
+    columns = &batch;
+    depth = 0;
+    Operand result = parseOr();
+    if ((result.kind != kindError) && ! value(result)) result.kind = kindError;
+    skipSpace();
+    if ((result.kind != kindError) && (position < source.size()))
+        fail("Unexpected text");
+    if (! errorText.isEmpty())
+    {
+        program.clear();
+        return false;
+    }
+/* Find the stack depth needed by the program */
+    int size = 0;
+    for (int n = 0; n < program.size(); n++)
+    {
+        Code code = program[n].code;
+        if ((code == pushColumn) || (code == pushConstant) ||
+            (code == textEqual) || (code == textNotEqual)) size++;
+        else if ((code != negate) && (code != logicalNot)) size--;
+        if (size > depth) depth = size;
+    }
+    stack.resize(depth);
+    return true;
+}
+
+/* Append an instruction to the program */
+inline void FilterExpression::generate(Code code, int column, float constant,
+                                   const QByteArray &text)
+{
+    Instruction instruction;
+    instruction.code = code;
+    instruction.column = column;
+    instruction.constant = constant;
+    instruction.text = text;
+    program.append(instruction);
+}
+
+/* Record the first error with its position, and give an error operand */
+inline FilterExpression::Operand FilterExpression::fail(const QString &message)
+{
+    if (errorText.isEmpty())
+        errorText = QString("%1 at position %2").arg(message).arg(position+1);
+    Operand operand;
+    operand.kind = kindError;
+    operand.column = -1;
+    return operand;
+}
+
+inline void FilterExpression::skipSpace()
+{
+    while ((position < source.size()) && (source[position] <= ' ')) position++;
+}
+
+/* Consume an operator token if it is next */
+inline bool FilterExpression::match(const char *token)
+{
+    skipSpace();
+    int length = qstrlen(token);
+    if (source.mid(position,length) != token) return false;
+/* Avoid taking the start of a longer operator */
+    if ((length == 1) && (position+1 < source.size()) &&
+        (source[position+1] == '=') && (strchr("<>=!",token[0]) != NULL))
+        return false;
+    position += length;
+    return true;
+}
+
+/* Emit the push of an operand that is to be used as a number */
+inline bool FilterExpression::value(const Operand &operand)
+{
+    if (operand.kind == kindError) return false;
+    if (operand.kind == kindText)
+    {
+        fail("Text can only be compared with a column");
+        return false;
+    }
+    if (operand.kind == kindColumn)
+    {
+        columns->need(operand.column,false);
+        generate(pushColumn,operand.column);
+    }
+    return true;
+}
+
+inline FilterExpression::Operand FilterExpression::parseOr()
+{
+    Operand left = parseAnd();
+    while (match("||"))
+    {
+        if (! value(left)) return fail("");
+        Operand right = parseAnd();
+        if (! value(right)) return fail("");
+        generate(logicalOr);
+        left.kind = kindValue;
+    }
+    return left;
+}
+
+inline FilterExpression::Operand FilterExpression::parseAnd()
+{
+    Operand left = parseComparison();
+    while (match("&&"))
+    {
+        if (! value(left)) return fail("");
+        Operand right = parseComparison();
+        if (! value(right)) return fail("");
+        generate(logicalAnd);
+        left.kind = kindValue;
+    }
+    return left;
+}
+
+//-----------------------------------------------------------------------------
+/** @brief Parse a Comparison
+
+A comparison of a column with text becomes a single instruction on the codes
+of the column.
+*/
+
+inline FilterExpression::Operand FilterExpression::parseComparison()
+{
+    Operand left = parseSum();
+    if (left.kind == kindError) return left;
+    static const char *const token[] = {"==", "!=", "<=", ">=", "<", ">"};
+    static const Code code[] = {equal, notEqual, lessEqual, greaterEqual,
+                                less, greater};
+    int op = -1;
+    for (int n = 0; (n < 6) && (op < 0); n++) if (match(token[n])) op = n;
+    if (op < 0) return left;
+    Operand right = parseSum();
+    if (right.kind == kindError) return right;
+    if ((left.kind == kindText) || (right.kind == kindText))
+    {
+        const Operand &column = (left.kind == kindText) ? right : left;
+        const Operand &text = (left.kind == kindText) ? left : right;
+        if ((column.kind != kindColumn) || (op > 1))
+            return fail("Text can only be compared with a column for equality");
+        columns->need(column.column,true);
+        generate((op == 0) ? textEqual : textNotEqual,column.column,0,text.text);
+    }
+    else
+    {
+/* The left operand is pushed after the right, so swap the ordering */
+        if (left.kind == kindColumn)
+        {
+            if (! value(right)) return fail("");
+            value(left);
+            static const Code swapped[] = {equal, notEqual, greaterEqual,
+                                           lessEqual, greater, less};
+            generate(swapped[op]);
+        }
+        else
+        {
+            if (! value(right)) return fail("");
+            generate(code[op]);
+        }
+    }
+    left.kind = kindValue;
+    return left;
+}
+
+inline FilterExpression::Operand FilterExpression::parseSum()
+{
+    Operand left = parseProduct();
+    while (true)
+    {
+        Code code;
+        if (match("+")) code = add;
+        else if (match("-")) code = subtract;
+        else return left;
+        if (! value(left)) return fail("");
+        Operand right = parseProduct();
+        if (! value(right)) return fail("");
+        generate(code);
+        left.kind = kindValue;
+    }
+}
+
+inline FilterExpression::Operand FilterExpression::parseProduct()
+{
+    Operand left = parseUnary();
+    while (true)
+    {
+        Code code;
+        if (match("*")) code = multiply;
+        else if (match("/")) code = divide;
+        else return left;
+        if (! value(left)) return fail("");
+        Operand right = parseUnary();
+        if (! value(right)) return fail("");
+        generate(code);
+        left.kind = kindValue;
+    }
+}
+
+inline FilterExpression::Operand FilterExpression::parseUnary()
+{
+    Code code;
+    if (match("!")) code = logicalNot;
+    else if (match("-")) code = negate;
+    else return parsePrimary();
+    Operand operand = parseUnary();
+    if (! value(operand)) return fail("");
+    generate(code);
+    operand.kind = kindValue;
+    return operand;
+}
+
+//-----------------------------------------------------------------------------
+/** @brief Parse a Number, Text, Column Name or Parenthesised Expression
+
+A column name starts with a letter and runs to the next character that is not
+a letter, digit, underscore or space. The column is not pushed until its use
+as a number or as text is known.
+*/
+
+inline FilterExpression::Operand FilterExpression::parsePrimary()
+{
+    Operand operand;
+    operand.kind = kindValue;
+    operand.column = -1;
+    skipSpace();
+    if (position >= source.size()) return fail("Missing operand");
+    char c = source[position];
+    if (match("("))
+    {
+        operand = parseOr();
+        if (operand.kind == kindError) return operand;
+        if (! match(")")) return fail("Missing )");
+        return operand;
+    }
+    if (c == '"')
+    {
+        int end = source.indexOf('"',position+1);
+        if (end < 0) return fail("Missing closing quote");
+        operand.kind = kindText;
+        operand.text = source.mid(position+1,end-position-1);
+        position = end+1;
+        return operand;
+    }
+    if (((c >= '0') && (c <= '9')) || (c == '.'))
+    {
+        int start = position;
+        while ((position < source.size()) &&
+               (isdigit((unsigned char)source[position]) ||
+                (source[position] == '.'))) position++;
+        if ((position < source.size()) &&
+            ((source[position] == 'e') || (source[position] == 'E')))
+        {
+            position++;
+            if ((position < source.size()) &&
+                ((source[position] == '+') || (source[position] == '-')))
+                position++;
+            while ((position < source.size()) &&
+                   isdigit((unsigned char)source[position])) position++;
+        }
+        bool ok;
+        float constant = source.mid(start,position-start).toFloat(&ok);
+        if (! ok)
+        {
+            position = start;
+            return fail("Invalid number");
+        }
+        generate(pushConstant,-1,constant);
+        return operand;
+    }
+    if (isalpha((unsigned char)c))
+    {
+        int start = position;
+        while ((position < source.size()) &&
+               (isalnum((unsigned char)source[position]) ||
+                (source[position] == '_') || (source[position] == ' ')))
+            position++;
+        QString columnName = QString::fromLatin1(source.mid(start,position-start));
+        operand.column = columns->columnIndex(columnName);
+        if (operand.column < 0)
+        {
+            position = start;
+            return fail(QString("Unknown column \"%1\"")
+                        .arg(columnName.simplified()));
+        }
+        operand.kind = kindColumn;
+        return operand;
+    }
+    return fail("Unexpected character");
+}
+
+//-----------------------------------------------------------------------------
+/** @brief Evaluate the Expression over a Batch
+
+Each instruction is applied to all rows of the batch before the next.
+
+@param[in] batch: filled batch.
+@param[out] result: true for each row satisfying the expression.
+*/
+
+inline void FilterExpression::evaluate(const ColumnBatch &batch,
+                                       QVector<bool> &result) const
+{
+    int rows = batch.rows();
+    result.fill(false,rows);
+    if (program.isEmpty()) return;
+    for (int n = 0; n < depth; n++) stack[n].resize(rows);
+    int top = -1;
+    for (int p = 0; p < program.size(); p++)
+    {
+        const Instruction &instruction = program[p];
+        switch (instruction.code)
+        {
+        case pushColumn:
+        {
+            float *out = stack[++top].data();
+            const float *in = batch.number(instruction.column);
+            for (int r = 0; r < rows; r++) out[r] = in[r];
+            break;
+        }
+        case pushConstant:
+        {
+            float *out = stack[++top].data();
+            for (int r = 0; r < rows; r++) out[r] = instruction.constant;
+            break;
+        }
+        case textEqual:
+        case textNotEqual:
+        {
+            float *out = stack[++top].data();
+            const int *in = batch.text(instruction.column);
+            int code = batch.textCode(instruction.column,instruction.text);
+            float same = (instruction.code == textEqual) ? 1 : 0;
+            for (int r = 0; r < rows; r++) out[r] = (in[r] == code) ? same : 1-same;
+            break;
+        }
+        case negate:
+        case logicalNot:
+        {
+            float *out = stack[top].data();
+            if (instruction.code == negate)
+                for (int r = 0; r < rows; r++) out[r] = -out[r];
+            else for (int r = 0; r < rows; r++) out[r] = (out[r] == 0);
+            break;
+        }
+        default:
+        {
+/* Binary operators take the top two entries and leave the result */
+            const float *b = stack[top--].constData();
+            float *a = stack[top].data();
+            switch (instruction.code)
+            {
+            case add: for (int r = 0; r < rows; r++) a[r] = a[r] + b[r]; break;
+            case subtract: for (int r = 0; r < rows; r++) a[r] = a[r] - b[r]; break;
+            case multiply: for (int r = 0; r < rows; r++) a[r] = a[r] * b[r]; break;
+            case divide: for (int r = 0; r < rows; r++) a[r] = a[r] / b[r]; break;
+            case less: for (int r = 0; r < rows; r++) a[r] = (a[r] < b[r]); break;
+            case lessEqual: for (int r = 0; r < rows; r++) a[r] = (a[r] <= b[r]); break;
+            case greater: for (int r = 0; r < rows; r++) a[r] = (a[r] > b[r]); break;
+            case greaterEqual: for (int r = 0; r < rows; r++) a[r] = (a[r] >= b[r]); break;
+            case equal: for (int r = 0; r < rows; r++) a[r] = (a[r] == b[r]); break;
+            case notEqual: for (int r = 0; r < rows; r++) a[r] = (a[r] != b[r]); break;
+            case logicalAnd: for (int r = 0; r < rows; r++) a[r] = (a[r] != 0) && (b[r] != 0); break;
+            case logicalOr: for (int r = 0; r < rows; r++) a[r] = (a[r] != 0) || (b[r] != 0); break;
+            default: break;
+            }
+        }
+        }
+    }
+    const float *out = stack[0].constData();
+    for (int r = 0; r < rows; r++) result[r] = (out[r] != 0);
+}
+
+#endif
@@ -0,0 +1,305 @@
+/*       Power Management Distribution Histograms over Day Files
+
+Histograms of battery and environment measures for sizing, gathered from a set
+of day files in one pass over each. Each file is mapped independently to a set
+of partial histograms, so that files can be read in parallel, and the partials
+are merged by adding counts. Merging is in any order.
+
+For each battery:
+
+- voltage in each state of charge band,
+- current in each charging phase while the battery is being charged,
+- current magnitude on logarithmic bins, covering small standby loads as well as
+  large charge and load currents,
+- depth of discharge, as the time spent at each depth,
+- voltage against current.
+
+The temperature is also gathered. Each row counts once, so counts are in rows of
+the day files. Rows of a missing battery are not counted for that battery.
+
+@date 18 October 2026
+*/
+
+/****************************************************************************
+ *   Copyright (C) 2013 by Ken Sarkies                                      *
+ *   ksarkies@internode.on.net                                              *
+ *                                                                          *
+ *   This file is part of Power Management                                  *
+ *                                                                          *
+ *   Power Management is free software; you can redistribute it and/or      *
+ *   modify it under the terms of the GNU General Public License as         *
+ *   published by the Free Software Foundation; either version 2 of the     *
+ *   License, or (at your option) any later version.                        *
+ *                                                                          *
+ *   Power Management is distributed in the hope that it will be useful,    *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the          *
+ *   GNU General Public License for more details.                           *
+ *                                                                          *
+ *   You should have received a copy of the GNU General Public License      *
+ *   along with Power Management if not, write to the                       *
+ *   Free Software Foundation, Inc.,                                        *
+ *   51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.              *
+ ***************************************************************************/
+
+#ifndef DATA_PROCESSING_HISTOGRAM_H
+#define DATA_PROCESSING_HISTOGRAM_H
+
+#include <math.h>
+#include <QByteArray>
+#include <QFile>
+#include <QString>
+#include <QVector>
+#include <QtGlobal>
+#include "power-management-records.h"
+#include "data-processing-dayfile.h"
+
+/* State of charge bands of 20% */
+#define HISTOGRAM_SOC_BANDS     5
+/* Charging phases, as chargeStateText */
+#define HISTOGRAM_PHASES        4
+
+//-----------------------------------------------------------------------------
+/** @brief Histogram Axis
+
+Bins are numbered from 1 to the number of bins, with bin 0 holding values below
+the range and the last bin those above it. Logarithmic bins need a positive
+lower limit, and values of zero or less fall below the range.
+*/
+
+class HistogramAxis
+{
+public:
+    HistogramAxis() : low(0), high(1), bins(1), logarithmic(false) {}
+    HistogramAxis(double lowLimit, double highLimit, int binCount,
+                  bool logBins = false)
+        : low(lowLimit), high(highLimit), bins(binCount),
+          logarithmic(logBins) {}
+    int size() const { return bins+2; }
+    int bin(double x) const;
+    double edge(int n) const;
+    bool operator==(const HistogramAxis &other) const
+    {
+        return (low == other.low) && (high == other.high) &&
+               (bins == other.bins) && (logarithmic == other.logarithmic);
+    }
+private:
+    double low;
+    double high;
+    int bins;
+    bool logarithmic;
+};
+
+inline int HistogramAxis::bin(double x) const
+{
+    double position;
+    if (logarithmic)
+    {
+        if (x <= 0) return 0;
+        position = log(x/low)/log(high/low);
+    }
+    else position = (x - low)/(high - low);
+    if (position < 0) return 0;
+    if (position >= 1) return bins+1;
+    int n = (int)(position*bins) + 1;
+    return (n > bins) ? bins : n;
+}
+
+/* Lower edge of bin n, or upper edge of bin n-1 */
+inline double HistogramAxis::edge(int n) const
+{
+    double position = (double)(n-1)/bins;
+    if (logarithmic) return low*pow(high/low,position);
+    return low + (high - low)*position;
+}
+
+//-----------------------------------------------------------------------------
+/** @brief Histogram of One Measure
+*/
+
+class Histogram
+{
+public:
+    Histogram() {}
+    Histogram(const HistogramAxis &histogramAxis)
+        : axis(histogramAxis), count(histogramAxis.size(),0) {}
+    void add(double x) { count[axis.bin(x)]++; }
+    void merge(const Histogram &other);
+    const HistogramAxis &binning() const { return axis; }
+    qint64 at(int n) const { return count[n]; }
+    qint64 total() const;
+private:
+    HistogramAxis axis;
+    QVector<qint64> count;
+};
+
+/* Histograms of differing binning are not merged */
+inline void Histogram::merge(const Histogram &other)
+{
+    if (! (axis == other.axis) || (count.size() != other.count.size())) return;
+    for (int n = 0; n < count.size(); n++) count[n] += other.count[n];
+}
+
+inline qint64 Histogram::total() const
+{
+    qint64 sum = 0;
+    for (int n = 0; n < count.size(); n++) sum += count[n];
+    return sum;
+}
+
+//-----------------------------------------------------------------------------
+/** @brief Histogram of Two Measures
+*/
+
+class Histogram2D
+{
+public:
+    Histogram2D() {}
+    Histogram2D(const HistogramAxis &xHistogramAxis,
+                const HistogramAxis &yHistogramAxis)
+        : xAxis(xHistogramAxis), yAxis(yHistogramAxis),
+          count(xHistogramAxis.size()*yHistogramAxis.size(),0) {}
+    void add(double x, double y)
+    {
+        count[xAxis.bin(x)*yAxis.size() + yAxis.bin(y)]++;
+    }
+    void merge(const Histogram2D &other);
+    const HistogramAxis &xBinning() const { return xAxis; }
+    const HistogramAxis &yBinning() const { return yAxis; }
+    qint64 at(int x, int y) const { return count[x*yAxis.size() + y]; }
+private:
+    HistogramAxis xAxis;
+    HistogramAxis yAxis;
+    QVector<qint64> count;
+};
+
+inline void Histogram2D::merge(const Histogram2D &other)
+{
+    if (! (xAxis == other.xAxis) || ! (yAxis == other.yAxis) ||
+        (count.size() != other.count.size())) return;
+    for (int n = 0; n < count.size(); n++) count[n] += other.count[n];
+}
+
+//-----------------------------------------------------------------------------
+/** @brief Histograms of the Day Files
+
+Voltages are in volts, currents in amperes, state of charge and depth of
+discharge in percent and temperature in degrees Celsius.
+*/
+
+struct HistogramSet
+{
+    HistogramSet();
+    void merge(const HistogramSet &other);
+    Histogram voltage[3][HISTOGRAM_SOC_BANDS];
+    Histogram current[3][HISTOGRAM_PHASES];
+    Histogram currentMagnitude[3];
+    Histogram depth[3];
+    Histogram temperature;
+    Histogram2D voltageCurrent[3];
+    long rows;
+};
+
+inline HistogramSet::HistogramSet() : rows(0)
+{
+    HistogramAxis voltageAxis(10,16,120);
+    HistogramAxis currentAxis(-30,30,120);
+    HistogramAxis magnitudeAxis(0.01,100,40,true);
+    HistogramAxis depthAxis(0,100,20);
+    for (int n = 0; n < 3; n++)
+    {
+        for (int band = 0; band < HISTOGRAM_SOC_BANDS; band++)
+            voltage[n][band] = Histogram(voltageAxis);
+        for (int phase = 0; phase < HISTOGRAM_PHASES; phase++)
+            current[n][phase] = Histogram(currentAxis);
+        currentMagnitude[n] = Histogram(magnitudeAxis);
+        depth[n] = Histogram(depthAxis);
+        voltageCurrent[n] = Histogram2D(HistogramAxis(10,16,60),
+                                        HistogramAxis(-30,30,60));
+    }
+    temperature = Histogram(HistogramAxis(-10,60,70));
+}
+
+inline void HistogramSet::merge(const HistogramSet &other)
+{
+    for (int n = 0; n < 3; n++)
+    {
+        for (int band = 0; band < HISTOGRAM_SOC_BANDS; band++)
+            voltage[n][band].merge(other.voltage[n][band]);
+        for (int phase = 0; phase < HISTOGRAM_PHASES; phase++)
+            current[n][phase].merge(other.current[n][phase]);
+        currentMagnitude[n].merge(other.currentMagnitude[n]);
+        depth[n].merge(other.depth[n]);
+        voltageCurrent[n].merge(other.voltageCurrent[n]);
+    }
+    temperature.merge(other.temperature);
+    rows += other.rows;
+}
+
+/* Reduction of the partial histograms of the day files */
+inline void histogramReduce(HistogramSet &total, const HistogramSet &partial)
+{
+    total.merge(partial);
+}
+
+//-----------------------------------------------------------------------------
+/** @brief Map a Day File to Partial Histograms
+
+A function object so that it can be given the time range to QtConcurrent. It is
+safe to call from several threads at once. Rows without a valid time, such as
+the header, and rows outside the time range are skipped.
+*/
+
+struct HistogramMapper
+{
+    typedef HistogramSet result_type;
+    HistogramMapper(qint64 startSeconds, qint64 endSeconds)
+        : start(startSeconds), end(endSeconds) {}
+    HistogramSet operator()(const QString &fileName) const;
+    qint64 start;               /* seconds, from the Julian day number */
+    qint64 end;
+};
+
+inline HistogramSet HistogramMapper::operator()(const QString &fileName) const
+{
+    HistogramSet partial;
+    QFile file(fileName);
+    if (! file.open(QIODevice::ReadOnly)) return partial;
+    while (! file.atEnd())
+    {
+        QByteArray line = file.readLine();
+        const char *text = line.constData();
+        const char *field[DAY_COLUMNS+1];
+        if (daySplitRow(text,text+line.size(),field,DAY_COLUMNS) <=
+            dayTemperatureColumn) continue;
+        qint64 julianDay;
+        qint64 seconds;
+        if (! dayRowTime(field,&julianDay,&seconds)) continue;
+        if ((seconds < start) || (seconds > end)) continue;
+        for (int n = 0; n < 3; n++)
+        {
+            int column = dayBatteryColumn(n);
+            int opState = dayFieldText(field,column+dayBatteryOpState,
+                                       opStateText,4);
+            if (opState == 3) continue;                 /* missing */
+            double current = dayFieldValue(field,column+dayBatteryCurrent);
+            double voltage = dayFieldValue(field,column+dayBatteryVoltage);
+            double charge = dayFieldValue(field,column+dayBatteryCharge);
+            int band = (int)(charge*HISTOGRAM_SOC_BANDS/100);
+            band = qBound(0,band,HISTOGRAM_SOC_BANDS-1);
+            partial.voltage[n][band].add(voltage);
+            int phase = dayFieldText(field,column+dayBatteryChargeState,
+                                     chargeStateText,HISTOGRAM_PHASES);
+            if ((opState == 1) && (phase >= 0))
+                partial.current[n][phase].add(current);
+            partial.currentMagnitude[n].add(qAbs(current));
+            partial.depth[n].add(100 - charge);
+            partial.voltageCurrent[n].add(voltage,current);
+        }
+        partial.temperature.add(dayFieldValue(field,dayTemperatureColumn));
+        partial.rows++;
+    }
+    return partial;
+}
+
+#endif
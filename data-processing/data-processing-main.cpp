@@ -31,10 +31,20 @@ Utility program to aid in analysis if BMS data files.
 
 
 #include "data-processing-main.h"
+#include "power-management-records.h"
+#include "data-processing-anomaly.h"
+#include "data-processing-energy.h"
+#include "data-processing-extract.h"
+#include "data-processing-filter.h"
+#include "data-processing-plot.h"
+#include "data-processing-solar.h"
+#include "data-processing-trend.h"
 #include <QApplication>
 #include <QString>
+#include <QComboBox>
 #include <QLineEdit>
 #include <QLabel>
+#include <QStatusBar>
 #include <QMessageBox>
 #include <QTextEdit>
 #include <QCloseEvent>
@@ -43,6 +53,9 @@ Utility program to aid in analysis if BMS data files.
 #include <QDir>
 #include <QFile>
 #include <QDebug>
+#include <QSettings>
+#include <QFuture>
+#include <QtConcurrentMap>
 #include <qwt_plot.h>
 #include <qwt_plot_curve.h>
 #include <qwt_plot_grid.h>
@@ -54,6 +67,30 @@ Utility program to aid in analysis if BMS data files.
 #include <iostream>
 #include <unistd.h>
 
+// Types of the day file columns in the columnar export
+static const ColumnarType dayColumnType[LINE_WIDTH] = {
+    columnarTime,
+    columnarFloat, columnarFloat, columnarFloat,
+    columnarDictionary, columnarDictionary, columnarDictionary,
+    columnarFloat, columnarFloat, columnarFloat,
+    columnarDictionary, columnarDictionary, columnarDictionary,
+    columnarFloat, columnarFloat, columnarFloat,
+    columnarDictionary, columnarDictionary, columnarDictionary,
+    columnarFloat, columnarFloat, columnarFloat,
+    columnarFloat, columnarFloat, columnarFloat,
+    columnarFloat,
+    columnarDictionary, columnarDictionary, columnarDictionary,
+    columnarDictionary,
+    columnarInt, columnarInt, columnarInt, columnarInt, columnarInt, columnarInt};
+
+// Fault rule used when none have been loaded: charger not allocated when a
+// battery is ready
+static const char defaultFaultRule[] = "Charger: "
+    "B1 Op != \"Charge\" && B2 Op != \"Charge\" && B3 Op != \"Charge\" && "
+    "((B1 Charge != \"Float\" && B1 Charge != \"Rest\" && M1 V > B1 V) || "
+    "(B2 Charge != \"Float\" && B2 Charge != \"Rest\" && M1 V > B2 V) || "
+    "(B3 Charge != \"Float\" && B3 Charge != \"Rest\" && M1 V > B3 V))";
+
 //-----------------------------------------------------------------------------
 /** Power Management Data Processing Main Window Constructor
 
@@ -100,6 +137,8 @@ DataProcessingGui::DataProcessingGui()
 
     energyOutFile = NULL;
     outFile = NULL;
+    connect(&energyWatcher, SIGNAL(finished()), this, SLOT(energyFilesFinished()));
+    connect(&histogramWatcher, SIGNAL(finished()), this, SLOT(histogramFinished()));
 }
 
 DataProcessingGui::~DataProcessingGui()
@@ -157,6 +196,9 @@ records subsequent to the time record are analysed and data is extracted
 to the appropriate fields. The code expects the records to have a particular
 order as sent by the BMS and the output has the same order without any
 identification. The output format is suitable for spreadsheet analysis.
+
+With the columnar option the same columns are written to a typed binary file
+for analysis tools instead.
 */
 
 void DataProcessingGui::on_dumpAllButton_clicked()
@@ -164,9 +206,34 @@ void DataProcessingGui::on_dumpAllButton_clicked()
     QDateTime startTime = DataProcessingMainUi.startTime->dateTime();
     QDateTime endTime = DataProcessingMainUi.endTime->dateTime();
     if (! inFile->isOpen()) return;
-    if (! openSaveFile()) return;
-    inFile->seek(0);      // rewind input file
-    combineRecords(startTime, endTime, inFile, outFile, true);
+    if (DataProcessingMainUi.columnarCheckBox->isChecked())
+    {
+        if (! openSaveFile("Columnar Data (*.bmsx)",".bmsx")) return;
+        inFile->seek(0);      // rewind input file
+        ColumnarWriter columnar(outFile);
+        for (int n = 0; n < LINE_WIDTH; n++)
+            columnar.addColumn(dayColumnName[n],dayColumnType[n]);
+// Codes of the state columns are those of the record bit fields
+        for (int battery = 0; battery < 3; battery++)
+        {
+            int column = dayBatteryColumn(battery);
+            columnar.setDictionary(column+dayBatteryOpState,opStateText,4);
+            columnar.setDictionary(column+dayBatteryFillState,fillStateText,4);
+            columnar.setDictionary(column+dayBatteryChargeState,
+                                   chargeStateText,4);
+        }
+        combineRecords(startTime, endTime, inFile, outFile, false, &columnar);
+        if (! columnar.finish())
+            displayErrorMessage("Could not write the columnar file");
+        else displayStatusMessage(QString("%1 rows written")
+                                    .arg(columnar.rows()));
+    }
+    else
+    {
+        if (! openSaveFile()) return;
+        inFile->seek(0);      // rewind input file
+        combineRecords(startTime, endTime, inFile, outFile, true);
+    }
     if (saveFile.isEmpty())
         displayErrorMessage("File already closed");
     else
@@ -307,11 +374,12 @@ void DataProcessingGui::on_energyButton_clicked()
     tableRow = 0;
 //    int interval = DataProcessingMainUi.intervalSpinBox->value();
 //    int intervaltype = DataProcessingMainUi.intervalType->currentIndex();
-    QTextStream inStream(inFile);
+    char lineIn[LINE_BUFFER_SIZE];
     QDateTime startTime = DataProcessingMainUi.startTime->dateTime();
     QDateTime finalTime = DataProcessingMainUi.endTime->dateTime();
     QDateTime time = startTime;
     QDateTime previousTime = startTime;
+    qint64 seconds = time.toMSecsSinceEpoch()/1000;
 // Cumulative energy measures
     long long battery1Energy = 0;
     long long battery2Energy = 0;
@@ -332,83 +400,71 @@ void DataProcessingGui::on_energyButton_clicked()
     QDateTime endTime(startTime.date(),QTime(23,59,59));
     while (true)
     {
-        if (! inStream.atEnd())
+        if (! inFile->atEnd())
         {
-          	QString lineIn = inStream.readLine();
-            QStringList breakdown = lineIn.split(",");
-            int size = breakdown.size();
-            if (size <= 0) break;
-            QString firstText = breakdown[0].simplified();
-            int secondField = 0;
-//            int thirdField = 0;
-            if (size > 1)
-            {
+            qint64 length = inFile->readLine(lineIn,sizeof(lineIn));
+            PowerManagementRecord record;
+            decodeRecord(lineIn,length,record);
+            int secondField = record.value[0];
 // Extract the time record for time range comparison.
 // records are nominally 0.5 seconds apart but QT doesn't have fractions of
 // a second. Therefore some intervals will be zero. This method however accounts
 // for gaps in the records.
-                if (firstText == "pH")
-                {
-                    previousTime = time;
-                    time = QDateTime::fromString(breakdown[1].simplified(),Qt::ISODate);
-                    elapsedSeconds = previousTime.secsTo(time);
-                }
-                else
-                {
-                    secondField = breakdown[1].simplified().toInt();
-                }
+            if (record.is(recordTime) && (record.fields > 0))
+            {
+                previousTime = time;
+                time = record.time();
+                elapsedSeconds = previousTime.secsTo(time);
+                seconds = time.toMSecsSinceEpoch()/1000;
             }
-//            if (size > 2) thirdField = breakdown[2].simplified().toInt();
 // Extract records of measured currents and add up. The second field is the
 // current times 256 and the third is the voltage times 256 (not needed).
-            if (time >= startTime)
+            if ((time >= startTime) && (record.fields > 0))
             {
-                if (firstText == "dB1")
+                if (record.is(recordBattery,1))
                 {
-                    int battery1Current = secondField-battery1CurrentZero;
+                    int battery1Current = secondField-currentZero[0].offset(seconds);
                     battery1Energy += battery1Current*elapsedSeconds;
                     battery1Seconds += elapsedSeconds;
                 }
-                if (firstText == "dB2")
+                if (record.is(recordBattery,2))
                 {
-                    int battery2Current = secondField-battery2CurrentZero;
+                    int battery2Current = secondField-currentZero[1].offset(seconds);
                     battery2Energy += battery2Current*elapsedSeconds;
                     battery2Seconds += elapsedSeconds;
                 }
-                if (firstText == "dB3")
+                if (record.is(recordBattery,3))
                 {
-                    int battery3Current = secondField-battery3CurrentZero;
+                    int battery3Current = secondField-currentZero[2].offset(seconds);
                     battery3Energy += battery3Current*elapsedSeconds;
                     battery3Seconds += elapsedSeconds;
                 }
 // Sum only positive currents. Negatives are phantoms due to electronics.
-                if (firstText == "dL1")
+                if (record.is(recordLoad,1))
                 {
                     int load1Current = secondField;
                     if (load1Current < 0) load1Current = 0;
                     load1Energy += load1Current*elapsedSeconds;
                     load1Seconds += elapsedSeconds;
                 }
-                if (firstText == "dL2")
+                if (record.is(recordLoad,2))
                 {
                     int load2Current = secondField;
                     if (load2Current < 0) load2Current = 0;
                     load2Energy += load2Current*elapsedSeconds;
                     load2Seconds += elapsedSeconds;
                 }
-                if (firstText == "dM1")
+                if (record.is(recordPanel,1))
                 {
                     int panelCurrent = secondField;
                     if (panelCurrent < 0) panelCurrent = 0;
                     panelEnergy += panelCurrent*elapsedSeconds;
                     panelSeconds += elapsedSeconds;
                 }
-// Get record of indicators (not needed)
-//                if (firstText == "dI") indicators = secondField;
             }
         }
 // Completion of a day or file. Print out and get ready for next.
-        if  ((time > endTime) || inStream.atEnd())
+        if  ((time > endTime) || inFile->atEnd())
         {
 // Add a row if necessary
             if (tableRow >= DataProcessingMainUi.energyView->rowCount())
@@ -444,7 +500,7 @@ void DataProcessingGui::on_energyButton_clicked()
             energyTotal->setFont(tableFont);
             DataProcessingMainUi.energyView->setItem(tableRow, 7, energyTotal);
 
-            if (inStream.atEnd()) break;
+            if (inFile->atEnd()) break;
 
 // Reset energy measures
             battery1Energy = 0;
@@ -510,105 +566,526 @@ void DataProcessingGui::on_energySaveButton_clicked()
     delete energyOutFile;
 }
 
+//-----------------------------------------------------------------------------
+/** @brief Find Energy Balance over Day Files.
+
+A set of day files from the split function is selected. Each file is reduced to
+ampere hour sums for each date it holds, with the files mapped in parallel on
+the global thread pool. The sums are then combined in time order, so that a day
+spread over two files and the interval between the last record of one file and
+the first of the next are both counted.
+
+The files are read while the window stays responsive, and the table is filled
+when the last is done.
+*/
+
+void DataProcessingGui::on_energyFilesButton_clicked()
+{
+    if (energyWatcher.isRunning()) return;
+    QStringList fileNames = QFileDialog::getOpenFileNames(this,
+                        "Day Files for Energy Balance",
+                        saveDirectory.absolutePath(),
+                        "Comma Separated Variables (*.csv *.txt)");
+    if (fileNames.isEmpty()) return;
+    DataProcessingMainUi.energyFilesButton->setEnabled(false);
+    displayStatusMessage(QString("Reading %1 day files").arg(fileNames.size()));
+    energyWatcher.setFuture(QtConcurrent::mapped(fileNames,mapEnergyFile));
+}
+
+//-----------------------------------------------------------------------------
+/** @brief Show the Energy Balance of the Day Files.
+
+The partial sums of the files are combined and the table is shown. The table
+shows each day followed by the totals of each week, month and year, and can be
+saved in the same way as the single file energy balance.
+*/
+
+void DataProcessingGui::energyFilesFinished()
+{
+    DataProcessingMainUi.energyFilesButton->setEnabled(true);
+    statusBar()->clearMessage();
+    EnergyTable table;
+    table.reduce(energyWatcher.future().results().toVector());
+    if (table.isEmpty())
+    {
+        displayErrorMessage("No energy records found in the day files");
+        return;
+    }
+    QStringList labels;
+    QVector<EnergySums> sums;
+    table.rows(labels,sums);
+    DataProcessingMainUi.energyView->clear();
+    DataProcessingMainUi.energyView->setRowCount(labels.size());
+    QFont tableFont = QApplication::font();
+    tableFont.setBold(true);
+    for (tableRow = 0; tableRow < labels.size(); tableRow++)
+    {
+        QTableWidgetItem *period = new QTableWidgetItem(labels[tableRow]);
+        DataProcessingMainUi.energyView->setItem(tableRow, 0, period);
+// Ampere seconds to ampere hours
+        for (int n = 0; n < ENERGY_CHANNELS; n++)
+        {
+            QTableWidgetItem *item = new QTableWidgetItem(tr("%1")
+                 .arg(sums[tableRow].charge[n]/3600,0,'g',3));
+            DataProcessingMainUi.energyView->setItem(tableRow, n+1, item);
+        }
+// Display total energy used (negative if charging) in last column
+        double totalEnergy = sums[tableRow].charge[0] + sums[tableRow].charge[1]
+                           + sums[tableRow].charge[2];
+        QTableWidgetItem *energyTotal = new QTableWidgetItem(tr("%1")
+             .arg(totalEnergy/3600,0,'g',3));
+        energyTotal->setFont(tableFont);
+        DataProcessingMainUi.energyView->setItem(tableRow, 7, energyTotal);
+    }
+}
+
+//-----------------------------------------------------------------------------
+/** @brief Find Battery Anomalies.
+
+The open raw file is passed through an anomaly detector between the start and
+end times, and each anomaly found is written to a csv file with its time,
+battery, the measure that was unusual, the operational state and charging
+phase, the value with that expected, and its score in deviations.
+
+The detector works in one pass with fixed memory, so files of any length may be
+examined.
+*/
+
+void DataProcessingGui::on_anomalyButton_clicked()
+{
+    if (inFile == NULL) return;
+    if (! inFile->isOpen()) return;
+    if (! openSaveFile()) return;
+    inFile->seek(0);      // rewind input file
+    QTextStream outStream(outFile);
+    outStream << "Time," << "Battery," << "Anomaly," << "Op," << "Charge,";
+    outStream << "Value," << "Expected," << "Score" << "\n\r";
+    QDateTime startTime = DataProcessingMainUi.startTime->dateTime();
+    QDateTime endTime = DataProcessingMainUi.endTime->dateTime();
+    QDateTime time;
+    qint64 seconds = 0;
+    AnomalyDetector detector;
+    AnomalyEvent events[2];
+    int anomalies = 0;
+    char lineIn[LINE_BUFFER_SIZE];
+    while (! inFile->atEnd())
+    {
+        qint64 length = inFile->readLine(lineIn,sizeof(lineIn));
+        if (length < 0) break;
+        PowerManagementRecord record;
+        if (! decodeRecord(lineIn,length,record)) continue;
+        if (record.fields == 0) continue;
+        if (record.is(recordTime))
+        {
+            time = record.time();
+            if (time > endTime) break;
+            seconds = time.toMSecsSinceEpoch()/1000;
+        }
+        if (! time.isValid() || (time < startTime)) continue;
+        if (record.is(recordOperational))
+            detector.setState(record.index,record.value[0]);
+        if (record.is(recordBattery) && (record.fields > 1))
+        {
+            int raised = detector.addBattery(seconds,record.index,
+                                        record.value[0],record.value[1],events);
+            for (int n = 0; n < raised; n++)
+            {
+                const AnomalyEvent &event = events[n];
+                outStream << time.toString(Qt::ISODate) << ",";
+                outStream << event.battery << ",";
+                outStream << ((event.kind == anomalySag) ? "Sag" : "Noise") << ",";
+                outStream << opStateText[event.opState] << ",";
+                outStream << chargeStateText[event.chargePhase] << ",";
+                outStream << (float)event.value/256 << ",";
+                outStream << (float)event.expected/256 << ",";
+                outStream << event.score << "\n\r";
+                anomalies++;
+            }
+        }
+    }
+    displayErrorMessage(QString("%1 anomalies found").arg(anomalies));
+    if (saveFile.isEmpty())
+        displayErrorMessage("File already closed");
+    else
+    {
+        outFile->close();
+        delete outFile;
+//! Null the name to prevent the same file being used.
+        saveFile = QString();
+    }
+}
+
+//-----------------------------------------------------------------------------
+/** @brief Distribution Histograms over Day Files.
+
+Any number of day files are selected and each is read in parallel to partial
+histograms of the rows between the start and end times. The partials are merged
+and all histograms written to a csv file, one row for each bin. The first and
+last bins of each histogram hold the values below and above its range, with the
+open limit left empty.
+
+The files are read while the window stays responsive, and the output file is
+asked for when the last is done.
+*/
+
+void DataProcessingGui::on_histogramButton_clicked()
+{
+    if (histogramWatcher.isRunning()) return;
+    QStringList fileNames = QFileDialog::getOpenFileNames(this,
+                        "Day Files for Histograms",
+                        saveDirectory.absolutePath(),
+                        "Comma Separated Variables (*.csv *.txt)");
+    if (fileNames.isEmpty()) return;
+// Time range in the seconds of the day file times
+    QDateTime startTime = DataProcessingMainUi.startTime->dateTime();
+    QDateTime endTime = DataProcessingMainUi.endTime->dateTime();
+    HistogramMapper mapper(
+        startTime.date().toJulianDay()*86400 + QTime(0,0).secsTo(startTime.time()),
+        endTime.date().toJulianDay()*86400 + QTime(0,0).secsTo(endTime.time()));
+    DataProcessingMainUi.histogramButton->setEnabled(false);
+    displayStatusMessage(QString("Reading %1 day files").arg(fileNames.size()));
+    histogramWatcher.setFuture(QtConcurrent::mappedReduced(fileNames,
+                                                    mapper,histogramReduce));
+}
+
+//-----------------------------------------------------------------------------
+/** @brief Write the Histograms of the Day Files.
+
+The merged histograms are written to a csv file, one row for each bin.
+*/
+
+void DataProcessingGui::histogramFinished()
+{
+    DataProcessingMainUi.histogramButton->setEnabled(true);
+    statusBar()->clearMessage();
+    HistogramSet histograms = histogramWatcher.result();
+    if (histograms.rows == 0)
+    {
+        displayErrorMessage("No rows found in the day files for the times");
+        return;
+    }
+    if (! openSaveFile()) return;
+    QTextStream outStream(outFile);
+    outStream << "Histogram," << "Battery," << "Band," << "X Low," << "X High,";
+    outStream << "Y Low," << "Y High," << "Count" << "\n\r";
+    for (int n = 0; n < 3; n++)
+    {
+        for (int band = 0; band < HISTOGRAM_SOC_BANDS; band++)
+        {
+            QString range = QString("SoC %1-%2").arg(band*100/HISTOGRAM_SOC_BANDS)
+                                      .arg((band+1)*100/HISTOGRAM_SOC_BANDS);
+            writeHistogram(outStream,"Voltage",n+1,range,
+                           histograms.voltage[n][band]);
+        }
+        for (int phase = 0; phase < HISTOGRAM_PHASES; phase++)
+            writeHistogram(outStream,"Charge Current",n+1,
+                           chargeStateText[phase],histograms.current[n][phase]);
+        writeHistogram(outStream,"Current Magnitude",n+1,"",
+                       histograms.currentMagnitude[n]);
+        writeHistogram(outStream,"Depth of Discharge",n+1,"",
+                       histograms.depth[n]);
+    }
+    writeHistogram(outStream,"Temperature",0,"",histograms.temperature);
+// Only the occupied bins of the voltage against current histograms
+    for (int n = 0; n < 3; n++)
+    {
+        const Histogram2D &histogram = histograms.voltageCurrent[n];
+        int xSize = histogram.xBinning().size();
+        int ySize = histogram.yBinning().size();
+        for (int x = 0; x < xSize; x++)
+        {
+            for (int y = 0; y < ySize; y++)
+            {
+                if (histogram.at(x,y) == 0) continue;
+                outStream << "Voltage Current," << n+1 << ",,";
+                if (x > 0) outStream << histogram.xBinning().edge(x);
+                outStream << ",";
+                if (x < xSize-1) outStream << histogram.xBinning().edge(x+1);
+                outStream << ",";
+                if (y > 0) outStream << histogram.yBinning().edge(y);
+                outStream << ",";
+                if (y < ySize-1) outStream << histogram.yBinning().edge(y+1);
+                outStream << "," << histogram.at(x,y) << "\n\r";
+            }
+        }
+    }
+    displayStatusMessage(QString("%1 rows counted").arg(histograms.rows));
+    outFile->close();
+    delete outFile;
+//! Null the name to prevent the same file being used.
+    saveFile = QString();
+}
+
+//-----------------------------------------------------------------------------
+/** @brief Write the Bins of a Histogram.
+
+@param[in] QTextStream& output stream.
+@param[in] QString name of the histogram.
+@param[in] int battery number, or 0 if not of a battery.
+@param[in] QString band or phase of the histogram.
+@param[in] Histogram& histogram.
+*/
+
+void DataProcessingGui::writeHistogram(QTextStream& outStream, QString name,
+                                       int battery, QString band,
+                                       const Histogram& histogram)
+{
+    int size = histogram.binning().size();
+    for (int n = 0; n < size; n++)
+    {
+        outStream << name << ",";
+        if (battery > 0) outStream << battery;
+        outStream << "," << band << ",";
+        if (n > 0) outStream << histogram.binning().edge(n);
+        outStream << ",";
+        if (n < size-1) outStream << histogram.binning().edge(n+1);
+        outStream << ",,," << histogram.at(n) << "\n\r";
+    }
+}
+
+//-----------------------------------------------------------------------------
+/** @brief Battery Capacity and Resistance Trends.
+
+A trend file is selected, which may already hold measures from earlier runs.
+Records of the open raw file newer than the last run are passed through the
+trend tracker, starting from the state saved by that run, and new capacity and
+resistance measures are appended to the trend file. The start and end times are
+not used. The time of the last record and any cycle in progress are saved in a
+state file beside the trend file.
+
+All measures in the trend file are then fitted, and the present value and rate
+of change per year of each measure for each battery are shown in the table.
+*/
+
+void DataProcessingGui::on_trendButton_clicked()
+{
+    if (inFile == NULL) return;
+    if (! inFile->isOpen()) return;
+    QString trendFilename = QFileDialog::getSaveFileName(this,
+                        "Trend File",
+                        QString(),
+                        "Comma Separated Variables (*.csv)",0,
+                        QFileDialog::DontConfirmOverwrite);
+    if (trendFilename.isEmpty()) return;
+    if (! trendFilename.endsWith(".csv")) trendFilename.append(".csv");
+    bool header = ! QFile::exists(trendFilename);
+    QFile trendFile(trendFilename);
+    if (! trendFile.open(QIODevice::WriteOnly | QIODevice::Append))
+    {
+        displayErrorMessage("Could not open the trend file");
+        return;
+    }
+    QSettings state(trendFilename + ".state",QSettings::IniFormat);
+    BatteryTrend trend;
+    trend.load(state);
+    qint64 lastTime = trend.lastTime();
+    QVector<TrendEvent> events;
+// Times are in seconds from the Julian day count, with the difference to the
+// epoch found on the first time record for the current zero curves.
+    qint64 julianDay;
+    qint64 seconds = 0;
+    qint64 epochOffset = 0;
+    bool epochFound = false;
+    bool newRecords = false;
+    inFile->seek(0);      // rewind input file
+    char lineIn[LINE_BUFFER_SIZE];
+    while (! inFile->atEnd())
+    {
+        qint64 length = inFile->readLine(lineIn,sizeof(lineIn));
+        if (length < 0) break;
+        PowerManagementRecord record;
+        if (! decodeRecord(lineIn,length,record)) continue;
+        if (record.fields == 0) continue;
+        if (record.is(recordTime))
+        {
+            if (! dayParseTime(record.text,record.text+record.textLength,
+                               &julianDay,&seconds)) continue;
+            newRecords = (seconds > lastTime);
+            if (! newRecords) continue;
+            if (! epochFound)
+            {
+                epochOffset = seconds - record.time().toMSecsSinceEpoch()/1000;
+                epochFound = true;
+            }
+            trend.setTime(seconds);
+        }
+        if (! newRecords) continue;
+        if (record.is(recordOperational))
+            trend.setStatus(record.index,record.value[0],events);
+        if (record.is(recordBattery) && (record.fields > 1) &&
+            (record.index >= 1) && (record.index <= 3))
+        {
+            int current = record.value[0] -
+                    currentZero[record.index-1].offset(seconds - epochOffset);
+            trend.addBattery(record.index,current,record.value[1],events);
+        }
+    }
+// Append the new measures and keep the state for the next run
+    QTextStream trendStream(&trendFile);
+    if (header)
+    {
+        trendStream << "Time," << "Battery," << "Measure," << "Value," << "Weight";
+        trendStream << "\n\r";
+    }
+    for (int n = 0; n < events.size(); n++)
+    {
+        const TrendEvent &event = events[n];
+        trendStream << QDate::fromJulianDay(event.time/86400).toString("yyyy-MM-dd")
+                    << "T" << QTime(0,0).addSecs(event.time%86400).toString("hh:mm:ss") << ",";
+        trendStream << event.battery << ",";
+        trendStream << ((event.measure == trendCapacity) ? "Capacity" : "Resistance") << ",";
+        trendStream << event.value << ",";
+        trendStream << event.weight << "\n\r";
+    }
+    trendStream.flush();
+    trendFile.close();
+    trend.save(state);
+    state.sync();
+
+// Fit all measures in the trend file
+    if (! trendFile.open(QIODevice::ReadOnly))
+    {
+        displayErrorMessage("Could not read the trend file");
+        return;
+    }
+    TrendFit fit[3][2];
+    while (! trendFile.atEnd())
+    {
+        QList<QByteArray> breakdown = trendFile.readLine().split(',');
+        if (breakdown.size() != 5) continue;
+        QByteArray timeField = breakdown[0].trimmed();
+        if (! dayParseTime(timeField.constData(),
+                           timeField.constData()+timeField.size(),
+                           &julianDay,&seconds)) continue;
+        int battery = breakdown[1].trimmed().toInt();
+        if ((battery < 1) || (battery > 3)) continue;
+        int measure = (breakdown[2].trimmed() == "Capacity") ? trendCapacity
+                                                              : trendResistance;
+        fit[battery-1][measure].add(seconds,breakdown[3].trimmed().toDouble(),
+                                    breakdown[4].trimmed().toDouble());
+    }
+    trendFile.close();
+
+// Show the fitted values at the last measure, and rates per year
+    QStringList rowTitle;
+    rowTitle << "Capacity Ah" << "Ah/year" << "Cycles";
+    rowTitle << "Resistance mOhm" << "mOhm/year" << "Days";
+    DataProcessingMainUi.energyView->clear();
+    DataProcessingMainUi.energyView->setRowCount(rowTitle.size());
+    for (tableRow = 0; tableRow < rowTitle.size(); tableRow++)
+    {
+        DataProcessingMainUi.energyView->setItem(tableRow, 0,
+                                    new QTableWidgetItem(rowTitle[tableRow]));
+        int measure = (tableRow < 3) ? trendCapacity : trendResistance;
+        double scale = (measure == trendCapacity) ? 1 : 1000;
+        for (int n = 0; n < 3; n++)
+        {
+            const TrendFit &entry = fit[n][measure];
+            QString text;
+            if (entry.points() > 0)
+            {
+                if (tableRow % 3 == 0)
+                    text = tr("%1").arg(entry.valueAt(entry.lastTime())*scale,0,'g',3);
+                else if (tableRow % 3 == 1)
+                    text = tr("%1").arg(entry.rate()*scale,0,'g',3);
+                else text = tr("%1").arg(entry.points());
+            }
+            DataProcessingMainUi.energyView->setItem(tableRow, n+1,
+                                                 new QTableWidgetItem(text));
+        }
+    }
+    displayErrorMessage(QString("%1 new trend measures").arg(events.size()));
+}
+
 //-----------------------------------------------------------------------------
 /** @brief Extract Data.
 
-Up to three data sets specified are extracted and written to a file.
+The record types selected in the combo boxes, followed by any record codes
+listed in the extract columns box, are extracted and written to a file.
 
 An interval is specified over which data may be taken as the first sample, the
 maximum or the average. The time over which the extraction occurs can be
 specified.
 
-A header is built from the selected record types specified.
-Each record when found is written directly, excluding the ident field.
-This means that some records will have more than one field and so are dealt
-with individually.
+A header is built from the selected record types. Each interval between time
+records gives a row with the last value of each column in that interval, or an
+empty field if there was none. Lines of other record types are rejected from
+their first characters without being decoded.
 */
 
 void DataProcessingGui::on_extractButton_clicked()
 {
     if (inFile == NULL) return;
     if (! inFile->isOpen()) return;
+    RecordExtractor extractor;
+    QComboBox* recordTypeBox[] = {DataProcessingMainUi.recordType_1,
+                                  DataProcessingMainUi.recordType_2,
+                                  DataProcessingMainUi.recordType_3,
+                                  DataProcessingMainUi.recordType_4,
+                                  DataProcessingMainUi.recordType_5};
+    for (unsigned int n=0; n<sizeof(recordTypeBox)/sizeof(recordTypeBox[0]); n++)
+    {
+        int index = recordTypeBox[n]->currentIndex();
+        if (index > 0)
+            extractor.addColumn(recordType[index-1],recordText[index-1]);
+    }
+    QStringList codes = DataProcessingMainUi.extractColumns->text()
+                            .split(",",QString::SkipEmptyParts);
+    for (int n=0; n<codes.size(); n++)
+    {
+        QString code = codes[n].trimmed();
+        if (code.isEmpty()) continue;
+        if (! extractor.addColumn(code,code))
+        {
+            displayErrorMessage(QString("Unknown record code %1").arg(code));
+            return;
+        }
+    }
+    if (extractor.columns() == 0) return;
     if (! openSaveFile()) return;
     inFile->seek(0);      // rewind input file
 //    int interval = DataProcessingMainUi.intervalSpinBox->value();
 //    int intervaltype = DataProcessingMainUi.intervalType->currentIndex();
-    QTextStream inStream(inFile);
     QTextStream outStream(outFile);
     QDateTime startTime = DataProcessingMainUi.startTime->dateTime();
     QDateTime endTime = DataProcessingMainUi.endTime->dateTime();
     QDateTime time;
-    QString header;
-    QString comboRecord;
-    int recordType_1 = DataProcessingMainUi.recordType_1->currentIndex();
-    int recordType_2 = DataProcessingMainUi.recordType_2->currentIndex();
-    int recordType_3 = DataProcessingMainUi.recordType_3->currentIndex();
-    int recordType_4 = DataProcessingMainUi.recordType_4->currentIndex();
-    int recordType_5 = DataProcessingMainUi.recordType_5->currentIndex();
 // The first time record is a reference. Anything before that must be ignored.
-// firstTime allows the program to build a header and the first record.
     bool firstTime = true;
 // The first record only is preceded by the constructed header.
     bool firstRecord = true;
-    while (! inStream.atEnd())
+    char lineIn[LINE_BUFFER_SIZE];
+    while (! inFile->atEnd())
     {
-      	QString lineIn = inStream.readLine();
-        QStringList breakdown = lineIn.split(",");
-        int size = breakdown.size();
-        if (size <= 0) break;
-        QString firstText = breakdown[0].simplified();
+        qint64 length = inFile->readLine(lineIn,sizeof(lineIn));
+        if (length < 0) break;
+        int slot = extractor.slot(lineIn,length);
+        if (slot < 0) continue;
+        PowerManagementRecord record;
+        decodeRecord(lineIn,length,record);
 // Extract the time record for time range comparison.
-        if (size > 1)
+        if (record.is(recordTime) && (record.fields > 0))
         {
-            if (firstText == "pH")
+            time = record.time();
+            if ((time >= startTime) && (time <= endTime))
             {
-                time = QDateTime::fromString(breakdown[1].simplified(),Qt::ISODate);
-                if ((time >= startTime) && (time <= endTime))
+                if (!firstTime)
                 {
-                    if (!firstTime)
+// On the first pass output the header string.
+                    if (firstRecord)
                     {
-// On the first pass output the accumulated header string.
-                        if (firstRecord)
-                        {
-                            outStream << header << "\n\r";
-                            firstRecord = false;
-                        }
-// Output the combined record and null it for next pass.
-                        outStream << comboRecord << "\n\r";
-                        comboRecord = QString();
+                        outStream << extractor.header() << "\n\r";
+                        firstRecord = false;
                     }
-                    firstTime = false;
+// Output the combined record, which is cleared for the next pass.
+                    outStream << extractor.takeRow() << "\n\r";
                 }
+                firstTime = false;
             }
         }
 // Extract records after the reference time record and between specified times.
         if (!firstTime && (time >= startTime) && (time <= endTime))
-        {
-// Find the relevant records and extract their fields.
-            int rec = 0;
-            if ((recordType_1 > 0) && (firstText == recordType[recordType_1-1]))
-                rec = recordType_1;
-            if ((recordType_2 > 0) && (firstText == recordType[recordType_2-1]))
-                rec = recordType_2;
-            if ((recordType_3 > 0) && (firstText == recordType[recordType_3-1]))
-                rec = recordType_3;
-            if ((recordType_4 > 0) && (firstText == recordType[recordType_4-1]))
-                rec = recordType_4;
-            if ((recordType_5 > 0) && (firstText == recordType[recordType_5-1]))
-                rec = recordType_5;
-            if (rec > 0)
-            {
-                if (firstRecord)
-                {
-                    if (! header.isEmpty()) header += ",";
-                    header += recordText[rec-1];
-                    if (size > 2) header += " I," + recordText[rec-1] + " V";
-                }
-                if (! comboRecord.isEmpty()) comboRecord += ",";
-                comboRecord += breakdown[1].simplified();
-                if (size > 2) comboRecord += "," + breakdown[2].simplified();
-            }
-        }
+            extractor.store(record,slot);
     }
     if (saveFile.isEmpty())
         displayErrorMessage("File already closed");
@@ -749,21 +1226,16 @@ void DataProcessingGui::on_plotFileSelectButton_clicked()
     QFile* inFile = new QFile(fileName);
     fileInfo.setFile(fileName);
     if (! inFile->open(QIODevice::ReadOnly)) return;
-    QTextStream inStream(inFile);
 
 // Setup Plot objects
     QwtPlotCurve *curve1;
     curve1 = new QwtPlotCurve();
-    QPolygonF points1;
     QwtPlotCurve *curve2;
     curve2 = new QwtPlotCurve();
-    QPolygonF points2;
     QwtPlotCurve *curve3;
     curve3 = new QwtPlotCurve();
-    QPolygonF points3;
     QwtPlotCurve *curve4;
     curve4 = new QwtPlotCurve();
-    QPolygonF points4;
 
 // States display needs massaging of the data
     if (showStates)                 // SoC, Voltage and charge state
@@ -872,80 +1344,75 @@ void DataProcessingGui::on_plotFileSelectButton_clicked()
         }
     }
 
-    bool ok;
-// Read in data from input file
-// Skip first line as it may be a header
-  	QString lineIn;
-    lineIn = inStream.readLine();
-    bool startRun = true;
+// Columns of the series shown, in the order of the curves
+    int seriesColumn[PLOT_SERIES];
+    int seriesCount = 0;
+    if (showPlot1) seriesColumn[seriesCount++] = i1;
+    if (showPlot2) seriesColumn[seriesCount++] = i2;
+    if (showPlot3) seriesColumn[seriesCount++] = i3;
+    if (showPlot4) seriesColumn[seriesCount++] = i4;
+
+// Read in data from input file, mapped into memory if possible
+    QByteArray contents;
+    uchar *map = inFile->map(0,inFile->size());
+    const char *text = (const char*)map;
+    const char *end = text + inFile->size();
+    if (map == NULL)
+    {
+        contents = inFile->readAll();
+        text = contents.constData();
+        end = text + contents.size();
+    }
+    QSharedPointer<PlotTable> table(new PlotTable(seriesCount));
+    table->reserve(plotCountRows(text,end));
 // Index increments by about 0.5 seconds
-// To have x-axis in date-time index must be "double" type, ie ms since epoch.
-    double index = 0;
-    QDateTime startTime;
-    QDateTime previousTime;
-    while (! inStream.atEnd())
-    {
-      	lineIn = inStream.readLine();
-        QStringList breakdown = lineIn.split(",");
-        int size = breakdown.size();
-        if (size == LINE_WIDTH)
+// To have x-axis in date-time index must be ms since epoch.
+    PlotClock clock;
+    qint64 index = 0;
+    qint64 previousTime = -1;
+    while (text < end)
+    {
+        const char *lineEnd = (const char*)memchr(text,'\n',end-text);
+        if (lineEnd == NULL) lineEnd = end;
+        const char *field[LINE_WIDTH+1];
+        int size = daySplitRow(text,lineEnd,field,LINE_WIDTH);
+        text = lineEnd+1;
+// The header, if any, has no valid time
+        qint64 julianDay;
+        qint64 time;
+        if ((size == LINE_WIDTH) && dayRowTime(field,&julianDay,&time))
         {
-            QDateTime time = QDateTime::fromString(breakdown[0].simplified(),Qt::ISODate);
-            if (time.isValid())
-            {
-// On the first run get the start time
-                if (startRun)
-                {
-                    startRun = false;
-                    startTime = time;
-                    previousTime = startTime;
-                    index = startTime.toMSecsSinceEpoch();
-                }
 // Try to keep index and time in sync to account for jumps in time.
 // Index is counting half seconds and time from records is integer seconds only
-                if (previousTime == time) index += 500;
-                else index = time.toMSecsSinceEpoch();
+            if (previousTime == time) index += 500;
+            else index = clock.milliseconds(julianDay,time);
+            previousTime = time;
 // Create points to plot
-                if (showStates)
-                {
+            float value[PLOT_SERIES];
+            if (showStates)
+            {
 // In this case data to be displayed needs to be converted to common scale.
-                    float batteryVoltage = (breakdown[i1].simplified().toFloat(&ok)-10)*100/10;
-                    points1 << QPointF(index,batteryVoltage);
-                    float stateOfCharge = breakdown[i2].simplified().toFloat(&ok);
-                    points2 << QPointF(index,stateOfCharge);
-                    QString chargeModetext = breakdown[i3].simplified();
-                    float chargeMode = 0;
-                    if (chargeModetext == "Isolate") chargeMode = 5;
-                    if (chargeModetext == "Charge") chargeMode = 10;
-                    if (chargeModetext == "Loaded") chargeMode = 0;
-                    points3 << QPointF(index,chargeMode);
-                }
-                else
+                value[0] = (dayFieldValue(field,i1)-10)*100/10;
+                value[1] = dayFieldValue(field,i2);
+                value[2] = 0;
+                if (dayFieldIs(field,i3,"Isolate")) value[2] = 5;
+                if (dayFieldIs(field,i3,"Charge")) value[2] = 10;
+            }
+            else
+            {
+                for (int n = 0; n < seriesCount; n++)
                 {
-                    if (showPlot1)
-                    {
-                        float currentBattery1 = breakdown[i1].simplified().toFloat(&ok);
-                        points1 << QPointF(index,currentBattery1);
-                    }
-                    if (showPlot2)
-                    {
-                        float currentBattery2 = breakdown[i2].simplified().toFloat(&ok);
-                        points2 << QPointF(index,currentBattery2);
-                    }
-                    if (showPlot3)
-                    {
-                        float currentBattery3 = breakdown[i3].simplified().toFloat(&ok);
-                        points3 << QPointF(index,currentBattery3);
-                    }
-                    if (showPlot4)
-                    {
-                        float currentModule = breakdown[i4].simplified().toFloat(&ok);
-                        points4 << QPointF(index,currentModule);
-                    }
+                    int column = seriesColumn[n];
+                    value[n] = dayFieldValue(field,column);
                 }
             }
+            table->append(index,value);
         }
     }
+    if (map != NULL) inFile->unmap(map);
+    inFile->close();
+    delete inFile;
+
 // Build plot
     QwtPlot *plot = new QwtPlot(0);
     if (showStates) plot->setTitle("Battery States");
@@ -969,24 +1436,26 @@ void DataProcessingGui::on_plotFileSelectButton_clicked()
     QwtPlotGrid *grid = new QwtPlotGrid();
     grid->attach(plot);
 
+// Curves share the table, which is freed with the last of them
+    int series = 0;
     if (showPlot1)
     {
-        curve1->setSamples(points1);
+        curve1->setData(new PlotSeriesData(table,series++));
         curve1->attach(plot);
     }
     if (showPlot2)
     {
-        curve2->setSamples(points2);
+        curve2->setData(new PlotSeriesData(table,series++));
         curve2->attach(plot);
     }
     if (showPlot3)
     {
-        curve3->setSamples(points3);
+        curve3->setData(new PlotSeriesData(table,series++));
         curve3->attach(plot);
     }
     if (showPlot4)
     {
-        curve4->setSamples(points4);
+        curve4->setData(new PlotSeriesData(table,series++));
         curve4->attach(plot);
     }
 
@@ -994,6 +1463,41 @@ void DataProcessingGui::on_plotFileSelectButton_clicked()
     plot->show();
 }
 
+//-----------------------------------------------------------------------------
+/** @brief Load Fault Rules.
+
+The rules are read from a text file with one rule on each line. A rule is an
+expression over the named columns of the day files, optionally preceded by a
+title and colon. Blank lines and lines starting with # are ignored. If no file
+is selected the built in rule is restored.
+*/
+
+void DataProcessingGui::on_faultRulesButton_clicked()
+{
+    faultRules.clear();
+    QString rulesFilename = QFileDialog::getOpenFileName(0,
+                                "Fault Rules","./","Text Files (*.txt)");
+    if (rulesFilename.isEmpty())
+    {
+        displayErrorMessage("Built in fault rule used");
+        return;
+    }
+    QFile rulesFile(rulesFilename);
+    if (! rulesFile.open(QIODevice::ReadOnly | QIODevice::Text))
+    {
+        displayErrorMessage("Could not open the fault rules file");
+        return;
+    }
+    QTextStream rulesStream(&rulesFile);
+    while (! rulesStream.atEnd())
+    {
+        QString line = rulesStream.readLine().simplified();
+        if (line.isEmpty() || line.startsWith("#")) continue;
+        faultRules << line;
+    }
+    displayErrorMessage(QString("%1 fault rules loaded").arg(faultRules.size()));
+}
+
 //-----------------------------------------------------------------------------
 /** @brief Analysis of CSV files for various performance indicators.
 
@@ -1001,10 +1505,12 @@ The file is analysed for a variety of faults and other performance indicators.
 
 The results are printed out to a report file.
 
-- Situations where the charger is not allocated but a battery is ready. To show
-  this look for no battery under charge and panel voltage above any battery.
-  Print the op state, charging phase, battery and panel voltages, switches,
-  decision and indicators.
+- Faults given by rules loaded with the Fault Rules button, all of which are
+  tested in one pass over the file. By default the situations where the charger
+  is not allocated but a battery is ready are found. To show this look for no
+  battery under charge and panel voltage above any battery. Print the op state,
+  charging phase, battery and panel voltages, switches, decision, indicators
+  and the titles of the rules met.
 
 - Battery current during the charging phase to show in particular how the float
   state is reached and if this is a true indication of a battery being fully
@@ -1013,6 +1519,11 @@ The results are printed out to a report file.
 - Solar current input derived from all batteries as they are charged in the bulk
   phase. This may cut short during any one day if all batteries enter the float
   state and the charger is de-allocated.
+
+- Solar yield with the solar current. Panel energy for each day, the time the
+  charger was idle while the panel could have charged and the energy wasted, and
+  the fraction curtailed while charging in absorption or float. A profile gives
+  the mean yield and the available power for each hour of the day.
 */
 
 void DataProcessingGui::on_analysisFileSelectButton_clicked()
@@ -1041,6 +1552,32 @@ void DataProcessingGui::on_analysisFileSelectButton_clicked()
 // Analysis for faults.
     if (DataProcessingMainUi.faultAnalysisCheckbox->isChecked())
     {
+        ColumnBatch batch;
+        batch.setColumns(dayFileColumns(inFile));
+// Compile the rules, or the built in rule if none have been loaded.
+        QStringList rules = faultRules;
+        if (rules.isEmpty()) rules << defaultFaultRule;
+        QStringList ruleTitle;
+        QVector<FilterExpression> rule(rules.size());
+        for (int n = 0; n < rules.size(); n++)
+        {
+            QString text = rules[n];
+            QString title = QString("Rule%1").arg(n+1);
+            int colon = text.indexOf(':');
+            if ((colon > 0) && ((text.indexOf('"') < 0) || (colon < text.indexOf('"'))))
+            {
+                title = text.left(colon).simplified();
+                text = text.mid(colon+1);
+            }
+            ruleTitle << title;
+            if (! rule[n].compile(text,batch))
+            {
+                displayErrorMessage(QString("Fault rule %1: %2")
+                                    .arg(title).arg(rule[n].error()));
+                return;
+            }
+        }
+
         QString reportFilename = QString("fault").append(outFileQualifier);
         bool header = true;
         if (outfileMessage(reportFilename, &header)) return; // Abort processing
@@ -1062,87 +1599,60 @@ void DataProcessingGui::on_analysisFileSelectButton_clicked()
             outStream << "B2 Op," << "B2 Charge,";
             outStream << "B3 Op," << "B3 Charge,";
             outStream << "B1 V," << "B2 V," << "B3 V," << "M1 V,";
-            outStream << "Switches," << "Decisions," << "Indicators";
+            outStream << "Switches," << "Decisions," << "Indicators," << "Rules";
             outStream << "\n\r";
         }
-// Read in data from input file
-// Skip first line as it may be a header
-        inFile->seek(0);      // rewind input file
-      	QString lineIn;
-        lineIn = inStream.readLine();
-        bool startRun = true;
-// Index increments by about 0.5 seconds
-// To have x-axis in date-time, index must be "double" type, ie ms since epoch.
-        double index = 0;
-        QDateTime startTime;
-        QDateTime previousTime;
-        while (! inStream.atEnd())
+// Read in batches of rows and apply all rules to each batch together.
+// Rows without the full set of fields are skipped.
+        QVector<bool> result;
+        QStringList matched;
+        bool endOfFile = false;
+        while (! endOfFile)
         {
-          	lineIn = inStream.readLine();
-            QStringList breakdown = lineIn.split(",");
-            int size = breakdown.size();
-            if (size == LINE_WIDTH)
+            batch.clear();
+            while (! batch.full())
             {
-                QDateTime time = QDateTime::fromString(breakdown[0].simplified(),Qt::ISODate);
-                if (time.isValid())
+                if (inFile->atEnd())
                 {
-// On the first run get the start time
-                    if (startRun)
-                    {
-                        startRun = false;
-                        startTime = time;
-                        previousTime = startTime;
-                        index = startTime.toMSecsSinceEpoch();
-                    }
-// Try to keep index and time in sync to account for jumps in time.
-// Index is counting half seconds and time from records is integer seconds only.
-                    if (previousTime == time) index += 500;
-                    else index = time.toMSecsSinceEpoch();
-
-// Analyse for faults.
-// Look for charger not allocated but not all batteries in float or rest.
-                    float battery1Voltage = breakdown[2].simplified().toFloat();
-                    float battery2Voltage = breakdown[8].simplified().toFloat();
-                    float battery3Voltage = breakdown[14].simplified().toFloat();
-                    float panel1Voltage = breakdown[24].simplified().toFloat();
-                    QString opState1 = breakdown[4].simplified();
-                    QString opState2 = breakdown[10].simplified();
-                    QString opState3 = breakdown[16].simplified();
-                    QString chargeState1 = breakdown[5].simplified();
-                    QString chargeState2 = breakdown[11].simplified();
-                    QString chargeState3 = breakdown[17].simplified();
-                    QString chargeMode1 = breakdown[6].simplified();
-                    QString chargeMode2 = breakdown[12].simplified();
-                    QString chargeMode3 = breakdown[18].simplified();
-                    if ((opState1 != "Charge") &&
-                        (opState2 != "Charge") &&
-                        (opState3 != "Charge") &&
-                        (((chargeMode1 != "Float") && (chargeMode1 != "Rest")
-                                                       && (panel1Voltage > battery1Voltage)) ||
-                        ((chargeMode2 != "Float") && (chargeMode2 != "Rest")
-                                                       && (panel1Voltage > battery2Voltage)) ||
-                        ((chargeMode3 != "Float") && (chargeMode3 != "Rest")
-                                                       && (panel1Voltage > battery3Voltage))))
-                    {
-                        outStream << breakdown[0].simplified() << ",";
-                        outStream << opState1 << ",";
-                        outStream << chargeMode1 << ",";
-                        outStream << opState2 << ",";
-                        outStream << chargeMode2 << ",";
-                        outStream << opState3 << ",";
-                        outStream << chargeMode3 << ",";
-                        outStream << battery1Voltage << ",";
-                        outStream << battery2Voltage << ",";
-                        outStream << battery3Voltage << ",";
-                        outStream << panel1Voltage << ",";
-                        outStream << breakdown[27].simplified() << ",";
-                        outStream << breakdown[28].simplified() << ",";
-                        outStream << breakdown[29].simplified();
-    //                    outStream << lineIn;
-                        outStream << "\n\r";
-                    }
+                    endOfFile = true;
+                    break;
+                }
+                batch.addRow(inFile->readLine());
+            }
+            matched.clear();
+            for (int row = 0; row < batch.rows(); row++) matched << QString();
+            for (int n = 0; n < rule.size(); n++)
+            {
+                rule[n].evaluate(batch,result);
+                for (int row = 0; row < batch.rows(); row++)
+                {
+                    if (! result[row]) continue;
+                    if (! matched[row].isEmpty()) matched[row].append(" ");
+                    matched[row].append(ruleTitle[n]);
                 }
             }
+            for (int row = 0; row < batch.rows(); row++)
+            {
+                if (matched[row].isEmpty()) continue;
+                QStringList breakdown = QString::fromLatin1(batch.line(row))
+                                                .split(",");
+                outStream << breakdown[0].simplified() << ",";
+                outStream << breakdown[4].simplified() << ",";
+                outStream << breakdown[6].simplified() << ",";
+                outStream << breakdown[10].simplified() << ",";
+                outStream << breakdown[12].simplified() << ",";
+                outStream << breakdown[16].simplified() << ",";
+                outStream << breakdown[18].simplified() << ",";
+                outStream << breakdown[2].simplified().toFloat() << ",";
+                outStream << breakdown[8].simplified().toFloat() << ",";
+                outStream << breakdown[14].simplified().toFloat() << ",";
+                outStream << breakdown[24].simplified().toFloat() << ",";
+                outStream << breakdown[27].simplified() << ",";
+                outStream << breakdown[28].simplified() << ",";
+                outStream << breakdown[29].simplified() << ",";
+                outStream << matched[row];
+                outStream << "\n\r";
+            }
         }
         outFile->close();
         delete outFile;
@@ -1302,7 +1812,116 @@ void DataProcessingGui::on_analysisFileSelectButton_clicked()
         }
         outFile->close();
         delete outFile;
+
+// Solar yield and charger utilization, by day and by hour of day
+        ColumnBatch batch;
+        batch.setColumns(dayFileColumns(inFile));
+        SolarAnalysis solar;
+        if (! solar.setColumns(batch))
+        {
+            displayErrorMessage("Solar analysis columns not found");
+            return;
+        }
+        bool endOfFile = false;
+        while (! endOfFile)
+        {
+            batch.clear();
+            while (! batch.full())
+            {
+                if (inFile->atEnd())
+                {
+                    endOfFile = true;
+                    break;
+                }
+                batch.addRow(inFile->readLine());
+            }
+            solar.addBatch(batch);
+        }
+        reportFilename = QString("solar-days").append(outFileQualifier);
+        header = true;
+        if (outfileMessage(reportFilename, &header)) return; // Abort processing
+        outFile = new QFile(reportFilename);
+        if (! outFile->open(QIODevice::WriteOnly | QIODevice::Append
+                                                 | QIODevice::Text))
+        {
+            displayErrorMessage("Could not open the output file");
+            return;
+        }
+        QTextStream daysStream(outFile);
+        if (header)
+        {
+            daysStream << "Date," << "Energy Wh," << "Charge Ah," << "Idle h,";
+            daysStream << "Wasted Wh," << "Curtailed";
+            daysStream << "\n\r";
+        }
+        const QMap<qint64,SolarDay> &days = solar.days();
+        QMap<qint64,SolarDay>::const_iterator i;
+        for (i = days.constBegin(); i != days.constEnd(); ++i)
+        {
+            const SolarDay &sums = i.value();
+            double idleTime = 0;
+            for (int n = 0; n < SOLAR_SLOTS; n++) idleTime += sums.idleTime[n];
+            daysStream << QDate::fromJulianDay(i.key()).toString("yyyy-MM-dd") << ",";
+            daysStream << sums.energy << ",";
+            daysStream << sums.charge << ",";
+            daysStream << idleTime/3600 << ",";
+            daysStream << solar.wasted(sums) << ",";
+            daysStream << solar.curtailment(sums);
+            daysStream << "\n\r";
+        }
+        outFile->close();
+        delete outFile;
+
+        reportFilename = QString("solar-profile").append(outFileQualifier);
+        header = true;
+        if (outfileMessage(reportFilename, &header)) return; // Abort processing
+        outFile = new QFile(reportFilename);
+        if (! outFile->open(QIODevice::WriteOnly | QIODevice::Append
+                                                 | QIODevice::Text))
+        {
+            displayErrorMessage("Could not open the output file");
+            return;
+        }
+        QTextStream profileStream(outFile);
+        if (header)
+        {
+            profileStream << "Hour," << "Yield Wh," << "Available W";
+            profileStream << "\n\r";
+        }
+        for (int n = 0; n < SOLAR_SLOTS; n++)
+        {
+            profileStream << n << ",";
+            profileStream << solar.yield(n) << ",";
+            profileStream << solar.available(n);
+            profileStream << "\n\r";
+        }
+        outFile->close();
+        delete outFile;
+    }
+}
+
+//-----------------------------------------------------------------------------
+/** @brief Column Names of a Day File.
+
+The names are taken from the header line, or are those written by the split
+function if the file has no header.
+
+@param[in] QFile* input file, left at the first data line.
+@returns QStringList column names.
+*/
+
+QStringList DataProcessingGui::dayFileColumns(QFile* inFile)
+{
+    inFile->seek(0);      // rewind input file
+    QByteArray headerLine = inFile->readLine();
+    QStringList columnNames = QString::fromLatin1(headerLine).split(",");
+    if (columnNames[0].simplified() != "Time")
+    {
+        columnNames.clear();
+        for (int n = 0; n < LINE_WIDTH; n++) columnNames << dayColumnName[n];
+        inFile->seek(0);
     }
+    return columnNames;
 }
 
 //-----------------------------------------------------------------------------
@@ -1311,14 +1930,20 @@ void DataProcessingGui::on_analysisFileSelectButton_clicked()
 Raw records are combined into single records for each time interval, and written
 to a csv file. Format suitable for spreadsheet analysis.
 
+Where a columnar writer is given the records are written to it instead, with
+the same columns, and the output file and header are not used.
+
 @param[in] QDateTime start time.
 @param[in] QDateTime end time.
 @param[in] QFile* input file.
 @param[in] QFile* output file.
+@param[in] bool write a header line.
+@param[in] ColumnarWriter* columnar writer, or NULL for csv.
 */
 
 bool DataProcessingGui::combineRecords(QDateTime startTime, QDateTime endTime,
-                                       QFile* inFile, QFile* outFile,bool header)
+                                       QFile* inFile, QFile* outFile,bool header,
+                                       ColumnarWriter* columnar)
 {
     int battery1Voltage = -1;
     int battery1Current = 0;
@@ -1356,49 +1981,79 @@ bool DataProcessingGui::combineRecords(QDateTime startTime, QDateTime endTime,
     int debug2b = -1;
     int debug3b = -1;
     bool blockStart = false;
-    QTextStream inStream(inFile);
+    qint64 blockTime = 0;
+    char lineIn[LINE_BUFFER_SIZE];
     QTextStream outStream(outFile);
-    if (header)
+    if (header && (columnar == NULL))
     {
-        outStream << "Time,";
-        outStream << "B1 I," << "B1 V," << "B1 Cap," << "B1 Op," << "B1 State," << "B1 Charge,";
-        outStream << "B2 I," << "B2 V," << "B2 Cap," << "B2 Op," << "B2 State," << "B2 Charge,";
-        outStream << "B3 I," << "B3 V," << "B3 Cap," << "B3 Op," << "B3 State," << "B3 Charge,";
-        outStream << "L1 I," << "L1 V," << "L2 I," << "L2 V," << "M1 I," << "M1 V,";
-        outStream << "Temp," << "Controls," << "Switches," << "Decisions," << "Indicators,";
-        outStream << "Debug 1a," << "Debug 1b," << "Debug 2a," << "Debug 2b," << "Debug 3a," << "Debug 3b";
+        for (int n = 0; n < LINE_WIDTH; n++)
+        {
+            if (n > 0) outStream << ",";
+            outStream << dayColumnName[n];
+        }
         outStream << "\n\r";
     }
     QDateTime time = startTime;
-    while (! inStream.atEnd())
+    qint64 seconds = time.toMSecsSinceEpoch()/1000;
+    while (! inFile->atEnd())
     {
         if  (time > endTime) break;
-      	QString lineIn = inStream.readLine();
-        QStringList breakdown = lineIn.split(",");
-        int size = breakdown.size();
-        if (size <= 0) break;
-        QString firstText = breakdown[0].simplified();
-        QString secondText;
-        QString thirdText;
+        qint64 length = inFile->readLine(lineIn,sizeof(lineIn));
+        if (length < 0) break;
+        PowerManagementRecord record;
+        decodeRecord(lineIn,length,record);
         int secondField = -1;
-        if (size > 1)
-        {
-            secondText = breakdown[1].simplified();
-            secondField = secondText.toInt();
-        }
+        if (record.fields > 0) secondField = record.value[0];
         int thirdField = -1;
-        if (size > 2)
-        {
-            thirdText = breakdown[2].simplified();
-            thirdField = thirdText.toInt();
-        }
-        if (size > 1)
+        if (record.fields > 1) thirdField = record.value[1];
+        if (record.fields > 0)
         {
 // Find and extract the time record
-            if (firstText == "pH")
+            if (record.is(recordTime))
             {
-                time = QDateTime::fromString(breakdown[1].simplified(),Qt::ISODate);
-                if ((blockStart) && (time > startTime))
+                time = record.time();
+                seconds = time.toMSecsSinceEpoch()/1000;
+                if ((blockStart) && (time > startTime) && (columnar != NULL))
+                {
+                    columnar->addTime(blockTime);
+                    columnar->addFloat((float)battery1Current/256);
+                    columnar->addFloat((float)battery1Voltage/256);
+                    columnar->addFloat((float)battery1SoC/256);
+                    columnar->addText(battery1StateText);
+                    columnar->addText(battery1FillText);
+                    columnar->addText(battery1ChargeText);
+                    columnar->addFloat((float)battery2Current/256);
+                    columnar->addFloat((float)battery2Voltage/256);
+                    columnar->addFloat((float)battery2SoC/256);
+                    columnar->addText(battery2StateText);
+                    columnar->addText(battery2FillText);
+                    columnar->addText(battery2ChargeText);
+                    columnar->addFloat((float)battery3Current/256);
+                    columnar->addFloat((float)battery3Voltage/256);
+                    columnar->addFloat((float)battery3SoC/256);
+                    columnar->addText(battery3StateText);
+                    columnar->addText(battery3FillText);
+                    columnar->addText(battery3ChargeText);
+                    columnar->addFloat((float)load1Voltage/256);
+                    columnar->addFloat((float)load1Current/256);
+                    columnar->addFloat((float)load2Voltage/256);
+                    columnar->addFloat((float)load2Current/256);
+                    columnar->addFloat((float)panel1Voltage/256);
+                    columnar->addFloat((float)panel1Current/256);
+                    columnar->addFloat((float)temperature/256);
+                    columnar->addText(controls);
+                    columnar->addText(switches);
+                    columnar->addText(decision);
+                    columnar->addText(indicatorString);
+                    columnar->addInt(debug1a);
+                    columnar->addInt(debug1b);
+                    columnar->addInt(debug2a);
+                    columnar->addInt(debug2b);
+                    columnar->addInt(debug3a);
+                    columnar->addInt(debug3b);
+                    columnar->endRow();
+                }
+                else if ((blockStart) && (time > startTime))
                 {
                     outStream << timeRecord << ",";
                     outStream << (float)battery1Current/256 << ",";
@@ -1438,163 +2093,116 @@ bool DataProcessingGui::combineRecords(QDateTime startTime, QDateTime endTime,
                     outStream << debug3b;
                     outStream << "\n\r";
                 }
-                timeRecord = breakdown[1].simplified();
+                timeRecord = QString::fromLatin1(record.text,record.textLength);
+                blockTime = time.toMSecsSinceEpoch();
                 blockStart = true;
             }
-            if (firstText == "dB1")
+            if (record.is(recordBattery,1))
             {
-                battery1Current = secondField-battery1CurrentZero;
+                battery1Current = secondField-currentZero[0].offset(seconds);
                 battery1Voltage = thirdField;
             }
-            if (firstText == "dB2")
+            if (record.is(recordBattery,2))
             {
-                battery2Current = secondField-battery2CurrentZero;
+                battery2Current = secondField-currentZero[1].offset(seconds);
                 battery2Voltage = thirdField;
             }
-            if (firstText == "dB3")
+            if (record.is(recordBattery,3))
             {
-                battery3Current = secondField-battery3CurrentZero;
+                battery3Current = secondField-currentZero[2].offset(seconds);
                 battery3Voltage = thirdField;
             }
-            if (firstText == "dC1")
+            if (record.is(recordCharge,1))
             {
                 battery1SoC = secondField;
             }
-            if (firstText == "dC2")
+            if (record.is(recordCharge,2))
             {
                 battery2SoC = secondField;
             }
-            if (firstText == "dC3")
+            if (record.is(recordCharge,3))
             {
                 battery3SoC = secondField;
             }
-            if (firstText == "dO1")
+            if (record.is(recordOperational,1))
             {
-                uint battery1State = (secondField & 0x03);
-                if (battery1State == 0) battery1StateText = "Loaded";
-                else if (battery1State == 1) battery1StateText = "Charge";
-                else if (battery1State == 2) battery1StateText = "Isolate";
-                else if (battery1State == 3) battery1StateText = "Missing";
-                else battery1StateText = "?";
-                uint battery1Fill = (secondField >> 2) & 0x03;
-                if (battery1Fill == 0) battery1FillText = "Normal";
-                else if (battery1Fill == 1) battery1FillText = "Low";
-                else if (battery1Fill == 2) battery1FillText = "Critical";
-                else if (battery1Fill == 3) battery1FillText = "Faulty";
-                else battery1FillText = "?";
-                uint battery1Charge = (secondField >> 4) & 0x03;
-                if (battery1Charge == 0) battery1ChargeText = "Bulk";
-                else if (battery1Charge == 1) battery1ChargeText = "Absorp";
-                else if (battery1Charge == 2) battery1ChargeText = "Float";
-                else if (battery1Charge == 3) battery1ChargeText = "Rest";
-                else battery1ChargeText = "?";
+                battery1StateText = opStateText[bitField(secondField,operationalOp)];
+                battery1FillText = fillStateText[bitField(secondField,operationalFill)];
+                battery1ChargeText = chargeStateText[bitField(secondField,operationalCharge)];
             }
-            if (firstText == "dO2")
+            if (record.is(recordOperational,2))
             {
-                uint battery2State = (secondField & 0x03);
-                if (battery2State == 0) battery2StateText = "Loaded";
-                else if (battery2State == 1) battery2StateText = "Charge";
-                else if (battery2State == 2) battery2StateText = "Isolate";
-                else if (battery2State == 3) battery2StateText = "Missing";
-                else battery2StateText = "?";
-                uint battery2Fill = (secondField >> 2) & 0x03;
-                if (battery2Fill == 0) battery2FillText = "Normal";
-                else if (battery2Fill == 1) battery2FillText = "Low";
-                else if (battery2Fill == 2) battery2FillText = "Critical";
-                else if (battery2Fill == 3) battery2FillText = "Faulty";
-                else battery2FillText = "?";
-                uint battery2Charge = (secondField >> 4) & 0x03;
-                if (battery2Charge == 0) battery2ChargeText = "Bulk";
-                else if (battery2Charge == 1) battery2ChargeText = "Absorp";
-                else if (battery2Charge == 2) battery2ChargeText = "Float";
-                else if (battery2Charge == 3) battery2ChargeText = "Rest";
-                else battery2ChargeText = "?";
+                battery2StateText = opStateText[bitField(secondField,operationalOp)];
+                battery2FillText = fillStateText[bitField(secondField,operationalFill)];
+                battery2ChargeText = chargeStateText[bitField(secondField,operationalCharge)];
             }
-            if (firstText == "dO3")
+            if (record.is(recordOperational,3))
             {
-                uint battery3State = (secondField & 0x03);
-                if (battery3State == 0) battery3StateText = "Loaded";
-                else if (battery3State == 1) battery3StateText = "Charge";
-                else if (battery3State == 2) battery3StateText = "Isolate";
-                else if (battery3State == 3) battery3StateText = "Missing";
-                else battery3StateText = "?";
-                uint battery3Fill = (secondField >> 2) & 0x03;
-                if (battery3Fill == 0) battery3FillText = "Normal";
-                else if (battery3Fill == 1) battery3FillText = "Low";
-                else if (battery3Fill == 2) battery3FillText = "Critical";
-                else if (battery3Fill == 3) battery3FillText = "Faulty";
-                else battery3FillText = "?";
-                uint battery3Charge = (secondField >> 4) & 0x03;
-                if (battery3Charge == 0) battery3ChargeText = "Bulk";
-                else if (battery3Charge == 1) battery3ChargeText = "Absorp";
-                else if (battery3Charge == 2) battery3ChargeText = "Float";
-                else if (battery3Charge == 3) battery3ChargeText = "Rest";
-                else battery3ChargeText = "?";
+                battery3StateText = opStateText[bitField(secondField,operationalOp)];
+                battery3FillText = fillStateText[bitField(secondField,operationalFill)];
+                battery3ChargeText = chargeStateText[bitField(secondField,operationalCharge)];
             }
-            if (firstText == "dL1")
+            if (record.is(recordLoad,1))
             {
                 load1Voltage = secondField;
                 load1Current = thirdField;
             }
-            if (firstText == "dL2")
+            if (record.is(recordLoad,2))
             {
                 load2Voltage = secondField;
                 load2Current = thirdField;
             }
-            if (firstText == "dM1")
+            if (record.is(recordPanel,1))
             {
                 panel1Voltage = secondField;
                 panel1Current = thirdField;
             }
-            if (firstText == "dT")
+            if (record.is(recordTemperature))
             {
                 temperature = secondField;
             }
 // A = autotrack, R = recording, M = send measurements,
 // D = debug, Charger algorithm, X = load avoidance, I = maintain isolation
-            if (firstText == "dD")
+            if (record.is(recordControls))
             {
-                if ((secondField & (1 << 0)) > 0) controls[0] = 'A';
-                if ((secondField & (1 << 1)) > 0) controls[1] = 'R';
-                if ((secondField & (1 << 3)) > 0) controls[2] = 'M';
-                if ((secondField & (1 << 4)) > 0) controls[3] = 'D';
-                if (((secondField >> 5) & 3) == 0) controls[4] = '1';
-                if (((secondField >> 5) & 3) == 1) controls[4] = '2';
-                if (((secondField >> 5) & 3) == 2) controls[4] = '3';
-                if ((secondField & (1 << 7)) > 0) controls[5] = 'X';
-                if ((secondField & (1 << 8)) > 0) controls[6] = 'I';
+                if (bitField(secondField,controlAutoTrack) > 0) controls[0] = 'A';
+                if (bitField(secondField,controlRecording) > 0) controls[1] = 'R';
+                if (bitField(secondField,controlMeasurement) > 0) controls[2] = 'M';
+                if (bitField(secondField,controlDebug) > 0) controls[3] = 'D';
+                int charger = bitField(secondField,controlCharger);
+                if (charger < 3) controls[4] = QChar('1' + charger);
+                if (bitField(secondField,controlLoadAvoid) > 0) controls[5] = 'X';
+                if (bitField(secondField,controlIsolation) > 0) controls[6] = 'I';
             }
 // Switch control bits - three 2-bit fields: battery number for each of
 // load1, load2 and panel.
-            if (firstText == "ds")
+            if (record.is(recordSwitches))
             {
                 switches.clear();
-                uint load1Battery = (secondField >> 0) & 0x03;
+                uint load1Battery = bitField(secondField,switchLoad1);
                 QString load1BatteryText;
                 load1BatteryText.setNum(load1Battery);
                 if (load1Battery > 0) switches.append(" ").append(load1BatteryText);
                 else switches.append(" 0");
-                uint load2Battery = (secondField >> 2) & 0x03;
+                uint load2Battery = bitField(secondField,switchLoad2);
                 QString load2BatteryText;
                 load2BatteryText.setNum(load2Battery);
                 if (load2Battery > 0) switches.append(" ").append(load2BatteryText);
                 else switches.append(" 0");
-                uint panelBattery = (secondField >> 4) & 0x03;
+                uint panelBattery = bitField(secondField,switchPanel);
                 QString panelBatteryText;
                 panelBatteryText.setNum(panelBattery);
                 if (panelBattery > 0) switches.append(" ").append(panelBatteryText);
                 else switches.append(" 0");
             }
-            if (firstText == "dd")
+            if (record.is(recordDecision))
             {
-                bool ok;
-                decision = QString("%1").arg(secondText.toInt(&ok),0,16);
+                decision = QString("%1").arg(secondField,0,16);
             }
-            if (firstText == "dI")
+            if (record.is(recordIndicators))
             {
-                bool ok;
                 indicatorString = "";
-                int indicators = secondText.toInt(&ok);
+                int indicators = secondField;
                 for (int i=0; i<12; i+=2)
                 {
                     if ((indicators & (1 << i)) > 0) indicatorString.append("_");
@@ -1603,24 +2211,24 @@ bool DataProcessingGui::combineRecords(QDateTime startTime, QDateTime endTime,
                     else indicatorString.append("U");
                 }
             }
-            if (firstText == "D1")
+            if (record.is(recordDebug,1))
             {
                 debug1a = secondField;
-                if (size > 2) debug1b = thirdField;
+                if (record.fields > 1) debug1b = thirdField;
             }
-            if (firstText == "D2")
+            if (record.is(recordDebug,2))
             {
                 debug2a = secondField;
-                if (size > 2) debug2b = thirdField;
+                if (record.fields > 1) debug2b = thirdField;
             }
-            if (firstText == "D3")
+            if (record.is(recordDebug,3))
             {
                 debug3a = secondField;
-                if (size > 2) debug3b = thirdField;
+                if (record.fields > 1) debug3b = thirdField;
             }
         }
     }
-    return inStream.atEnd();
+    return inFile->atEnd();
 }
 
 //-----------------------------------------------------------------------------
@@ -1636,18 +2244,17 @@ found.
 QDateTime DataProcessingGui::findFirstTimeRecord(QFile* inFile)
 {
     QDateTime time;
-    QTextStream inStream(inFile);
-    while (! inStream.atEnd())
+    char lineIn[LINE_BUFFER_SIZE];
+    while (! inFile->atEnd())
     {
-      	QString lineIn = inStream.readLine();
-        QStringList breakdown = lineIn.split(",");
-        int size = breakdown.size();
-        if (size <= 0) break;
-        QString firstText = breakdown[0].simplified();
+        qint64 length = inFile->readLine(lineIn,sizeof(lineIn));
+        if (length < 0) break;
+        PowerManagementRecord record;
+        decodeRecord(lineIn,length,record);
 // Find and extract the time record
-        if ((size > 1) && (firstText == "pH"))
+        if (record.is(recordTime) && (record.fields > 0))
         {
-            time = QDateTime::fromString(breakdown[1].simplified(),Qt::ISODate);
+            time = record.time();
             break;
         }
     }
@@ -1660,10 +2267,12 @@ QDateTime DataProcessingGui::findFirstTimeRecord(QFile* inFile)
 This is called from other action functions. The file is requested in a file
 dialogue and opened. The function aborts if the file exists.
 
+@param[in] QString file dialogue filter.
+@param[in] QString extension added if not given.
 @returns true if file successfully created and opened.
 */
 
-bool DataProcessingGui::openSaveFile()
+bool DataProcessingGui::openSaveFile(QString filter, QString extension)
 {
     if (! saveFile.isEmpty())
     {
@@ -1671,11 +2280,11 @@ bool DataProcessingGui::openSaveFile()
         return false;
     }
     QString filename = QFileDialog::getSaveFileName(this,
-                        "Save csv Data",
+                        "Save Data",
                         QString(),
-                        "Comma Separated Variables (*.csv)",0,0);
+                        filter,0,0);
     if (filename.isEmpty()) return false;
-    if (! filename.endsWith(".csv")) filename.append(".csv");
+    if (! filename.endsWith(extension)) filename.append(extension);
     QFileInfo fileInfo(filename);
     saveDirectory = fileInfo.absolutePath();
     saveFile = saveDirectory.filePath(filename);
@@ -1692,91 +2301,54 @@ bool DataProcessingGui::openSaveFile()
 /** @brief Scan the data file
 
 Look for start and end times and record types. Obtain the current zeros from
-records that have isolated operational status.
+records that have isolated operational status. Each isolation period, or each
+hour of a long one, gives a point on a current zero curve for the battery, so
+that drift over the file is followed.
 
 */
 
 void DataProcessingGui::scanFile(QFile* inFile)
 {
     if (! inFile->isOpen()) return;
-    QTextStream inStream(inFile);
+    char lineIn[LINE_BUFFER_SIZE];
     QDateTime startTime, endTime;
-    uint calibration1Count = 0;
-    uint calibration2Count = 0;
-    uint calibration3Count = 0;
-    int battery1Current = 0;
-    int battery2Current = 0;
-    int battery3Current = 0;
-    battery1CurrentZero = 0;
-    battery2CurrentZero = 0;
-    battery3CurrentZero = 0;
-    while (! inStream.atEnd())
-    {
-      	QString lineIn = inStream.readLine();
-        QStringList breakdown = lineIn.split(",");
-        int length = breakdown.size();
-        if (length <= 0) break;
-        QString firstText = breakdown[0].simplified();
-        QString secondText = breakdown[1].simplified();
-        if ((firstText == "pH") && (length > 1))
+    qint64 seconds = 0;
+    int batteryCurrent[3] = {0, 0, 0};
+    for (int n=0; n<3; n++) currentZero[n].clear();
+    while (! inFile->atEnd())
+    {
+        qint64 length = inFile->readLine(lineIn,sizeof(lineIn));
+        if (length < 0) break;
+        PowerManagementRecord record;
+        decodeRecord(lineIn,length,record);
+        if (record.fields <= 0) continue;
+        if (record.is(recordTime))
         {
-            QDateTime time = QDateTime::fromString(secondText,Qt::ISODate);
+            QDateTime time = record.time();
             if (startTime.isNull()) startTime = time;
             endTime = time;
+            seconds = time.toMSecsSinceEpoch()/1000;
         }
-        int secondField = secondText.toInt();
-        if ((firstText == "dB1") && (length > 1))
+        int secondField = record.value[0];
+        if (record.is(recordBattery) && (record.index <= 3))
         {
-            battery1Current = secondField;
+            batteryCurrent[record.index-1] = secondField;
         }
-        if ((firstText == "dB2") && (length > 1))
+        if (record.is(recordOperational) && (record.index <= 3))
         {
-            battery2Current = secondField;
-        }
-        if ((firstText == "dB3") && (length > 1))
-        {
-            battery3Current = secondField;
-        }
-        if ((firstText == "dO1") && (length > 1))
-        {
-            int operationalStatus = secondField&0x03;
+            int battery = record.index-1;
+            int operationalStatus = bitField(secondField,operationalOp);
             if (operationalStatus == 2)
-            {
-                calibration1Count++;
-                battery1CurrentZero += battery1Current;
-            }
-        }
-        if ((firstText == "dO2") && (length > 1))
-        {
-            int operationalStatus = secondField&0x03;
-            if (operationalStatus == 2)
-            {
-                calibration2Count++;
-                battery2CurrentZero += battery2Current;
-            }
-        }
-        if ((firstText == "dO3") && (length > 1))
-        {
-            int operationalStatus = secondField&0x03;
-            if (operationalStatus == 2)
-            {
-                calibration3Count++;
-                battery3CurrentZero += battery3Current;
-            }
+                currentZero[battery].addSample(seconds,batteryCurrent[battery]);
+            else currentZero[battery].endPeriod();
         }
     }
 // Remove the zero point of current if required
-    if (DataProcessingMainUi.zeroCurrentCheckBox->isChecked())  
+    for (int n=0; n<3; n++)
     {
-        battery1CurrentZero /= calibration1Count;
-        battery2CurrentZero /= calibration2Count;
-        battery3CurrentZero /= calibration3Count;
-    }
-    else
-    {
-        battery1CurrentZero = 0;
-        battery2CurrentZero = 0;
-        battery3CurrentZero = 0;
+        currentZero[n].endPeriod();
+        if (! DataProcessingMainUi.zeroCurrentCheckBox->isChecked())
+            currentZero[n].clear();
     }
     if (! startTime.isNull()) DataProcessingMainUi.startTime->setDateTime(startTime);
     if (! endTime.isNull()) DataProcessingMainUi.endTime->setDateTime(endTime);
@@ -1792,6 +2364,18 @@ void DataProcessingGui::displayErrorMessage(QString message)
     DataProcessingMainUi.errorMessageLabel->setText(message);
 }
 
+//-----------------------------------------------------------------------------
+/** @brief Show a status message in the status bar.
+
+The error label is cleared so that an earlier error is not left beside it.
+*/
+
+void DataProcessingGui::displayStatusMessage(QString message)
+{
+    DataProcessingMainUi.errorMessageLabel->clear();
+    statusBar()->showMessage(message);
+}
+
 //-----------------------------------------------------------------------------
 /** @brief Message box for output file exists.
 
@@ -42,13 +42,22 @@
 #define Voffset R9*Vref/R5
 #define Vscale (1+R4/R5)/(1+R9/R7)
 
-#define LINE_WIDTH 36
+#define LINE_WIDTH DAY_COLUMNS
+// Longest record line read in one piece by the extraction
+#define LINE_BUFFER_SIZE 256
 
 #include "ui_data-processing-main.h"
+#include "data-processing-dayfile.h"
+#include "data-processing-zero.h"
+#include "data-processing-columnar.h"
+#include "data-processing-energy.h"
+#include "data-processing-histogram.h"
 #include <QDialog>
 #include <QDir>
 #include <QFile>
 #include <QFileInfo>
+#include <QFutureWatcher>
+#include <QTextStream>
 
 typedef enum {battery1UnderVoltage, battery2UnderVoltage, battery3UnderVoltage, 
               battery1OverCurrent, battery2OverCurrent, battery3OverCurrent,
@@ -76,6 +85,10 @@ private slots:
     void on_splitButton_clicked();
     void on_energyButton_clicked();
     void on_energySaveButton_clicked();
+    void on_energyFilesButton_clicked();
+    void on_anomalyButton_clicked();
+    void on_histogramButton_clicked();
+    void on_trendButton_clicked();
     void on_extractButton_clicked();
     void on_voltagePlotCheckBox_clicked();
     void on_plotFileSelectButton_clicked();
@@ -84,16 +97,25 @@ private slots:
     void on_battery2Checkbox_clicked();
     void on_battery3Checkbox_clicked();
     void on_statesPlotCheckbox_clicked();
+    void on_faultRulesButton_clicked();
     void on_analysisFileSelectButton_clicked();
+    void energyFilesFinished();
+    void histogramFinished();
 private:
 // User Interface object instance
     Ui::DataProcessingMainWindow DataProcessingMainUi;
     void scanFile(QFile* file);
     bool combineRecords(QDateTime startTime, QDateTime endTime,
-                                   QFile* inFile, QFile* outFile, bool header);
+                                   QFile* inFile, QFile* outFile, bool header,
+                                   ColumnarWriter* columnar = NULL);
     void displayErrorMessage(QString message);
+    void displayStatusMessage(QString message);
+    QStringList dayFileColumns(QFile* inFile);
+    void writeHistogram(QTextStream& outStream, QString name, int battery,
+                        QString band, const Histogram& histogram);
     QDateTime findFirstTimeRecord(QFile* inFile);
-    bool openSaveFile(void);
+    bool openSaveFile(QString filter = "Comma Separated Variables (*.csv)",
+                      QString extension = ".csv");
     bool outfileMessage(QString filename, bool* append);
     QStringList recordType;
     QStringList recordText;
@@ -104,9 +126,11 @@ private:
     QString energySaveFile;
     QDir saveDirectory;
     QFileInfo fileInfo;
-    long long battery1CurrentZero;
-    long long battery2CurrentZero;
-    long long battery3CurrentZero;
+    CurrentZeroCurve currentZero[3];
+    QStringList faultRules;
+// Day file passes run on the thread pool and finish in these
+    QFutureWatcher<EnergyPartial> energyWatcher;
+    QFutureWatcher<HistogramSet> histogramWatcher;
 // Record information
     QString timeRecord;
     int tableRow;
@@ -0,0 +1,175 @@
+/*       Power Management Plot Data Storage
+
+Columnar storage of the points of a plot read from a day file. All series of a
+plot share the same times, so a single time column is kept in milliseconds
+since the epoch, with one single precision column for each series shown. This
+takes 8 bytes a row plus 4 for each series, against 16 for each point of each
+series held as QPointF.
+
+The columns are given to Qwt through a series data adapter that makes each
+point when it is asked for, so they are never copied. The table is shared by
+the curves and freed with the last of them.
+
+The day file is read from a memory map where possible. Rows are counted first
+so that the columns are allocated once.
+
+@date 18 October 2026
+*/
+
+/****************************************************************************
+ *   Copyright (C) 2013 by Ken Sarkies                                      *
+ *   ksarkies@internode.on.net                                              *
+ *                                                                          *
+ *   This file is part of Power Management                                  *
+ *                                                                          *
+ *   Power Management is free software; you can redistribute it and/or      *
+ *   modify it under the terms of the GNU General Public License as         *
+ *   published by the Free Software Foundation; either version 2 of the     *
+ *   License, or (at your option) any later version.                        *
+ *                                                                          *
+ *   Power Management is distributed in the hope that it will be useful,    *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the          *
+ *   GNU General Public License for more details.                           *
+ *                                                                          *
+ *   You should have received a copy of the GNU General Public License      *
+ *   along with Power Management if not, write to the                       *
+ *   Free Software Foundation, Inc.,                                        *
+ *   51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.              *
+ ***************************************************************************/
+
+#ifndef DATA_PROCESSING_PLOT_H
+#define DATA_PROCESSING_PLOT_H
+
+#include <string.h>
+#include <QByteArray>
+#include <QDate>
+#include <QDateTime>
+#include <QPointF>
+#include <QRectF>
+#include <QSharedPointer>
+#include <QTime>
+#include <QVector>
+#include <QtGlobal>
+#include <qwt_series_data.h>
+
+/* Most series in one plot */
+#define PLOT_SERIES     4
+
+//-----------------------------------------------------------------------------
+/** @brief Plot Table
+
+A time column and up to PLOT_SERIES value columns of equal length.
+*/
+
+class PlotTable
+{
+public:
+    PlotTable(int seriesCount) : count(qBound(0,seriesCount,PLOT_SERIES)) {}
+    void reserve(int rows);
+    void append(qint64 milliseconds, const float *values);
+    int rows() const { return time.size(); }
+    int series() const { return count; }
+    qint64 timeAt(int row) const { return time[row]; }
+    float value(int series, int row) const { return column[series][row]; }
+private:
+    int count;
+    QVector<qint64> time;
+    QVector<float> column[PLOT_SERIES];
+};
+
+inline void PlotTable::reserve(int rows)
+{
+    time.reserve(rows);
+    for (int n = 0; n < count; n++) column[n].reserve(rows);
+}
+
+/* One value is taken for each series */
+inline void PlotTable::append(qint64 milliseconds, const float *values)
+{
+    time.append(milliseconds);
+    for (int n = 0; n < count; n++) column[n].append(values[n]);
+}
+
+//-----------------------------------------------------------------------------
+/** @brief Plot Series Data
+
+Adapter giving one series of a plot table to a curve. The curve takes ownership
+of the adapter, which holds a reference to the shared table.
+*/
+
+class PlotSeriesData : public QwtSeriesData<QPointF>
+{
+public:
+    PlotSeriesData(QSharedPointer<const PlotTable> plotTable, int plotSeries)
+        : table(plotTable), series(plotSeries) {}
+    virtual size_t size() const { return table->rows(); }
+    virtual QPointF sample(size_t i) const
+    {
+        return QPointF(table->timeAt(i),table->value(series,i));
+    }
+    virtual QRectF boundingRect() const;
+private:
+    QSharedPointer<const PlotTable> table;
+    int series;
+};
+
+/* The bounds are found once, on first use */
+inline QRectF PlotSeriesData::boundingRect() const
+{
+    if (d_boundingRect.width() < 0) d_boundingRect = qwtBoundingRect(*this);
+    return d_boundingRect;
+}
+
+//-----------------------------------------------------------------------------
+/** @brief Plot Clock
+
+Converts the times of the day files, in seconds from the start of the Julian day
+count, to local milliseconds since the epoch. The offset is found once for each
+hour as daylight saving changes fall on the hour.
+*/
+
+class PlotClock
+{
+public:
+    PlotClock() : hour(-1), offset(0) {}
+    qint64 milliseconds(qint64 julianDay, qint64 seconds);
+private:
+    qint64 hour;
+    qint64 offset;
+};
+
+inline qint64 PlotClock::milliseconds(qint64 julianDay, qint64 seconds)
+{
+    if (seconds/3600 != hour)
+    {
+        hour = seconds/3600;
+        QDateTime start(QDate::fromJulianDay(julianDay),
+                        QTime((seconds % 86400)/3600,0));
+        offset = start.toMSecsSinceEpoch() - hour*3600000;
+    }
+    return seconds*1000 + offset;
+}
+
+//-----------------------------------------------------------------------------
+/** @brief Count the Rows of a File in Memory
+
+@param[in] text: start of the file contents.
+@param[in] end: pointer past the end of the contents.
+@returns int number of lines.
+*/
+
+inline int plotCountRows(const char *text, const char *end)
+{
+    int rows = 0;
+    while (text < end)
+    {
+        const char *next = (const char*)memchr(text,'\n',end-text);
+        rows++;
+        if (next == NULL) break;
+        text = next+1;
+    }
+    return rows;
+}
+
+#endif
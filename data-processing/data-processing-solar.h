@@ -0,0 +1,303 @@
+/*       Power Management Solar Yield and Charger Utilization
+
+Solar analysis of the day files, run over the column batches of the filter
+engine. Each batch is processed by a few simple loops over its columns: the
+intervals between rows and the panel power, then the charger state of each row,
+then the sums by day and hour of day.
+
+- Panel energy in watt hours and ampere hours for each day.
+- Yield profile: the mean energy delivered in each hour of the day.
+- Available power: the mean panel power in each hour of the day while a battery
+  is charged in the bulk phase, when the charger does not limit the current.
+- Charger idle time: time during which no battery is being charged while all
+  are in float or rest and the panel voltage is above every battery, so that the
+  panel could be producing. The energy wasted is estimated from the available
+  power for the hour.
+- Curtailment: while a battery is charged in the absorption or float phases the
+  charger limits the panel current. The fraction curtailed is that of the energy
+  available over those times that was not delivered.
+
+@date 18 October 2026
+*/
+
+/****************************************************************************
+ *   Copyright (C) 2013 by Ken Sarkies                                      *
+ *   ksarkies@internode.on.net                                              *
+ *                                                                          *
+ *   This file is part of Power Management                                  *
+ *                                                                          *
+ *   Power Management is free software; you can redistribute it and/or      *
+ *   modify it under the terms of the GNU General Public License as         *
+ *   published by the Free Software Foundation; either version 2 of the     *
+ *   License, or (at your option) any later version.                        *
+ *                                                                          *
+ *   Power Management is distributed in the hope that it will be useful,    *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the          *
+ *   GNU General Public License for more details.                           *
+ *                                                                          *
+ *   You should have received a copy of the GNU General Public License      *
+ *   along with Power Management if not, write to the                       *
+ *   Free Software Foundation, Inc.,                                        *
+ *   51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.              *
+ ***************************************************************************/
+
+#ifndef DATA_PROCESSING_SOLAR_H
+#define DATA_PROCESSING_SOLAR_H
+
+#include <QMap>
+#include <QVector>
+#include <QtGlobal>
+#include "power-management-records.h"
+#include "data-processing-filter.h"
+
+/* Hour of day bins */
+#define SOLAR_SLOTS         24
+/* Longest interval between rows that is counted (seconds) */
+#define SOLAR_MAX_GAP       60
+
+/* Charger state of a row */
+typedef enum {solarOther, solarBulk, solarCurtailed, solarIdle} SolarState;
+
+//-----------------------------------------------------------------------------
+/** @brief Solar Sums for a Day
+
+Energy in watt hours, charge in ampere hours and times in seconds.
+*/
+
+struct SolarDay
+{
+    SolarDay() : energy(0), charge(0), curtailedEnergy(0)
+    {
+        for (int n = 0; n < SOLAR_SLOTS; n++)
+        {
+            idleTime[n] = 0;
+            curtailedTime[n] = 0;
+        }
+    }
+    double energy;
+    double charge;
+    double curtailedEnergy;
+    double idleTime[SOLAR_SLOTS];
+    double curtailedTime[SOLAR_SLOTS];
+};
+
+//-----------------------------------------------------------------------------
+/** @brief Solar Analysis
+
+The columns are found and marked in a batch with setColumns(), then each filled
+batch is given to addBatch() in time order.
+*/
+
+class SolarAnalysis
+{
+public:
+    SolarAnalysis();
+    bool setColumns(ColumnBatch &batch);
+    void addBatch(const ColumnBatch &batch);
+    const QMap<qint64,SolarDay> &days() const { return day; }
+    double yield(int slot) const;
+    double available(int slot) const;
+    double wasted(const SolarDay &sums) const;
+    double curtailment(const SolarDay &sums) const;
+private:
+    int panelCurrent;
+    int panelVoltage;
+    int batteryVoltage[3];
+    int opState[3];
+    int chargePhase[3];
+    qint64 previousTime;
+    QVector<float> interval;
+    QVector<float> power;
+    QVector<char> state;
+    double yieldEnergy[SOLAR_SLOTS];
+    double bulkEnergy[SOLAR_SLOTS];
+    double bulkTime[SOLAR_SLOTS];
+    QMap<qint64,SolarDay> day;
+};
+
+inline SolarAnalysis::SolarAnalysis()
+{
+    previousTime = 0;
+    for (int n = 0; n < SOLAR_SLOTS; n++)
+    {
+        yieldEnergy[n] = 0;
+        bulkEnergy[n] = 0;
+        bulkTime[n] = 0;
+    }
+}
+
+//-----------------------------------------------------------------------------
+/** @brief Find the Columns Used
+
+@param[in] batch: batch with the day file column names set.
+@returns true if all columns were found.
+*/
+
+inline bool SolarAnalysis::setColumns(ColumnBatch &batch)
+{
+    int time = batch.columnIndex("Time");
+    panelCurrent = batch.columnIndex("M1 I");
+    panelVoltage = batch.columnIndex("M1 V");
+    if ((time < 0) || (panelCurrent < 0) || (panelVoltage < 0)) return false;
+    batch.needTime(time);
+    batch.need(panelCurrent,false);
+    batch.need(panelVoltage,false);
+    for (int n = 0; n < 3; n++)
+    {
+        QString battery = QString("B%1 ").arg(n+1);
+        batteryVoltage[n] = batch.columnIndex(battery + "V");
+        opState[n] = batch.columnIndex(battery + "Op");
+        chargePhase[n] = batch.columnIndex(battery + "Charge");
+        if ((batteryVoltage[n] < 0) || (opState[n] < 0) ||
+            (chargePhase[n] < 0)) return false;
+        batch.need(batteryVoltage[n],false);
+        batch.need(opState[n],true);
+        batch.need(chargePhase[n],true);
+    }
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+/** @brief Add a Batch of Rows
+
+@param[in] batch: filled batch.
+*/
+
+inline void SolarAnalysis::addBatch(const ColumnBatch &batch)
+{
+    int rows = batch.rows();
+    if (rows == 0) return;
+    interval.resize(rows);
+    power.resize(rows);
+    state.resize(rows);
+    const qint64 *time = batch.time();
+    const float *current = batch.number(panelCurrent);
+    const float *voltage = batch.number(panelVoltage);
+/* Intervals since the previous row, and panel power */
+    for (int r = 0; r < rows; r++)
+    {
+        qint64 gap = time[r] - ((r > 0) ? time[r-1] : previousTime);
+        bool counted = ((previousTime > 0) || (r > 0)) &&
+                       (gap > 0) && (gap <= SOLAR_MAX_GAP);
+        interval[r] = counted ? gap : 0;
+    }
+    previousTime = time[rows-1];
+    for (int r = 0; r < rows; r++)
+        power[r] = (current[r] > 0) ? current[r]*voltage[r] : 0;
+/* Charger state. Start with idle and remove rows where the charger is in use,
+a battery is not finished, or the panel could not charge a battery. */
+    for (int r = 0; r < rows; r++) state[r] = solarIdle;
+    for (int n = 0; n < 3; n++)
+    {
+        const int *op = batch.text(opState[n]);
+        const int *phase = batch.text(chargePhase[n]);
+        const float *battery = batch.number(batteryVoltage[n]);
+        int charge = batch.textCode(opState[n],opStateText[1]);
+        int bulk = batch.textCode(chargePhase[n],chargeStateText[0]);
+        int absorption = batch.textCode(chargePhase[n],chargeStateText[1]);
+        int floating = batch.textCode(chargePhase[n],chargeStateText[2]);
+        int rest = batch.textCode(chargePhase[n],chargeStateText[3]);
+        for (int r = 0; r < rows; r++)
+        {
+            if (op[r] == charge)
+            {
+                if (phase[r] == bulk) state[r] = solarBulk;
+                else if ((phase[r] == absorption) || (phase[r] == floating))
+                    state[r] = solarCurtailed;
+                else state[r] = solarOther;
+            }
+            else if ((state[r] == solarIdle) &&
+                     (((phase[r] != floating) && (phase[r] != rest)) ||
+                      (voltage[r] <= battery[r]))) state[r] = solarOther;
+        }
+    }
+/* Sums by day and hour of day. Rows are in time order so the day is kept. */
+    qint64 currentDay = -1;
+    SolarDay *sums = NULL;
+    for (int r = 0; r < rows; r++)
+    {
+        if (time[r]/86400 != currentDay)
+        {
+            currentDay = time[r]/86400;
+            sums = &day[currentDay];
+        }
+        int slot = (time[r] % 86400)/3600;
+        double energy = power[r]*interval[r]/3600;
+        sums->energy += energy;
+        if (current[r] > 0) sums->charge += current[r]*interval[r]/3600;
+        yieldEnergy[slot] += energy;
+        if (state[r] == solarBulk)
+        {
+            bulkEnergy[slot] += energy;
+            bulkTime[slot] += interval[r];
+        }
+        else if (state[r] == solarCurtailed)
+        {
+            sums->curtailedEnergy += energy;
+            sums->curtailedTime[slot] += interval[r];
+        }
+        else if (state[r] == solarIdle) sums->idleTime[slot] += interval[r];
+    }
+}
+
+//-----------------------------------------------------------------------------
+/** @brief Mean Energy Delivered in an Hour of the Day
+
+@param[in] slot: hour of the day.
+@returns double watt hours.
+*/
+
+inline double SolarAnalysis::yield(int slot) const
+{
+    if (day.isEmpty()) return 0;
+    return yieldEnergy[slot]/day.size();
+}
+
+//-----------------------------------------------------------------------------
+/** @brief Mean Panel Power while Charging in Bulk in an Hour of the Day
+
+@param[in] slot: hour of the day.
+@returns double watts, zero if there was no bulk charging in that hour.
+*/
+
+inline double SolarAnalysis::available(int slot) const
+{
+    if (bulkTime[slot] <= 0) return 0;
+    return bulkEnergy[slot]*3600/bulkTime[slot];
+}
+
+//-----------------------------------------------------------------------------
+/** @brief Energy Wasted while the Charger was Idle
+
+@param[in] sums: sums for a day.
+@returns double watt hours.
+*/
+
+inline double SolarAnalysis::wasted(const SolarDay &sums) const
+{
+    double energy = 0;
+    for (int n = 0; n < SOLAR_SLOTS; n++)
+        energy += sums.idleTime[n]*available(n)/3600;
+    return energy;
+}
+
+//-----------------------------------------------------------------------------
+/** @brief Fraction of Available Energy Curtailed by the Charger
+
+@param[in] sums: sums for a day.
+@returns double fraction from 0 to 1, zero if there was no curtailed time.
+*/
+
+inline double SolarAnalysis::curtailment(const SolarDay &sums) const
+{
+    double potential = 0;
+    for (int n = 0; n < SOLAR_SLOTS; n++)
+        potential += sums.curtailedTime[n]*available(n)/3600;
+    if (potential <= 0) return 0;
+    double fraction = 1 - sums.curtailedEnergy/potential;
+    if (fraction < 0) fraction = 0;
+    return fraction;
+}
+
+#endif
@@ -0,0 +1,367 @@
+/*       Power Management Battery Capacity and Resistance Trends
+
+Battery ageing measures gathered from the raw records, to support replacement
+decisions.
+
+- Usable capacity. A cycle starts at a full charge, taken as the end of the
+  absorption phase, and ends at a deep discharge, taken as the entry to the low
+  or critical fill state. The ampere hours drawn between them are the usable
+  capacity for that cycle. A gap in the measurements abandons the cycle.
+- Internal resistance. A step in current between successive measurements gives
+  the resistance from the step in voltage. Steps are averaged over each day.
+
+The measures of each battery are fitted by weighted least squares to a straight
+line over time, giving the rate of capacity fade and resistance rise per year.
+
+The tracking state can be saved and restored, so that a later run over newer
+logs continues from where the last left off, including any cycle in progress
+and the day of resistance steps being gathered.
+
+@date 18 October 2026
+*/
+
+/****************************************************************************
+ *   Copyright (C) 2013 by Ken Sarkies                                      *
+ *   ksarkies@internode.on.net                                              *
+ *                                                                          *
+ *   This file is part of Power Management                                  *
+ *                                                                          *
+ *   Power Management is free software; you can redistribute it and/or      *
+ *   modify it under the terms of the GNU General Public License as         *
+ *   published by the Free Software Foundation; either version 2 of the     *
+ *   License, or (at your option) any later version.                        *
+ *                                                                          *
+ *   Power Management is distributed in the hope that it will be useful,    *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the          *
+ *   GNU General Public License for more details.                           *
+ *                                                                          *
+ *   You should have received a copy of the GNU General Public License      *
+ *   along with Power Management if not, write to the                       *
+ *   Free Software Foundation, Inc.,                                        *
+ *   51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.              *
+ ***************************************************************************/
+
+#ifndef DATA_PROCESSING_TREND_H
+#define DATA_PROCESSING_TREND_H
+
+#include <QSettings>
+#include <QString>
+#include <QVector>
+#include <QtGlobal>
+#include "power-management-records.h"
+
+/* Smallest current step used for resistance, times 256 (2A) */
+#define TREND_STEP_CURRENT      512
+/* Longest time between the measurements either side of a step (seconds) */
+#define TREND_STEP_INTERVAL     2
+/* Largest credible resistance (ohm), rejecting steps from switching */
+#define TREND_MAX_RESISTANCE    0.5
+/* Fewest steps in a day for a resistance value */
+#define TREND_MIN_STEPS         3
+/* Longest gap in measurements within a capacity cycle (seconds) */
+#define TREND_MAX_GAP           60
+/* Smallest usable capacity accepted from a cycle (Ah) */
+#define TREND_MIN_CAPACITY      1.0
+/* Seconds in a year, for the fitted rates */
+#define TREND_YEAR              31557600.0
+
+typedef enum {trendCapacity, trendResistance} TrendMeasure;
+
+//-----------------------------------------------------------------------------
+/** @brief Trend Measurement
+
+Time is in seconds as given to the tracker. Capacity is in ampere hours and
+resistance in ohms. The weight is the number of steps averaged.
+*/
+
+struct TrendEvent
+{
+    qint64 time;
+    int battery;
+    TrendMeasure measure;
+    double value;
+    int weight;
+};
+
+//-----------------------------------------------------------------------------
+/** @brief Weighted Straight Line Fit
+
+Sums are kept about the first time added so that they stay well conditioned.
+*/
+
+class TrendFit
+{
+public:
+    TrendFit() : origin(0), weight(0), sumT(0), sumY(0), sumTT(0), sumTY(0),
+                 last(0), count(0) {}
+    void add(qint64 time, double value, double w);
+    int points() const { return count; }
+    double rate() const;
+    double valueAt(qint64 time) const;
+    qint64 lastTime() const { return last; }
+private:
+    qint64 origin;
+    double weight;
+    double sumT;
+    double sumY;
+    double sumTT;
+    double sumTY;
+    qint64 last;
+    int count;
+};
+
+inline void TrendFit::add(qint64 time, double value, double w)
+{
+    if (count == 0) origin = time;
+    double t = (time - origin)/TREND_YEAR;
+    weight += w;
+    sumT += w*t;
+    sumY += w*value;
+    sumTT += w*t*t;
+    sumTY += w*t*value;
+    if (time > last) last = time;
+    count++;
+}
+
+/* Change per year, zero until the points span some time */
+inline double TrendFit::rate() const
+{
+    if (weight <= 0) return 0;
+    double variance = sumTT*weight - sumT*sumT;
+    if (variance <= 1e-12*weight*weight) return 0;
+    return (sumTY*weight - sumT*sumY)/variance;
+}
+
+inline double TrendFit::valueAt(qint64 time) const
+{
+    if (weight <= 0) return 0;
+    double t = (time - origin)/TREND_YEAR;
+    return sumY/weight + rate()*(t - sumT/weight);
+}
+
+//-----------------------------------------------------------------------------
+/** @brief Battery Trend Tracker
+
+Time records are given with setTime(), then the operational status and battery
+records that follow. Events are appended to the list given.
+*/
+
+class BatteryTrend
+{
+public:
+    BatteryTrend();
+    void load(QSettings &settings);
+    void save(QSettings &settings) const;
+    qint64 lastTime() const { return time; }
+    void setTime(qint64 seconds) { time = seconds; }
+    void setStatus(int battery, int status, QVector<TrendEvent> &events);
+    void addBattery(int battery, int current, int voltage,
+                    QVector<TrendEvent> &events);
+private:
+    struct Track
+    {
+        bool statusKnown;
+        int chargePhase;
+        int fillState;
+        bool cycle;                 /* full charge seen, no discharge yet */
+        double drawn;               /* current times 256 by seconds */
+        bool sampled;
+        qint64 sampleTime;
+        int current;
+        int voltage;
+        qint64 day;
+        double resistanceSum;
+        int steps;
+    };
+    void endDay(int n, QVector<TrendEvent> &events);
+    Track track[3];
+    qint64 time;
+};
+
+inline BatteryTrend::BatteryTrend()
+{
+    time = 0;
+    for (int n = 0; n < 3; n++)
+    {
+        Track &entry = track[n];
+        entry.statusKnown = false;
+        entry.chargePhase = 0;
+        entry.fillState = 0;
+        entry.cycle = false;
+        entry.drawn = 0;
+        entry.sampled = false;
+        entry.sampleTime = 0;
+        entry.current = 0;
+        entry.voltage = 0;
+        entry.day = 0;
+        entry.resistanceSum = 0;
+        entry.steps = 0;
+    }
+}
+
+//-----------------------------------------------------------------------------
+/** @brief Restore the Tracking State
+
+@param[in] settings: settings holding the state saved by an earlier run.
+*/
+
+inline void BatteryTrend::load(QSettings &settings)
+{
+    time = settings.value("time",0).toLongLong();
+    for (int n = 0; n < 3; n++)
+    {
+        Track &entry = track[n];
+        settings.beginGroup(QString("battery%1").arg(n+1));
+        entry.statusKnown = settings.value("statusKnown",false).toBool();
+        entry.chargePhase = settings.value("chargePhase",0).toInt();
+        entry.fillState = settings.value("fillState",0).toInt();
+        entry.cycle = settings.value("cycle",false).toBool();
+        entry.drawn = settings.value("drawn",0).toDouble();
+        entry.day = settings.value("day",0).toLongLong();
+        entry.resistanceSum = settings.value("resistanceSum",0).toDouble();
+        entry.steps = settings.value("steps",0).toInt();
+        entry.sampled = settings.value("sampled",false).toBool();
+        entry.sampleTime = settings.value("sampleTime",0).toLongLong();
+        entry.current = settings.value("current",0).toInt();
+        entry.voltage = settings.value("voltage",0).toInt();
+        settings.endGroup();
+    }
+}
+
+inline void BatteryTrend::save(QSettings &settings) const
+{
+    settings.setValue("time",time);
+    for (int n = 0; n < 3; n++)
+    {
+        const Track &entry = track[n];
+        settings.beginGroup(QString("battery%1").arg(n+1));
+        settings.setValue("statusKnown",entry.statusKnown);
+        settings.setValue("chargePhase",entry.chargePhase);
+        settings.setValue("fillState",entry.fillState);
+        settings.setValue("cycle",entry.cycle);
+        settings.setValue("drawn",entry.drawn);
+        settings.setValue("day",entry.day);
+        settings.setValue("resistanceSum",entry.resistanceSum);
+        settings.setValue("steps",entry.steps);
+        settings.setValue("sampled",entry.sampled);
+        settings.setValue("sampleTime",entry.sampleTime);
+        settings.setValue("current",entry.current);
+        settings.setValue("voltage",entry.voltage);
+        settings.endGroup();
+    }
+}
+
+//-----------------------------------------------------------------------------
+/** @brief Operational Status of a Battery
+
+The end of absorption starts a capacity cycle and the entry to a low fill state
+ends one. A missing or faulty battery abandons any cycle.
+
+@param[in] battery: battery number 1-3.
+@param[in] status: operational status field of the dO record.
+@param[out] events: list to which a capacity event is appended.
+*/
+
+inline void BatteryTrend::setStatus(int battery, int status,
+                                    QVector<TrendEvent> &events)
+{
+    if ((battery < 1) || (battery > 3)) return;
+    Track &entry = track[battery-1];
+    int chargePhase = bitField(status,operationalCharge);
+    int fillState = bitField(status,operationalFill);
+    int opState = bitField(status,operationalOp);
+    if (entry.statusKnown)
+    {
+        if ((entry.chargePhase == 1) && (chargePhase == 2))
+        {
+            entry.cycle = true;
+            entry.drawn = 0;
+/* Integrate from the start of the cycle */
+            if (entry.sampled) entry.sampleTime = time;
+        }
+        else if (entry.cycle && (entry.fillState == 0) &&
+                 ((fillState == 1) || (fillState == 2)))
+        {
+            TrendEvent event;
+            event.time = time;
+            event.battery = battery;
+            event.measure = trendCapacity;
+            event.value = entry.drawn/921600;
+            event.weight = 1;
+            if (event.value >= TREND_MIN_CAPACITY) events.append(event);
+            entry.cycle = false;
+        }
+    }
+    if ((opState == 3) || (fillState == 3)) entry.cycle = false;
+    entry.chargePhase = chargePhase;
+    entry.fillState = fillState;
+    entry.statusKnown = true;
+}
+
+//-----------------------------------------------------------------------------
+/** @brief Battery Measurement
+
+@param[in] battery: battery number 1-3.
+@param[in] current: current times 256 with the zero offset removed, positive
+           when discharging.
+@param[in] voltage: voltage times 256.
+@param[out] events: list to which a resistance event is appended at the end of
+            each day.
+*/
+
+inline void BatteryTrend::addBattery(int battery, int current, int voltage,
+                                     QVector<TrendEvent> &events)
+{
+    if ((battery < 1) || (battery > 3)) return;
+    int n = battery-1;
+    Track &entry = track[n];
+    if (entry.day != time/86400)
+    {
+        endDay(n,events);
+        entry.day = time/86400;
+    }
+    if (entry.sampled)
+    {
+        qint64 interval = time - entry.sampleTime;
+/* Ampere hours drawn since the full charge */
+        if (interval > TREND_MAX_GAP) entry.cycle = false;
+        else if (entry.cycle) entry.drawn += (double)current*interval;
+/* Resistance from a step in current */
+        int step = current - entry.current;
+        if ((interval <= TREND_STEP_INTERVAL) &&
+            (qAbs(step) >= TREND_STEP_CURRENT))
+        {
+            double resistance = -(double)(voltage - entry.voltage)/step;
+            if ((resistance > 0) && (resistance < TREND_MAX_RESISTANCE))
+            {
+                entry.resistanceSum += resistance;
+                entry.steps++;
+            }
+        }
+    }
+    entry.sampled = true;
+    entry.sampleTime = time;
+    entry.current = current;
+    entry.voltage = voltage;
+}
+
+/* Give the mean resistance of the day if there were enough steps */
+inline void BatteryTrend::endDay(int n, QVector<TrendEvent> &events)
+{
+    Track &entry = track[n];
+    if (entry.steps >= TREND_MIN_STEPS)
+    {
+        TrendEvent event;
+        event.time = entry.day*86400 + 43200;
+        event.battery = n+1;
+        event.measure = trendResistance;
+        event.value = entry.resistanceSum/entry.steps;
+        event.weight = entry.steps;
+        events.append(event);
+    }
+    entry.resistanceSum = 0;
+    entry.steps = 0;
+}
+
+#endif
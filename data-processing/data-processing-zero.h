@@ -0,0 +1,171 @@
+/*       Power Management Current Zero Drift
+
+The zero point of each battery current amplifier is estimated from the current
+measured while the battery is isolated, and drifts with temperature and time.
+Isolation periods found by the file scan are reduced to knots of mean current,
+one for each period or for each window of a long period, giving a piecewise
+linear offset curve over the file. The number of knots is bounded by merging
+the closest pair when the limit is reached, so memory does not grow with the
+length of the file.
+
+@date 18 October 2026
+*/
+
+/****************************************************************************
+ *   Copyright (C) 2013 by Ken Sarkies                                      *
+ *   ksarkies@internode.on.net                                              *
+ *                                                                          *
+ *   This file is part of Power Management                                  *
+ *                                                                          *
+ *   Power Management is free software; you can redistribute it and/or      *
+ *   modify it under the terms of the GNU General Public License as         *
+ *   published by the Free Software Foundation; either version 2 of the     *
+ *   License, or (at your option) any later version.                        *
+ *                                                                          *
+ *   Power Management is distributed in the hope that it will be useful,    *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the          *
+ *   GNU General Public License for more details.                           *
+ *                                                                          *
+ *   You should have received a copy of the GNU General Public License      *
+ *   along with Power Management if not, write to the                       *
+ *   Free Software Foundation, Inc.,                                        *
+ *   51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.              *
+ ***************************************************************************/
+
+#ifndef DATA_PROCESSING_ZERO_H
+#define DATA_PROCESSING_ZERO_H
+
+#include <QVector>
+#include <QtGlobal>
+
+/* Longest part of an isolation period averaged into one knot (seconds) */
+#define CURRENT_ZERO_WINDOW 3600
+/* Largest number of knots kept for each battery */
+#define CURRENT_ZERO_KNOTS  512
+
+//-----------------------------------------------------------------------------
+/** @brief Current Zero Curve
+
+Samples are added in time order during the scan, with endPeriod() called when
+isolation ends. offset() then gives the zero at any time, interpolated between
+knots and held constant beyond the first and last. Lookups in time order take
+constant time.
+*/
+
+class CurrentZeroCurve
+{
+public:
+    CurrentZeroCurve() { clear(); }
+    void clear();
+    void addSample(qint64 time, int current);
+    void endPeriod();
+    int offset(qint64 time) const;
+    int knots() const { return knot.size(); }
+private:
+    struct Knot
+    {
+        double time;
+        double value;
+        double weight;
+    };
+    void addKnot(const Knot &entry);
+    QVector<Knot> knot;
+    qint64 periodStart;
+    qint64 periodEnd;
+    long long periodSum;
+    long periodCount;
+    mutable int cursor;
+};
+
+inline void CurrentZeroCurve::clear()
+{
+    knot.clear();
+    periodSum = 0;
+    periodCount = 0;
+    cursor = 0;
+}
+
+//-----------------------------------------------------------------------------
+/** @brief Add a Current Sample Taken During Isolation
+
+@param[in] time: time of the sample in seconds.
+@param[in] current: current reading times 256.
+*/
+
+inline void CurrentZeroCurve::addSample(qint64 time, int current)
+{
+    if ((periodCount > 0) && (time - periodStart >= CURRENT_ZERO_WINDOW))
+        endPeriod();
+    if (periodCount == 0) periodStart = time;
+    periodEnd = time;
+    periodSum += current;
+    periodCount++;
+}
+
+//-----------------------------------------------------------------------------
+/** @brief Close the Current Isolation Period
+
+The mean of the samples is kept as a knot at the middle of the period.
+*/
+
+inline void CurrentZeroCurve::endPeriod()
+{
+    if (periodCount == 0) return;
+    Knot entry;
+    entry.time = ((double)periodStart + (double)periodEnd)/2;
+    entry.value = (double)periodSum/periodCount;
+    entry.weight = periodCount;
+    addKnot(entry);
+    periodSum = 0;
+    periodCount = 0;
+}
+
+//-----------------------------------------------------------------------------
+/** @brief Append a Knot, Merging the Closest Pair if Full
+
+The merged knot is placed at the weighted mean time and value of the pair.
+*/
+
+inline void CurrentZeroCurve::addKnot(const Knot &entry)
+{
+    knot.append(entry);
+    if (knot.size() <= CURRENT_ZERO_KNOTS) return;
+    int closest = 0;
+    for (int n = 1; n < knot.size()-1; n++)
+    {
+        if ((knot[n+1].time - knot[n].time) <
+            (knot[closest+1].time - knot[closest].time)) closest = n;
+    }
+    Knot &first = knot[closest];
+    const Knot &second = knot[closest+1];
+    double weight = first.weight + second.weight;
+    first.time = (first.time*first.weight + second.time*second.weight)/weight;
+    first.value = (first.value*first.weight + second.value*second.weight)/weight;
+    first.weight = weight;
+    knot.remove(closest+1);
+}
+
+//-----------------------------------------------------------------------------
+/** @brief Current Zero at a Given Time
+
+@param[in] time: time in seconds.
+@returns int current zero times 256, or zero if there were no isolation periods.
+*/
+
+inline int CurrentZeroCurve::offset(qint64 time) const
+{
+    int size = knot.size();
+    if (size == 0) return 0;
+    if (time <= knot[0].time) return qRound(knot[0].value);
+    if (time >= knot[size-1].time) return qRound(knot[size-1].value);
+/* Move the cursor to the knot interval holding the time */
+    if ((cursor >= size-1) || (time < knot[cursor].time)) cursor = 0;
+    while (time >= knot[cursor+1].time) cursor++;
+    const Knot &left = knot[cursor];
+    const Knot &right = knot[cursor+1];
+    double fraction = (time - left.time)/(right.time - left.time);
+    return qRound(left.value + fraction*(right.value - left.value));
+}
+
+#endif
@@ -2,6 +2,7 @@ PROJECT =       Power Management Data Processing GUI
 TEMPLATE =      app
 TARGET          += 
 DEPENDPATH      += .
+INCLUDEPATH     += ../gui
 
 QWT_ROOT        = /usr/local/qwt-6.1.0
 include( $${QWT_ROOT}/features/qwt.prf )
@@ -13,11 +14,24 @@ MOC_DIR         = moc
 UI_HEADERS_DIR  = ui
 UI_SOURCES_DIR  = ui
 LANGUAGE        = C++
-CONFIG          += qt warn_on release
+CONFIG          += qt warn_on release c++11
+greaterThan(QT_MAJOR_VERSION, 4): QT += concurrent
 
 # Input
 FORMS           += data-processing-main.ui
 HEADERS         += data-processing-main.h
+HEADERS         += data-processing-anomaly.h
+HEADERS         += data-processing-columnar.h
+HEADERS         += data-processing-dayfile.h
+HEADERS         += data-processing-energy.h
+HEADERS         += data-processing-extract.h
+HEADERS         += data-processing-filter.h
+HEADERS         += data-processing-histogram.h
+HEADERS         += data-processing-plot.h
+HEADERS         += data-processing-solar.h
+HEADERS         += data-processing-trend.h
+HEADERS         += data-processing-zero.h
+HEADERS         += ../gui/power-management-records.h
 SOURCES         += data-processing.cpp
 SOURCES         += data-processing-main.cpp
 
@@ -0,0 +1,7 @@
+/* Host stand-in for the FreeRTOS header, for building firmware modules on a
+PC. Only what the modules built here use is provided. */
+
+#ifndef INC_FREERTOS_H
+#define INC_FREERTOS_H
+
+#endif
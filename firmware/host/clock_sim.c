@@ -0,0 +1,239 @@
+/*-----------------------------------------------------------------------*/
+/* Clock discipline simulation for the power management firmware         */
+/*-----------------------------------------------------------------------*/
+
+/* Builds power-management-time.c on a Linux PC and runs its disciplined clock
+against a simulated host over a serial link, a millisecond at a time.
+
+The millisecond count runs fast or slow of the host by a set frequency error
+and the RTC by another. The time is first set from the host, a whole second
+being sent as with the H command, then the host sends a probe every 5.3s as the
+GUI does. Each direction of the link has a fixed delay with random jitter, and
+some probes and replies are held up further as if queued behind records.
+Probes are stopped for the last part of the run to show how well the clock
+holds to the host on its frequency correction alone.
+
+The clock is read every second as by the monitor task, checking that it never
+goes backwards and recording its offset from the host. Setting the RTC counter
+leaves its prescaler running, as on the STM32F1, so the RTC seconds start at a
+fixed phase of their own. The error of the RTC is taken at each of its ticks.
+
+Usage: clock_sim [-f ppm] [-r ppm] [-j ms] [-q percent] [-h hours] [-o hours]
+  -f  frequency error of the millisecond count (default 40)
+  -r  frequency error of the RTC (default -20)
+  -j  mean jitter of each direction (default 3)
+  -q  percentage of messages queued behind records (default 20)
+  -h  hours of probing (default 36)
+  -o  hours without probes at the end (default 12)
+*/
+
+/*
+ * This file is part of the battery-management-system project.
+ *
+ * Copyright 2013 K. Sarkies <ksarkies@internode.on.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <unistd.h>
+
+#include "power-management-hardware.h"
+#include "power-management-time.h"
+
+/* Host time at the start, milliseconds since 1970 */
+#define HOST_START      1760745600250LL
+/* Fixed delay of each direction, about a line at 38400 baud plus USB */
+#define LINK_DELAY      9
+/* Extra delay of a message queued behind a burst of records */
+#define QUEUE_DELAY     80
+#define PROBE_INTERVAL  5300
+
+/* Phase of the RTC prescaler against the host seconds, ms */
+#define RTC_PHASE       637
+
+/* Simulated time in ms from the start, and the counters derived from it */
+static int64_t now;
+static double countRate;
+static double rtcRate;
+static int64_t rtcBase;
+
+/* Seconds counted by the RTC prescaler since the start */
+static int64_t rtcTicks(void)
+{
+    return (int64_t)floor((now*rtcRate + RTC_PHASE)/1000);
+}
+
+uint32_t getMilliSecondsCount()
+{
+    return (uint32_t)floor(now*countRate);
+}
+
+uint32_t getSecondsCount()
+{
+    return (uint32_t)(rtcBase + rtcTicks());
+}
+
+void setSecondsCount(uint32_t time)
+{
+    rtcBase = (int64_t)time - rtcTicks();
+}
+
+static int64_t hostTime(void)
+{
+    return HOST_START + now;
+}
+
+/* Delay of one direction of the link */
+static int64_t linkDelay(double jitter, int queued)
+{
+    double delay = LINK_DELAY - jitter*log(1.0 - rand()/(RAND_MAX + 1.0));
+    if ((rand() % 100) < queued) delay += QUEUE_DELAY*rand()/(RAND_MAX + 1.0);
+    return (int64_t)delay;
+}
+
+int main(int argc, char *argv[])
+{
+    double frequency = 40;
+    double rtcFrequency = -20;
+    double jitter = 3;
+    int queued = 20;
+    double probeHours = 36;
+    double holdHours = 12;
+    int option;
+    while ((option = getopt(argc, argv, "f:r:j:q:h:o:")) != -1)
+    {
+        switch (option)
+        {
+        case 'f': frequency = atof(optarg); break;
+        case 'r': rtcFrequency = atof(optarg); break;
+        case 'j': jitter = atof(optarg); break;
+        case 'q': queued = atoi(optarg); break;
+        case 'h': probeHours = atof(optarg); break;
+        case 'o': holdHours = atof(optarg); break;
+        default:
+            fprintf(stderr, "Usage: %s [-f ppm] [-r ppm] [-j ms] [-q percent] "
+                            "[-h hours] [-o hours]\n", argv[0]);
+            return 1;
+        }
+    }
+    countRate = 1 + frequency*1e-6;
+    rtcRate = 1 + rtcFrequency*1e-6;
+    srand(1);
+
+    int64_t probeEnd = (int64_t)(probeHours*3600000);
+    int64_t end = probeEnd + (int64_t)(holdHours*3600000);
+
+/* Set the time to the whole second, as the H command does */
+    setTimeSeconds((uint32_t)(hostTime()/1000));
+
+/* Probe in flight: host send time, arrival and reply times */
+    int64_t probeSend = 0;
+    int64_t probeArrive = -1;
+    int64_t replyArrive = -1;
+    uint32_t lastSend = 0;
+    uint32_t lastReceive = 0;
+    bool answered = false;
+    int64_t nextProbe = PROBE_INTERVAL;
+
+    uint64_t lastRead = 0;
+    int backwards = 0;
+    int64_t worstSettled = 0;
+    int64_t worstHold = 0;
+    double sumSquares = 0;
+    long settledReads = 0;
+    int64_t firstWithin = -1;
+    uint32_t lastRtc = getSecondsCount();
+    int64_t worstRtc = 0;
+    int64_t rtcError = 0;
+    int64_t offset = 0;
+
+    for (now = 0; now <= end; now++)
+    {
+        if ((now == nextProbe) && (now < probeEnd))
+        {
+            if (! answered)
+            {
+                lastSend = 0;
+                lastReceive = 0;
+            }
+            answered = false;
+            probeSend = hostTime();
+            probeArrive = now + linkDelay(jitter, queued);
+            nextProbe += PROBE_INTERVAL;
+        }
+        if (now == probeArrive)
+        {
+            clockProbe((uint32_t)probeSend, lastSend, lastReceive);
+            replyArrive = now + linkDelay(jitter, queued);
+            probeArrive = -1;
+        }
+        if (now == replyArrive)
+        {
+            lastSend = (uint32_t)probeSend;
+            lastReceive = (uint32_t)hostTime();
+            answered = true;
+            replyArrive = -1;
+        }
+/* Error of each RTC tick against the clock, once the clock has settled */
+        if (getSecondsCount() != lastRtc)
+        {
+            lastRtc = getSecondsCount();
+            rtcError = (int64_t)lastRtc*1000 - (int64_t)getTimeMilliseconds();
+            int64_t size = (rtcError < 0) ? -rtcError : rtcError;
+            if ((now >= probeEnd/2) && (now < probeEnd) && (size > worstRtc))
+                worstRtc = size;
+        }
+        if ((now % 1000) == 0)
+        {
+            uint64_t time = getTimeMilliseconds();
+            if (time < lastRead) backwards++;
+            lastRead = time;
+            offset = (int64_t)time - hostTime();
+            int64_t size = (offset < 0) ? -offset : offset;
+            if ((size > 5) && (now < probeEnd)) firstWithin = -1;
+            else if (firstWithin < 0) firstWithin = now;
+/* Settled over the second half of the probing */
+            if ((now >= probeEnd/2) && (now < probeEnd))
+            {
+                if (size > worstSettled) worstSettled = size;
+                sumSquares += (double)offset*offset;
+                settledReads++;
+            }
+            if ((now >= probeEnd) && (size > worstHold)) worstHold = size;
+        }
+    }
+
+    printf("Count error %.1fppm, RTC error %.1fppm, jitter %.1fms, "
+           "%d%% queued\n", frequency, rtcFrequency, jitter, queued);
+    if (firstWithin >= 0)
+        printf("Within 5ms of the host from %.2f hours\n", firstWithin/3600000.0);
+    else printf("Never settled within 5ms of the host\n");
+    if (settledReads > 0)
+        printf("Offset over the last %.1f hours of probing: worst %lldms, "
+               "rms %.2fms\n", probeHours/2, (long long)worstSettled,
+               sqrt(sumSquares/settledReads));
+    printf("Offset after %.1f hours without probes: %lldms, worst %lldms\n",
+           holdHours, (long long)offset, (long long)worstHold);
+    printf("RTC ticks against the clock over the last %.1f hours of probing: "
+           "worst %lldms\n", probeHours/2, (long long)worstRtc);
+    printf("RTC tick against the clock at the end: %lldms\n",
+           (long long)rtcError);
+    printf("Clock went backwards %d times\n", backwards);
+    return (backwards == 0) ? 0 : 1;
+}
@@ -0,0 +1,13 @@
+/* Host stand-in for the FreeRTOS queue header. Only the calls made from the
+ISR side of the transmit scheduler are provided; the host program using them
+supplies the queue. */
+
+#ifndef INC_QUEUE_H
+#define INC_QUEUE_H
+
+typedef void * xQueueHandle;
+
+long xQueueReceiveFromISR(xQueueHandle queue, void *buffer, long *woken);
+unsigned long uxQueueMessagesWaitingFromISR(xQueueHandle queue);
+
+#endif
@@ -0,0 +1,10 @@
+/* Host stand-in for the FreeRTOS task header. The host programs here are
+single threaded, so critical sections do nothing. */
+
+#ifndef INC_TASK_H
+#define INC_TASK_H
+
+#define taskENTER_CRITICAL()
+#define taskEXIT_CRITICAL()
+
+#endif
@@ -0,0 +1,244 @@
+/*-----------------------------------------------------------------------*/
+/* Time string benchmark for the power management firmware on a host     */
+/*-----------------------------------------------------------------------*/
+
+/* Builds power-management-time.c on a Linux PC against seconds and millisecond
+counters provided here, and compares putTimeToString and putTimeToPath with the library
+localtime() conversion and intToAscii/stringAppend formatting that they
+replace.
+
+The strings are first checked against the reference for runs of seconds across
+month, year, leap day and century boundaries, for jumps forward and back as
+when the time is set, and for random times over the range of the seconds count.
+
+The cost of each method is then measured in processor cycles per call, with
+the seconds count advancing one second every two calls as in the monitor task.
+Cycles are read from the time stamp counter on x86 and are only a guide to the
+relative cost on the Cortex M3, where the library localtime() is much slower
+again for lack of a hardware divider wide enough for its 64 bit arithmetic.
+
+Usage: time_bench [-n calls]
+*/
+
+/*
+ * This file is part of the battery-management-system project.
+ *
+ * Copyright 2013 K. Sarkies <ksarkies@internode.on.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "power-management-hardware.h"
+#include "power-management-lib.h"
+#include "power-management-time.h"
+
+/* Seconds counter in place of the RTC, and millisecond count in place of the
+systick count */
+static uint32_t secondsCount;
+static uint32_t millisecondsCount;
+
+uint32_t getSecondsCount()
+{
+    return secondsCount;
+}
+
+uint32_t getMilliSecondsCount()
+{
+    return millisecondsCount;
+}
+
+void setSecondsCount(uint32_t time)
+{
+    secondsCount = time;
+}
+
+/*-----------------------------------------------------------------------*/
+/* Processor cycles, or nanoseconds where there is no cycle counter      */
+/*-----------------------------------------------------------------------*/
+
+static uint64_t cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec*1000000000 + now.tv_nsec;
+#endif
+}
+
+/*-----------------------------------------------------------------------*/
+/* The conversion as it was before the incremental calendar              */
+/*-----------------------------------------------------------------------*/
+
+static void referenceTimeToString(char* timeString)
+{
+    time_t currentTime = (time_t)getSecondsCount();
+    struct tm *rtc = localtime(&currentTime);
+    char buffer[10];
+    intToAscii(rtc->tm_year+1900, timeString);
+    stringAppend(timeString,"-");
+    if (rtc->tm_mon < 9) stringAppend(timeString,"0");
+    intToAscii(rtc->tm_mon+1, buffer);
+    stringAppend(timeString,buffer);
+    stringAppend(timeString,"-");
+    if (rtc->tm_mday < 10) stringAppend(timeString,"0");
+    intToAscii(rtc->tm_mday, buffer);
+    stringAppend(timeString,buffer);
+    stringAppend(timeString,"T");
+    if (rtc->tm_hour < 10) stringAppend(timeString,"0");
+    intToAscii(rtc->tm_hour, buffer);
+    stringAppend(timeString,buffer);
+    stringAppend(timeString,":");
+    if (rtc->tm_min < 10) stringAppend(timeString,"0");
+    intToAscii(rtc->tm_min, buffer);
+    stringAppend(timeString,buffer);
+    stringAppend(timeString,":");
+    if (rtc->tm_sec < 10) stringAppend(timeString,"0");
+    intToAscii(rtc->tm_sec, buffer);
+    stringAppend(timeString,buffer);
+}
+
+static void referenceTimeToPath(char* path, size_t size, uint32_t seconds)
+{
+    time_t currentTime = (time_t)seconds;
+    struct tm *rtc = localtime(&currentTime);
+    snprintf(path, size, "%04d/%02d/%02d-%02d%02d", rtc->tm_year+1900,
+             rtc->tm_mon+1, rtc->tm_mday, rtc->tm_hour, rtc->tm_min);
+}
+
+/*-----------------------------------------------------------------------*/
+/* Compare the strings at one time                                       */
+/*-----------------------------------------------------------------------*/
+
+static int errors;
+
+static void check(uint32_t seconds)
+{
+    char timeString[20];
+    char reference[20];
+    char path[16];
+    char referencePath[64];
+    setTimeSeconds(seconds);
+    putTimeToString(timeString);
+    referenceTimeToString(reference);
+    putTimeToPath(path, seconds);
+    referenceTimeToPath(referencePath, sizeof(referencePath), seconds);
+    if ((strcmp(timeString, reference) != 0) ||
+        (strcmp(path, referencePath) != 0))
+    {
+        if (errors < 10)
+            printf("Mismatch at %u: %s %s, %s %s\n", seconds, timeString,
+                   reference, path, referencePath);
+        errors++;
+    }
+}
+
+/* A run of seconds from a starting date, stepping by a given amount */
+static void checkRun(int year, int month, int day, int hour, int minute,
+                     int second, uint32_t count, uint32_t step)
+{
+    struct tm start;
+    memset(&start, 0, sizeof(start));
+    start.tm_year = year-1900;
+    start.tm_mon = month-1;
+    start.tm_mday = day;
+    start.tm_hour = hour;
+    start.tm_min = minute;
+    start.tm_sec = second;
+    uint32_t seconds = (uint32_t)timegm(&start);
+    uint32_t i;
+    for (i=0; i<count; i++) check(seconds + i*step);
+}
+
+/*-----------------------------------------------------------------------*/
+/* Cycles per call over a number of calls                                */
+/*-----------------------------------------------------------------------*/
+
+static double measure(void (*convert)(char*), uint32_t calls)
+{
+    char timeString[20];
+    volatile char sink = 0;
+    setTimeSeconds(1760745600);
+    uint64_t begin = cycles();
+    uint32_t i;
+    for (i=0; i<calls; i++)
+    {
+        if ((i & 1) == 0) secondsCount++;
+        millisecondsCount += 500;
+        convert(timeString);
+        sink ^= timeString[18];
+    }
+    uint64_t end = cycles();
+    (void)sink;
+    return (double)(end - begin)/calls;
+}
+
+int main(int argc, char *argv[])
+{
+    uint32_t calls = 1000000;
+    int option;
+    while ((option = getopt(argc, argv, "n:")) != -1)
+    {
+        if (option == 'n') calls = strtoul(optarg, NULL, 10);
+        else
+        {
+            fprintf(stderr, "Usage: %s [-n calls]\n", argv[0]);
+            return 1;
+        }
+    }
+    setenv("TZ", "UTC", 1);
+    tzset();
+
+/* Runs of seconds across boundaries, then steps of minutes, hours and days */
+    checkRun(1970, 1, 1, 0, 0, 0, 100000, 1);
+    checkRun(2015, 12, 31, 23, 0, 0, 7200, 1);
+    checkRun(2016, 2, 28, 23, 0, 0, 90000, 1);
+    checkRun(2026, 10, 18, 0, 0, 0, 2*86400, 1);
+    checkRun(2099, 12, 31, 23, 59, 0, 120, 1);
+    checkRun(2100, 2, 28, 23, 59, 0, 120, 1);
+    checkRun(2000, 2, 28, 23, 59, 0, 86400*2, 1);
+    checkRun(2013, 1, 1, 0, 0, 0, 200000, 61);
+    checkRun(2013, 1, 1, 0, 0, 30, 100000, 3599);
+    checkRun(1970, 1, 1, 12, 0, 0, 49710, 86400);
+/* Jumps back and forward as when the time is set */
+    checkRun(2030, 6, 30, 23, 59, 59, 1000, (uint32_t)-7);
+    srand(1);
+    uint32_t i;
+    for (i=0; i<1000000; i++)
+        check(((uint32_t)rand() << 16) ^ (uint32_t)rand());
+    check(0xFFFFFFFF);
+    printf("Conversion check: %s (%d mismatches)\n",
+           (errors == 0) ? "passed" : "FAILED", errors);
+
+    double reference = measure(referenceTimeToString, calls);
+    double calendar = measure(putTimeToString, calls);
+    printf("Cycles per call over %u calls:\n", calls);
+    printf("  localtime and intToAscii/stringAppend  %8.1f\n", reference);
+    printf("  incremental calendar                   %8.1f\n", calendar);
+    printf("  ratio                                  %8.1f\n",
+           reference/calendar);
+    return (errors == 0) ? 0 : 1;
+}
@@ -0,0 +1,326 @@
+/*-----------------------------------------------------------------------*/
+/* Transmit scheduler simulation for the power management firmware       */
+/*-----------------------------------------------------------------------*/
+
+/* Builds power-management-transmit.c on a Linux PC and drives it over a
+simulated serial link, a millisecond at a time.
+
+Each second the monitor queues the same telemetry as the firmware, with an
+alarm now and then. The host sends a command every few seconds whose response
+is written to the response queue as the communications task does, and
+downloads a file a block at a time with the GUI's window and timeout. The ISR
+is called whenever the transmitter is free and its interrupt enabled.
+
+The receiving end checks every line for corruption, and records the age of
+telemetry when it arrives and the delay of responses. Dropped and replaced
+messages are counted by the scheduler.
+
+Usage: transmit_sim [-b baud] [-s seconds]
+  -b  link speed in bits per second (default 2400)
+  -s  seconds to run (default 600)
+*/
+
+/*
+ * This file is part of the battery-management-system project.
+ *
+ * Copyright 2013 K. Sarkies <ksarkies@internode.on.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "queue.h"
+#include "power-management-hardware.h"
+#include "power-management-lib.h"
+#include "power-management-transmit.h"
+
+#define RESPONSE_QUEUE_SIZE 512
+#define COMMAND_INTERVAL    3000
+#define DOWNLOAD_WINDOW     6
+#define DOWNLOAD_TIMEOUT    2000
+#define BLOCKS              64
+#define IDENTS              32
+
+/* Response queue, the communications send queue of the firmware */
+static char responseQueue[RESPONSE_QUEUE_SIZE];
+static unsigned responseHead;
+static unsigned responseCount;
+xQueueHandle commsSendQueue = responseQueue;
+
+static bool txInterrupt;
+
+long xQueueReceiveFromISR(xQueueHandle queue, void *buffer, long *woken)
+{
+    if (responseCount == 0) return 0;
+    *(char*)buffer = responseQueue[responseHead];
+    responseHead = (responseHead + 1) % RESPONSE_QUEUE_SIZE;
+    responseCount--;
+    return 1;
+}
+
+unsigned long uxQueueMessagesWaitingFromISR(xQueueHandle queue)
+{
+    return responseCount;
+}
+
+void commsEnableTxInterrupt(uint8_t enable)
+{
+    txInterrupt = enable;
+}
+
+/* Time each telemetry identifier was last queued */
+static char identName[IDENTS][4];
+static int64_t identQueued[IDENTS];
+static int identCount;
+
+static int identIndex(const char *ident)
+{
+    int i;
+    for (i=0; i<identCount; i++)
+        if (strcmp(identName[i], ident) == 0) return i;
+    strcpy(identName[identCount], ident);
+    return identCount++;
+}
+
+static int64_t now;
+
+static void telemetry(char *ident, int32_t param1, int32_t param2, bool dual)
+{
+    char text[24];
+    char buffer[12];
+    intToAscii(param1, text);
+    if (dual)
+    {
+        stringAppend(text, ",");
+        intToAscii(param2, buffer);
+        stringAppend(text, buffer);
+    }
+    identQueued[identIndex(ident)] = now;
+    transmitLine(telemetryP, ident, text);
+}
+
+/* The set of messages sent by the monitor task each second */
+static void monitorCycle(void)
+{
+    char id[4] = "d00";
+    int i;
+    telemetry("pH", 1760745600 + (int32_t)(now/1000), 0, false);
+    for (i=0; i<3; i++)
+    {
+        id[2] = '1'+i;
+        id[1] = 'B';
+        telemetry(id, -1234 - rand()%100, 12800 + rand()%100, true);
+        id[1] = 'C';
+        telemetry(id, 20000 + rand()%100, 0, false);
+        id[1] = 'O';
+        telemetry(id, 0x45, 0, false);
+    }
+    id[1] = 'L';
+    for (i=0; i<2; i++)
+    {
+        id[2] = '1'+i;
+        telemetry(id, 2345 + rand()%100, 12700 + rand()%100, true);
+    }
+    id[1] = 'M';
+    id[2] = '1';
+    telemetry(id, 3456 + rand()%100, 18000 + rand()%100, true);
+    telemetry("dT", 2500 + rand()%10, 0, false);
+    telemetry("dD", 0x123, 0, false);
+    telemetry("ds", 0x12, 0, false);
+    telemetry("dd", 0x4000, 0, false);
+    telemetry("dI", 0, 0, false);
+}
+
+/* Communications task writing a response, waiting while the queue is full */
+static const char *responsePending;
+static int64_t responseStart;
+
+static void commsTask(void)
+{
+    while (responsePending && *responsePending &&
+           (responseCount < RESPONSE_QUEUE_SIZE))
+    {
+        responseQueue[(responseHead + responseCount) % RESPONSE_QUEUE_SIZE] =
+            *responsePending++;
+        responseCount++;
+        commsEnableTxInterrupt(true);
+    }
+}
+
+/* File download by the host */
+static int64_t blockRequested[BLOCKS];
+static bool blockReceived[BLOCKS];
+static int blocksDone;
+static long blockRequests;
+
+static void requestBlock(int block)
+{
+    char ident[3] = "fB";
+    char data[12 + 64 + 1];
+    int i;
+    intToAscii(block*32, data);
+    stringAppend(data, ",");
+    int start = stringLength(data);
+    for (i=start; i<start+64; i++) data[i] = "0123456789ABCDEF"[i & 0xF];
+    data[i] = 0;
+    blockRequested[block] = now;
+    blockRequests++;
+    transmitLine(bulkP, ident, data);
+}
+
+static void downloadCheck(void)
+{
+    int outstanding = 0;
+    int block;
+    for (block=0; block<BLOCKS; block++)
+    {
+        if (blockReceived[block] || (blockRequested[block] < 0)) continue;
+        if (now - blockRequested[block] > DOWNLOAD_TIMEOUT) requestBlock(block);
+        outstanding++;
+    }
+    for (block=0; (block<BLOCKS) && (outstanding<DOWNLOAD_WINDOW); block++)
+    {
+        if (blockRequested[block] >= 0) continue;
+        requestBlock(block);
+        outstanding++;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    long baud = 2400;
+    long seconds = 600;
+    int option;
+    while ((option = getopt(argc, argv, "b:s:")) != -1)
+    {
+        switch (option)
+        {
+        case 'b': baud = atol(optarg); break;
+        case 's': seconds = atol(optarg); break;
+        default:
+            fprintf(stderr, "Usage: %s [-b baud] [-s seconds]\n", argv[0]);
+            return 1;
+        }
+    }
+    srand(1);
+    initTransmit();
+    int block;
+    for (block=0; block<BLOCKS; block++) blockRequested[block] = -1;
+
+    char line[256];
+    unsigned position = 0;
+    double characterTime = 0;
+    long corrupted = 0;
+    long telemetryLines = 0;
+    double telemetryAgeSum = 0;
+    int64_t telemetryAgeWorst = 0;
+    long responses = 0;
+    int64_t responseWorst = 0;
+    long alarms = 0;
+    int64_t downloadTime = -1;
+
+    for (now = 0; now < seconds*1000; now++)
+    {
+        if ((now % 1000) == 0) monitorCycle();
+        if ((now % 7919) == 0) transmitLine(alarmP, "D", "Charger Restarted");
+        if (((now % COMMAND_INTERVAL) == 500) &&
+            ! (responsePending && *responsePending))
+        {
+            responsePending = "pK,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15\r\n";
+            responseStart = now;
+        }
+        if (now >= 2000) downloadCheck();
+        commsTask();
+
+/* Characters sent this millisecond */
+        characterTime += baud/10000.0;
+        while ((characterTime >= 1) && txInterrupt)
+        {
+            char character;
+            if (! transmitNextCharacter(&character))
+            {
+                commsEnableTxInterrupt(false);
+                break;
+            }
+            characterTime -= 1;
+            if (position < sizeof(line)-1) line[position++] = character;
+            if (character != '\n') continue;
+            line[position] = 0;
+            position = 0;
+            char ident[4] = "";
+            sscanf(line, "%3[^,]", ident);
+            char *parameters = strchr(line, ',');
+            if ((parameters == NULL) || (strchr(parameters, '\r') == NULL) ||
+                (strchr(parameters, '\r')[1] != '\n'))
+            {
+                corrupted++;
+                continue;
+            }
+            if (strcmp(ident, "pK") == 0)
+            {
+                if (strcmp(line, "pK,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15\r\n"))
+                    corrupted++;
+                responses++;
+                if (now - responseStart > responseWorst)
+                    responseWorst = now - responseStart;
+            }
+            else if (strcmp(ident, "D") == 0) alarms++;
+            else if (strcmp(ident, "fB") == 0)
+            {
+                block = atoi(parameters+1)/32;
+                char *data = strchr(parameters+1, ',');
+                if ((block < 0) || (block >= BLOCKS) || (data == NULL) ||
+                    (strlen(data) != 1+64+2))
+                    corrupted++;
+                else if (! blockReceived[block])
+                {
+                    blockReceived[block] = true;
+                    if (++blocksDone == BLOCKS) downloadTime = now - 2000;
+                }
+            }
+            else
+            {
+                int64_t age = now - identQueued[identIndex(ident)];
+                telemetryLines++;
+                telemetryAgeSum += age;
+                if (age > telemetryAgeWorst) telemetryAgeWorst = age;
+            }
+        }
+        if (characterTime > 1) characterTime = 1;
+    }
+
+    printf("Link %ld baud for %ld seconds\n", baud, seconds);
+    printf("Responses: %ld delivered, worst delay %lldms, %u dropped\n",
+           responses, (long long)responseWorst, getTransmitDrops(responseP));
+    printf("Alarms: %ld delivered, %u dropped\n", alarms,
+           getTransmitDrops(alarmP));
+    printf("Telemetry: %ld delivered, age mean %.0fms worst %lldms, "
+           "%u replaced, %u dropped\n", telemetryLines,
+           telemetryLines ? telemetryAgeSum/telemetryLines : 0.0,
+           (long long)telemetryAgeWorst, getTransmitReplaced(),
+           getTransmitDrops(telemetryP));
+    if (downloadTime >= 0)
+        printf("Bulk: %d blocks in %.1fs, %ld requests, %u dropped\n",
+               BLOCKS, downloadTime/1000.0, blockRequests, getTransmitDrops(bulkP));
+    else printf("Bulk: %d of %d blocks, %ld requests, %u dropped\n",
+                blocksDone, BLOCKS, blockRequests, getTransmitDrops(bulkP));
+    printf("Corrupted lines %ld\n", corrupted);
+    return (corrupted == 0) ? 0 : 1;
+}
@@ -54,6 +54,7 @@ Initial 29 September 2013
 #include "power-management-time.h"
 #include "power-management-lib.h"
 #include "power-management-comms.h"
+#include "power-management-transmit.h"
 #include "ff.h"
 
 /*--------------------------------------------------------------------------*/
@@ -66,6 +67,8 @@ static void commsPrintInt(int32_t value);
 static void commsPrintHex(uint32_t value);
 static void commsPrintString(char *ch);
 static void commsPrintChar(char *ch);
+static void commsTransmit(transmit_Class priority, char* ident, char* string);
+static void receiveFileName(char *name);
 
 /*--------------------------------------------------------------------------*/
 /* Global Variables */
@@ -79,16 +82,18 @@ extern union ConfigGroup configData;
 /* The semaphore must be used to protect messages until they have been queued
 in their entirety. This is done in convenience functions defined below */
 xQueueHandle commsSendQueue, commsReceiveQueue;
-xSemaphoreHandle commsSendSemaphore, commsEmptySemaphore;
+xSemaphoreHandle commsSendSemaphore;
 /* FreeRTOS queue to receive command responses, defined in File */
 extern xQueueHandle fileReceiveQueue;
 extern xSemaphoreHandle fileSendSemaphore;
+extern xQueueHandle fileReadReceiveQueue;
+extern xSemaphoreHandle fileReadSemaphore;
 
 /*--------------------------------------------------------------------------*/
 /* Local Variables */
 static uint32_t intf;
-static char writeFileName[12];
-static char readFileName[12];
+static char writeFileName[FILE_NAME_SIZE];
+static char readFileName[FILE_NAME_SIZE];
 static uint8_t writeFileHandle;
 static uint8_t readFileHandle;
 static int lapseCommsID;
@@ -105,8 +110,8 @@ void prvCommsTask(void *pvParameters)
 {
     pvParameters = pvParameters;
 
-    static uint8_t line[80];
-    static uint8_t characterPosition = 0;
+    static uint8_t line[COMMS_LINE_SIZE];
+    static uint16_t characterPosition = 0;
 
     initGlobals();
 
@@ -120,7 +125,8 @@ seconds */
 indefinitely waiting for input. */
         char character;
         xQueueReceive(commsReceiveQueue,&character,portMAX_DELAY);
-        if ((character == 0x0D) || (character == 0x0A) || (characterPosition > 78))
+        if ((character == 0x0D) || (character == 0x0A) ||
+            (characterPosition > COMMS_LINE_SIZE-2))
         {
             if (lapseCommsTimer != NULL) xTimerReset(lapseCommsTimer,0);
             line[characterPosition] = 0;
@@ -134,7 +140,8 @@ indefinitely waiting for input. */
 /*--------------------------------------------------------------------------*/
 /** @brief Initialize
 
-This initializes the queues and semaphores used by the task.
+This initializes the queues and semaphores used by the task, and the transmit
+scheduler.
 */
 
 void initComms(void)
@@ -144,8 +151,7 @@ void initComms(void)
     commsReceiveQueue = xQueueCreate(COMMS_QUEUE_SIZE,1);
     commsSendSemaphore = xSemaphoreCreateBinary();
     xSemaphoreGive(commsSendSemaphore);
-    commsEmptySemaphore = xSemaphoreCreateBinary();
-    xSemaphoreGive(commsEmptySemaphore);
+    initTransmit();
 }
 
 /*--------------------------------------------------------------------------*/
@@ -168,7 +174,7 @@ static void initGlobals(void)
 Commands to and from the BMS are single line ASCII text strings consisting of
 a category character (a=action, d=data request, p=parameter, f=file) followed
 by an upper case command character and an arbitrary length set of parameters
-(limited to 80 character line length in total).
+(limited to COMMS_LINE_SIZE characters in total).
 
 Unrecognizable messages are just discarded.
 
@@ -319,6 +325,38 @@ settings. */
                                    (int32_t)configData.config.floatBulkSoC);
                 break;
             }
+/**
+<li> <b>K</b> Ask for a snapshot of the entire configuration. The response is
+"pK,v,l,c,data" with v the snapshot version, l the length of the snapshot, c
+its CRC-32 checksum and the snapshot itself, both in hex. The snapshot layout is
+given in the object dictionary header. */
+        case 'K':
+            {
+                static uint8_t snapshot[CONFIG_SNAPSHOT_LENGTH];
+                uint16_t length = getConfigSnapshot(snapshot);
+                uint32_t crc = crc32Update(0xFFFFFFFF,snapshot,length) ^ 0xFFFFFFFF;
+                if (! xSemaphoreTake(commsSendSemaphore,COMMS_SEND_TIMEOUT))
+                    break;
+                commsPrintString("pK,");
+                commsPrintInt(CONFIG_SNAPSHOT_VERSION);
+                commsPrintString(",");
+                commsPrintInt(length);
+                commsPrintString(",");
+                commsPrintHex(crc >> 16);
+                commsPrintHex(crc & 0xFFFF);
+                commsPrintString(",");
+                uint16_t i;
+                for (i=0; i<length; i++)
+                {
+                    char hex = "0123456789ABCDEF"[snapshot[i] >> 4];
+                    commsPrintChar(&hex);
+                    hex = "0123456789ABCDEF"[snapshot[i] & 0xF];
+                    commsPrintChar(&hex);
+                }
+                commsPrintString("\r\n");
+                xSemaphoreGive(commsSendSemaphore);
+                break;
+            }
         }
     }
 /**
@@ -371,6 +409,24 @@ settings. */
                 break;
             }
 /**
+<li> <b>Nt,s,r</b> Clock probe. t is the host time of sending, s and r the host
+times of sending the previous probe and receiving its reply, in milliseconds
+as 32 bit hexadecimal. The reply pN,t,offset is sent at once, with the clock
+offset from the host in ms found from the previous exchange. */
+        case 'N':
+            {
+                uint8_t i = 2;
+                uint32_t hostSend = asciiHexToInt((char*)line+i);
+                while ((line[i] > 0) && (line[i++] != ','));
+                uint32_t lastHostSend = asciiHexToInt((char*)line+i);
+                while ((line[i] > 0) && (line[i++] != ','));
+                uint32_t lastHostReceive = asciiHexToInt((char*)line+i);
+                int32_t offset = clockProbe(hostSend,lastHostSend,
+                                            lastHostReceive);
+                dataMessageSend("pN",(int32_t)hostSend,offset);
+                break;
+            }
+/**
 <li> <b>M-, M+</b> Turn on/off data messaging (mainly for debug) */
         case 'M':
             {
@@ -546,6 +602,44 @@ loading the battery under charge. */
                 configData.config.floatBulkSoC = asciiToInt((char*)line+2);
                 break;
             }
+/**
+<li> <b>Kv,l,c,data</b> Replace the entire configuration with a snapshot in the
+form sent in response to dK. The version, length and checksum are checked before
+the configuration is replaced in a single step and written to FLASH. The
+communications and recording controls keep their current values. The response
+"pk,s" gives the status: 0 success, 1 wrong version, 2 wrong length,
+3 checksum or format error, 4 FLASH write failure. */
+        case 'K':
+            {
+                static uint8_t snapshotData[CONFIG_SNAPSHOT_LENGTH];
+                uint8_t status = 0;
+                uint16_t i = 2;
+                uint16_t n;
+                uint8_t version = asciiToInt((char*)line+i);
+                while ((line[i] > 0) && (line[i++] != ','));
+                uint16_t length = asciiToInt((char*)line+i);
+                while ((line[i] > 0) && (line[i++] != ','));
+                uint32_t crc = asciiHexToInt((char*)line+i);
+                while ((line[i] > 0) && (line[i++] != ','));
+                if (version != CONFIG_SNAPSHOT_VERSION) status = 1;
+                else if (length != CONFIG_SNAPSHOT_LENGTH) status = 2;
+                else
+                {
+                    for (n=0; n<length; n++)
+                    {
+                        char hex[3] = {line[i], line[i+1], 0};
+                        if ((line[i] == 0) || (line[i+1] == 0)) break;
+                        snapshotData[n] = asciiHexToInt(hex);
+                        i += 2;
+                    }
+                    if ((n < length) ||
+                        ((crc32Update(0xFFFFFFFF,snapshotData,length) ^ 0xFFFFFFFF)
+                            != crc)) status = 3;
+                    else if (setConfigSnapshot(snapshotData) != 0) status = 4;
+                }
+                sendResponse("pk",status);
+                break;
+            }
         }
     }
 /**
@@ -554,15 +648,20 @@ loading the battery under charge. */
 /* ======================== File commands ================ */
 /*
 F           - get free clusters
-Wfilename   - Open file for read/write. Filename is 8.3 string style. Returns handle.
-Rfilename   - Open file read only. Filename is 8.3 string style. Returns handle.
-Xfilename   - Delete the file. Filename is 8.3 string style.
+W[filename] - Open file for read/write. Filename is a path, long names allowed.
+              Without a name, YYYY/MM/DD-HHMM.TXT is used and rotated daily.
+              Returns handle.
+Rfilename   - Open file read only. Filename is a path. Returns handle.
+Xfilename   - Delete the file. Filename is a path.
 Cxx         - Close file. x is the file handle.
 Gxx         - Read a record from read or write file.
-Ddirname    - Get a directory listing. Directory name is 8.3 string style.
+Bxx,o       - Read a block from read or write file at byte offset o.
+Kxx[,l]     - Get the size and checksum of a file.
+Ddirname    - Get a directory listing. Directory name is a path.
 d[dirname]  - Get the first (if dirname present) or next entry in directory.
 s           - Get status of open files and configData.config.recording flag
 M           - Mount the SD card.
+T           - Get the SD card clock and self-test throughput.
 All commands return an error status byte at the end.
 Only one file for writing and a second for reading is possible.
 Data is not written to the file externally. */
@@ -605,16 +704,19 @@ Data is not written to the file externally. */
                 break;
             }
 /**
-<li> <b>Wf</b> Open a file f=filename for writing */
+<li> <b>W[f]</b> Open a file f=filename for writing. Missing directories in
+the path are created. If no name is given the file is named from the current
+time as YYYY/MM/DD-HHMM.TXT, and changed to a new file at midnight or when it
+reaches LOG_ROTATE_SIZE. */
             case 'W':
             {
-                if (stringLength((char*)line+2) < 12)
+                if (stringLength((char*)line+2) < FILE_NAME_SIZE)
                 {
                     uint8_t fileStatus = FR_INT_ERR;
                     if (xSemaphoreTake(fileSendSemaphore,COMMS_FILE_TIMEOUT))
                     {
                         stringCopy(writeFileName,(char*)line+2);
-                        sendFileCommand('W',13,line+2);
+                        sendFileCommand('W',FILE_NAME_SIZE,line+2);
                         xQueueReceive(fileReceiveQueue,&writeFileHandle,portMAX_DELAY);
                         sendResponse("fW",writeFileHandle);
                         xQueueReceive(fileReceiveQueue,&fileStatus,portMAX_DELAY);
@@ -628,13 +730,13 @@ Data is not written to the file externally. */
 <li> <b>Rf</b> Open a file f=filename for Reading */
             case 'R':
             {
-                if (stringLength((char*)line+2) < 12)
+                if (stringLength((char*)line+2) < FILE_NAME_SIZE)
                 {
                     uint8_t fileStatus = FR_INT_ERR;
                     if (xSemaphoreTake(fileSendSemaphore,COMMS_FILE_TIMEOUT))
                     {
                         stringCopy(readFileName,(char*)line+2);
-                        sendFileCommand('R',13,line+2);
+                        sendFileCommand('R',FILE_NAME_SIZE,line+2);
                         xQueueReceive(fileReceiveQueue,&readFileHandle,portMAX_DELAY);
                         sendResponse("fR",readFileHandle);
                         xQueueReceive(fileReceiveQueue,&fileStatus,portMAX_DELAY);
@@ -684,7 +786,12 @@ request. */
             case 'G':
             {
                 uint8_t fileStatus = FR_INT_ERR;
-                if (xSemaphoreTake(fileSendSemaphore,COMMS_FILE_TIMEOUT))
+                uint8_t fileHandle = asciiToInt((char*)line+2);
+/* Reads of the read file go to the file read task */
+                bool bulk = (readFileHandle < 0xFF) && (fileHandle == readFileHandle);
+                xSemaphoreHandle semaphore = bulk ? fileReadSemaphore : fileSendSemaphore;
+                xQueueHandle replyQueue = bulk ? fileReadReceiveQueue : fileReceiveQueue;
+                if (xSemaphoreTake(semaphore,COMMS_FILE_TIMEOUT))
                 {
                     int numberRecords = asciiToInt((char*)line+2);
                     if (numberRecords < 1) numberRecords = 1;
@@ -694,7 +801,6 @@ request. */
                     static uint8_t writePointer = 0;
                     char sendData[GET_RECORD_SIZE];
                     uint8_t sendPointer = 0;
-                    uint8_t fileHandle = asciiToInt((char*)line+2);
                     uint8_t blockLength = GET_RECORD_SIZE-1;
                     uint8_t numRead;
                     uint8_t parameters[2] = {fileHandle, blockLength};
@@ -703,9 +809,10 @@ request. */
 /* The buffer is empty, so fill up. */
                         if (readPointer == writePointer)
                         {
-                            sendFileCommand('G',2,parameters);
+                            if (bulk) sendFileReadCommand('G',2,parameters);
+                            else sendFileCommand('G',2,parameters);
                             numRead = 0;
-                            xQueueReceive(fileReceiveQueue,&numRead,portMAX_DELAY);
+                            xQueueReceive(replyQueue,&numRead,portMAX_DELAY);
 /* As records are written in entirety, premature EOF should not happen. */
                             if (numRead != blockLength)
                             {
@@ -718,12 +825,12 @@ request. */
                             {
                                 uint8_t nextWritePointer = (writePointer+1)
                                                 % GET_RECORD_SIZE;
-                                xQueueReceive(fileReceiveQueue,
+                                xQueueReceive(replyQueue,
                                     buffer+writePointer,portMAX_DELAY);
                                 writePointer = nextWritePointer;
                             }
 /* Get status byte. */
-                            xQueueReceive(fileReceiveQueue,&fileStatus,portMAX_DELAY);
+                            xQueueReceive(replyQueue,&fileStatus,portMAX_DELAY);
                         }
 /* Assemble the data message until EOL encountered, or block exhausted. */
                         while (sendPointer < GET_RECORD_SIZE-1)
@@ -743,15 +850,128 @@ request. */
                             sendPointer++;
                         }
                     }
-                    xSemaphoreGive(fileSendSemaphore);
+                    xSemaphoreGive(semaphore);
                 }
 /* Status sent is from the last time the file was read. */
                 sendResponse("fE",(uint8_t)fileStatus);
                 break;
             }
 /**
-<li> <b>Dd</b> Get a directory listing d=dirname. Directory name is 8.3 string
-style. Gets all items in the directory and sends the type,size and name, each
+<li> <b>Bh,o</b> h is the file handle, o is a byte offset in decimal. Read a
+block of GET_BLOCK_SIZE bytes from the file starting at the offset and send it
+as "fB,o,data" with the data in hexadecimal. The block is shorter at the end of
+the file. Each response carries its own offset so that a number of requests may
+be outstanding at once and the responses assembled in any order. To keep the
+link load down an error status is only sent if the read failed. Block reads
+move the file position so are not to be mixed with record reads. */
+#define GET_BLOCK_SIZE 32
+            case 'B':
+            {
+                uint8_t fileStatus = FR_INT_ERR;
+                uint8_t fileHandle = asciiToInt((char*)line+2);
+                bool bulk = (readFileHandle < 0xFF) && (fileHandle == readFileHandle);
+                xSemaphoreHandle semaphore = bulk ? fileReadSemaphore : fileSendSemaphore;
+                xQueueHandle replyQueue = bulk ? fileReadReceiveQueue : fileReceiveQueue;
+                if (xSemaphoreTake(semaphore,COMMS_FILE_TIMEOUT))
+                {
+                    uint8_t i = 2;
+                    while ((line[i] > 0) && (line[i] != ',')) i++;
+                    uint32_t offset = 0;
+                    if (line[i] == ',') offset = asciiToInt((char*)line+i+1);
+                    uint8_t parameters[6] = {fileHandle,
+                                             (offset >> 24) & 0xFF,
+                                             (offset >> 16) & 0xFF,
+                                             (offset >> 8) & 0xFF,
+                                             offset & 0xFF,
+                                             GET_BLOCK_SIZE};
+                    if (bulk) sendFileReadCommand('B',6,parameters);
+                    else sendFileCommand('B',6,parameters);
+                    uint8_t numRead = 0;
+                    xQueueReceive(replyQueue,&numRead,portMAX_DELAY);
+/* Build the response as offset followed by the data in hex. */
+                    char sendData[12+2*GET_BLOCK_SIZE];
+                    intToAscii(offset,sendData);
+                    stringAppend(sendData,",");
+                    uint8_t sendPointer = stringLength(sendData);
+                    for (i=0; i<numRead; i++)
+                    {
+                        uint8_t dataByte = 0;
+                        xQueueReceive(replyQueue,&dataByte,portMAX_DELAY);
+                        if (i < GET_BLOCK_SIZE)
+                        {
+                            sendData[sendPointer++] = "0123456789ABCDEF"[dataByte >> 4];
+                            sendData[sendPointer++] = "0123456789ABCDEF"[dataByte & 0xF];
+                        }
+                    }
+                    sendData[sendPointer] = 0;
+                    xQueueReceive(replyQueue,&fileStatus,portMAX_DELAY);
+                    xSemaphoreGive(semaphore);
+                    if (fileStatus == FR_OK) sendStringBulk("fB",sendData);
+                }
+                if (fileStatus != FR_OK) sendResponse("fE",(uint8_t)fileStatus);
+                break;
+            }
+/**
+<li> <b>Kh[,l]</b> h is the file handle, l is an optional length in decimal.
+Compute a CRC-32 checksum over the first l bytes of the file, or the whole file
+if l is absent. The response is "fK,l,c" with the length covered in decimal and
+the checksum in hexadecimal. For the read file this is done by the file read
+task while recording continues. For the write file the file task is busy for
+the duration, so any records sent meanwhile may be dropped. */
+            case 'K':
+            {
+                uint8_t fileStatus = FR_INT_ERR;
+                uint8_t fileHandle = asciiToInt((char*)line+2);
+                bool bulk = (readFileHandle < 0xFF) && (fileHandle == readFileHandle);
+                xSemaphoreHandle semaphore = bulk ? fileReadSemaphore : fileSendSemaphore;
+                xQueueHandle replyQueue = bulk ? fileReadReceiveQueue : fileReceiveQueue;
+                if (xSemaphoreTake(semaphore,COMMS_FILE_TIMEOUT))
+                {
+                    uint8_t i = 2;
+                    while ((line[i] > 0) && (line[i] != ',')) i++;
+                    uint32_t length = 0;
+                    if (line[i] == ',') length = asciiToInt((char*)line+i+1);
+                    uint8_t parameters[5] = {fileHandle,
+                                             (length >> 24) & 0xFF,
+                                             (length >> 16) & 0xFF,
+                                             (length >> 8) & 0xFF,
+                                             length & 0xFF};
+                    if (bulk) sendFileReadCommand('K',5,parameters);
+                    else sendFileCommand('K',5,parameters);
+                    uint8_t wordBuf;
+                    uint32_t crc = 0;
+                    length = 0;
+                    for (i=0; i<4; i++)
+                    {
+                        wordBuf = 0;
+                        xQueueReceive(replyQueue,&wordBuf,portMAX_DELAY);
+                        length = (length << 8) | wordBuf;
+                    }
+                    for (i=0; i<4; i++)
+                    {
+                        wordBuf = 0;
+                        xQueueReceive(replyQueue,&wordBuf,portMAX_DELAY);
+                        crc = (crc << 8) | wordBuf;
+                    }
+                    xQueueReceive(replyQueue,&fileStatus,portMAX_DELAY);
+                    xSemaphoreGive(semaphore);
+                    if ((fileStatus == FR_OK) &&
+                        xSemaphoreTake(commsSendSemaphore,COMMS_SEND_TIMEOUT))
+                    {
+                        commsPrintString("fK,");
+                        commsPrintInt(length);
+                        commsPrintString(",");
+                        commsPrintHex(crc >> 16);
+                        commsPrintHex(crc & 0xFFFF);
+                        commsPrintString("\r\n");
+                        xSemaphoreGive(commsSendSemaphore);
+                    }
+                }
+                sendResponse("fE",(uint8_t)fileStatus);
+                break;
+            }
+/**
+<li> <b>Dd</b> Get a directory listing d=dirname. Directory name is a path. Gets all items in the directory and sends the type,size and name, each
 group preceded by a comma. The file command requests each entry in turn,
 terminated by a null filename when the directory listing is exhausted. */
             case 'D':
@@ -762,7 +982,7 @@ terminated by a null filename when the directory listing is exhausted. */
                 if (xSemaphoreTake(fileSendSemaphore,COMMS_FILE_TIMEOUT))
                 {
                     char firstCharacter;
-                    sendFileCommand('D',13,line+2);
+                    sendFileCommand('D',FILE_NAME_SIZE,line+2);
                     commsPrintString("fD");
                     do
                     {
@@ -824,7 +1044,7 @@ no further entries found in the directory, then an empty string is sent back. */
                 uint8_t fileStatus = FR_INT_ERR;
                 if (xSemaphoreTake(fileSendSemaphore,COMMS_FILE_TIMEOUT))
                 {
-                    sendFileCommand('D',13,line+2);
+                    sendFileCommand('D',FILE_NAME_SIZE,line+2);
                     commsPrintString("fd");
                     char type = 0;
 /* Single character entry type */
@@ -878,11 +1098,48 @@ no further entries found in the directory, then an empty string is sent back. */
                 break;
             }
 /**
+<li> <b>T</b> Return the SPI clock and the clock rated by the card in kHz, then
+the read and write throughput measured in the startup self-test in kB/s (MB/s
+times 1000). The status is the self-test result. */
+            case 'T':
+            {
+                uint8_t wordBuf;
+                uint32_t values[4] = {0, 0, 0, 0};
+                uint8_t fileStatus = FR_INT_ERR;
+                if (xSemaphoreTake(fileSendSemaphore,COMMS_FILE_TIMEOUT))
+                {
+                    sendFileCommand('T',0,line+2);
+                    uint8_t i;
+                    for (i=0; i<16; i++)
+                    {
+                        wordBuf = 0;
+                        xQueueReceive(fileReceiveQueue,&wordBuf,portMAX_DELAY);
+                        values[i >> 2] |= (wordBuf << 8*(i & 3));
+                    }
+                    dataMessageSend("fT",values[0]/1000,values[1]/1000);
+                    dataMessageSend("fV",values[2]/1000,values[3]/1000);
+                    xQueueReceive(fileReceiveQueue,&fileStatus,portMAX_DELAY);
+                    xSemaphoreGive(fileSendSemaphore);
+                }
+                sendResponse("fE",(uint8_t)fileStatus);
+                break;
+            }
+/**
 <li> <b>s</b> Send a status message containing: software switches
 (configData.config.recording), names of open files, with open write filename
-first followed by read filename, or blank if files are not open. */
+first followed by read filename, or blank if files are not open. The names
+are taken from the file task as a log may have been rotated. */
             case 's':
             {
+                if (xSemaphoreTake(fileSendSemaphore,COMMS_FILE_TIMEOUT))
+                {
+                    uint8_t fileStatus;
+                    sendFileCommand('S',0,NULL);
+                    receiveFileName(writeFileName);
+                    receiveFileName(readFileName);
+                    xQueueReceive(fileReceiveQueue,&fileStatus,portMAX_DELAY);
+                    xSemaphoreGive(fileSendSemaphore);
+                }
                 if (! xSemaphoreTake(commsSendSemaphore,COMMS_SEND_TIMEOUT))
                     break;;
                 commsPrintString("fs,");
@@ -914,7 +1171,7 @@ the time. A status is returned to signal a directory refresh. */
                 uint8_t fileStatus = FR_INT_ERR;
                 if (xSemaphoreTake(fileSendSemaphore,COMMS_FILE_TIMEOUT))
                 {
-                    sendFileCommand('X',13,line+2);
+                    sendFileCommand('X',FILE_NAME_SIZE,line+2);
                     xQueueReceive(fileReceiveQueue,&fileStatus,portMAX_DELAY);
                     xSemaphoreGive(fileSendSemaphore);
                 }
@@ -975,10 +1232,11 @@ void dataMessageSend(char* ident, int32_t param1, int32_t param2)
 /*--------------------------------------------------------------------------*/
 /** @brief Send a data message with two parameters at low priority.
 
-This is the same as dataMessageSend except that a message is only sent if the
-commsSendQueue is empty.
+This is the same as dataMessageSend except that the message is passed to the
+transmit scheduler as periodic telemetry. It is sent after any responses and
+alarms, and replaces a message of the same identifier still waiting to be sent.
 
-This blocks indefinitely until the queue is empty of all messages.
+This does not block. The message is dropped if it cannot be held.
 
 @param ident: char* an identifier string recognized by the receiving program.
 @param param1: int32_t first integer parameter.
@@ -989,21 +1247,13 @@ void dataMessageSendLowPriority(char* ident, int32_t param1, int32_t param2)
 {
     if (configData.config.measurementSend)
     {
-/**
-If any characters are on the send queue, block on the commsEmptySemaphore
-which is released by the ISR after the last character has been sent. One
-message is then sent. The calling task cannot queue more than one message.
-Block indefinitely as the message must not be abandoned */
-        while (uxQueueMessagesWaiting(commsSendQueue) > 0)
-            xSemaphoreTake(commsEmptySemaphore,portMAX_DELAY);
-        if (! xSemaphoreTake(commsSendSemaphore,COMMS_SEND_DELAY)) return;
-        commsPrintString(ident);
-        commsPrintString(",");
-        commsPrintInt(param1);
-        commsPrintString(",");
-        commsPrintInt(param2);
-        commsPrintString("\r\n");
-        xSemaphoreGive(commsSendSemaphore);
+        char parameters[24];
+        char buffer[12];
+        intToAscii(param1,parameters);
+        stringAppend(parameters,",");
+        intToAscii(param2,buffer);
+        stringAppend(parameters,buffer);
+        commsTransmit(telemetryP,ident,parameters);
     }
 }
 
@@ -1033,8 +1283,8 @@ void sendResponse(char* ident, int32_t parameter)
 /*--------------------------------------------------------------------------*/
 /** @brief Send a data message with one parameter at low priority.
 
-Use to send a simple response to a command. The calling task will block until
-commsSendSemaphore is available.
+The message is passed to the transmit scheduler as periodic telemetry. This
+does not block.
 
 @param[in] ident: char* Response identifier string
 @param[in] parameter: int32_t Single integer parameter.
@@ -1044,27 +1294,18 @@ void sendResponseLowPriority(char* ident, int32_t parameter)
 {
     if (configData.config.measurementSend)
     {
-/**
-If any characters are on the send queue, block on the commsEmptySemaphore
-which is released by the ISR after the last character has been sent. One
-message is then sent. The calling task cannot queue more than one message.
-Block indefinitely as the message must not be abandoned */
-        while (uxQueueMessagesWaiting(commsSendQueue) > 0)
-            xSemaphoreTake(commsEmptySemaphore,portMAX_DELAY);
-        if (! xSemaphoreTake(commsSendSemaphore,COMMS_SEND_DELAY)) return;
-        commsPrintString(ident);
-        commsPrintString(",");
-        commsPrintInt(parameter);
-        commsPrintString("\r\n");
-        xSemaphoreGive(commsSendSemaphore);
+        char buffer[12];
+        intToAscii(parameter,buffer);
+        commsTransmit(telemetryP,ident,buffer);
     }
 }
 
 /*--------------------------------------------------------------------------*/
 /** @brief Send a debug message with one parameter at low priority.
 
-Use to send a simple debug response to a command. The calling task will block
-until commsSendSemaphore is available.
+Debug messages, with identifiers starting with D, are sent only if enabled and
+are passed to the transmit scheduler as alarms. Others are sent as telemetry.
+This does not block.
 
 @param[in] ident: char* Response identifier string
 @param[in] parameter: int32_t Single integer parameter.
@@ -1073,19 +1314,9 @@ until commsSendSemaphore is available.
 void sendDebugResponse(char* ident, int32_t parameter)
 {
     if ((ident[0] == 'D') && !configData.config.debugMessageSend) return;
-/**
-If any characters are on the send queue, block on the commsEmptySemaphore
-which is released by the ISR after the last character has been sent. One
-message is then sent. The calling task cannot queue more than one message.
-Block indefinitely as the message must not be abandoned */
-    while (uxQueueMessagesWaiting(commsSendQueue) > 0)
-        xSemaphoreTake(commsEmptySemaphore,portMAX_DELAY);
-    if (! xSemaphoreTake(commsSendSemaphore,COMMS_SEND_DELAY)) return;
-    commsPrintString(ident);
-    commsPrintString(",");
-    commsPrintInt(parameter);
-    commsPrintString("\r\n");
-    xSemaphoreGive(commsSendSemaphore);
+    char buffer[12];
+    intToAscii(parameter,buffer);
+    commsTransmit((ident[0] == 'D') ? alarmP : telemetryP,ident,buffer);
 }
 
 /*--------------------------------------------------------------------------*/
@@ -1118,45 +1349,42 @@ void sendString(char* ident, char* string)
 /*--------------------------------------------------------------------------*/
 /** @brief Send a string at low priority.
 
-Use to send a string. A message is only sent if the commsSendQueue is empty.
-
-This blocks indefinitely until the queue is empty of all messages.
+The message is passed to the transmit scheduler as periodic telemetry. This
+does not block.
 
 @param[in] ident: char* Response identifier string
-@param[in] string: char* Arbitrary length string.
+@param[in] string: char* String of up to TRANSMIT_LINE_SIZE with the ident.
 */
 
 void sendStringLowPriority(char* ident, char* string)
 {
     if (configData.config.measurementSend)
-    {
-/**
-If any characters are on the send queue, block on the commsEmptySemaphore
-which is released by the ISR after the last character has been sent. One
-message is then sent. The calling task cannot queue more than one message.
-Block indefinitely as the message must not be abandoned */
-        if ((uint16_t)uxQueueSpacesAvailable(commsSendQueue) >=
-            stringLength(ident)+stringLength(string)+3)
-        {
-            while (uxQueueMessagesWaiting(commsSendQueue) > 0)
-                xSemaphoreTake(commsEmptySemaphore,portMAX_DELAY);
-            xSemaphoreTake(commsSendSemaphore,portMAX_DELAY);
-            commsPrintString(ident);
-            commsPrintString(",");
-            commsPrintString(string);
-            commsPrintString("\r\n");
-            xSemaphoreGive(commsSendSemaphore);
-        }
-    }
+        commsTransmit(telemetryP,ident,string);
 }
 
 /*--------------------------------------------------------------------------*/
-/** @brief Send a debug string at low priority.
+/** @brief Send a string as bulk data.
+
+Use for file blocks, which are sent after all other messages. This does not
+block. The message is dropped if the bulk buffer is full, and the receiving
+program is expected to ask for it again.
+
+@param[in] ident: char* Response identifier string
+@param[in] string: char* String of data.
+*/
 
-Use to send a debug string. A message is only sent if the commsSendQueue is
-empty and the debug messages are enabled.
+void sendStringBulk(char* ident, char* string)
+{
+    if (configData.config.measurementSend)
+        commsTransmit(bulkP,ident,string);
+}
 
-This blocks indefinitely until the queue is empty of all messages.
+/*--------------------------------------------------------------------------*/
+/** @brief Send a debug string at low priority.
+
+Debug messages, with identifiers starting with D, are sent only if enabled and
+are passed to the transmit scheduler as alarms. Others are sent as telemetry.
+This does not block.
 
 @param[in] ident: char* Response identifier string
 @param[in] string: char* Single integer parameter string.
@@ -1165,23 +1393,7 @@ This blocks indefinitely until the queue is empty of all messages.
 void sendDebugString(char* ident, char* string)
 {
     if ((ident[0] == 'D') && !configData.config.debugMessageSend) return;
-/**
-If any characters are on the send queue, block on the commsEmptySemaphore
-which is released by the ISR after the last character has been sent. One
-message is then sent. The calling task cannot queue more than one message.
-Block indefinitely as the message must not be abandoned */
-    if ((uint16_t)uxQueueSpacesAvailable(commsSendQueue) >=
-        stringLength(ident)+stringLength(string)+3)
-    {
-        while (uxQueueMessagesWaiting(commsSendQueue) > 0)
-            xSemaphoreTake(commsEmptySemaphore,portMAX_DELAY);
-        xSemaphoreTake(commsSendSemaphore,portMAX_DELAY);
-        commsPrintString(ident);
-        commsPrintString(",");
-        commsPrintString(string);
-        commsPrintString("\r\n");
-        xSemaphoreGive(commsSendSemaphore);
-    }
+    commsTransmit((ident[0] == 'D') ? alarmP : telemetryP,ident,string);
 }
 
 /*--------------------------------------------------------------------------*/
@@ -1261,17 +1473,19 @@ void commsPrintString(char *ch)
 /*--------------------------------------------------------------------------*/
 /** @brief Print a Character
 
-Disable the Tx interrupt first to prevent queue corruption in the ISR.
-This is where the characters are queued for the ISR to transmit.
-The ISR is in the hardware module.
+This is where the characters of command responses are queued for the ISR to
+transmit. The ISR is in the hardware module and takes characters from the
+queue through the transmit scheduler, which sends responses ahead of other
+messages. The Tx interrupt is enabled after each character in case the ISR has
+stopped part way through a line while waiting for more.
 
 Characters are placed on a queue and picked up by the ISR for transmission.
 The application is responsible for protecting a message with semaphores
 to ensure it is sent in entirety (see convenience functions defined here).
 
-If the queue fails to respond it is reset. A number of messages will be lost but
-hopefully the application will continue to run. A receiving program may see
-a corrupted message.
+If the queue fails to respond it is reset and the loss is counted. A number of
+messages will be lost but hopefully the application will continue to run. A
+receiving program may see a corrupted message.
 
 @param[in] ch: char* pointer to character to be printed.
 */
@@ -1280,17 +1494,57 @@ void commsPrintChar(char *ch)
 {
     if (configData.config.enableSend)
     {
-        commsEnableTxInterrupt(false);
         while (xQueueSendToBack(commsSendQueue,ch,COMMS_SEND_TIMEOUT) != pdTRUE)
         {
             xQueueReset(commsSendQueue);
-            commsEnableTxInterrupt(true);
+            countTransmitDrop(responseP);
             taskYIELD();
         }
         commsEnableTxInterrupt(true);
     }
 }
 
+/*--------------------------------------------------------------------------*/
+/** @brief Pass a Message to the Transmit Scheduler
+
+@param[in] priority: transmit_Class class of the message.
+@param[in] ident: char* Response identifier string
+@param[in] string: char* parameters of the message.
+*/
+
+static void commsTransmit(transmit_Class priority, char* ident, char* string)
+{
+    if (configData.config.enableSend) transmitLine(priority,ident,string);
+}
+
+/*--------------------------------------------------------------------------*/
+/** @brief Receive a File Handle and Name from the File Task
+
+Part of the response to the file status command. The handle is followed by the
+null terminated name if the file is open, otherwise the name is cleared.
+
+@param[out] name: char* buffer of FILE_NAME_SIZE for the name.
+*/
+
+static void receiveFileName(char *name)
+{
+    uint8_t fileHandle = 0xFF;
+    uint8_t i = 0;
+    char character;
+    xQueueReceive(fileReceiveQueue,&fileHandle,portMAX_DELAY);
+    if (fileHandle < 0xFF)
+    {
+        do
+        {
+            character = 0;
+            xQueueReceive(fileReceiveQueue,&character,portMAX_DELAY);
+            if (i < FILE_NAME_SIZE-1) name[i++] = character;
+        }
+        while (character > 0);
+    }
+    name[i] = 0;
+}
+
 /*--------------------------------------------------------------------------*/
 /** @brief Callback function to lapse communications
 
@@ -33,6 +33,8 @@ Initial 29 September 2013
 #include <stdbool.h>
 
 #define COMMS_QUEUE_SIZE            512
+/* Long enough for a configuration snapshot in hex */
+#define COMMS_LINE_SIZE             320
 #define COMMS_SEND_DELAY            ((portTickType)1000/portTICK_RATE_MS)
 #define COMMS_SEND_TIMEOUT          ((portTickType)2000/portTICK_RATE_MS)
 
@@ -50,6 +52,7 @@ void sendResponseLowPriority(char* ident, int32_t parameter);
 void sendDebugResponse(char* ident, int32_t parameter);
 void sendString(char* ident, char* string);
 void sendStringLowPriority(char* ident, char* string);
+void sendStringBulk(char* ident, char* string);
 void sendDebugString(char* ident, char* string);
 
 #endif
@@ -18,6 +18,21 @@ This calls on underlying driver code that is compiled in.
 
 This code allows only one read and one write file to be opened at a time.
 
+Reads of the read file (commands G, B and K) are served by a separate file read
+task at a lower priority with its own queues and semaphore, so that a download
+does not hold up recording. FatFs is built reentrant and locks the volume with
+a mutex for each call, so while the read task is in FatFs the file task waits
+for at most one sector transfer and the read task inherits its priority. Reads
+of the write file stay with the file task as they share its file object.
+
+A write file opened without a name is named from the time and rotated at
+midnight, or when it reaches LOG_ROTATE_SIZE. Some minutes before, the file task
+creates the next file between commands, so the change itself is a close and an
+open. Between commands the file task also allocates clusters to the log a
+small chunk ahead of the records, and frees the unused allocation of a file
+when it is finished with. Allocation left by a reset or a card change is freed
+when the volume is mounted.
+
 Initial 1 October 2013
 */
 
@@ -55,37 +70,72 @@ Initial 1 October 2013
 #include "integer.h"
 #include "diskio.h"
 #include "ff.h"
+#include "sector_cache.h"
+#include "sd_spi_loc3_stm32.h"
 
 /* Project Includes */
+#include "power-management.h"
 #include "power-management-board-defs.h"
 #include "power-management-hardware.h"
 #include "power-management-objdic.h"
 #include "power-management-comms.h"
 #include "power-management-lib.h"
+#include "power-management-time.h"
 #include "power-management-file.h"
 
 /* Local Prototypes */
 static void initFile(void);
 static void parseFileCommand(char *line);
+static FRESULT readFileCommand(char *line, xQueueHandle replyQueue);
+static void prvFileReadTask(void *pvParameters);
+static void flushCache(void);
+static bool sendCommand(xQueueHandle queue, char command, uint8_t length,
+                        uint8_t *parameters);
 static uint8_t findFileHandle(void);
 static void deleteFileHandle(uint8_t fileHandle);
+static FRESULT makePath(char *path);
+static void rotateLog(void);
+static void growLogFile(void);
+static void prepareLogFile(uint32_t seconds);
+static void discardLogFile(void);
+static FRESULT trimFile(char *name);
+static void trimLogFiles(void);
+static void trimLogDay(uint32_t seconds);
+static FRESULT testCard(void);
+static uint32_t transferRate(portTickType start);
 
 /* FreeRTOS queues and intercommunication variables */
 xQueueHandle fileSendQueue, fileReceiveQueue;
 /* This semaphore must be used to protect messages until they have been queued
 in their entirety */
 xSemaphoreHandle fileSendSemaphore;
+/* Queues and semaphore for the file read task */
+xQueueHandle fileReadSendQueue, fileReadReceiveQueue;
+xSemaphoreHandle fileReadSemaphore;
 
 /* Local Variables */
 /* ChaN FAT */
 static FATFS Fatfs[_VOLUMES];
 static FATFS *fs;		            /* File system object for logical drive 0 */
 static FIL file[MAX_OPEN_FILES];    /* file descriptions, 2 files maximum. */
-static FILINFO fileInfo[MAX_OPEN_FILES];
+static char fileName[MAX_OPEN_FILES][FILE_NAME_SIZE];
 static bool fileUsable;
 static uint8_t filemap=0;           /* map of open file handles */
 static uint8_t writeFileHandle;
 static uint8_t readFileHandle;
+/* Log rotation */
+static FIL logFile;                 /* file description for housekeeping */
+static bool rotating;               /* write file is a log named by time */
+static uint32_t logDay;             /* day that the write file was started */
+static DWORD logAllocated;          /* size the write file is allocated up to */
+static char nextFileName[FILE_NAME_SIZE];
+static uint32_t nextFileDay;        /* day that the next file is named for */
+static char trimFileName[FILE_NAME_SIZE];
+/* Card self-test results */
+static FRESULT cardTestStatus;
+static uint32_t cardReadRate;       /* bytes per second */
+static uint32_t cardWriteRate;
+static uint32_t testBuffer[CARD_TEST_BLOCK/4];
 /*--------------------------------------------------------------------------*/
 /** @brief File Management Task
 
@@ -101,8 +151,10 @@ void prvFileTask( void *pvParameters )
     static char line[80];
     static uint8_t characterPosition = 0;
     static uint8_t lineLength = 2;
+    portTickType lastHousekeeping;
 
     initFile();
+    lastHousekeeping = xTaskGetTickCount();
 
     while (1)
     {
@@ -110,14 +162,24 @@ void prvFileTask( void *pvParameters )
 /** The first character is the command, followed by the total message length
 in bytes (which is the number of parameter bytes, if any, plus 2). */
         char character;
-        xQueueReceive(fileSendQueue,&character,portMAX_DELAY);
-        if (characterPosition == 1) lineLength = character;
-        line[characterPosition++] = character;
-        if (characterPosition >= lineLength)
+        if (xQueueReceive(fileSendQueue,&character,FILE_HOUSEKEEPING_PERIOD))
         {
-            line[characterPosition] = 0;
-            characterPosition = 0;
-            parseFileCommand(line);
+            if (characterPosition == 1) lineLength = character;
+            line[characterPosition++] = character;
+            if (characterPosition >= lineLength)
+            {
+                line[characterPosition] = 0;
+                characterPosition = 0;
+                parseFileCommand(line);
+            }
+        }
+/* Between commands, check periodically if the log is due to be rotated */
+        if ((characterPosition == 0) &&
+            ((xTaskGetTickCount() - lastHousekeeping) >= FILE_HOUSEKEEPING_PERIOD))
+        {
+            lastHousekeeping = xTaskGetTickCount();
+            rotateLog();
+            growLogFile();
         }
     }
 }
@@ -127,6 +189,11 @@ in bytes (which is the number of parameter bytes, if any, plus 2). */
 
 The FreeRTOS queue and semaphore are initialised. The file system work area is
 initialised.
+
+The card is tested for throughput and integrity. If data is corrupted the SPI
+clock is stepped down and the volume remounted until the test passes. Commands
+from other tasks wait in the queue meanwhile. The file read task is then
+started.
 */
 
 static void initFile(void)
@@ -135,6 +202,9 @@ static void initFile(void)
     fileSendQueue = xQueueCreate(FILE_QUEUE_SIZE,1);
     fileReceiveQueue = xQueueCreate(FILE_QUEUE_SIZE,1);
     vSemaphoreCreateBinary(fileSendSemaphore);
+    fileReadSendQueue = xQueueCreate(FILE_READ_QUEUE_SIZE,1);
+    fileReadReceiveQueue = xQueueCreate(FILE_READ_QUEUE_SIZE,1);
+    vSemaphoreCreateBinary(fileReadSemaphore);
 
 /* initialise the drive working area */
     FRESULT fileStatus = f_mount(&Fatfs[0],"",0);
@@ -144,8 +214,24 @@ static void initFile(void)
     writeFileHandle = 0xFF;
     readFileHandle = 0xFF;
     uint8_t i=0;
-    for (i=0; i<MAX_OPEN_FILES; i++) fileInfo[i].fname[0] = 0;
+    for (i=0; i<MAX_OPEN_FILES; i++) fileName[i][0] = 0;
     filemap = 0;
+    rotating = false;
+    nextFileName[0] = 0;
+    trimFileName[0] = 0;
+
+/* Test the card, stepping the SPI clock down until it transfers reliably */
+    cardTestStatus = testCard();
+    while ((cardTestStatus == FR_DISK_ERR) && sd_step_clock_down())
+    {
+        f_mount(&Fatfs[0],"",0);
+        cardTestStatus = testCard();
+    }
+    if (fileUsable) trimLogFiles();
+
+/* Start reading files for other tasks once the volume is settled */
+    xTaskCreate(prvFileReadTask, (portCHAR * ) "File Read", \
+                configMINIMAL_STACK_SIZE, NULL, FILE_READ_TASK_PRIORITY, NULL);
 }
 
 /*--------------------------------------------------------------------------*/
@@ -160,7 +246,10 @@ R - open a file for reading. Returns a file handle.
 C - close a file.
 S - store a block of data.
 G - retrieve a block of data.
+B - retrieve a block of data from a given position.
+K - size and checksum of a file.
 F - Free space on drive
+T - SPI clock and self-test throughput
 
 All commands return a status value at the end of any other data sent.
 
@@ -174,7 +263,9 @@ static void parseFileCommand(char *line)
     switch (line[0])
     {
 /* Open a file for read/write */
-/* Parameter is a filename, 8 character plus dot plus 3 character extension */
+/* Parameter is a path of up to FILE_NAME_SIZE-1 characters. Long names are
+allowed and any missing directories in the path are created. If the name is
+empty the file is named from the time as YYYY/MM/DD-HHMM and rotated. */
 /* Returns a file handle. On error file handle is 0xFF. */
         case 'W':
         {
@@ -190,8 +281,20 @@ static void parseFileCommand(char *line)
                     fileStatus = FR_TOO_MANY_OPEN_FILES;
                 else
                 {
+                    uint32_t seconds = getSecondsCount();
+                    rotating = (line[2] == 0);
+                    if (rotating)
+                    {
+                        putTimeToPath(line+2,seconds);
+                        stringAppend(line+2,LOG_FILE_EXTENSION);
+                        logDay = seconds/86400;
+                        logAllocated = 0;
+                    }
+/* Create the directories leading to the file, ignoring those that exist */
+                    fileStatus = makePath(line+2);
 /* Try to open a file write/read, creating it if necessary */
-                    fileStatus = f_open(&file[fileHandle], line+2, \
+                    if (fileStatus == FR_OK)
+                        fileStatus = f_open(&file[fileHandle], line+2, \
                                         FA_OPEN_ALWAYS | FA_READ | FA_WRITE);
 /* Skip to the end of the file to append. */
                     if (fileStatus == FR_OK)
@@ -203,14 +306,15 @@ static void parseFileCommand(char *line)
                     }
                     writeFileHandle = fileHandle;
                     if (fileStatus == FR_OK)
-                        fileStatus = f_stat(line+2, fileInfo+writeFileHandle);
+                        stringCopy(fileName[writeFileHandle],line+2);
+                    else rotating = false;
                 }
             }
           	xQueueSendToBack(fileReceiveQueue,&fileHandle,FILE_SEND_TIMEOUT);
             break;
         }
 /* Open a file read only. No check if the file is already opened. */
-/* Parameter is a filename, 8 character plus dot plus 3 character extension */
+/* Parameter is a path of up to FILE_NAME_SIZE-1 characters. */
 /* Returns a file handle */
         case 'R':
         {
@@ -236,7 +340,7 @@ static void parseFileCommand(char *line)
                     }
                     readFileHandle = fileHandle;
                     if (fileStatus == FR_OK)
-                        fileStatus = f_stat(line+2, fileInfo+readFileHandle);
+                        stringCopy(fileName[readFileHandle],line+2);
                 }
             }
           	xQueueSendToBack(fileReceiveQueue,&fileHandle,FILE_SEND_TIMEOUT);
@@ -257,16 +361,26 @@ static void parseFileCommand(char *line)
                 fileStatus = FR_INVALID_OBJECT;
                 break;
             }
-            if (writeFileHandle == fileHandle) writeFileHandle = 0xFF;
+            if (writeFileHandle == fileHandle)
+            {
+                writeFileHandle = 0xFF;
+/* Free any allocation beyond the end of the file, and drop an unused log */
+                if (f_lseek(&file[fileHandle],f_size(&file[fileHandle])) == FR_OK)
+                    f_truncate(&file[fileHandle]);
+                if (nextFileName[0] != 0) discardLogFile();
+                rotating = false;
+            }
             else if (readFileHandle == fileHandle) readFileHandle = 0xFF;
             else
             {
                 fileStatus = FR_INVALID_OBJECT;
                 break;
             }
-            fileInfo[fileHandle].fname[0] = 0;
+            fileName[fileHandle][0] = 0;
             deleteFileHandle(fileHandle);
             fileStatus = f_close(&file[fileHandle]);
+/* Make sure nothing is left in the sector cache if syncs are being deferred */
+            flushCache();
             fileHandle = 0xFF;
             break;
         }
@@ -295,28 +409,12 @@ is full. */
 /* Send a denied status if the disk fills. The caller probably won't use this. */
             break;
         }
-/* Get data from a file from the last position that data was read after opening. */
-/* Parameters are filehandle followed by the number of bytes to get.
-Returns the number read followed by binary byte-wise data. The number read will
-differ from the number requested if EOF reached. */
+/* Reads from the write file. Reads from the read file go to the read task. */
         case 'G':
-        {
-            uint8_t buffer[80];
-            uint8_t fileHandle = line[2];
-            uint8_t i = 0;
-            UINT length = line[3];
-            UINT numRead = 0;
-            if (length < 82)
-                fileStatus = f_read(&file[fileHandle],buffer,length,&numRead);
-            else fileStatus = FR_INVALID_PARAMETER;
-            if (uxQueueSpacesAvailable(fileReceiveQueue) >= numRead+1)
-            {
-                xQueueSendToBack(fileReceiveQueue,&numRead,FILE_SEND_TIMEOUT);
-                for (i=0; i<numRead; i++)
-                    xQueueSendToBack(fileReceiveQueue,buffer+i,FILE_SEND_TIMEOUT);
-            }
+        case 'B':
+        case 'K':
+            fileStatus = readFileCommand(line,fileReceiveQueue);
             break;
-        }
 /* Directory listing. */
 /* If the name is given, the directory specified is opened and the first entry
 returned. Subsequent calls with zero length name will return subsequent entries.
@@ -330,7 +428,8 @@ will be sent. */
             uint8_t i = 0;
             uint8_t numRead = 0;
             static DIR directory;
-            FILINFO fileInfo;
+/* Static as long file names make this too large for the task stack */
+            static FILINFO fileInfo;
             fileStatus = FR_OK;
             if (line[2] != 0) fileStatus = f_opendir(&directory, line+2);
             if (fileStatus == FR_OK)
@@ -388,6 +487,30 @@ first) and null terminated filename */
             }
             break;
         }
+/* Read the SD card clock and the throughput measured in the self-test. */
+/* No parameters. Returns the SPI clock, the clock rated by the card (Hz), the
+read and write rates (bytes per second) as 4 bytes each, lowest first. The
+status is the self-test result. */
+        case 'T':
+        {
+            uint32_t cardClock;
+            uint32_t values[4];
+            values[0] = sd_get_clock(&cardClock);
+            values[1] = cardClock;
+            values[2] = cardReadRate;
+            values[3] = cardWriteRate;
+            uint8_t i;
+            if (uxQueueSpacesAvailable(fileReceiveQueue) >= 17)
+            {
+                for (i=0; i<16; i++)
+                {
+                    uint8_t wordBuf = (values[i >> 2] >> 8*(i & 3)) & 0xFF;
+                    xQueueSendToBack(fileReceiveQueue,&wordBuf,FILE_SEND_TIMEOUT);
+                }
+            }
+            fileStatus = cardTestStatus;
+            break;
+        }
 /* Return the file handles and names of open write and read files. */
         case 'S':
         {
@@ -398,7 +521,7 @@ first) and null terminated filename */
                 uint8_t i=0;
                 do
                 {
-                    writeNameChar = fileInfo[writeFileHandle].fname+i;
+                    writeNameChar = fileName[writeFileHandle]+i;
                     xQueueSendToBack(fileReceiveQueue,writeNameChar,FILE_SEND_TIMEOUT);
                     i++;
                 }
@@ -411,7 +534,7 @@ first) and null terminated filename */
                 uint8_t i=0;
                 do
                 {
-                    readNameChar = fileInfo[readFileHandle].fname+i;
+                    readNameChar = fileName[readFileHandle]+i;
                     xQueueSendToBack(fileReceiveQueue,readNameChar,FILE_SEND_TIMEOUT);
                     i++;
                 }
@@ -425,9 +548,9 @@ Checks the filename and handle for the write and read files, if they are open. *
         case 'X':
         {
             if (! ((writeFileHandle < 0xFF) &&
-                stringEqual((char*)line+2, fileInfo[writeFileHandle].fname)) &&
+                stringEqual((char*)line+2, fileName[writeFileHandle])) &&
                 ! ((readFileHandle < 0xFF) &&
-                stringEqual((char*)line+2, fileInfo[readFileHandle].fname)))
+                stringEqual((char*)line+2, fileName[readFileHandle])))
             {
                 fileStatus = f_unlink(line+2);
             }
@@ -443,8 +566,13 @@ Checks the filename and handle for the write and read files, if they are open. *
             writeFileHandle = 0xFF;
             readFileHandle = 0xFF;
             uint8_t i=0;
-            for (i=0; i<MAX_OPEN_FILES; i++) fileInfo[i].fname[0] = 0;
+            for (i=0; i<MAX_OPEN_FILES; i++) fileName[i][0] = 0;
             filemap = 0;
+            rotating = false;
+            nextFileName[0] = 0;
+            trimFileName[0] = 0;
+/* Free allocation left in logs by the last use of the card */
+            if (fileUsable) trimLogFiles();
             break;
         }
     }
@@ -452,6 +580,199 @@ Checks the filename and handle for the write and read files, if they are open. *
     xQueueSendToBack(fileReceiveQueue,&fileStatus,FILE_SEND_TIMEOUT);
 }
 
+/*--------------------------------------------------------------------------*/
+/** @brief File Read Task
+
+This serves reads of the read file for other tasks in the same way as the file
+task, through its own queues. It runs at a lower priority than the file task.
+Each FatFs call reads no more than a sector, so the file task (recording) gets
+the volume within a sector transfer of asking for it.
+*/
+
+static void prvFileReadTask(void *pvParameters)
+{
+    pvParameters = pvParameters;
+    static char line[16];
+    static uint8_t characterPosition = 0;
+    static uint8_t lineLength = 2;
+
+    while (1)
+    {
+/* Build a command line before actioning, as for the file task */
+        char character;
+        xQueueReceive(fileReadSendQueue,&character,portMAX_DELAY);
+        if (characterPosition == 1) lineLength = character;
+        if (characterPosition < sizeof(line)) line[characterPosition] = character;
+        characterPosition++;
+        if (characterPosition >= lineLength)
+        {
+            uint8_t fileStatus = FR_INVALID_PARAMETER;
+            if (characterPosition < sizeof(line))
+            {
+                line[characterPosition] = 0;
+                fileStatus = readFileCommand(line,fileReadReceiveQueue);
+            }
+            characterPosition = 0;
+/* Return the file status */
+            xQueueSendToBack(fileReadReceiveQueue,&fileStatus,FILE_SEND_TIMEOUT);
+        }
+    }
+}
+
+/*--------------------------------------------------------------------------*/
+/** @brief Act on a File Read Command
+
+Reads for the G, B and K commands, with data returned to the given queue. The
+caller sends the status.
+
+@param[in] line: char* the command line
+@param[in] replyQueue: xQueueHandle queue for the data returned.
+@returns FRESULT status of the read.
+*/
+
+static FRESULT readFileCommand(char *line, xQueueHandle replyQueue)
+{
+    FRESULT fileStatus = FR_INVALID_PARAMETER;
+
+    switch (line[0])
+    {
+/* Get data from a file from the last position that data was read after opening. */
+/* Parameters are filehandle followed by the number of bytes to get.
+Returns the number read followed by binary byte-wise data. The number read will
+differ from the number requested if EOF reached. */
+        case 'G':
+        {
+            uint8_t buffer[80];
+            uint8_t fileHandle = line[2];
+            uint8_t i = 0;
+            UINT length = line[3];
+            UINT numRead = 0;
+            if (length < 82)
+                fileStatus = f_read(&file[fileHandle],buffer,length,&numRead);
+            else fileStatus = FR_INVALID_PARAMETER;
+            if (uxQueueSpacesAvailable(replyQueue) >= numRead+1)
+            {
+                xQueueSendToBack(replyQueue,&numRead,FILE_SEND_TIMEOUT);
+                for (i=0; i<numRead; i++)
+                    xQueueSendToBack(replyQueue,buffer+i,FILE_SEND_TIMEOUT);
+            }
+            break;
+        }
+/* Get a block of data from a file at a given position. */
+/* Parameters are filehandle, four bytes of file offset (MSB first) and the
+number of bytes to get. The file position is moved to the offset before reading
+so that blocks can be requested in any order.
+Returns the number read followed by binary byte-wise data. The number read will
+differ from the number requested if EOF reached. */
+        case 'B':
+        {
+            uint8_t buffer[80];
+            uint8_t fileHandle = line[2];
+            uint8_t i = 0;
+            DWORD offset = ((DWORD)(uint8_t)line[3] << 24) |
+                           ((DWORD)(uint8_t)line[4] << 16) |
+                           ((DWORD)(uint8_t)line[5] << 8) |
+                            (DWORD)(uint8_t)line[6];
+            UINT length = line[7];
+            UINT numRead = 0;
+            if ((fileHandle >= MAX_OPEN_FILES) || (line[1] != 8))
+                fileStatus = FR_INVALID_PARAMETER;
+            else if (length < 81)
+            {
+                fileStatus = f_lseek(&file[fileHandle],offset);
+                if (fileStatus == FR_OK)
+                    fileStatus = f_read(&file[fileHandle],buffer,length,&numRead);
+            }
+            else fileStatus = FR_INVALID_PARAMETER;
+            if (uxQueueSpacesAvailable(replyQueue) >= numRead+2)
+            {
+                xQueueSendToBack(replyQueue,&numRead,FILE_SEND_TIMEOUT);
+                for (i=0; i<numRead; i++)
+                    xQueueSendToBack(replyQueue,buffer+i,FILE_SEND_TIMEOUT);
+            }
+            break;
+        }
+/* Compute the size and CRC-32 checksum of a file. */
+/* Parameters are filehandle and four bytes of length (MSB first). A length of
+zero, or greater than the file size, means the whole file. The file position is
+restored afterwards. Returns four bytes of length then four bytes of checksum,
+both MSB first. */
+        case 'K':
+        {
+            uint8_t buffer[64];
+            uint8_t fileHandle = line[2];
+            uint8_t i = 0;
+            DWORD length = ((DWORD)(uint8_t)line[3] << 24) |
+                           ((DWORD)(uint8_t)line[4] << 16) |
+                           ((DWORD)(uint8_t)line[5] << 8) |
+                            (DWORD)(uint8_t)line[6];
+            uint32_t crc = 0xFFFFFFFF;
+            if ((fileHandle >= MAX_OPEN_FILES) || (line[1] != 7))
+            {
+                fileStatus = FR_INVALID_PARAMETER;
+                length = 0;
+            }
+            else
+            {
+                DWORD position = f_tell(&file[fileHandle]);
+                DWORD remaining;
+                if ((length == 0) || (length > f_size(&file[fileHandle])))
+                    length = f_size(&file[fileHandle]);
+                remaining = length;
+                fileStatus = f_lseek(&file[fileHandle],0);
+                while ((fileStatus == FR_OK) && (remaining > 0))
+                {
+                    UINT blockLength = sizeof(buffer);
+                    UINT numRead = 0;
+                    if (remaining < blockLength) blockLength = remaining;
+                    fileStatus = f_read(&file[fileHandle],buffer,blockLength,&numRead);
+                    if (numRead == 0) break;
+                    crc = crc32Update(crc,buffer,numRead);
+                    remaining -= numRead;
+                }
+                length -= remaining;
+                f_lseek(&file[fileHandle],position);
+            }
+            crc ^= 0xFFFFFFFF;
+            if (uxQueueSpacesAvailable(replyQueue) >= 9)
+            {
+                for (i=0; i<4; i++)
+                {
+                    uint8_t wordBuf = (length >> (24-8*i)) & 0xFF;
+                    xQueueSendToBack(replyQueue,&wordBuf,FILE_SEND_TIMEOUT);
+                }
+                for (i=0; i<4; i++)
+                {
+                    uint8_t wordBuf = (crc >> (24-8*i)) & 0xFF;
+                    xQueueSendToBack(replyQueue,&wordBuf,FILE_SEND_TIMEOUT);
+                }
+            }
+            break;
+        }
+    }
+    return fileStatus;
+}
+
+/*--------------------------------------------------------------------------*/
+/** @brief Flush the Sector Cache
+
+The volume is locked as for a FatFs call, since the read task may be using the
+card. Nothing is done if the cache is disabled.
+*/
+
+static void flushCache(void)
+{
+#if _SECTOR_CACHE > 0
+#if _FS_REENTRANT
+    if (! ff_req_grant(Fatfs[0].sobj)) return;
+#endif
+    disk_ioctl(0,CTRL_CACHE_FLUSH,0);
+#if _FS_REENTRANT
+    ff_rel_grant(Fatfs[0].sobj);
+#endif
+#endif
+}
+
 /*--------------------------------------------------------------------------*/
 /** @brief Find a file handle
 
@@ -492,6 +813,357 @@ static void deleteFileHandle(uint8_t fileHandle)
         filemap &= ~(1 << fileHandle);
 }
 
+/*--------------------------------------------------------------------------*/
+/** @brief Create the Directories in a Path
+
+Each directory named in the path is created in turn if it does not exist. The
+last component is taken as the file name and is not created. The path is
+terminated temporarily at each separator.
+
+@param[in] path: char* path to a file.
+@returns FRESULT FR_OK if all directories exist, otherwise the f_mkdir error.
+*/
+
+static FRESULT makePath(char *path)
+{
+    FRESULT fileStatus = FR_OK;
+    uint8_t i;
+    for (i=1; path[i] != 0; i++)
+    {
+        if (path[i] == '/')
+        {
+            path[i] = 0;
+            fileStatus = f_mkdir(path);
+            path[i] = '/';
+            if (fileStatus == FR_EXIST) fileStatus = FR_OK;
+            if (fileStatus != FR_OK) break;
+        }
+    }
+    return fileStatus;
+}
+
+/*--------------------------------------------------------------------------*/
+/** @brief Rotate the Log File
+
+Called by the file task between commands. A write file named by the firmware
+is changed to a new file when the day changes or it reaches LOG_ROTATE_SIZE.
+
+The next file is prepared when the change is within LOG_ROTATE_LEAD seconds of
+midnight or LOG_ROTATE_SIZE_LEAD bytes of the size limit. At the change the old
+file is closed and the prepared one opened in the same file handle, so the
+handle held by other tasks stays valid. Records are synced as they are written
+so nothing is pending at the close. The allocation left over in the old file is
+freed at the next call.
+
+A file prepared for midnight is only used at midnight, and one prepared for
+the size limit only on the same day. At the change a prepared file named for
+another day is discarded and the next file prepared again for the current time.
+
+If the next file cannot be prepared the change waits and is tried again at
+each call, so the old file keeps growing past LOG_ROTATE_SIZE until a new file
+can be made. If the new file cannot be opened the old one is reopened.
+*/
+
+static void rotateLog(void)
+{
+    uint8_t fileHandle = writeFileHandle;
+    if (trimFileName[0] != 0)
+    {
+        trimFile(trimFileName);
+        trimFileName[0] = 0;
+        return;
+    }
+    if (! rotating || (fileHandle >= MAX_OPEN_FILES)) return;
+    uint32_t seconds = getSecondsCount();
+    uint32_t toMidnight = 86400 - (seconds % 86400);
+    DWORD size = f_size(&file[fileHandle]);
+    bool due = ((seconds/86400) != logDay) || (size >= LOG_ROTATE_SIZE);
+/* Create the next file ahead, named for midnight if that comes first */
+    if ((nextFileName[0] == 0) &&
+        (due || (toMidnight <= LOG_ROTATE_LEAD) ||
+         (size + LOG_ROTATE_SIZE_LEAD >= LOG_ROTATE_SIZE)))
+    {
+        if (due || (size + LOG_ROTATE_SIZE_LEAD >= LOG_ROTATE_SIZE))
+            prepareLogFile(seconds);
+        else prepareLogFile(seconds + toMidnight);
+    }
+/* A file prepared for the other kind of change is named for the wrong day */
+    if (due && (nextFileName[0] != 0) && (nextFileDay != seconds/86400))
+    {
+        discardLogFile();
+        prepareLogFile(seconds);
+    }
+    if (! due || (nextFileName[0] == 0)) return;
+    f_close(&file[fileHandle]);
+    FRESULT fileStatus = f_open(&file[fileHandle], nextFileName, \
+                                FA_OPEN_ALWAYS | FA_READ | FA_WRITE);
+    if (fileStatus == FR_OK)
+        fileStatus = f_lseek(&file[fileHandle], f_size(&file[fileHandle]));
+    if (fileStatus == FR_OK)
+    {
+        stringCopy(trimFileName,fileName[fileHandle]);
+        stringCopy(fileName[fileHandle],nextFileName);
+        logDay = seconds/86400;
+        logAllocated = LOG_GROW_SIZE;
+    }
+/* Carry on with the old file. The next file will be prepared again. */
+    else if ((f_open(&file[fileHandle], fileName[fileHandle], \
+                     FA_OPEN_ALWAYS | FA_READ | FA_WRITE) != FR_OK) ||
+             (f_lseek(&file[fileHandle], f_size(&file[fileHandle])) != FR_OK))
+    {
+        deleteFileHandle(fileHandle);
+        fileName[fileHandle][0] = 0;
+        writeFileHandle = 0xFF;
+        rotating = false;
+    }
+    nextFileName[0] = 0;
+    flushCache();
+}
+
+/*--------------------------------------------------------------------------*/
+/** @brief Allocate Clusters to the Log File ahead of the Records
+
+Called by the file task between commands. When the records come within half of
+LOG_GROW_SIZE of the end of the allocation, a contiguous chunk of LOG_GROW_SIZE
+is added to the end of the file's cluster chain without changing its size.
+Records then fill it without searching the FAT for free clusters. The search
+for the chunk starts after the last cluster of the file, so on a volume filled
+in order it holds up recording for a few FAT sector reads.
+
+If no contiguous chunk is found the records allocate clusters as they are
+written, and the next try is made a chunk later. The file has at most two
+chunks beyond its end, which are freed by trimLogFiles if they are left by a
+reset.
+*/
+
+static void growLogFile(void)
+{
+    uint8_t fileHandle = writeFileHandle;
+    if (! rotating || (fileHandle >= MAX_OPEN_FILES)) return;
+    DWORD size = f_size(&file[fileHandle]);
+    if (size > logAllocated) logAllocated = size;
+    if (size + LOG_GROW_SIZE/2 < logAllocated) return;
+    f_expand(&file[fileHandle], LOG_GROW_SIZE, 2);
+    logAllocated += LOG_GROW_SIZE;
+}
+
+/*--------------------------------------------------------------------------*/
+/** @brief Prepare the Next Log File
+
+The file is created with its directories and a contiguous chunk of
+LOG_GROW_SIZE is allocated to it while keeping the size at zero, so that the
+first records written after the change do not search the FAT. If no contiguous
+chunk is available the file is left empty. The name is kept in nextFileName,
+which is left empty on failure so that it is tried again.
+
+@param[in] seconds: uint32_t time used to name the file.
+*/
+
+static void prepareLogFile(uint32_t seconds)
+{
+    static char name[FILE_NAME_SIZE];
+    putTimeToPath(name,seconds);
+    stringAppend(name,LOG_FILE_EXTENSION);
+/* A size change within the minute the file was started gives the same name */
+    if (stringEqual(name,fileName[writeFileHandle])) return;
+    FRESULT fileStatus = makePath(name);
+    if (fileStatus == FR_OK)
+        fileStatus = f_open(&logFile, name, FA_OPEN_ALWAYS | FA_WRITE);
+    if (fileStatus != FR_OK) return;
+    if (f_size(&logFile) == 0) f_expand(&logFile, LOG_GROW_SIZE, 2);
+    if (f_close(&logFile) == FR_OK)
+    {
+        stringCopy(nextFileName,name);
+        nextFileDay = seconds/86400;
+    }
+}
+
+/*--------------------------------------------------------------------------*/
+/** @brief Discard the Prepared Log File
+
+The file is deleted if nothing has been written to it, which leaves a file of
+the same name that already held records in place.
+*/
+
+static void discardLogFile(void)
+{
+    if (f_open(&logFile, nextFileName, FA_OPEN_EXISTING | FA_READ) == FR_OK)
+    {
+        bool empty = (f_size(&logFile) == 0);
+        f_close(&logFile);
+        if (empty) f_unlink(nextFileName);
+    }
+    nextFileName[0] = 0;
+}
+
+/*--------------------------------------------------------------------------*/
+/** @brief Free the Unused Allocation of a File
+
+@param[in] name: char* path of a closed file.
+@returns FRESULT status of the operation.
+*/
+
+static FRESULT trimFile(char *name)
+{
+    FRESULT fileStatus = f_open(&logFile, name, FA_OPEN_EXISTING | FA_WRITE);
+    if (fileStatus != FR_OK) return fileStatus;
+    fileStatus = f_lseek(&logFile, f_size(&logFile));
+    if (fileStatus == FR_OK) fileStatus = f_truncate(&logFile);
+    f_close(&logFile);
+    flushCache();
+    return fileStatus;
+}
+
+/*--------------------------------------------------------------------------*/
+/** @brief Free the Unused Allocation of Recent Logs
+
+A reset, or a card change, can leave the write file and the prepared file with
+clusters allocated beyond their end, which would otherwise be lost. All logs of
+the day before, the day of and the day after the current time are trimmed,
+which covers both files. Files with nothing beyond their end are not modified.
+*/
+
+static void trimLogFiles(void)
+{
+    uint32_t seconds = getSecondsCount();
+    trimLogDay(seconds - 86400);
+    trimLogDay(seconds);
+    trimLogDay(seconds + 86400);
+}
+
+/*--------------------------------------------------------------------------*/
+/** @brief Free the Unused Allocation of the Logs of a Day
+
+The logs of a day are the DD-HHMM files in its YYYY/MM directory.
+
+@param[in] seconds: uint32_t time in the day.
+*/
+
+static void trimLogDay(uint32_t seconds)
+{
+    static DIR directory;
+/* Static as long file names make this too large for the task stack */
+    static FILINFO fileInfo;
+    static char path[FILE_NAME_SIZE];
+    char day[3];
+    putTimeToPath(path,seconds);
+    day[0] = path[8];
+    day[1] = path[9];
+    day[2] = path[10];
+    path[7] = 0;
+    if (f_opendir(&directory, path) != FR_OK) return;
+    path[7] = '/';
+    uint16_t extensionLength = stringLength(LOG_FILE_EXTENSION);
+    while ((f_readdir(&directory, &fileInfo) == FR_OK) &&
+           (fileInfo.fname[0] != 0))
+    {
+        uint16_t nameLength = stringLength(fileInfo.fname);
+        if ((fileInfo.fattrib & AM_DIR) || (nameLength < extensionLength) ||
+            (nameLength + 8 >= FILE_NAME_SIZE) ||
+            (fileInfo.fname[0] != day[0]) || (fileInfo.fname[1] != day[1]) ||
+            (fileInfo.fname[2] != day[2]) ||
+            ! stringEqual(fileInfo.fname+nameLength-extensionLength,
+                          LOG_FILE_EXTENSION))
+            continue;
+        path[8] = 0;
+        stringAppend(path,fileInfo.fname);
+        trimFile(path);
+    }
+    f_closedir(&directory);
+}
+
+/*--------------------------------------------------------------------------*/
+/** @brief Card Self-Test
+
+A test file is written sequentially, read back and verified, and deleted. The
+blocks are multiples of the sector size so that FatFs transfers them directly
+with multiple block commands, bypassing the sector cache. The words written
+differ throughout the file so that misplaced blocks are also detected.
+
+Data read back incorrectly, or CRC errors corrected by the driver during the
+test, give FR_DISK_ERR as does a failure to transfer. Other errors (no card,
+write protected, disk full) are returned as they occur.
+
+This uses the first file object and must be done before files are opened.
+
+@returns FRESULT test status.
+*/
+
+static FRESULT testCard(void)
+{
+    FIL *testFile = &file[0];
+    struct sdErrorCounts before, after;
+    uint32_t offset;
+    uint16_t i;
+    UINT count;
+    portTickType start;
+
+    cardReadRate = 0;
+    cardWriteRate = 0;
+    sd_get_error_counts(&before);
+    FRESULT status = f_open(testFile, CARD_TEST_FILE, \
+                            FA_CREATE_ALWAYS | FA_READ | FA_WRITE);
+    if (status != FR_OK) return status;
+
+/* Write and time */
+    start = xTaskGetTickCount();
+    for (offset = 0; (offset < CARD_TEST_SIZE) && (status == FR_OK);
+         offset += CARD_TEST_BLOCK)
+    {
+        for (i = 0; i < CARD_TEST_BLOCK/4; i++)
+            testBuffer[i] = (offset/4 + i) * 0x9E3779B1;
+        status = f_write(testFile, testBuffer, CARD_TEST_BLOCK, &count);
+        if ((status == FR_OK) && (count != CARD_TEST_BLOCK)) status = FR_DENIED;
+    }
+    if (status == FR_OK) status = f_sync(testFile);
+/* Include FAT and directory sectors held in the sector cache */
+    if (status == FR_OK) flushCache();
+    if (status == FR_OK) cardWriteRate = transferRate(start);
+
+/* Read back, verify and time */
+    if (status == FR_OK) status = f_lseek(testFile, 0);
+    start = xTaskGetTickCount();
+    for (offset = 0; (offset < CARD_TEST_SIZE) && (status == FR_OK);
+         offset += CARD_TEST_BLOCK)
+    {
+        status = f_read(testFile, testBuffer, CARD_TEST_BLOCK, &count);
+        if ((status == FR_OK) && (count != CARD_TEST_BLOCK)) status = FR_DISK_ERR;
+        for (i = 0; (i < CARD_TEST_BLOCK/4) && (status == FR_OK); i++)
+            if (testBuffer[i] != (offset/4 + i) * 0x9E3779B1) status = FR_DISK_ERR;
+    }
+    if (status == FR_OK) cardReadRate = transferRate(start);
+
+    f_close(testFile);
+    f_unlink(CARD_TEST_FILE);
+    flushCache();
+
+/* Corrected errors mean the clock is marginal */
+    sd_get_error_counts(&after);
+    if ((status == FR_OK) &&
+        ((after.crcReadErrors != before.crcReadErrors) ||
+         (after.crcWriteErrors != before.crcWriteErrors))) status = FR_DISK_ERR;
+    if (status != FR_OK)
+    {
+        cardReadRate = 0;
+        cardWriteRate = 0;
+    }
+    return status;
+}
+
+/*--------------------------------------------------------------------------*/
+/** @brief Transfer Rate of the Card Self-Test
+
+@param[in] start: portTickType tick count at the start of the transfer.
+@returns uint32_t bytes per second.
+*/
+
+static uint32_t transferRate(portTickType start)
+{
+    uint32_t time = (xTaskGetTickCount() - start)*portTICK_RATE_MS;
+    if (time == 0) time = 1;
+    return (CARD_TEST_SIZE*1000)/time;
+}
+
 /*--------------------------------------------------------------------------*/
 /** @brief Record a Data Record with One Integer Parameter
 
@@ -639,17 +1311,50 @@ in the queue.
 */
 
 bool sendFileCommand(char command, uint8_t length, uint8_t *parameters)
+{
+    return sendCommand(fileSendQueue,command,length,parameters);
+}
+
+/*--------------------------------------------------------------------------*/
+/** @brief Send a Command to the File Read Task
+
+As for sendFileCommand, for the G, B and K commands on the read file. The
+caller must hold fileReadSemaphore and take the reply from fileReadReceiveQueue.
+
+@param[in] command: char command to send
+@param[in] length: uint8_t length of parameter list
+@param[in] parameters: uint8_t* pointer to list of parameters
+@returns bool true if the command was successfully sent.
+*/
+
+bool sendFileReadCommand(char command, uint8_t length, uint8_t *parameters)
+{
+    return sendCommand(fileReadSendQueue,command,length,parameters);
+}
+
+/*--------------------------------------------------------------------------*/
+/** @brief Send a Command to a File Queue
+
+@param[in] queue: xQueueHandle command queue of the task
+@param[in] command: char command to send
+@param[in] length: uint8_t length of parameter list
+@param[in] parameters: uint8_t* pointer to list of parameters
+@returns bool true if the command was successfully sent.
+*/
+
+static bool sendCommand(xQueueHandle queue, char command, uint8_t length,
+                        uint8_t *parameters)
 {
     uint8_t i;
     uint8_t totalLength = length+2;
-    if (uxQueueSpacesAvailable(fileSendQueue) >= totalLength)
+    if (uxQueueSpacesAvailable(queue) >= totalLength)
     {
-        if (! xQueueSendToBack(fileSendQueue,&command,FILE_SEND_TIMEOUT))
+        if (! xQueueSendToBack(queue,&command,FILE_SEND_TIMEOUT))
             return false;
-        if (! xQueueSendToBack(fileSendQueue,&totalLength,FILE_SEND_TIMEOUT))
+        if (! xQueueSendToBack(queue,&totalLength,FILE_SEND_TIMEOUT))
             return false;
         for (i=0; i<length; i++)
-            if (! xQueueSendToBack(fileSendQueue,parameters+i,FILE_SEND_TIMEOUT))
+            if (! xQueueSendToBack(queue,parameters+i,FILE_SEND_TIMEOUT))
                 return false;
     }
     return true;
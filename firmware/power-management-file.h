@@ -29,9 +29,27 @@ Initial 1 October 2013
 #define POWER_MANAGEMENT_FILE_H_
 
 #define FILE_QUEUE_SIZE             256
+#define FILE_READ_QUEUE_SIZE        128
 #define FILE_SEND_TIMEOUT          ((portTickType)2000/portTICK_RATE_MS)
 
 #define MAX_OPEN_FILES              2
+/* Longest path accepted, with its terminator. Logs are named YYYY/MM/DD-HHMM */
+#define FILE_NAME_SIZE              32
+#define LOG_FILE_EXTENSION          ".TXT"
+
+/* Rotation of logs named by the firmware, at midnight or when the size is
+reached. The next file is created ahead of the change. Clusters are allocated
+to the log in chunks of LOG_GROW_SIZE between records. */
+#define LOG_ROTATE_SIZE             4194304
+#define LOG_ROTATE_SIZE_LEAD        16384
+#define LOG_ROTATE_LEAD             300
+#define LOG_GROW_SIZE               32768
+#define FILE_HOUSEKEEPING_PERIOD    ((portTickType)1000/portTICK_RATE_MS)
+
+/* Card self-test file, written and deleted at startup */
+#define CARD_TEST_FILE              "SDTEST.TMP"
+#define CARD_TEST_SIZE              32768
+#define CARD_TEST_BLOCK             1024
 
 /*--------------------------------------------------------------------------*/
 /* Prototypes */
@@ -41,6 +59,7 @@ uint8_t recordString(char* ident, char* string);
 uint8_t recordDual(char* ident, int32_t param1, int32_t param2);
 uint8_t recordSingle(char* ident, int32_t param1);
 bool sendFileCommand(char command, uint8_t length, uint8_t *parameters);
+bool sendFileReadCommand(char command, uint8_t length, uint8_t *parameters);
 
 #endif
 
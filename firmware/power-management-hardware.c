@@ -47,6 +47,7 @@ so must be commented out for normal use. */
 
 #include "power-management-board-defs.h"
 #include "power-management-hardware.h"
+#include "power-management-transmit.h"
 
 /* libopencm3 driver includes */
 #include <libopencm3/stm32/iwdg.h>
@@ -88,7 +89,7 @@ static uint8_t adceoc;          /* A/D end of conversion flag */
 static uint32_t lostCharacters; /* Number of characters lost due to queue full */
 
 /* FreeRTOS queues and intercommunication variables defined in Comms */
-extern xQueueHandle commsSendQueue, commsReceiveQueue, commsEmptySemaphore;
+extern xQueueHandle commsReceiveQueue;
 
 /* Time variables needed when systick is the timer */
 static uint32_t secondsCount;
@@ -758,16 +759,11 @@ void usart1_isr(void)
 /* Check if we were called because of TXE. */
     if (usart_get_flag(USART1,USART_SR_TXE))
     {
-/* If the queue is empty, disable the tx interrupt until something is sent. */
+/* If nothing is waiting, disable the tx interrupt until something is sent. */
         char data;
-        if (xQueueReceiveFromISR(commsSendQueue,&data,NULL))
+        if (transmitNextCharacter(&data))
             usart_send(USART1, data);
-        else
-        {
-            int32_t wokenTask;
-            usart_disable_tx_interrupt(USART1);
-            xSemaphoreGiveFromISR(commsEmptySemaphore,&wokenTask);    /* Flag as empty */
-        }
+        else usart_disable_tx_interrupt(USART1);
     }
 }
 
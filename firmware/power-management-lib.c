@@ -53,6 +53,28 @@ int32_t asciiToInt(char* buffer)
     return number;
 }
 /*--------------------------------------------------------------------------*/
+/** @brief Convert an ASCII hexadecimal string to an unsigned integer
+
+Conversion stops at the first character that is not a hex digit (either case).
+
+@param[in] buffer: char* externally defined buffer with the string.
+@returns uint32_t: integer value.
+*/
+
+uint32_t asciiHexToInt(char* buffer)
+{
+    uint32_t number = 0;
+    while (1)
+    {
+        char digit = *buffer++;
+        if ((digit >= '0') && (digit <= '9')) number = (number << 4) + (digit - '0');
+        else if ((digit >= 'A') && (digit <= 'F')) number = (number << 4) + (digit - 'A' + 10);
+        else if ((digit >= 'a') && (digit <= 'f')) number = (number << 4) + (digit - 'a' + 10);
+        else break;
+    }
+    return number;
+}
+/*--------------------------------------------------------------------------*/
 /** @brief Convert an Integer to ASCII decimal form
 
 @param[in] value: int32_t integer value to be converted to ASCII form.
@@ -156,5 +178,35 @@ uint16_t stringEqual(char* string1,char* string2)
     return 1;
 }
 
+/*--------------------------------------------------------------------------*/
+/** @brief Update a CRC-32 Checksum
+
+The standard reflected CRC-32 (polynomial 0xEDB88320) is computed bitwise to
+avoid a 1K lookup table. The checksum must be initialised to 0xFFFFFFFF and the
+final value inverted by the caller, so that a checksum can be accumulated over
+a number of blocks.
+
+@param[in] crc: uint32_t checksum accumulated so far.
+@param[in] data: uint8_t* block of data to add to the checksum.
+@param[in] length: uint16_t number of bytes in the block.
+@returns uint32_t: updated checksum.
+*/
+
+uint32_t crc32Update(uint32_t crc, uint8_t* data, uint16_t length)
+{
+    uint16_t i;
+    uint8_t bit;
+    for (i=0; i<length; i++)
+    {
+        crc ^= data[i];
+        for (bit=0; bit<8; bit++)
+        {
+            if (crc & 1) crc = (crc >> 1) ^ 0xEDB88320;
+            else crc >>= 1;
+        }
+    }
+    return crc;
+}
+
 /**@}*/
 
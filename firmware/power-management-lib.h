@@ -31,10 +31,12 @@ Initial 30 November 2013
 
 void intToAscii(int32_t value, char* buffer);
 int32_t asciiToInt(char* buffer);
+uint32_t asciiHexToInt(char* buffer);
 void stringAppend(char* string, char* appendage);
 void stringCopy(char* string, char* original);
 uint16_t stringLength(char* string);
 uint16_t stringEqual(char* string1,char* string2);
+uint32_t crc32Update(uint32_t crc, uint8_t* data, uint16_t length);
 
 #endif
 
@@ -68,10 +68,14 @@ Updated 15 November 2016
 #include "power-management-time.h"
 #include "power-management-file.h"
 #include "power-management-comms.h"
+#include "power-management-transmit.h"
 #include "power-management-measurement.h"
 #include "power-management-charger.h"
 #include "power-management-monitor.h"
 
+/* ChaN FAT card driver for error counts */
+#include "sd_spi_loc3_stm32.h"
+
 /*--------------------------------------------------------------------------*/
 /* Local Prototypes */
 static void initGlobals(void);
@@ -95,6 +99,8 @@ static union InterfaceGroup voltages;
 static uint8_t batteryUnderCharge;
 static uint8_t batteryUnderLoad;
 static bool chargerOff;                 /* At night the charger is disabled */
+static uint32_t cardErrorsSent;         /* CRC errors and failures last sent */
+static uint32_t transmitDropsSent;      /* Messages dropped last sent */
 
 /*--------------------------------------------------------------------------*/
 /** @brief <b>Monitoring Task</b>
@@ -323,6 +329,29 @@ via the File module, and transmitted via the Communications module. */
 /* Read the interface fault indicators and send out */
         sendResponseLowPriority("dI",getIndicators());
         recordSingle("dI",getIndicators());
+/* Send the memory card CRC error and failed transfer counts when they change.
+These are not recorded as they describe the recording medium itself. */
+        struct sdErrorCounts cardErrors;
+        sd_get_error_counts(&cardErrors);
+        uint32_t crcErrors = cardErrors.crcReadErrors+cardErrors.crcWriteErrors;
+        if (crcErrors+cardErrors.failures != cardErrorsSent)
+        {
+            dataMessageSendLowPriority("dR",crcErrors,cardErrors.failures);
+            cardErrorsSent = crcErrors+cardErrors.failures;
+        }
+
+/* Send the count of messages dropped by the transmit scheduler when it
+changes, along with the count of telemetry replaced by newer values before it
+was sent. Replacement is expected on a slow link and would otherwise have dX
+sent every cycle, adding to the traffic it reports. */
+        uint32_t transmitDrops = 0;
+        for (i=0; i<TRANSMIT_CLASSES; i++)
+            transmitDrops += getTransmitDrops((transmit_Class)i);
+        if (transmitDrops != transmitDropsSent)
+        {
+            transmitDropsSent = transmitDrops;
+            dataMessageSendLowPriority("dX",transmitDrops,getTransmitReplaced());
+        }
 
 /*------------- COMPUTE BATTERY STATE -----------------------*/
 /**
@@ -931,6 +960,8 @@ allow other batteries to pass to the isolation state. */
 static void initGlobals(void)
 {
     calibrate = false;
+    cardErrorsSent = 0;
+    transmitDropsSent = 0;
     uint8_t i=0;
     for (i=0; i<NUM_BATS; i++)
     {
@@ -32,14 +32,74 @@ Note these definitions cannot be placed in the header file.
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
 
 #include "FreeRTOS.h"
+#include "task.h"
 #include "power-management-objdic.h"
 #include "power-management-hardware.h"
 
 /* Byte pattern that indicates if a valid NVM config data block is present */
 #define VALID_BLOCK                 0xD5
 
+/* Fields of struct Config in the order of a configuration snapshot, with
+their size in the structure and in the snapshot. The sizes differ for enums,
+which the ARM toolchain makes a single byte. validBlock is not sent. */
+struct SnapshotField
+{
+    uint8_t offset;
+    uint8_t size;
+    uint8_t snapshotSize;
+    uint8_t count;
+};
+
+#define SNAPSHOT_FIELD(field,snapshotSize,count) \
+    {offsetof(struct Config,field), sizeof(((struct Config*)0)->field), \
+     snapshotSize, count}
+
+static const struct SnapshotField snapshotFields[] =
+{
+    SNAPSHOT_FIELD(enableSend,1,1),
+    SNAPSHOT_FIELD(measurementSend,1,1),
+    SNAPSHOT_FIELD(debugMessageSend,1,1),
+    SNAPSHOT_FIELD(recording,1,1),
+    SNAPSHOT_FIELD(batteryCapacity[0],2,NUM_BATS),
+    SNAPSHOT_FIELD(batteryType[0],1,NUM_BATS),
+    SNAPSHOT_FIELD(absorptionVoltage[0],2,NUM_BATS),
+    SNAPSHOT_FIELD(floatVoltage[0],2,NUM_BATS),
+    SNAPSHOT_FIELD(floatStageCurrentScale[0],2,NUM_BATS),
+    SNAPSHOT_FIELD(bulkCurrentLimitScale[0],2,NUM_BATS),
+    SNAPSHOT_FIELD(alphaR,2,1),
+    SNAPSHOT_FIELD(alphaV,2,1),
+    SNAPSHOT_FIELD(alphaC,2,1),
+    SNAPSHOT_FIELD(autoTrack,1,1),
+    SNAPSHOT_FIELD(panelSwitchSetting,1,1),
+    SNAPSHOT_FIELD(monitorStrategy,1,1),
+    SNAPSHOT_FIELD(lowVoltage,2,1),
+    SNAPSHOT_FIELD(criticalVoltage,2,1),
+    SNAPSHOT_FIELD(lowSoC,2,1),
+    SNAPSHOT_FIELD(criticalSoC,2,1),
+    SNAPSHOT_FIELD(floatBulkSoC,2,1),
+    SNAPSHOT_FIELD(chargerStrategy,1,1),
+    SNAPSHOT_FIELD(restTime,2,1),
+    SNAPSHOT_FIELD(absorptionTime,2,1),
+    SNAPSHOT_FIELD(minDutyCycle,2,1),
+    SNAPSHOT_FIELD(floatTime,2,1),
+    SNAPSHOT_FIELD(watchdogDelay,4,1),
+    SNAPSHOT_FIELD(chargerDelay,4,1),
+    SNAPSHOT_FIELD(measurementDelay,4,1),
+    SNAPSHOT_FIELD(monitorDelay,4,1),
+    SNAPSHOT_FIELD(calibrationDelay,4,1),
+    SNAPSHOT_FIELD(currentOffsets.data[0],2,NUM_IFS),
+};
+
+#define SNAPSHOT_FIELDS (sizeof(snapshotFields)/sizeof(struct SnapshotField))
+
+/* Fail the compile if the struct Config field sizes no longer fit the
+snapshot. */
+typedef char configSnapshotSizeCheck
+    [((sizeof(battery_Type) <= 4) && (sizeof(portTickType) <= 4)) ? 1 : -1];
+
 /*--------------------------------------------------------------------------*/
 /* Preset the config data block in FLASH to a given pattern to indicate unused. */
 union ConfigGroup configDataBlock __attribute__ ((section (".configBlock"))) = {{0xA5}};
@@ -120,6 +180,86 @@ uint32_t writeConfigBlock(void)
                           configData.data, sizeof(configData.config));
 }
 
+/*--------------------------------------------------------------------------*/
+/** @brief Take a Snapshot of the Configuration
+
+The configuration is written field by field in the snapshot layout (see
+power-management-objdic.h).
+
+@param[out] snapshot: uint8_t* buffer of CONFIG_SNAPSHOT_LENGTH bytes.
+@returns uint16_t length of the snapshot.
+*/
+
+uint16_t getConfigSnapshot(uint8_t* snapshot)
+{
+    uint16_t length = 0;
+    uint8_t field, element, byte;
+    for (field=0; field<SNAPSHOT_FIELDS; field++)
+    {
+        const struct SnapshotField *entry = &snapshotFields[field];
+        for (element=0; element<entry->count; element++)
+        {
+            uint8_t *data = configData.data+entry->offset+element*entry->size;
+            uint32_t value = data[0];
+            if (entry->size == 2) value = *(uint16_t*)data;
+            else if (entry->size == 4) value = *(uint32_t*)data;
+            for (byte=0; byte<entry->snapshotSize; byte++)
+            {
+                if (length >= CONFIG_SNAPSHOT_LENGTH) return length;
+                snapshot[length++] = (value >> 8*byte) & 0xFF;
+            }
+        }
+    }
+    return length;
+}
+
+/*--------------------------------------------------------------------------*/
+/** @brief Replace the Configuration from a Snapshot
+
+The snapshot is decoded field by field into a copy of the configuration, which
+then replaces the entire configuration in one step so that no task sees a mix
+of old and new settings, and is written to flash. The communications enable
+and recording controls are runtime states that keep their current values. The
+current offsets also keep their values as they calibrate this board, and the
+snapshot may come from another.
+
+@param[in] snapshot: uint8_t* CONFIG_SNAPSHOT_LENGTH bytes, already validated.
+@returns uint32_t result code. 0 success, 1 fail.
+*/
+
+uint32_t setConfigSnapshot(uint8_t* snapshot)
+{
+    static struct Config newConfig;
+    newConfig = configData.config;
+    uint16_t length = 0;
+    uint8_t field, element, byte;
+    for (field=0; field<SNAPSHOT_FIELDS; field++)
+    {
+        const struct SnapshotField *entry = &snapshotFields[field];
+        for (element=0; element<entry->count; element++)
+        {
+            uint32_t value = 0;
+            for (byte=0; byte<entry->snapshotSize; byte++)
+            {
+                if (length >= CONFIG_SNAPSHOT_LENGTH) return 1;
+                value |= (uint32_t)snapshot[length++] << 8*byte;
+            }
+            uint8_t *data = (uint8_t*)&newConfig+entry->offset+element*entry->size;
+            if (entry->size == 2) *(uint16_t*)data = value;
+            else if (entry->size == 4) *(uint32_t*)data = value;
+            else data[0] = value;
+        }
+    }
+    newConfig.validBlock = VALID_BLOCK;
+    newConfig.enableSend = configData.config.enableSend;
+    newConfig.recording = configData.config.recording;
+    newConfig.currentOffsets = configData.config.currentOffsets;
+    taskENTER_CRITICAL();
+    configData.config = newConfig;
+    taskEXIT_CRITICAL();
+    return writeConfigBlock();
+}
+
 /*--------------------------------------------------------------------------*/
 /** @brief Set the Battery Charge Parameters given the Type
 
@@ -280,12 +280,41 @@ union ConfigGroup
     struct Config config;
 };
 
+/* A configuration snapshot transfers struct Config as a single binary block
+in a fixed layout, independent of how the compiler lays out the structure.
+Fields are little endian with no padding, in this order (byte offsets):
+
+ 0 enableSend, 1 measurementSend, 2 debugMessageSend, 3 recording (1 each)
+ 4 batteryCapacity[3] (2 each), 10 batteryType[3] (1 each)
+13 absorptionVoltage[3], 19 floatVoltage[3], 25 floatStageCurrentScale[3],
+31 bulkCurrentLimitScale[3] (2 each)
+37 alphaR, 39 alphaV, 41 alphaC (2 each)
+43 autoTrack, 44 panelSwitchSetting, 45 monitorStrategy (1 each)
+46 lowVoltage, 48 criticalVoltage, 50 lowSoC, 52 criticalSoC, 54 floatBulkSoC
+   (2 each)
+56 chargerStrategy (1)
+57 restTime, 59 absorptionTime, 61 minDutyCycle, 63 floatTime (2 each)
+65 watchdogDelay, 69 chargerDelay, 73 measurementDelay, 77 monitorDelay,
+81 calibrationDelay (4 each)
+85 currentOffsets[6] (2 each)
+
+The current offsets are the calibration of this board's current interfaces.
+They are sent so that a saved snapshot records them, but are not restored from
+a snapshot, which may have been saved from another board.
+
+The GUI decodes the block by these offsets, so the version must be changed and
+the layout and length updated whenever a field is added or altered. */
+#define CONFIG_SNAPSHOT_VERSION 2
+#define CONFIG_SNAPSHOT_LENGTH  97
+
 /*--------------------------------------------------------------------------*/
 /* Prototypes */
 /*--------------------------------------------------------------------------*/
 
 void setGlobalDefaults(void);
 uint32_t writeConfigBlock(void);
+uint16_t getConfigSnapshot(uint8_t* snapshot);
+uint32_t setConfigSnapshot(uint8_t* snapshot);
 
 void setBatteryChargeParameters(int battery);
 battery_Type getBatteryType(int battery);
@@ -6,6 +6,13 @@ This counter carries the real time count in seconds for
 time stamping of records. Access functions are provided for setting from a UTC
 string and reading to a string.
 
+The time of records is taken from a disciplined clock kept in milliseconds from
+the systick count. It is started from the RTC and set along with it, and can be
+kept to the time of the host by probes exchanged over the communications link
+(see clockProbe). Offsets found by the probes are slewed out by changing the
+rate of the clock slightly rather than by stepping it, so that the time never
+goes backwards except when it is set explicitly.
+
 Initial 25 November 2013
 */
 
@@ -34,47 +41,273 @@ Initial 25 November 2013
 #include <stdbool.h>
 #include <time.h>
 
-#include "power-management-objdic.h"
+/* Scheduler includes. */
+#include "FreeRTOS.h"
+#include "task.h"
+
 #include "power-management-hardware.h"
 #include "power-management-lib.h"
 #include "power-management-time.h"
 #include "power-management-comms.h"
 
+/* Largest step in seconds taken by ticking the calendar forward. Longer steps,
+and steps back when the time is set, convert the time afresh. */
+#define CALENDAR_MAX_TICKS  60
+
+/* Clock corrections are in parts per 10^9, and the clock carries fractions of
+a millisecond in the same units */
+#define CLOCK_UNIT          1000000000
+/* Greatest rate of slewing an offset, and greatest frequency correction */
+#define CLOCK_SLEW_PPB      500000
+#define CLOCK_FREQUENCY_PPB 500000
+/* Exchanges held by the clock filter, the one least delayed being used */
+#define CLOCK_FILTER_SIZE   8
+/* Exchanges taking longer than this round trip are discarded */
+#define CLOCK_DELAY_MAX_MS  1000
+/* Offsets behind the host larger than this are stepped. Offsets ahead of the
+host larger than this are taken to be a change of the host clock and ignored. */
+#define CLOCK_STEP_MS       2000
+/* Span of host time over which the frequency is first estimated, that over
+which later estimates are made, and the span at which the reference is
+restarted to follow slow changes. */
+#define CLOCK_SPAN_FIRST_MS 900000
+#define CLOCK_SPAN_MS       21600000
+#define CLOCK_SPAN_RESTART_MS 86400000
+/* The RTC is checked against the clock only within this of the middle of a
+second of the clock. Setting the RTC counter does not restart its prescaler, so
+setting it there keeps its seconds within half a second of those of the clock,
+and within about 0.6s with the window. */
+#define CLOCK_RTC_WINDOW_MS 100
+
+/* One exchange of the clock filter */
+typedef struct
+{
+    int32_t offset;             /* clock less host time, ms */
+    int32_t delay;              /* round trip less the turnaround, ms */
+    uint32_t raw;               /* millisecond count at the probe arrival */
+    uint32_t host;              /* host time at the probe arrival */
+    int64_t slewed;             /* total slewed by the probe arrival */
+} ClockSample;
+
+/* Broken-down UTC time */
+typedef struct
+{
+    uint16_t year;
+    uint8_t month;              /* 1-12 */
+    uint8_t day;                /* 1-31 */
+    uint8_t hour;
+    uint8_t minute;
+    uint8_t second;
+} Calendar;
+
+static void calendarFromSeconds(uint32_t seconds, Calendar *calendar);
+static void calendarTick(Calendar *calendar);
+static uint8_t daysInMonth(uint16_t year, uint8_t month);
+static void putTwoDigits(char *string, uint8_t value);
+static void putDate(char *string, Calendar *calendar);
+static void clockUpdate(void);
+static void clockStart(uint64_t time);
+static int32_t clockExchange(uint32_t hostSend, uint32_t arrival,
+                             uint32_t raw, int64_t slewed, uint32_t reply,
+                             uint32_t hostReceive);
+static void clockFrequencyEstimate(ClockSample *sample);
+
+/* Calendar of the time string, the seconds count it was last brought up to,
+and the date part of the string "YYYY-MM-DDT" which changes only at midnight */
+static Calendar timeCalendar;
+static uint32_t timeCalendarSeconds;
+static bool timeCalendarValid = false;
+static char timeDate[11];
+
+/* Disciplined clock: millisecond count and time at the last update, fraction
+of a millisecond, frequency correction, offset remaining to be slewed and the
+total slewed so far. */
+static uint32_t clockRaw;
+static uint64_t clockTime;
+static int64_t clockFraction;
+static int32_t clockFrequency = 0;
+static int64_t clockSlew;
+static int64_t clockSlewed;
+static bool clockValid = false;
+
+/* Clock filter, and the millisecond count of the exchange last used */
+static ClockSample clockFilter[CLOCK_FILTER_SIZE];
+static uint8_t clockFilterCount;
+static uint8_t clockFilterNext;
+static uint32_t clockUsedRaw;
+static bool clockUsed;
+
+/* Reference exchange of the frequency estimate */
+static ClockSample clockReference;
+static bool clockReferenceValid = false;
+static bool clockReferenceTrusted;
+static bool clockFrequencyValid = false;
+
+/* Timestamps of the last probe, to be completed by the next */
+static uint32_t probeHostSend;
+static uint32_t probeArrival;
+static uint32_t probeRaw;
+static int64_t probeSlewed;
+static uint32_t probeReply;
+static bool probeValid = false;
+
 /*--------------------------------------------------------------------------*/
 /** @brief Return a string containing the time and date
 
 Convert the global time to an ISO 8601 string.
 
-@param[out] timeString char*. Returns pointer to string with formatted date.
+The calendar is carried forward a second at a time from the last call, which
+is normally one or two seconds earlier, rather than being converted afresh from
+the seconds count. The date part is kept already formatted, and the time part
+is written digit by digit. This is called only from the monitor task.
+
+@param[out] timeString char*. Returns pointer to string with formatted date
+(20 characters including the terminator).
 */
 
 void putTimeToString(char* timeString)
 {
-    time_t currentTime = (time_t)getSecondsCount();
-    struct tm *rtc = localtime(&currentTime);
-//    strftime(timeString, sizeof timeString, "%FT%TZ", rtc);
-    char buffer[10];
-    intToAscii(rtc->tm_year+1900, timeString);
-    stringAppend(timeString,"-");
-    if (rtc->tm_mon < 9) stringAppend(timeString,"0");
-    intToAscii(rtc->tm_mon+1, buffer);
-    stringAppend(timeString,buffer);
-    stringAppend(timeString,"-");
-    if (rtc->tm_mday < 10) stringAppend(timeString,"0");
-    intToAscii(rtc->tm_mday, buffer);
-    stringAppend(timeString,buffer);
-    stringAppend(timeString,"T");
-    if (rtc->tm_hour < 10) stringAppend(timeString,"0");
-    intToAscii(rtc->tm_hour, buffer);
-    stringAppend(timeString,buffer);
-    stringAppend(timeString,":");
-    if (rtc->tm_min < 10) stringAppend(timeString,"0");
-    intToAscii(rtc->tm_min, buffer);
-    stringAppend(timeString,buffer);
-    stringAppend(timeString,":");
-    if (rtc->tm_sec < 10) stringAppend(timeString,"0");
-    intToAscii(rtc->tm_sec, buffer);
-    stringAppend(timeString,buffer);
+    uint32_t seconds = (uint32_t)(getTimeMilliseconds()/1000);
+    uint32_t elapsed = seconds - timeCalendarSeconds;
+    if (! timeCalendarValid || (seconds < timeCalendarSeconds) ||
+        (elapsed > CALENDAR_MAX_TICKS))
+    {
+        calendarFromSeconds(seconds, &timeCalendar);
+        putDate(timeDate, &timeCalendar);
+        timeCalendarValid = true;
+    }
+    else
+    {
+        uint8_t day = timeCalendar.day;
+        while (elapsed-- > 0) calendarTick(&timeCalendar);
+        if (timeCalendar.day != day) putDate(timeDate, &timeCalendar);
+    }
+    timeCalendarSeconds = seconds;
+    uint8_t i;
+    for (i=0; i<11; i++) timeString[i] = timeDate[i];
+    putTwoDigits(timeString+11, timeCalendar.hour);
+    timeString[13] = ':';
+    putTwoDigits(timeString+14, timeCalendar.minute);
+    timeString[16] = ':';
+    putTwoDigits(timeString+17, timeCalendar.second);
+    timeString[19] = 0;
+}
+
+/*--------------------------------------------------------------------------*/
+/** @brief Return a path naming a file by the time and date
+
+Convert a time to a path of the form YYYY/MM/DD-HHMM, for files filed by year
+and month directories. The caller adds the extension.
+
+@param[out] path char*. Returns pointer to string with the path (16 characters).
+@param[in] seconds uint32_t. Time in seconds as given by getSecondsCount.
+*/
+
+void putTimeToPath(char* path, uint32_t seconds)
+{
+    Calendar calendar;
+    calendarFromSeconds(seconds, &calendar);
+    putDate(path, &calendar);
+    path[4] = '/';
+    path[7] = '/';
+    path[10] = '-';
+    putTwoDigits(path+11, calendar.hour);
+    putTwoDigits(path+13, calendar.minute);
+    path[15] = 0;
+}
+
+/*--------------------------------------------------------------------------*/
+/** @brief Convert a seconds count to a calendar
+
+The days since 1970 are converted to a date by whole eras of 400 years, which
+is exact for the full range of the seconds count and does not need the library
+localtime(), which is slow and not reentrant.
+
+@param[in] seconds uint32_t. Seconds since 1970, UTC.
+@param[out] calendar Calendar*. Broken-down time.
+*/
+
+static void calendarFromSeconds(uint32_t seconds, Calendar *calendar)
+{
+    uint32_t daySeconds = seconds % 86400;
+    calendar->hour = daySeconds/3600;
+    calendar->minute = (daySeconds % 3600)/60;
+    calendar->second = daySeconds % 60;
+/* Days from 1 March 0000, so that the leap day falls at the end of a year */
+    uint32_t days = seconds/86400 + 719468;
+    uint32_t era = days/146097;
+    uint32_t dayOfEra = days - era*146097;
+    uint32_t yearOfEra = (dayOfEra - dayOfEra/1460 + dayOfEra/36524
+                          - dayOfEra/146096)/365;
+    uint32_t dayOfYear = dayOfEra - (365*yearOfEra + yearOfEra/4
+                                     - yearOfEra/100);
+    uint32_t monthIndex = (5*dayOfYear + 2)/153;       /* 0 is March */
+    calendar->day = dayOfYear - (153*monthIndex + 2)/5 + 1;
+    calendar->month = (monthIndex < 10) ? monthIndex + 3 : monthIndex - 9;
+    calendar->year = yearOfEra + era*400 + ((calendar->month <= 2) ? 1 : 0);
+}
+
+/*--------------------------------------------------------------------------*/
+/** @brief Advance a calendar by one second
+
+Each field is carried into the next as it rolls over.
+
+@param[in,out] calendar Calendar*. Broken-down time.
+*/
+
+static void calendarTick(Calendar *calendar)
+{
+    if (++calendar->second < 60) return;
+    calendar->second = 0;
+    if (++calendar->minute < 60) return;
+    calendar->minute = 0;
+    if (++calendar->hour < 24) return;
+    calendar->hour = 0;
+    if (++calendar->day <= daysInMonth(calendar->year, calendar->month)) return;
+    calendar->day = 1;
+    if (++calendar->month <= 12) return;
+    calendar->month = 1;
+    calendar->year++;
+}
+
+static uint8_t daysInMonth(uint16_t year, uint8_t month)
+{
+    static const uint8_t monthDays[12] =
+        {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    if ((month == 2) && ((year % 4) == 0) &&
+        (((year % 100) != 0) || ((year % 400) == 0))) return 29;
+    return monthDays[month-1];
+}
+
+/*--------------------------------------------------------------------------*/
+/** @brief Write a two digit decimal number, without terminator
+*/
+
+static void putTwoDigits(char *string, uint8_t value)
+{
+    string[0] = '0' + value/10;
+    string[1] = '0' + value % 10;
+}
+
+/*--------------------------------------------------------------------------*/
+/** @brief Write the date part "YYYY-MM-DDT" of a time string, without
+terminator
+*/
+
+static void putDate(char *string, Calendar *calendar)
+{
+    uint16_t year = calendar->year;
+    string[3] = '0' + year % 10;
+    year /= 10;
+    string[2] = '0' + year % 10;
+    year /= 10;
+    string[1] = '0' + year % 10;
+    string[0] = '0' + year/10;
+    string[4] = '-';
+    putTwoDigits(string+5, calendar->month);
+    string[7] = '-';
+    putTwoDigits(string+8, calendar->day);
+    string[10] = 'T';
 }
 
 /*--------------------------------------------------------------------------*/
@@ -104,7 +337,262 @@ void setTimeFromString(char* timeString)
     for (i=0; i<2; i++) buffer[i] = timeString[i+17];
     newTime.tm_sec = asciiToInt(buffer);
 
-    setSecondsCount((uint32_t)mktime(&newTime));
+    setTimeSeconds((uint32_t)mktime(&newTime));
+}
+
+/*--------------------------------------------------------------------------*/
+/** @brief Set the Time
+
+The RTC and the disciplined clock are both set. This is the only way the time
+can go backwards. Probe exchanges and the frequency reference made against the
+old time are discarded, but the frequency correction is kept.
+
+@param[in] seconds: uint32_t seconds since 1970.
+*/
+
+void setTimeSeconds(uint32_t seconds)
+{
+    setSecondsCount(seconds);
+    taskENTER_CRITICAL();
+    clockStart((uint64_t)seconds*1000);
+    clockReferenceValid = false;
+    taskEXIT_CRITICAL();
+}
+
+/*--------------------------------------------------------------------------*/
+/** @brief Read the Disciplined Clock
+
+The clock is started from the RTC on first use.
+
+@returns uint64_t milliseconds since 1970.
+*/
+
+uint64_t getTimeMilliseconds(void)
+{
+    taskENTER_CRITICAL();
+    if (! clockValid) clockStart((uint64_t)getSecondsCount()*1000);
+    clockUpdate();
+    uint64_t time = clockTime;
+    taskEXIT_CRITICAL();
+    return time;
+}
+
+/*--------------------------------------------------------------------------*/
+/** @brief Bring the Clock up to the Millisecond Count
+
+The elapsed milliseconds are added with the frequency correction and as much of
+the remaining offset as can be slewed in the time, held to fractions of a
+millisecond. As neither correction exceeds 500ppm the clock always advances.
+Call with interrupts disabled.
+*/
+
+static void clockUpdate(void)
+{
+    uint32_t raw = getMilliSecondsCount();
+    uint32_t elapsed = raw - clockRaw;
+    clockRaw = raw;
+    int64_t slew = (int64_t)elapsed*CLOCK_SLEW_PPB;
+    if (clockSlew >= 0)
+    {
+        if (slew > clockSlew) slew = clockSlew;
+    }
+    else
+    {
+        slew = -slew;
+        if (slew < clockSlew) slew = clockSlew;
+    }
+    clockSlew -= slew;
+    clockSlewed += slew;
+    int64_t adjust = (int64_t)elapsed*clockFrequency + slew + clockFraction;
+    int64_t whole = adjust/CLOCK_UNIT;
+    clockFraction = adjust - whole*CLOCK_UNIT;
+    if (clockFraction < 0)
+    {
+        clockFraction += CLOCK_UNIT;
+        whole--;
+    }
+    clockTime += elapsed + whole;
+}
+
+/*--------------------------------------------------------------------------*/
+/** @brief Start the Clock at a Time
+
+Any offset being slewed, the exchanges held by the filter and the last probe
+are dropped. Call with interrupts disabled.
+
+@param[in] time: uint64_t milliseconds since 1970.
+*/
+
+static void clockStart(uint64_t time)
+{
+    clockRaw = getMilliSecondsCount();
+    clockTime = time;
+    clockFraction = 0;
+    clockSlew = 0;
+    clockFilterCount = 0;
+    clockFilterNext = 0;
+    clockUsed = false;
+    clockValid = true;
+    probeValid = false;
+}
+
+/*--------------------------------------------------------------------------*/
+/** @brief Take a Clock Probe from the Host
+
+The host sends probes at intervals of some seconds, each carrying its time of
+sending T1. The clock time of arrival T2 is taken here and the time of the
+reply T3 at the end, when the probe is to be answered at once. The host gives
+its time of receiving the reply T4 with the next probe, along with the T1 it
+belongs to, so that the exchange can be completed as in NTP:
+
+offset = ((T2-T1) + (T3-T4))/2, delay = (T4-T1) - (T3-T2).
+
+All times are in milliseconds and only the low 32 bits are exchanged, so the
+offset must be less than 24 days, which setting the time first ensures.
+
+The exchange least delayed of the last few is taken as the least affected by
+queueing, and its offset is slewed out if it is newer than the one last used.
+The frequency of the millisecond count against the host is estimated from these
+exchanges over some hours, and corrected.
+
+@param[in] hostSend: uint32_t host time of sending this probe.
+@param[in] lastHostSend: uint32_t host time of sending the previous probe.
+@param[in] lastHostReceive: uint32_t host time of receiving the previous reply.
+@returns int32_t offset in ms of the clock from the host by the exchange just
+         completed, or 0 if none.
+*/
+
+int32_t clockProbe(uint32_t hostSend, uint32_t lastHostSend,
+                   uint32_t lastHostReceive)
+{
+    int32_t offset = 0;
+    taskENTER_CRITICAL();
+    if (! clockValid) clockStart((uint64_t)getSecondsCount()*1000);
+    clockUpdate();
+    bool complete = probeValid && (lastHostSend == probeHostSend);
+    uint32_t lastArrival = probeArrival;
+    uint32_t lastRaw = probeRaw;
+    int64_t lastSlewed = probeSlewed;
+    probeHostSend = hostSend;
+    probeArrival = (uint32_t)clockTime;
+    probeRaw = clockRaw;
+    probeSlewed = clockSlewed;
+    probeValid = true;
+/* A step of the clock drops the probe just taken along with the filter */
+    if (complete)
+        offset = clockExchange(lastHostSend,lastArrival,lastRaw,lastSlewed,
+                               probeReply,lastHostReceive);
+    taskEXIT_CRITICAL();
+/* Keep the RTC, which holds the time over a reset, to the clock. Near the
+middle of a second of the clock the RTC reads the same second unless it has
+drifted by more than half a second. */
+    uint64_t time = getTimeMilliseconds();
+    int32_t fromMiddle = (int32_t)(time % 1000) - 500;
+    if ((fromMiddle < CLOCK_RTC_WINDOW_MS) && (fromMiddle > -CLOCK_RTC_WINDOW_MS))
+    {
+        uint32_t seconds = (uint32_t)(time/1000);
+        if (seconds != getSecondsCount()) setSecondsCount(seconds);
+    }
+    probeReply = (uint32_t)getTimeMilliseconds();
+    return offset;
+}
+
+/*--------------------------------------------------------------------------*/
+/** @brief Complete an Exchange and Correct the Clock
+
+Call with interrupts disabled.
+
+@returns int32_t offset in ms of the clock from the host.
+*/
+
+static int32_t clockExchange(uint32_t hostSend, uint32_t arrival,
+                             uint32_t raw, int64_t slewed, uint32_t reply,
+                             uint32_t hostReceive)
+{
+    int32_t offset = ((int32_t)(arrival - hostSend) +
+                      (int32_t)(reply - hostReceive))/2;
+    int32_t delay = (int32_t)(hostReceive - hostSend) -
+                    (int32_t)(reply - arrival);
+    if ((delay < 0) || (delay > CLOCK_DELAY_MAX_MS)) return offset;
+/* The host clock has jumped back, or the time was set wrongly. Leave it to be
+set again rather than take the clock back. */
+    if (offset > CLOCK_STEP_MS)
+    {
+        clockReferenceValid = false;
+        return offset;
+    }
+    ClockSample sample;
+    sample.offset = offset;
+    sample.delay = delay;
+    sample.raw = raw;
+    sample.host = arrival - offset;
+    sample.slewed = slewed;
+/* Well behind the host, as on first synchronization, so step forward */
+    if (offset < -CLOCK_STEP_MS)
+    {
+        clockFrequencyEstimate(&sample);
+        clockUpdate();
+        clockStart(clockTime - offset);
+        clockUsedRaw = raw;
+        clockUsed = true;
+        return offset;
+    }
+    clockFilter[clockFilterNext] = sample;
+    clockFilterNext = (clockFilterNext + 1) % CLOCK_FILTER_SIZE;
+    if (clockFilterCount < CLOCK_FILTER_SIZE) clockFilterCount++;
+    ClockSample *best = &clockFilter[0];
+    uint8_t i;
+    for (i=1; i<clockFilterCount; i++)
+        if (clockFilter[i].delay < best->delay) best = &clockFilter[i];
+/* Offsets measured before the last correction are out of date. The offset, with
+what has been slewed since it was measured, replaces what remains to be slewed
+as that part is not in the offset. */
+    if (clockUsed && ((int32_t)(best->raw - clockUsedRaw) <= 0)) return offset;
+    clockFrequencyEstimate(best);
+    clockUpdate();
+    clockSlew = -(int64_t)best->offset*CLOCK_UNIT
+                - (clockSlewed - best->slewed);
+    clockUsedRaw = best->raw;
+    clockUsed = true;
+    return offset;
+}
+
+/*--------------------------------------------------------------------------*/
+/** @brief Estimate the Frequency of the Millisecond Count
+
+The millisecond count over the span from a reference exchange is compared with
+the host time over the same span. This does not depend on corrections made to
+the clock in between. The first estimate is made after a short span, and is
+refined as the span grows. The reference is restarted after a day, with the
+estimate from the old reference kept until the new span is long enough.
+Call with interrupts disabled.
+
+@param[in] sample: ClockSample* the exchange just completed.
+*/
+
+static void clockFrequencyEstimate(ClockSample *sample)
+{
+    uint32_t span = sample->host - clockReference.host;
+    if (! clockReferenceValid || (span >= CLOCK_SPAN_RESTART_MS))
+    {
+        clockReference = *sample;
+        clockReferenceValid = true;
+        clockReferenceTrusted = false;
+        return;
+    }
+    if (! clockReferenceTrusted)
+    {
+        if (span < (clockFrequencyValid ? CLOCK_SPAN_MS : CLOCK_SPAN_FIRST_MS))
+            return;
+        clockReferenceTrusted = true;
+    }
+    int32_t drift = (int32_t)(sample->raw - clockReference.raw) - (int32_t)span;
+    int64_t frequency = -(int64_t)drift*CLOCK_UNIT/span;
+    if (frequency > CLOCK_FREQUENCY_PPB) frequency = CLOCK_FREQUENCY_PPB;
+    if (frequency < -CLOCK_FREQUENCY_PPB) frequency = -CLOCK_FREQUENCY_PPB;
+    clockUpdate();
+    clockFrequency = (int32_t)frequency;
+    clockFrequencyValid = true;
 }
 
 /**@}*/
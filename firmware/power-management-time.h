@@ -29,6 +29,11 @@ Initial 25 November 2013
 
 void setTimeFromString(char* timeString);
 void putTimeToString(char* timeString);
+void putTimeToPath(char* path, uint32_t seconds);
+void setTimeSeconds(uint32_t seconds);
+uint64_t getTimeMilliseconds(void);
+int32_t clockProbe(uint32_t hostSend, uint32_t lastHostSend,
+                   uint32_t lastHostReceive);
 
 #endif
 
@@ -0,0 +1,376 @@
+/** @defgroup Transmit_file Transmit Scheduler
+
+@brief Prioritized Transmit Scheduler
+
+Outgoing messages are held in a buffer for each of four priority classes and
+passed to the communications ISR a whole line at a time, the highest class
+with a message waiting going first when the previous line is finished.
+
+- Responses: replies to commands from the communications task. These are
+  written a character at a time to the communications send queue, and the
+  communications task waits for room as it has always done, so that long
+  replies such as directory listings are not broken up.
+- Alarms: debug and error messages.
+- Telemetry: the periodic measurements. A message waiting to be sent is
+  replaced by a newer one with the same identifier, so that stale values are
+  not sent after their time.
+- Bulk: file blocks requested by the host, which requests them again if they
+  are lost. So that a file download is not held up for as long as telemetry
+  fills the link, a waiting bulk line goes ahead of telemetry after every
+  TRANSMIT_BULK_SHARE telemetry lines. A request repeated by the host while
+  its line is still waiting is not queued again.
+
+Other than responses, messages are queued without blocking. A message that
+does not fit is dropped and counted, and so is a telemetry message replaced
+before it could be sent.
+
+Initial 18 October 2026
+*/
+
+/*
+ * This file is part of the battery-management-system project.
+ *
+ * Copyright 2013 K. Sarkies <ksarkies@internode.on.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**@{*/
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Scheduler includes. */
+#include "FreeRTOS.h"
+#include "task.h"
+#include "queue.h"
+
+#include "power-management-hardware.h"
+#include "power-management-lib.h"
+#include "power-management-transmit.h"
+
+/* Buffer of whole lines, sent in order */
+typedef struct
+{
+    char *buffer;
+    uint16_t size;
+    uint16_t head;              /* next character to send */
+    uint16_t tail;              /* next free position */
+} TransmitRing;
+
+/* Telemetry message and the order in which it was queued */
+typedef struct
+{
+    char line[TRANSMIT_LINE_SIZE];
+    uint32_t sequence;
+    bool waiting;
+} TransmitSlot;
+
+/*--------------------------------------------------------------------------*/
+/* Local Prototypes */
+static bool ringPut(TransmitRing *ring, char* ident, char* text);
+static void ringPutString(TransmitRing *ring, char* string);
+static uint16_t ringFree(TransmitRing *ring);
+static bool ringHolds(TransmitRing *ring, char* ident, char* text);
+static bool ringMatches(TransmitRing *ring, uint16_t *position, char* string);
+static bool identMatches(char* line, char* ident);
+
+/*--------------------------------------------------------------------------*/
+/* Global Variables */
+/* Responses are queued here by the communications task */
+extern xQueueHandle commsSendQueue;
+
+/*--------------------------------------------------------------------------*/
+/* Local Variables */
+static char alarmBuffer[TRANSMIT_ALARM_SIZE];
+static char bulkBuffer[TRANSMIT_BULK_SIZE];
+static TransmitRing alarmRing;
+static TransmitRing bulkRing;
+static TransmitSlot telemetrySlot[TRANSMIT_TELEMETRY_SLOTS];
+static uint32_t telemetrySequence;
+static uint32_t transmitDrops[TRANSMIT_CLASSES];
+static uint32_t transmitReplaced;
+
+/* State of the ISR: the class of the line being sent, or -1 between lines, and
+the telemetry line being sent, which is copied out so that its slot is free. */
+static int8_t transmitCurrent;
+static char transmitTelemetryLine[TRANSMIT_LINE_SIZE];
+static uint8_t transmitPosition;
+/* Telemetry lines sent while a bulk line waited */
+static uint8_t transmitBulkWait;
+
+/*--------------------------------------------------------------------------*/
+/** @brief Initialize
+
+Call before the scheduler is started.
+*/
+
+void initTransmit(void)
+{
+    alarmRing.buffer = alarmBuffer;
+    alarmRing.size = TRANSMIT_ALARM_SIZE;
+    alarmRing.head = 0;
+    alarmRing.tail = 0;
+    bulkRing.buffer = bulkBuffer;
+    bulkRing.size = TRANSMIT_BULK_SIZE;
+    bulkRing.head = 0;
+    bulkRing.tail = 0;
+    uint8_t i;
+    for (i=0; i<TRANSMIT_TELEMETRY_SLOTS; i++) telemetrySlot[i].waiting = false;
+    for (i=0; i<TRANSMIT_CLASSES; i++) transmitDrops[i] = 0;
+    telemetrySequence = 0;
+    transmitReplaced = 0;
+    transmitCurrent = -1;
+    transmitBulkWait = 0;
+}
+
+/*--------------------------------------------------------------------------*/
+/** @brief Queue a Message
+
+The message "ident,text" is queued in the buffer of its class, with a line
+ending added, and the ISR is started. This does not block. Responses are not
+taken here; they are written to the communications send queue.
+
+@param[in] priority: transmit_Class class of the message.
+@param[in] ident: char* identifier string recognized by the receiving program.
+@param[in] text: char* parameters of the message.
+@returns bool true if the message was queued, false if it was dropped.
+*/
+
+bool transmitLine(transmit_Class priority, char* ident, char* text)
+{
+    bool queued = false;
+    taskENTER_CRITICAL();
+    if (priority == alarmP) queued = ringPut(&alarmRing,ident,text);
+    else if (priority == bulkP)
+        queued = ringHolds(&bulkRing,ident,text) ||
+                 ringPut(&bulkRing,ident,text);
+    else if ((priority == telemetryP) &&
+             (stringLength(ident)+stringLength(text)+3 < TRANSMIT_LINE_SIZE))
+    {
+/* Replace a waiting message of the same identifier, or take a free slot */
+        TransmitSlot *slot = NULL;
+        uint8_t i;
+        for (i=0; i<TRANSMIT_TELEMETRY_SLOTS; i++)
+        {
+            if (telemetrySlot[i].waiting &&
+                identMatches(telemetrySlot[i].line,ident))
+            {
+                slot = &telemetrySlot[i];
+                transmitReplaced++;
+                break;
+            }
+            if ((slot == NULL) && ! telemetrySlot[i].waiting)
+                slot = &telemetrySlot[i];
+        }
+        if (slot != NULL)
+        {
+            if (! slot->waiting) slot->sequence = telemetrySequence++;
+            stringCopy(slot->line,ident);
+            stringAppend(slot->line,",");
+            stringAppend(slot->line,text);
+            stringAppend(slot->line,"\r\n");
+            slot->waiting = true;
+            queued = true;
+        }
+    }
+    if (! queued) transmitDrops[priority]++;
+    taskEXIT_CRITICAL();
+    if (queued) commsEnableTxInterrupt(true);
+    return queued;
+}
+
+/*--------------------------------------------------------------------------*/
+/** @brief Get the Next Character to Send
+
+Called from the communications ISR when the transmitter is ready. A line is
+sent to its end before another class is looked at. A response line is waited
+for if the communications task has not yet finished writing it.
+
+@param[out] character: char* the character to send.
+@returns bool true if there is a character to send. The ISR then disables the
+         transmit interrupt until a new message is queued.
+*/
+
+bool transmitNextCharacter(char* character)
+{
+    if (transmitCurrent < 0)
+    {
+        if (uxQueueMessagesWaitingFromISR(commsSendQueue) > 0)
+            transmitCurrent = responseP;
+        else if (alarmRing.head != alarmRing.tail) transmitCurrent = alarmP;
+        else if ((bulkRing.head != bulkRing.tail) &&
+                 (transmitBulkWait >= TRANSMIT_BULK_SHARE))
+        {
+            transmitBulkWait = 0;
+            transmitCurrent = bulkP;
+        }
+        else
+        {
+/* The telemetry message queued earliest */
+            TransmitSlot *slot = NULL;
+            uint8_t i;
+            for (i=0; i<TRANSMIT_TELEMETRY_SLOTS; i++)
+            {
+                if (telemetrySlot[i].waiting &&
+                    ((slot == NULL) ||
+                     ((int32_t)(telemetrySlot[i].sequence-slot->sequence) < 0)))
+                    slot = &telemetrySlot[i];
+            }
+            if (slot != NULL)
+            {
+                stringCopy(transmitTelemetryLine,slot->line);
+                slot->waiting = false;
+                transmitPosition = 0;
+                transmitCurrent = telemetryP;
+                if (bulkRing.head != bulkRing.tail) transmitBulkWait++;
+            }
+            else if (bulkRing.head != bulkRing.tail)
+            {
+                transmitBulkWait = 0;
+                transmitCurrent = bulkP;
+            }
+            else return false;
+        }
+    }
+    switch (transmitCurrent)
+    {
+    case responseP:
+        if (! xQueueReceiveFromISR(commsSendQueue,character,NULL)) return false;
+        break;
+    case alarmP:
+        *character = alarmRing.buffer[alarmRing.head];
+        alarmRing.head = (alarmRing.head + 1) % alarmRing.size;
+        break;
+    case telemetryP:
+        *character = transmitTelemetryLine[transmitPosition++];
+        break;
+    default:
+        *character = bulkRing.buffer[bulkRing.head];
+        bulkRing.head = (bulkRing.head + 1) % bulkRing.size;
+        break;
+    }
+    if (*character == '\n') transmitCurrent = -1;
+    return true;
+}
+
+/*--------------------------------------------------------------------------*/
+/** @brief Count a Message Dropped Elsewhere
+
+Used for responses lost when the communications send queue is reset.
+
+@param[in] priority: transmit_Class class of the message.
+*/
+
+void countTransmitDrop(transmit_Class priority)
+{
+    taskENTER_CRITICAL();
+    transmitDrops[priority]++;
+    taskEXIT_CRITICAL();
+}
+
+/*--------------------------------------------------------------------------*/
+/** @brief Messages Dropped in a Class
+
+@param[in] priority: transmit_Class class of the message.
+@returns uint32_t number of messages dropped since startup.
+*/
+
+uint32_t getTransmitDrops(transmit_Class priority)
+{
+    return transmitDrops[priority];
+}
+
+/*--------------------------------------------------------------------------*/
+/** @brief Telemetry Messages Replaced before Being Sent
+
+@returns uint32_t number of messages replaced since startup.
+*/
+
+uint32_t getTransmitReplaced(void)
+{
+    return transmitReplaced;
+}
+
+/*--------------------------------------------------------------------------*/
+/** @brief Put a Whole Line in a Ring Buffer
+
+@returns bool false if there is not room for the whole line.
+*/
+
+static bool ringPut(TransmitRing *ring, char* ident, char* text)
+{
+    if (stringLength(ident)+stringLength(text)+3 > ringFree(ring)) return false;
+    ringPutString(ring,ident);
+    ringPutString(ring,",");
+    ringPutString(ring,text);
+    ringPutString(ring,"\r\n");
+    return true;
+}
+
+static void ringPutString(TransmitRing *ring, char* string)
+{
+    while (*string)
+    {
+        ring->buffer[ring->tail] = *string++;
+        ring->tail = (ring->tail + 1) % ring->size;
+    }
+}
+
+/* One place is kept empty to tell a full ring from an empty one */
+static uint16_t ringFree(TransmitRing *ring)
+{
+    return (ring->head + ring->size - ring->tail - 1) % ring->size;
+}
+
+/* Test whether a line "ident,text" is waiting in a ring buffer */
+static bool ringHolds(TransmitRing *ring, char* ident, char* text)
+{
+    uint16_t line = ring->head;
+    while (line != ring->tail)
+    {
+        uint16_t position = line;
+        if (ringMatches(ring,&position,ident) &&
+            ringMatches(ring,&position,",") &&
+            ringMatches(ring,&position,text) &&
+            ringMatches(ring,&position,"\r\n")) return true;
+/* Go on to the start of the next line */
+        while ((line != ring->tail) && (ring->buffer[line] != '\n'))
+            line = (line + 1) % ring->size;
+        if (line != ring->tail) line = (line + 1) % ring->size;
+    }
+    return false;
+}
+
+/* Compare a string with the ring contents, moving the position past it */
+static bool ringMatches(TransmitRing *ring, uint16_t *position, char* string)
+{
+    while (*string)
+    {
+        if ((*position == ring->tail) || (ring->buffer[*position] != *string++))
+            return false;
+        *position = (*position + 1) % ring->size;
+    }
+    return true;
+}
+
+/* Test whether a line starts with an identifier followed by a comma */
+static bool identMatches(char* line, char* ident)
+{
+    while (*ident)
+        if (*line++ != *ident++) return false;
+    return (*line == ',');
+}
+
+/**@}*/
@@ -0,0 +1,59 @@
+/* STM32F1 Power Management for Solar Power
+
+This header file contains defines and prototypes for the transmit scheduler,
+which orders outgoing messages by priority class for the communications ISR.
+
+Initial 18 October 2026
+*/
+
+/*
+ * This file is part of the battery-management-system project.
+ *
+ * Copyright 2013 K. Sarkies <ksarkies@internode.on.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef POWER_MANAGEMENT_TRANSMIT_H_
+#define POWER_MANAGEMENT_TRANSMIT_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Longest telemetry message including the line ending */
+#define TRANSMIT_LINE_SIZE          48
+/* Telemetry messages held, one for each identifier */
+#define TRANSMIT_TELEMETRY_SLOTS    24
+/* Alarm and bulk buffer sizes in characters */
+#define TRANSMIT_ALARM_SIZE         128
+#define TRANSMIT_BULK_SIZE          512
+/* Telemetry lines sent before a waiting bulk line is given its turn */
+#define TRANSMIT_BULK_SHARE         4
+
+/* Priority classes, highest first */
+typedef enum {responseP=0, alarmP=1, telemetryP=2, bulkP=3} transmit_Class;
+#define TRANSMIT_CLASSES            4
+
+/*--------------------------------------------------------------------------*/
+/* Prototypes */
+/*--------------------------------------------------------------------------*/
+void initTransmit(void);
+bool transmitLine(transmit_Class priority, char* ident, char* text);
+bool transmitNextCharacter(char* character);
+void countTransmitDrop(transmit_Class priority);
+uint32_t getTransmitDrops(transmit_Class priority);
+uint32_t getTransmitReplaced(void);
+
+#endif
+
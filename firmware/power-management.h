@@ -34,7 +34,8 @@ FreeRTOS 9 August 2013
 /*--------------------------------------------------------------------------*/
 
 #define WATCHDOG_TASK_PRIORITY      ( tskIDLE_PRIORITY + 0 )
-#define FILE_TASK_PRIORITY          ( tskIDLE_PRIORITY + 0 )
+#define FILE_READ_TASK_PRIORITY     ( tskIDLE_PRIORITY + 0 )
+#define FILE_TASK_PRIORITY          ( tskIDLE_PRIORITY + 1 )
 #define CHARGER_TASK_PRIORITY       ( tskIDLE_PRIORITY + 1 )
 #define MONITOR_TASK_PRIORITY       ( tskIDLE_PRIORITY + 1 )
 #define COMMS_TASK_PRIORITY         ( tskIDLE_PRIORITY + 2 )
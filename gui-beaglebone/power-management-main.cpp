@@ -273,23 +273,22 @@ Parse the line and take action on the command received.
 void PowerManagementGui::processResponse(const QString response)
 {
     responseReceived = true;        // indicate that comms is happening
-    QStringList breakdown = response.split(",");
-    int size = breakdown.size();
-    QString firstField;
-    firstField = breakdown[0].simplified();
-    QString secondField;
-    if (size > 1) secondField = breakdown[1].simplified();
+    QByteArray line = response.toLatin1();
+    PowerManagementRecord record;
+    decodeRecord(line.constData(),line.size(),record);
+    QString firstField = response.section(',',0,0).simplified();
+    int secondField = record.value[0];
     QString current, voltage;
 /* When the time field is received, send back a short message to keep comms
 alive. Also check for calibration as time messages stop during this process. */
-    if ((size > 0) && ((firstField == "pH") || (firstField == "pQ")))
+    if ((firstField == "pH") || (firstField == "pQ"))
     {
         socket->write("pc+\n\r");
     }
 // Load 1 current/voltage values
-    if ((size > 0) && (firstField == "dL1"))
+    if (record.is(recordLoad,1))
     {
-        getCurrentVoltage(breakdown,&current,&voltage);
+        getCurrentVoltage(record,&current,&voltage);
         if (PowerManagementMainUi.load1PushButton->isChecked())
         {
             if (testIndicator(load1UnderVoltage) || testIndicator(load1OverCurrent))
@@ -299,9 +298,9 @@ alive. Also check for calibration as time messages stop during this process. */
             }
             else
             {
-                if (size > 1)
+                if (record.fields > 0)
                     PowerManagementMainUi.load1Current->setText(current);
-                if (size > 2)
+                if (record.fields > 1)
                     PowerManagementMainUi.load1Voltage->setText(voltage);
             }
         }
@@ -312,9 +311,9 @@ alive. Also check for calibration as time messages stop during this process. */
         }
     }
 // Load 2 current/voltage values
-    if ((size > 0) && (firstField == "dL2"))
+    if (record.is(recordLoad,2))
     {
-        getCurrentVoltage(breakdown,&current,&voltage);
+        getCurrentVoltage(record,&current,&voltage);
         if (PowerManagementMainUi.load2PushButton->isChecked())
         {
             if (testIndicator(load2UnderVoltage) || testIndicator(load2OverCurrent))
@@ -324,9 +323,9 @@ alive. Also check for calibration as time messages stop during this process. */
             }
             else
             {
-                if (size > 1)
+                if (record.fields > 0)
                     PowerManagementMainUi.load2Current->setText(current);
-                if (size > 2)
+                if (record.fields > 1)
                     PowerManagementMainUi.load2Voltage->setText(voltage);
             }
         }
@@ -337,9 +336,9 @@ alive. Also check for calibration as time messages stop during this process. */
         }
     }
 // Panel current/voltage values
-    if ((size > 0) && (firstField == "dM1"))
+    if (record.is(recordPanel,1))
     {
-        getCurrentVoltage(breakdown,&current,&voltage);
+        getCurrentVoltage(record,&current,&voltage);
         if (PowerManagementMainUi.panelPushButton->isChecked())
         {
             if (testIndicator(panelUnderVoltage) || testIndicator(panelOverCurrent))
@@ -349,9 +348,9 @@ alive. Also check for calibration as time messages stop during this process. */
             }
             else
             {
-                if (size > 1)
+                if (record.fields > 0)
                     PowerManagementMainUi.panelCurrent->setText(current);
-                if (size > 2)
+                if (record.fields > 1)
                     PowerManagementMainUi.panelVoltage->setText(voltage);
             }
         }
@@ -362,9 +361,9 @@ alive. Also check for calibration as time messages stop during this process. */
         }
     }
 // Battery 1 current/voltage values
-    if ((size > 0) && (firstField == "dB1"))
+    if (record.is(recordBattery,1))
     {
-        getCurrentVoltage(breakdown,&current,&voltage);
+        getCurrentVoltage(record,&current,&voltage);
         if (PowerManagementMainUi.battery1PushButton->isChecked())
         {
             if (testIndicator(battery1UnderVoltage) || testIndicator(battery1OverCurrent))
@@ -374,9 +373,9 @@ alive. Also check for calibration as time messages stop during this process. */
             }
             else
             {
-                if (size > 1)
+                if (record.fields > 0)
                     PowerManagementMainUi.battery1Current->setText(current);
-                if (size > 2)
+                if (record.fields > 1)
                     PowerManagementMainUi.battery1Voltage->setText(voltage);
             }
         }
@@ -387,9 +386,9 @@ alive. Also check for calibration as time messages stop during this process. */
         }
     }
 // Battery 2 current/voltage values
-    if ((size > 0) && (firstField == "dB2"))
+    if (record.is(recordBattery,2))
     {
-        getCurrentVoltage(breakdown,&current,&voltage);
+        getCurrentVoltage(record,&current,&voltage);
         if (PowerManagementMainUi.battery2PushButton->isChecked())
         {
             if (testIndicator(battery2UnderVoltage) || testIndicator(battery2OverCurrent))
@@ -399,9 +398,9 @@ alive. Also check for calibration as time messages stop during this process. */
             }
             else
             {
-                if (size > 1)
+                if (record.fields > 0)
                     PowerManagementMainUi.battery2Current->setText(current);
-                if (size > 2)
+                if (record.fields > 1)
                     PowerManagementMainUi.battery2Voltage->setText(voltage);
             }
         }
@@ -412,9 +411,9 @@ alive. Also check for calibration as time messages stop during this process. */
         }
     }
 // Battery 3 current/voltage values
-    if ((size > 0) && (firstField == "dB3"))
+    if (record.is(recordBattery,3))
     {
-        getCurrentVoltage(breakdown,&current,&voltage);
+        getCurrentVoltage(record,&current,&voltage);
         if (PowerManagementMainUi.battery3PushButton->isChecked())
         {
             if (testIndicator(battery3UnderVoltage) || testIndicator(battery3OverCurrent))
@@ -424,9 +423,9 @@ alive. Also check for calibration as time messages stop during this process. */
             }
             else
             {
-                if (size > 1)
+                if (record.fields > 0)
                     PowerManagementMainUi.battery3Current->setText(current);
-                if (size > 2)
+                if (record.fields > 1)
                     PowerManagementMainUi.battery3Voltage->setText(voltage);
             }
         }
@@ -438,9 +437,9 @@ alive. Also check for calibration as time messages stop during this process. */
     }
 // Restore the current software settings.
 // Bit 0 = autotrack
-    if ((size > 0) && (firstField == "dD"))
+    if (record.is(recordControls))
     {
-        bool autoTrackOn = ((secondField.toInt() & 0x01) > 0);
+        bool autoTrackOn = (bitField(secondField,controlAutoTrack) > 0);
         PowerManagementMainUi.autoTrackPushButton->setChecked(autoTrackOn);
         disableRadioButtons(autoTrackOn);
     }
@@ -449,12 +448,11 @@ alive. Also check for calibration as time messages stop during this process. */
 // Disable unused batteries and associated buttons, and set checkboxes.
 // Lower case s is used for autotrack to allow switch settings to be observed.
 // In that case the original settings of the checkboxes are preserved.
-    if ((size > 0) && ((firstField == "dS") || (firstField == "ds")))
+    if (record.is(recordSwitches))
     {
-        unsigned int settings = secondField.toInt();
-        unsigned int load1Setting = (settings & 0x03);
-        unsigned int load2Setting = ((settings >> 2) & 0x03);
-        unsigned int panelSetting = ((settings >> 4) & 0x03);
+        unsigned int load1Setting = bitField(secondField,switchLoad1);
+        unsigned int load2Setting = bitField(secondField,switchLoad2);
+        unsigned int panelSetting = bitField(secondField,switchPanel);
         bool battery1Enabled = ((load1Setting == 1) || (load2Setting == 1)\
                                        || (panelSetting == 1));
         bool battery2Enabled = ((load1Setting == 2) || (load2Setting == 2)\
@@ -596,12 +594,18 @@ alive. Also check for calibration as time messages stop during this process. */
         if (! panelBattery2enabled) PowerManagementMainUi.panelBattery2->setEnabled(false);
         if (! panelBattery3enabled) PowerManagementMainUi.panelBattery3->setEnabled(false);
     }
+// Memory card CRC errors and transfers that failed after retries
+    if (record.is(recordCardErrors))
+    {
+        displayErrorMessage(QString("Memory card: %1 CRC errors, %2 failed transfers")
+                            .arg(record.value[0]).arg(record.value[1]));
+    }
 // Overload and undervoltage indicators from the I/Fs
 // Battery 1, Battery 2, Battery 3, Load 1, Load 2, Panel
 // ON is low.
-    if ((size > 0) && (firstField == "dI"))
+    if (record.is(recordIndicators))
     {
-        indicators = secondField.toInt();
+        indicators = secondField;
         if (testIndicator(battery1OverCurrent))
         {
             PowerManagementMainUi.battery1OverCurrent->
@@ -772,12 +776,12 @@ alive. Also check for calibration as time messages stop during this process. */
         }
     }
 /* Battery 1 Fill, Health and Operational State Indicators */
-    if ((size > 0) && (firstField == "dO1"))
+    if (record.is(recordOperational,1))
     {
-        int opState = secondField.toInt() & 0x03;
-        int fillState = (secondField.toInt() >> 2) & 0x03;
-        int chargingState = (secondField.toInt() >> 4) & 0x03;
-        int healthState = (secondField.toInt() >> 6) & 0x03;
+        int opState = bitField(secondField,operationalOp);
+        int fillState = bitField(secondField,operationalFill);
+        int chargingState = bitField(secondField,operationalCharge);
+        int healthState = bitField(secondField,operationalHealth);
         if (fillState == 0)         // Normal
         {
             PowerManagementMainUi.battery1Fill->
@@ -907,12 +911,12 @@ alive. Also check for calibration as time messages stop during this process. */
         }
     }
 /* Battery 2 Fill, Health and Operational State Indicators */
-    if ((size > 0) && (firstField == "dO2"))
+    if (record.is(recordOperational,2))
     {
-        int opState = secondField.toInt() & 0x03;
-        int fillState = (secondField.toInt() >> 2) & 0x03;
-        int chargingState = (secondField.toInt() >> 4) & 0x03;
-        int healthState = (secondField.toInt() >> 6) & 0x03;
+        int opState = bitField(secondField,operationalOp);
+        int fillState = bitField(secondField,operationalFill);
+        int chargingState = bitField(secondField,operationalCharge);
+        int healthState = bitField(secondField,operationalHealth);
         if (fillState == 0)         // Normal
         {
             PowerManagementMainUi.battery2Fill->
@@ -1042,12 +1046,12 @@ alive. Also check for calibration as time messages stop during this process. */
         }
     }
 /* Battery 3 Fill, Health and Operational State Indicators */
-    if ((size > 0) && (firstField == "dO3"))
+    if (record.is(recordOperational,3))
     {
-        int opState = secondField.toInt() & 0x03;
-        int fillState = (secondField.toInt() >> 2) & 0x03;
-        int chargingState = (secondField.toInt() >> 4) & 0x03;
-        int healthState = (secondField.toInt() >> 6) & 0x03;
+        int opState = bitField(secondField,operationalOp);
+        int fillState = bitField(secondField,operationalFill);
+        int chargingState = bitField(secondField,operationalCharge);
+        int healthState = bitField(secondField,operationalHealth);
         if (fillState == 0)         // Normal
         {
             PowerManagementMainUi.battery3Fill->
@@ -1177,67 +1181,63 @@ alive. Also check for calibration as time messages stop during this process. */
         }
     }
 /* SoC estimates */
-    if ((size > 0) && (firstField == "dC1"))
+    if (record.is(recordCharge,1))
     {
         if (PowerManagementMainUi.battery1PushButton->isChecked())
         {
-            if (size > 1) PowerManagementMainUi.battery1Charge
-                ->setText(QString("%1").arg(secondField
-                        .toFloat()/256,0,'f',0).append('%'));
+            if (record.fields > 0) PowerManagementMainUi.battery1Charge
+                ->setText(QString("%1").arg(record.scaled(0),0,'f',0).append('%'));
         }
         else
         {
             PowerManagementMainUi.battery1Charge->clear();
         }
     }
-    if ((size > 0) && (firstField == "dC2"))
+    if (record.is(recordCharge,2))
     {
         if (PowerManagementMainUi.battery2PushButton->isChecked())
         {
-            if (size > 1) PowerManagementMainUi.battery2Charge
-                ->setText(QString("%1").arg(secondField
-                        .toFloat()/256,0,'f',0).append('%'));
+            if (record.fields > 0) PowerManagementMainUi.battery2Charge
+                ->setText(QString("%1").arg(record.scaled(0),0,'f',0).append('%'));
         }
         else
         {
             PowerManagementMainUi.battery2Charge->clear();
         }
     }
-    if ((size > 0) && (firstField == "dC3"))
+    if (record.is(recordCharge,3))
     {
         if (PowerManagementMainUi.battery3PushButton->isChecked())
         {
-            if (size > 1) PowerManagementMainUi.battery3Charge
-                ->setText(QString("%1").arg(secondField
-                        .toFloat()/256,0,'f',0).append('%'));
+            if (record.fields > 0) PowerManagementMainUi.battery3Charge
+                ->setText(QString("%1").arg(record.scaled(0),0,'f',0).append('%'));
         }
         else
         {
             PowerManagementMainUi.battery3Charge->clear();
         }
     }
-    if ((size > 0) && (firstField == "dT"))
+    if (record.is(recordTemperature))
     {
-        if (size > 1) PowerManagementMainUi.temperature
-            ->setText(QString("%1").arg(secondField
-                .toFloat()/256,0,'f',1).append(QChar(0x00B0)).append("C"));
+        if (record.fields > 0) PowerManagementMainUi.temperature
+            ->setText(QString("%1").arg(record.scaled(0),0,'f',1).append(QChar(0x00B0)).append("C"));
     }
 /* Messages for the File Task start with f */
-    if ((size > 0) && (firstField.left(1) == "f"))
+    if (firstField.left(1) == "f")
     {
         recordMessageReceived(response);
     }
 /* Messages for the Configure Task start with p or dO or dD (debug) */
-    if ((size > 0) && ((firstField.left(1) == "p") || (firstField.left(2) == "dO")))
+    if ((firstField.left(1) == "p") || (firstField.left(2) == "dO"))
     {
         configureMessageReceived(response);
     }
-    if ((size > 0) && (firstField.left(2) == "dD"))
+    if (firstField.left(2) == "dD")
     {
         configureMessageReceived(response);
     }
 /* This allows debug messages to be displayed on the terminal. */
-    if ((size > 0) && (firstField.left(1) == "D"))
+    if (firstField.left(1) == "D")
     {
         qDebug() << response;
     }
@@ -1246,27 +1246,26 @@ alive. Also check for calibration as time messages stop during this process. */
 //-----------------------------------------------------------------------------
 /** @brief Convert Voltage and Current Strings for Display
 
-The current and voltage values are obtained from the command string breakdown
-converted to a QString form suitable for display. The breakdown is
-0 - command, 1 - current, 2- voltage.
+The current and voltage values are obtained from the decoded record and
+converted to a QString form suitable for display. The record fields are
+0 - current, 1 - voltage.
 
 An entry is saved in the save file if it is open.
 */
 
-void PowerManagementGui::getCurrentVoltage(const QStringList breakdown,
+void PowerManagementGui::getCurrentVoltage(const PowerManagementRecord &record,
                                            QString* sCurrent, QString* sVoltage)
 {
-    int size = breakdown.size();
-    QString entry = breakdown[0].simplified();
-    if (size > 1)
+    QString entry = QString::fromLatin1(record.code,2).append(QString::number(record.index));
+    if (record.fields > 0)
     {
-        float fCurrent = breakdown[1].simplified().toFloat()/256;
+        float fCurrent = record.scaled(0);
         *sCurrent = QString("%1").arg(fCurrent,0,'f',2);
         entry = entry.append(",").append(*sCurrent);
     }
-    if (size > 2)
+    if (record.fields > 1)
     {
-        float fVoltage = breakdown[2].simplified().toFloat()/256;
+        float fVoltage = record.scaled(1);
         *sVoltage = QString("%1").arg(fVoltage,0,'f',2);
         entry = entry.append(",").append(*sVoltage);
     }
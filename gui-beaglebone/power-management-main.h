@@ -42,6 +42,7 @@
 
 #include "ui_power-management.h"
 #include "power-management.h"
+#include "power-management-records.h"
 #include "serialport.h"
 #include <QDir>
 #include <QFile>
@@ -150,8 +151,8 @@ private:
     unsigned int indicators;
     void initGui();
     void processResponse(const QString response);
-    void getCurrentVoltage(const QStringList breakdown,QString* sVoltage,
-                           QString* sCurrent);
+    void getCurrentVoltage(const PowerManagementRecord &record,
+                           QString* sVoltage, QString* sCurrent);
     void displayErrorMessage(const QString message);
     void ssleep(int seconds);
     char timeTick;
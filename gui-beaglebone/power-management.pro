@@ -2,6 +2,7 @@ PROJECT =       Power Management GUI
 TEMPLATE =      app
 TARGET          += 
 DEPENDPATH      += .
+INCLUDEPATH     += ../gui
 include(../auxiliary/qextserialport-v1.2/src/qextserialport.pri)
 
 OBJECTS_DIR     = obj
@@ -9,7 +10,7 @@ MOC_DIR         = moc
 UI_HEADERS_DIR  = ui
 UI_SOURCES_DIR  = ui
 LANGUAGE        = C++
-CONFIG          += qt warn_on release
+CONFIG          += qt warn_on release c++11
 QT              += network
 
 RESOURCES       = power-management-gui.qrc
@@ -17,6 +18,7 @@ RESOURCES       = power-management-gui.qrc
 FORMS           += power-management.ui
 HEADERS         += power-management-main.h
 HEADERS         += serialport.h
+HEADERS         += ../gui/power-management-records.h
 SOURCES         += power-management.cpp
 SOURCES         += power-management-main.cpp
 SOURCES         += serialport.cpp
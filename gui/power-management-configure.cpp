@@ -39,6 +39,7 @@ algorithmic configurations, calibration and general operational configuration.
 #include <QDateTime>
 #include <QDir>
 #include <QFile>
+#include <QtEndian>
 #include <QDebug>
 #include <QtNetwork>
 #include <QTcpSocket>
@@ -103,14 +104,11 @@ PowerManagementConfigGui::PowerManagementConfigGui(QTcpSocket* tcpSocket, QWidge
             ->setText(QString("0 m").append(QChar(0x03A9)));
 /* Ask for identification */
     socket->write("aE\n\r");
-/* Ask for battery parameters to fill display */
-    on_queryBatteryButton_clicked();
+/* Ask for the entire configuration in a single snapshot to fill display. The
+measured battery resistances are not part of this and are obtained by Query. */
+    socket->write("dK\n\r");
 /* Ask for switch control settings */
     socket->write("dS\n\r");
-/* Ask for monitor strategy parameter settings */
-    socket->write("dT\n\r");
-/* Ask for charger strategy parameter settings */
-    socket->write("dC\n\r");
 }
 
 PowerManagementConfigGui::~PowerManagementConfigGui()
@@ -724,6 +722,51 @@ void PowerManagementConfigGui::onMessageReceived(const QString &response)
         PowerManagementConfigUi.boardVersion->setText("Interface Board Version: " + breakdown[3]);
         return;
     }
+// Configuration snapshot: version, length, checksum and data in hex.
+    if (command == 'K')
+    {
+        if (size != 5) return;
+        bool ok;
+        int version = breakdown[1].simplified().toInt();
+        int length = breakdown[2].simplified().toInt();
+        quint32 crc = breakdown[3].simplified().toUInt(&ok,16);
+        QByteArray snapshot = QByteArray::fromHex(breakdown[4].simplified().toLatin1());
+        if (! ok || (snapshot.size() != length) ||
+            ((crc32Update(0xFFFFFFFF,snapshot.constData(),length) ^ 0xFFFFFFFF) != crc))
+        {
+            displayErrorMessage("Configuration snapshot corrupted");
+            snapshotFileName.clear();
+            return;
+        }
+        if ((version == CONFIG_SNAPSHOT_VERSION) && (length == CONFIG_SNAPSHOT_LENGTH))
+            displayConfigSnapshot(snapshot);
+        else
+            displayErrorMessage("Configuration snapshot version not supported");
+// A snapshot of any version can be saved to a file if this was requested.
+        if (! snapshotFileName.isEmpty())
+        {
+            QByteArray header;
+            header.append((char)version);
+            saveConfigSnapshot(header.append(snapshot),crc);
+        }
+        return;
+    }
+// Status of a configuration snapshot load
+    if (command == 'k')
+    {
+        if (size < 2) return;
+        QString statusText[5] = {"Configuration loaded and saved to FLASH",
+                                 "Configuration snapshot version not supported",
+                                 "Configuration snapshot length mismatch",
+                                 "Configuration snapshot corrupted",
+                                 "Configuration FLASH write failed"};
+        int status = breakdown[1].simplified().toInt();
+        if ((status >= 0) && (status < 5)) displayErrorMessage(statusText[status]);
+/* Refresh the display from the configuration now in force */
+        socket->write("dK\n\r");
+        return;
+    }
+    if (breakdown[0].size() < 3) return;
     QChar battery = breakdown[0].at(2);
     QChar parameter = breakdown[0].at(2);
     int controlByte = 0;
@@ -1041,6 +1084,195 @@ battery; bit 1 is to maintain an isolated battery in normal conditions. */
     }
 }
 
+//-----------------------------------------------------------------------------
+/** @brief Save a Configuration Snapshot
+
+A file name is chosen and a snapshot requested from the remote. The file is
+written when the snapshot arrives.
+*/
+
+void PowerManagementConfigGui::on_saveConfigButton_clicked()
+{
+    QString fileName = QFileDialog::getSaveFileName(this,
+                        "Save Configuration Snapshot",
+                        QString(),
+                        "Configuration Snapshots (*.cfg)");
+    if (fileName.isEmpty()) return;
+    if (! fileName.endsWith(".cfg")) fileName.append(".cfg");
+    snapshotFileName = fileName;
+    socket->write("dK\n\r");
+}
+
+//-----------------------------------------------------------------------------
+/** @brief Load a Configuration Snapshot
+
+The snapshot file is checked and sent to the remote, which replaces its entire
+configuration and writes it to FLASH. The current offset calibration of the
+remote is kept, as the snapshot may have been saved from another board. The
+response status is processed later.
+*/
+
+void PowerManagementConfigGui::on_loadConfigButton_clicked()
+{
+    QString fileName = QFileDialog::getOpenFileName(this,
+                        "Load Configuration Snapshot",
+                        QString(),
+                        "Configuration Snapshots (*.cfg)");
+    if (fileName.isEmpty()) return;
+    QFile file(fileName);
+    if (! file.open(QIODevice::ReadOnly))
+    {
+        displayErrorMessage("Could not open the snapshot file");
+        return;
+    }
+    QByteArray contents = file.readAll();
+    file.close();
+// Header is "BMSC", version, two bytes of length and four bytes of checksum.
+    if ((contents.size() < 11) || (! contents.startsWith("BMSC")))
+    {
+        displayErrorMessage("Not a configuration snapshot file");
+        return;
+    }
+    const uchar *header = (const uchar*)contents.constData();
+    int version = header[4];
+    int length = qFromLittleEndian<quint16>(header+5);
+    quint32 crc = qFromLittleEndian<quint32>(header+7);
+    QByteArray snapshot = contents.mid(11);
+    if ((snapshot.size() != length) ||
+        ((crc32Update(0xFFFFFFFF,snapshot.constData(),length) ^ 0xFFFFFFFF) != crc))
+    {
+        displayErrorMessage("Configuration snapshot file corrupted");
+        return;
+    }
+    if (version != CONFIG_SNAPSHOT_VERSION)
+    {
+        displayErrorMessage("Configuration snapshot version not supported");
+        return;
+    }
+    socket->write(QString("pK%1,%2,%3,").arg(version).arg(length)
+                    .arg(crc,8,16,QChar('0')).toUpper().toLatin1().constData());
+    socket->write(snapshot.toHex().toUpper().constData());
+    socket->write("\n\r");
+}
+
+//-----------------------------------------------------------------------------
+/** @brief Write a Configuration Snapshot to the requested File
+
+@param[in] snapshot Version byte followed by the configuration snapshot.
+@param[in] crc Checksum of the configuration snapshot.
+*/
+
+void PowerManagementConfigGui::saveConfigSnapshot(const QByteArray &snapshot,
+                                                  quint32 crc)
+{
+    QFile file(snapshotFileName);
+    snapshotFileName.clear();
+    if (! file.open(QIODevice::WriteOnly))
+    {
+        displayErrorMessage("Could not open the snapshot file");
+        return;
+    }
+    uchar field[4];
+    QByteArray contents("BMSC");
+    contents.append(snapshot.left(1));
+    qToLittleEndian<quint16>(snapshot.size()-1,field);
+    contents.append((const char*)field,2);
+    qToLittleEndian<quint32>(crc,field);
+    contents.append((const char*)field,4);
+    contents.append(snapshot.mid(1));
+    if (file.write(contents) != contents.size())
+        displayErrorMessage("Error writing the snapshot file");
+    else
+        displayErrorMessage("Configuration snapshot saved");
+    file.close();
+}
+
+//-----------------------------------------------------------------------------
+/** @brief Display a Configuration Snapshot
+
+The snapshot is decoded by the field offsets of snapshot version 2, a fixed
+little endian layout without padding that does not depend on how the firmware
+compiler lays out its configuration structure. Battery type and capacity are
+set first as changing these resets the other battery parameters to defaults.
+
+@param[in] snapshot Configuration snapshot.
+*/
+
+void PowerManagementConfigGui::displayConfigSnapshot(const QByteArray &snapshot)
+{
+    const uchar *data = (const uchar*)snapshot.constData();
+    QComboBox *typeCombo[3] = {PowerManagementConfigUi.battery1TypeCombo,
+                               PowerManagementConfigUi.battery2TypeCombo,
+                               PowerManagementConfigUi.battery3TypeCombo};
+    QSpinBox *capacity[3] = {PowerManagementConfigUi.battery1CapacitySpinBox,
+                             PowerManagementConfigUi.battery2CapacitySpinBox,
+                             PowerManagementConfigUi.battery3CapacitySpinBox};
+    QDoubleSpinBox *absorptionVoltage[3] =
+                        {PowerManagementConfigUi.battery1AbsorptionVoltage,
+                         PowerManagementConfigUi.battery2AbsorptionVoltage,
+                         PowerManagementConfigUi.battery3AbsorptionVoltage};
+    QDoubleSpinBox *absorptionCurrent[3] =
+                        {PowerManagementConfigUi.battery1AbsorptionCurrent,
+                         PowerManagementConfigUi.battery2AbsorptionCurrent,
+                         PowerManagementConfigUi.battery3AbsorptionCurrent};
+    QDoubleSpinBox *floatVoltage[3] =
+                        {PowerManagementConfigUi.battery1FloatVoltage,
+                         PowerManagementConfigUi.battery2FloatVoltage,
+                         PowerManagementConfigUi.battery3FloatVoltage};
+    QDoubleSpinBox *floatCurrent[3] =
+                        {PowerManagementConfigUi.battery1FloatCurrent,
+                         PowerManagementConfigUi.battery2FloatCurrent,
+                         PowerManagementConfigUi.battery3FloatCurrent};
+// Communications controls
+    PowerManagementConfigUi.dataMessageCheckbox->setChecked(data[snapshotMeasurementSend] != 0);
+    PowerManagementConfigUi.debugMessageCheckbox->setChecked(data[snapshotDebugMessageSend] != 0);
+// Battery parameters
+    for (int i=0; i<3; i++)
+    {
+        float batteryCapacity =
+            qFromLittleEndian<quint16>(data+snapshotBatteryCapacity+2*i);
+        typeCombo[i]->setCurrentIndex(data[snapshotBatteryType+i]);
+        capacity[i]->setValue(batteryCapacity);
+        absorptionVoltage[i]->setValue((float)qFromLittleEndian<qint16>
+                                (data+snapshotAbsorptionVoltage+2*i)/256);
+        floatVoltage[i]->setValue((float)qFromLittleEndian<qint16>
+                                (data+snapshotFloatVoltage+2*i)/256);
+        qint16 floatCurrentScale =
+            qFromLittleEndian<qint16>(data+snapshotFloatStageCurrentScale+2*i);
+        if (floatCurrentScale > 0)
+            floatCurrent[i]->setValue(batteryCapacity/floatCurrentScale);
+        qint16 bulkCurrentScale =
+            qFromLittleEndian<qint16>(data+snapshotBulkCurrentLimitScale+2*i);
+        if (bulkCurrentScale > 0)
+            absorptionCurrent[i]->setValue(batteryCapacity/bulkCurrentScale);
+    }
+/* Monitor strategy byte. Bit 0 is to allow charger and load on the same
+battery; bit 1 is to maintain an isolated battery in normal conditions. */
+    int monitorStrategy = data[snapshotMonitorStrategy];
+    PowerManagementConfigUi.loadChargeCheckBox->setChecked((monitorStrategy & 1) > 0);
+    PowerManagementConfigUi.isolationMaintainCheckBox->setChecked((monitorStrategy & 2) > 0);
+    PowerManagementConfigUi.lowVoltageDoubleSpinBox
+        ->setValue((float)qFromLittleEndian<qint16>(data+snapshotLowVoltage)/256);
+    PowerManagementConfigUi.criticalVoltageDoubleSpinBox
+        ->setValue((float)qFromLittleEndian<qint16>(data+snapshotCriticalVoltage)/256);
+    PowerManagementConfigUi.lowSoCSpinBox
+        ->setValue(qFromLittleEndian<qint16>(data+snapshotLowSoC)/256);
+    PowerManagementConfigUi.criticalSoCSpinBox
+        ->setValue(qFromLittleEndian<qint16>(data+snapshotCriticalSoC)/256);
+    PowerManagementConfigUi.floatBulkSoCSpinBox
+        ->setValue(qFromLittleEndian<qint16>(data+snapshotFloatBulkSoC)/256);
+/* Charger strategy byte. Bit 0 is to suppress the absortion phase for EMI. */
+    PowerManagementConfigUi.absorptionMuteCheckbox->setChecked((data[snapshotChargerStrategy] & 1) > 0);
+    PowerManagementConfigUi.restTimeSpinBox
+        ->setValue(qFromLittleEndian<qint16>(data+snapshotRestTime));
+    PowerManagementConfigUi.absorptionTimeSpinBox
+        ->setValue(qFromLittleEndian<quint16>(data+snapshotAbsorptionTime));
+    PowerManagementConfigUi.minimumDutyCycleSpinBox
+        ->setValue(qFromLittleEndian<qint16>(data+snapshotMinDutyCycle)/256);
+    PowerManagementConfigUi.floatDelaySpinBox
+        ->setValue(qFromLittleEndian<qint16>(data+snapshotFloatTime));
+}
+
 //-----------------------------------------------------------------------------
 /** @brief Error Message
 
@@ -36,6 +36,38 @@
 #include <QDialog>
 #include <QtNetwork>
 #include <QTcpSocket>
+#include <QByteArray>
+
+//! Configuration snapshot version understood here; must match the firmware.
+#define CONFIG_SNAPSHOT_VERSION 2
+//! Length of the configuration snapshot for this snapshot version.
+#define CONFIG_SNAPSHOT_LENGTH  97
+
+//! Byte offsets of the fields of snapshot version 2, which is little endian
+//! with no padding (see power-management-objdic.h in the firmware). Battery
+//! fields are arrays of three, each of two bytes except the type of one byte.
+enum ConfigSnapshotOffset
+{
+    snapshotMeasurementSend = 1,
+    snapshotDebugMessageSend = 2,
+    snapshotBatteryCapacity = 4,
+    snapshotBatteryType = 10,
+    snapshotAbsorptionVoltage = 13,
+    snapshotFloatVoltage = 19,
+    snapshotFloatStageCurrentScale = 25,
+    snapshotBulkCurrentLimitScale = 31,
+    snapshotMonitorStrategy = 45,
+    snapshotLowVoltage = 46,
+    snapshotCriticalVoltage = 48,
+    snapshotLowSoC = 50,
+    snapshotCriticalSoC = 52,
+    snapshotFloatBulkSoC = 54,
+    snapshotChargerStrategy = 56,
+    snapshotRestTime = 57,
+    snapshotAbsorptionTime = 59,
+    snapshotMinDutyCycle = 61,
+    snapshotFloatTime = 63
+};
 
 //-----------------------------------------------------------------------------
 /** @brief Power Management Configure Window.
@@ -77,6 +109,8 @@ private slots:
     void on_setTrackOptionButton_clicked();
     void on_setChargeOptionButton_clicked();
     void on_absorptionMuteCheckbox_clicked();
+    void on_saveConfigButton_clicked();
+    void on_loadConfigButton_clicked();
     void onMessageReceived(const QString &text);
     void displayErrorMessage(const QString message);
 private:
@@ -90,6 +124,9 @@ private:
     QString errorMessage;
     QString response;           // String to build a line of characters
     QString quiescentCurrent;
+    void displayConfigSnapshot(const QByteArray &snapshot);
+    void saveConfigSnapshot(const QByteArray &snapshot, quint32 crc);
+    QString snapshotFileName;   // File awaiting a snapshot to be saved
 };
 
 #endif
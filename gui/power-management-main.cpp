@@ -78,6 +78,10 @@ PowerManagementGui::PowerManagementGui(QString device, uint parameter,
 
     saveFile.clear();
     response.clear();
+    probeSend = 0;
+    lastProbeSend = 0;
+    lastProbeReceive = 0;
+    probeAnswered = false;
 
     socket = NULL;
 #ifdef SERIAL
@@ -103,6 +107,10 @@ PowerManagementGui::PowerManagementGui(QString device, uint parameter,
 /* This should cause the microcontroller to respond with all data */
         socket->write("dS\n\r");
     }
+/* Keep the remote clock to the time of this machine */
+    clockProbeTimer = new QTimer(this);
+    connect(clockProbeTimer, SIGNAL(timeout()), this, SLOT(onClockProbeTimeout()));
+    clockProbeTimer->start(CLOCK_PROBE_INTERVAL);
 }
 
 PowerManagementGui::~PowerManagementGui()
@@ -273,6 +281,46 @@ void PowerManagementGui::onDataAvailable()
     }
 }
 
+//-----------------------------------------------------------------------------
+/** @brief Send a Clock Probe
+
+The remote clock is kept to the time of this machine by an exchange of probes
+as in NTP. Each probe carries the time it was sent, and the times of sending the
+previous probe and of receiving its reply if it was answered, all in ms as
+32 bit hexadecimal. The remote system works out the offset and frequency of its
+clock from these and slews its clock to match.
+*/
+
+void PowerManagementGui::onClockProbeTimeout()
+{
+    if (socket == NULL) return;
+    if (! probeAnswered)
+    {
+        lastProbeSend = 0;
+        lastProbeReceive = 0;
+    }
+    probeAnswered = false;
+    probeSend = hostClock();
+    QString probe = QString("pN%1,%2,%3\n\r").arg(probeSend,8,16,QChar('0'))
+                                          .arg(lastProbeSend,8,16,QChar('0'))
+                                          .arg(lastProbeReceive,8,16,QChar('0'));
+    socket->write(probe.toLatin1().constData());
+}
+
+//-----------------------------------------------------------------------------
+/** @brief Host Clock for the Remote System
+
+The time is that given when the remote time is set, that is local time taken as
+UTC, in ms. Only the low 32 bits are used.
+*/
+
+quint32 PowerManagementGui::hostClock()
+{
+    QDateTime localDateTime = QDateTime::currentDateTime();
+    localDateTime.setTimeSpec(Qt::UTC);
+    return (quint32)localDateTime.toMSecsSinceEpoch();
+}
+
 //-----------------------------------------------------------------------------
 /** @brief Process the incoming serial data
 
@@ -281,24 +329,39 @@ Parse the line and take action on the command received.
 
 void PowerManagementGui::processResponse(const QString response)
 {
-    QStringList breakdown = response.split(",");
-    int size = breakdown.size();
-    QString firstField;
-    firstField = breakdown[0].simplified();
-    QString secondField;
-    if (size > 1) secondField = breakdown[1].simplified();
+/* Reply to a clock probe, kept to complete the exchange with the next probe */
+    if (response.startsWith("pN"))
+    {
+        quint32 received = hostClock();
+        if ((quint32)response.section(',',1,1).toLongLong() == probeSend)
+        {
+            lastProbeSend = probeSend;
+            lastProbeReceive = received;
+            probeAnswered = true;
+        }
+        return;
+    }
+    QByteArray line = response.toLatin1();
+    PowerManagementRecord record;
+    decodeRecord(line.constData(),line.size(),record);
+/* Decoded numeric records are made available to other windows */
+    if ((record.type != recordNone) && (record.type != recordTime))
+        telemetry.write(record);
+    bool switchRecord = recordIdentifierIs(line.constData(),line.size(),"dS");
+    int secondField = record.value[0];
     QString current, voltage;
     if (! saveFile.isEmpty()) saveLine(response);
 /* When the time field is received, send back a short message to keep comms
 alive. Also check for calibration as time messages stop during this process. */
-    if ((size > 0) && ((firstField == "pH") || (firstField == "pQ")))
+    if (recordIdentifierIs(line.constData(),line.size(),"pH") ||
+        recordIdentifierIs(line.constData(),line.size(),"pQ"))
     {
         socket->write("pc+\n\r");
     }
 // Load 1 current/voltage values
-    if ((size > 0) && (firstField == "dL1"))
+    if (record.is(recordLoad,1))
     {
-        getCurrentVoltage(breakdown,&current,&voltage);
+        getCurrentVoltage(record,&current,&voltage);
         if (PowerManagementMainUi.load1CheckBox->isChecked())
         {
             if (testIndicator(load1UnderVoltage) || testIndicator(load1OverCurrent))
@@ -308,9 +371,9 @@ alive. Also check for calibration as time messages stop during this process. */
             }
             else
             {
-                if (size > 1)
+                if (record.fields > 0)
                     PowerManagementMainUi.load1Current->setText(current);
-                if (size > 2)
+                if (record.fields > 1)
                     PowerManagementMainUi.load1Voltage->setText(voltage);
             }
         }
@@ -321,9 +384,9 @@ alive. Also check for calibration as time messages stop during this process. */
         }
     }
 // Load 2 current/voltage values
-    if ((size > 0) && (firstField == "dL2"))
+    if (record.is(recordLoad,2))
     {
-        getCurrentVoltage(breakdown,&current,&voltage);
+        getCurrentVoltage(record,&current,&voltage);
         if (PowerManagementMainUi.load2CheckBox->isChecked())
         {
             if (testIndicator(load2UnderVoltage) || testIndicator(load2OverCurrent))
@@ -333,9 +396,9 @@ alive. Also check for calibration as time messages stop during this process. */
             }
             else
             {
-                if (size > 1)
+                if (record.fields > 0)
                     PowerManagementMainUi.load2Current->setText(current);
-                if (size > 2)
+                if (record.fields > 1)
                     PowerManagementMainUi.load2Voltage->setText(voltage);
             }
         }
@@ -346,9 +409,9 @@ alive. Also check for calibration as time messages stop during this process. */
         }
     }
 // Panel current/voltage values
-    if ((size > 0) && (firstField == "dM1"))
+    if (record.is(recordPanel,1))
     {
-        getCurrentVoltage(breakdown,&current,&voltage);
+        getCurrentVoltage(record,&current,&voltage);
         if (PowerManagementMainUi.panelCheckBox->isChecked())
         {
             if (testIndicator(panelUnderVoltage) || testIndicator(panelOverCurrent))
@@ -358,9 +421,9 @@ alive. Also check for calibration as time messages stop during this process. */
             }
             else
             {
-                if (size > 1)
+                if (record.fields > 0)
                     PowerManagementMainUi.panelCurrent->setText(current);
-                if (size > 2)
+                if (record.fields > 1)
                     PowerManagementMainUi.panelVoltage->setText(voltage);
             }
         }
@@ -371,9 +434,9 @@ alive. Also check for calibration as time messages stop during this process. */
         }
     }
 // Battery 1 current/voltage values
-    if ((size > 0) && (firstField == "dB1"))
+    if (record.is(recordBattery,1))
     {
-        getCurrentVoltage(breakdown,&current,&voltage);
+        getCurrentVoltage(record,&current,&voltage);
         if (PowerManagementMainUi.battery1CheckBox->isChecked())
         {
             if (testIndicator(battery1UnderVoltage) || testIndicator(battery1OverCurrent))
@@ -383,9 +446,9 @@ alive. Also check for calibration as time messages stop during this process. */
             }
             else
             {
-                if (size > 1)
+                if (record.fields > 0)
                     PowerManagementMainUi.battery1Current->setText(current);
-                if (size > 2)
+                if (record.fields > 1)
                     PowerManagementMainUi.battery1Voltage->setText(voltage);
             }
         }
@@ -396,9 +459,9 @@ alive. Also check for calibration as time messages stop during this process. */
         }
     }
 // Battery 2 current/voltage values
-    if ((size > 0) && (firstField == "dB2"))
+    if (record.is(recordBattery,2))
     {
-        getCurrentVoltage(breakdown,&current,&voltage);
+        getCurrentVoltage(record,&current,&voltage);
         if (PowerManagementMainUi.battery2CheckBox->isChecked())
         {
             if (testIndicator(battery2UnderVoltage) || testIndicator(battery2OverCurrent))
@@ -408,9 +471,9 @@ alive. Also check for calibration as time messages stop during this process. */
             }
             else
             {
-                if (size > 1)
+                if (record.fields > 0)
                     PowerManagementMainUi.battery2Current->setText(current);
-                if (size > 2)
+                if (record.fields > 1)
                     PowerManagementMainUi.battery2Voltage->setText(voltage);
             }
         }
@@ -421,9 +484,9 @@ alive. Also check for calibration as time messages stop during this process. */
         }
     }
 // Battery 3 current/voltage values
-    if ((size > 0) && (firstField == "dB3"))
+    if (record.is(recordBattery,3))
     {
-        getCurrentVoltage(breakdown,&current,&voltage);
+        getCurrentVoltage(record,&current,&voltage);
         if (PowerManagementMainUi.battery3CheckBox->isChecked())
         {
             if (testIndicator(battery3UnderVoltage) || testIndicator(battery3OverCurrent))
@@ -433,9 +496,9 @@ alive. Also check for calibration as time messages stop during this process. */
             }
             else
             {
-                if (size > 1)
+                if (record.fields > 0)
                     PowerManagementMainUi.battery3Current->setText(current);
-                if (size > 2)
+                if (record.fields > 1)
                     PowerManagementMainUi.battery3Voltage->setText(voltage);
             }
         }
@@ -447,9 +510,9 @@ alive. Also check for calibration as time messages stop during this process. */
     }
 // Restore the current software settings.
 // Bit 0 = autotrack
-    if ((size > 0) && (firstField == "dD"))
+    if (record.is(recordControls))
     {
-        bool autoTrackOn = ((secondField.toInt() & 0x01) > 0);
+        bool autoTrackOn = (bitField(secondField,controlAutoTrack) > 0);
         PowerManagementMainUi.autoTrackCheckBox->setChecked(autoTrackOn);
         disableRadioButtons(autoTrackOn);
     }
@@ -458,12 +521,11 @@ alive. Also check for calibration as time messages stop during this process. */
 // Disable unused batteries and associated buttons, and set checkboxes.
 // Lower case s is used for autotrack to allow switch settings to be observed.
 // In that case the original settings of the checkboxes are preserved.
-    if ((size > 0) && ((firstField == "dS") || (firstField == "ds")))
+    if (record.is(recordSwitches))
     {
-        unsigned int settings = secondField.toInt();
-        unsigned int load1Setting = (settings & 0x03);
-        unsigned int load2Setting = ((settings >> 2) & 0x03);
-        unsigned int panelSetting = ((settings >> 4) & 0x03);
+        unsigned int load1Setting = bitField(secondField,switchLoad1);
+        unsigned int load2Setting = bitField(secondField,switchLoad2);
+        unsigned int panelSetting = bitField(secondField,switchPanel);
         bool battery1Enabled = ((load1Setting == 1) || (load2Setting == 1)\
                                        || (panelSetting == 1));
         bool battery2Enabled = ((load1Setting == 2) || (load2Setting == 2)\
@@ -471,7 +533,7 @@ alive. Also check for calibration as time messages stop during this process. */
         bool battery3Enabled = ((load1Setting == 3) || (load2Setting == 3)\
                                        || (panelSetting == 3));
 // Disable a battery if none of the load/panels are selected for it
-        if (firstField == "dS")
+        if (switchRecord)
         {
             PowerManagementMainUi.battery1CheckBox->setChecked(battery1Enabled);
             PowerManagementMainUi.battery2CheckBox->setChecked(battery2Enabled);
@@ -487,7 +549,7 @@ alive. Also check for calibration as time messages stop during this process. */
             PowerManagementMainUi.panelBattery3->setEnabled(battery3Enabled);
         }
 // Set each of the switch settings
-        if (firstField == "dS")
+        if (switchRecord)
             PowerManagementMainUi.load1CheckBox->setChecked(true);
         bool load1Battery1enabled = PowerManagementMainUi.load1Battery1->isEnabled();
         bool load1Battery2enabled = PowerManagementMainUi.load1Battery2->isEnabled();
@@ -526,7 +588,7 @@ alive. Also check for calibration as time messages stop during this process. */
         if (! load1Battery2enabled) PowerManagementMainUi.load1Battery2->setEnabled(false);
         if (! load1Battery3enabled) PowerManagementMainUi.load1Battery3->setEnabled(false);
 
-        if (firstField == "dS")
+        if (switchRecord)
             PowerManagementMainUi.load2CheckBox->setChecked(true);
         bool load2Battery1enabled = PowerManagementMainUi.load2Battery1->isEnabled();
         bool load2Battery2enabled = PowerManagementMainUi.load2Battery2->isEnabled();
@@ -565,7 +627,7 @@ alive. Also check for calibration as time messages stop during this process. */
         if (! load2Battery2enabled) PowerManagementMainUi.load2Battery2->setEnabled(false);
         if (! load2Battery3enabled) PowerManagementMainUi.load2Battery3->setEnabled(false);
 
-        if (firstField == "dS")
+        if (switchRecord)
             PowerManagementMainUi.panelBattery1->setChecked(true);
         bool panelBattery1enabled = PowerManagementMainUi.panelBattery1->isEnabled();
         bool panelBattery2enabled = PowerManagementMainUi.panelBattery2->isEnabled();
@@ -605,12 +667,18 @@ alive. Also check for calibration as time messages stop during this process. */
         if (! panelBattery2enabled) PowerManagementMainUi.panelBattery2->setEnabled(false);
         if (! panelBattery3enabled) PowerManagementMainUi.panelBattery3->setEnabled(false);
     }
+// Memory card CRC errors and transfers that failed after retries
+    if (record.is(recordCardErrors))
+    {
+        displayErrorMessage(QString("Memory card: %1 CRC errors, %2 failed transfers")
+                            .arg(record.value[0]).arg(record.value[1]));
+    }
 // Overload and undervoltage indicators from the I/Fs
 // Battery 1, Battery 2, Battery 3, Load 1, Load 2, Panel
 // ON is low.
-    if ((size > 0) && (firstField == "dI"))
+    if (record.is(recordIndicators))
     {
-        indicators = secondField.toInt();
+        indicators = secondField;
         if (testIndicator(battery1OverCurrent))
         {
             PowerManagementMainUi.battery1OverCurrent->
@@ -781,12 +849,12 @@ alive. Also check for calibration as time messages stop during this process. */
         }
     }
 /* Battery 1 Fill, Health and Operational State Indicators */
-    if ((size > 0) && (firstField == "dO1"))
+    if (record.is(recordOperational,1))
     {
-        int opState = secondField.toInt() & 0x03;
-        int fillState = (secondField.toInt() >> 2) & 0x03;
-        int chargingState = (secondField.toInt() >> 4) & 0x03;
-        int healthState = (secondField.toInt() >> 6) & 0x03;
+        int opState = bitField(secondField,operationalOp);
+        int fillState = bitField(secondField,operationalFill);
+        int chargingState = bitField(secondField,operationalCharge);
+        int healthState = bitField(secondField,operationalHealth);
         if (fillState == 0)         // Normal
         {
             PowerManagementMainUi.battery1Fill->
@@ -923,12 +991,12 @@ alive. Also check for calibration as time messages stop during this process. */
         }
     }
 /* Battery 2 Fill, Health and Operational State Indicators */
-    if ((size > 0) && (firstField == "dO2"))
+    if (record.is(recordOperational,2))
     {
-        int opState = secondField.toInt() & 0x03;
-        int fillState = (secondField.toInt() >> 2) & 0x03;
-        int chargingState = (secondField.toInt() >> 4) & 0x03;
-        int healthState = (secondField.toInt() >> 6) & 0x03;
+        int opState = bitField(secondField,operationalOp);
+        int fillState = bitField(secondField,operationalFill);
+        int chargingState = bitField(secondField,operationalCharge);
+        int healthState = bitField(secondField,operationalHealth);
         if (fillState == 0)         // Normal
         {
             PowerManagementMainUi.battery2Fill->
@@ -1058,12 +1126,12 @@ alive. Also check for calibration as time messages stop during this process. */
         }
     }
 /* Battery 3 Fill, Health and Operational State Indicators */
-    if ((size > 0) && (firstField == "dO3"))
+    if (record.is(recordOperational,3))
     {
-        int opState = secondField.toInt() & 0x03;
-        int fillState = (secondField.toInt() >> 2) & 0x03;
-        int chargingState = (secondField.toInt() >> 4) & 0x03;
-        int healthState = (secondField.toInt() >> 6) & 0x03;
+        int opState = bitField(secondField,operationalOp);
+        int fillState = bitField(secondField,operationalFill);
+        int chargingState = bitField(secondField,operationalCharge);
+        int healthState = bitField(secondField,operationalHealth);
         if (fillState == 0)         // Normal
         {
             PowerManagementMainUi.battery3Fill->
@@ -1193,65 +1261,61 @@ alive. Also check for calibration as time messages stop during this process. */
         }
     }
 /* SoC estimates */
-    if ((size > 0) && (firstField == "dC1"))
+    if (record.is(recordCharge,1))
     {
         if (PowerManagementMainUi.battery1CheckBox->isChecked())
         {
-            if (size > 1) PowerManagementMainUi.battery1Charge
-                ->setText(QString("%1").arg(secondField
-                        .toFloat()/256,0,'f',0).append('%'));
+            if (record.fields > 0) PowerManagementMainUi.battery1Charge
+                ->setText(QString("%1").arg(record.scaled(0),0,'f',0).append('%'));
         }
         else
         {
             PowerManagementMainUi.battery1Charge->clear();
         }
     }
-    if ((size > 0) && (firstField == "dC2"))
+    if (record.is(recordCharge,2))
     {
         if (PowerManagementMainUi.battery2CheckBox->isChecked())
         {
-            if (size > 1) PowerManagementMainUi.battery2Charge
-                ->setText(QString("%1").arg(secondField
-                        .toFloat()/256,0,'f',0).append('%'));
+            if (record.fields > 0) PowerManagementMainUi.battery2Charge
+                ->setText(QString("%1").arg(record.scaled(0),0,'f',0).append('%'));
         }
         else
         {
             PowerManagementMainUi.battery2Charge->clear();
         }
     }
-    if ((size > 0) && (firstField == "dC3"))
+    if (record.is(recordCharge,3))
     {
         if (PowerManagementMainUi.battery3CheckBox->isChecked())
         {
-            if (size > 1) PowerManagementMainUi.battery3Charge
-                ->setText(QString("%1").arg(secondField
-                        .toFloat()/256,0,'f',0).append('%'));
+            if (record.fields > 0) PowerManagementMainUi.battery3Charge
+                ->setText(QString("%1").arg(record.scaled(0),0,'f',0).append('%'));
         }
         else
         {
             PowerManagementMainUi.battery3Charge->clear();
         }
     }
-    if ((size > 0) && (firstField == "dT"))
+    if (record.is(recordTemperature))
     {
-        if (size > 1) PowerManagementMainUi.temperature
-            ->setText(QString("%1").arg(secondField
-                .toFloat()/256,0,'f',1).append(QChar(0x00B0)).append("C"));
+        if (record.fields > 0) PowerManagementMainUi.temperature
+            ->setText(QString("%1").arg(record.scaled(0),0,'f',1).append(QChar(0x00B0)).append("C"));
     }
 /* Messages for the File Task start with f */
-    if ((size > 0) && (firstField.left(1) == "f"))
+    if (record.code[0] == 'f')
     {
         emit this->recordMessageReceived(response);
     }
 /* Messages for the Configure Task start with p or certain of the data responses */
-    if ((size > 0) && ((firstField.left(1) == "p") || (firstField.left(2) == "dO")
-                                                   || (firstField.left(2) == "dE")
-                                                   || (firstField.left(2) == "dD")))
+    if ((record.code[0] == 'p') || ((record.code[0] == 'd') &&
+            ((record.code[1] == 'O') || (record.code[1] == 'E')
+                                     || (record.code[1] == 'D'))))
     {
         emit this->configureMessageReceived(response);
     }
 /* This allows debug messages to be displayed on the terminal. */
-    if ((size > 0) && (firstField.left(1) == "D"))
+    if (record.code[0] == 'D')
     {
         qDebug() << response;
         if (! saveFile.isEmpty()) saveLine(response);
@@ -1261,33 +1325,25 @@ alive. Also check for calibration as time messages stop during this process. */
 //-----------------------------------------------------------------------------
 /** @brief Convert Voltage and Current Strings for Display
 
-The current and voltage values are obtained from the command string breakdown
-converted to a QString form suitable for display. The breakdown is
-0 - command, 1 - current, 2- voltage.
+The current and voltage values are obtained from the decoded record and
+converted to a QString form suitable for display. The record fields are
+0 - current, 1 - voltage.
 
-An entry is saved in the save file if it is open.
-The entry is sent to the monitor window.
 */
 
-void PowerManagementGui::getCurrentVoltage(const QStringList breakdown,
+void PowerManagementGui::getCurrentVoltage(const PowerManagementRecord &record,
                                            QString* sCurrent, QString* sVoltage)
 {
-    int size = breakdown.size();
-    QString entry = breakdown[0].simplified();
-    if (size > 1)
+    if (record.fields > 0)
     {
-        float fCurrent = breakdown[1].simplified().toFloat()/256;
+        float fCurrent = record.scaled(0);
         *sCurrent = QString("%1").arg(fCurrent,0,'f',2);
-        entry = entry.append(",").append(*sCurrent);
     }
-    if (size > 2)
+    if (record.fields > 1)
     {
-        float fVoltage = breakdown[2].simplified().toFloat()/256;
+        float fVoltage = record.scaled(1);
         *sVoltage = QString("%1").arg(fVoltage,0,'f',2);
-        entry = entry.append(",").append(*sVoltage);
     }
-    emit this->monitorMessageReceived(entry);
-//    if (! saveFile.isEmpty()) saveLine(entry);
 }
 //-----------------------------------------------------------------------------
 /** @brief Test indicators on the Interface Cards.
@@ -1761,16 +1817,14 @@ void PowerManagementGui::on_recordingButton_clicked()
 /** @brief Call up the Monitor Window.
 
 @Note The monitor window is created without a parent to ensure it can be
-placed to the background.
+placed to the background. It reads the telemetry ring through its own cursor.
 */
 
 void PowerManagementGui::on_monitorButton_clicked()
 {
     PowerManagementMonitorGui* powerManagementMonitorForm =
-                    new PowerManagementMonitorGui(socket,NULL);   
+                    new PowerManagementMonitorGui(socket,&telemetry,NULL);
     powerManagementMonitorForm->setAttribute(Qt::WA_DeleteOnClose);
-    connect(this, SIGNAL(monitorMessageReceived(const QString&)),
-                  powerManagementMonitorForm, SLOT(onMessageReceived(const QString&)));
     powerManagementMonitorForm->setModal(false);
     powerManagementMonitorForm->show();
 }
@@ -30,12 +30,15 @@
 
 #include "ui_power-management-main.h"
 #include "power-management.h"
+#include "power-management-records.h"
+#include "power-management-telemetry.h"
 #include <QSerialPort>
 #include <QSerialPortInfo>
 #include <QTcpSocket>
 #include <QDir>
 #include <QFile>
 #include <QTime>
+#include <QTimer>
 #include <QListWidgetItem>
 #include <QDialog>
 #include <QCloseEvent>
@@ -51,6 +54,10 @@ typedef enum {battery1UnderVoltage, battery2UnderVoltage, battery3UnderVoltage,
 #define DEFAULT_TCP_ADDRESS "192.168.2.16"
 #define DEFAULT_TCP_PORT    6666
 
+/* Interval between clock probes in ms, chosen not to keep step with the
+records so that some probes meet an empty send queue */
+#define CLOCK_PROBE_INTERVAL 5300
+
 #define millisleep(a) usleep(a*1000)
 
 //-----------------------------------------------------------------------------
@@ -69,6 +76,7 @@ public:
 private slots:
     void on_connectButton_clicked();
     void onDataAvailable();
+    void onClockProbeTimeout();
     void on_load1Battery1_pressed();
     void on_load1Battery2_pressed();
     void on_load1Battery3_pressed();
@@ -103,7 +111,6 @@ private slots:
     void closeEvent(QCloseEvent*);
     void disableRadioButtons(bool enable);
 signals:
-    void monitorMessageReceived(const QString response);
     void recordMessageReceived(const QString response);
     void configureMessageReceived(const QString response);
 private:
@@ -114,10 +121,12 @@ private:
     void setSourceComboBox(int index);
 // Methods
     void processResponse(const QString response);
-    void getCurrentVoltage(const QStringList breakdown,QString* sVoltage, QString* sCurrent);
+    void getCurrentVoltage(const PowerManagementRecord &record,
+                           QString* sVoltage, QString* sCurrent);
     void displayErrorMessage(const QString message);
     void saveLine(QString line);    // Save line to a file
     void ssleep(int seconds);
+    quint32 hostClock();
 // Variables
     QString serialDevice;
     uint baudrate;
@@ -126,6 +135,7 @@ private:
     quint16 connectPort;
     QString errorMessage;
     QString response;
+    TelemetryRing telemetry;        //!< Decoded telemetry for other windows
 #ifdef SERIAL
     QSerialPort* socket;           //!< Serial port object pointer
 #else
@@ -141,6 +151,11 @@ private:
     int load1Voltage;
     unsigned int indicators;
     char timeTick;
+    QTimer *clockProbeTimer;
+    quint32 probeSend;              //!< Host time the last probe was sent
+    quint32 lastProbeSend;          //!< Exchange completed by the next probe
+    quint32 lastProbeReceive;
+    bool probeAnswered;
 };
 
 #endif
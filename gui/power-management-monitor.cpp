@@ -58,6 +58,7 @@ Parts of QWT 6.1.0 examples "realtime" were adapted for this code.
 #include <qwt_plot.h>
 #include <qwt_plot_grid.h>
 #include <qwt_plot_canvas.h>
+#include <qwt_scale_map.h>
 #include <qwt_plot_layout.h>
 #include <qwt_scale_widget.h>
 #include <qwt_scale_draw.h>
@@ -108,22 +109,33 @@ public:
         d_samples.squeeze();
         d_boundingRect = QRectF( 0.0, 0.0, -1.0, -1.0 );
     }
+
+    void removeBefore( double x )
+    {
+        int n = 0;
+        while ( ( n < d_samples.size() ) && ( d_samples[n].x() < x ) ) n++;
+        d_samples.remove( 0, n );
+        d_boundingRect = QRectF( 0.0, 0.0, -1.0, -1.0 );
+    }
 };
 
 //-----------------------------------------------------------------------------
 /** Monitor GUI Constructor
 
 @param[in] p TCP Socket object pointer
+@param[in] telemetry Ring of decoded telemetry written by the main window.
 @param[in] parent Parent widget.
 */
 
 #ifdef SERIAL
-PowerManagementMonitorGui::PowerManagementMonitorGui(QSerialPort* p, QWidget* parent)
+PowerManagementMonitorGui::PowerManagementMonitorGui(QSerialPort* p,
+                            const TelemetryRing* telemetry, QWidget* parent)
                                                     : QDialog(parent)
 {
     socket = p;
 #else
-PowerManagementMonitorGui::PowerManagementMonitorGui(QTcpSocket* tcpSocket, QWidget* parent)
+PowerManagementMonitorGui::PowerManagementMonitorGui(QTcpSocket* tcpSocket,
+                            const TelemetryRing* telemetry, QWidget* parent)
                                                     : QDialog(parent)
 {
     socket = tcpSocket;
@@ -178,6 +190,16 @@ PowerManagementMonitorGui::PowerManagementMonitorGui(QTcpSocket* tcpSocket, QWid
     d_directPainter1 = new QwtPlotDirectPainter(this);
     d_directPainter2 = new QwtPlotDirectPainter(this);
 
+/* The canvas backing store is not used as scrolling reuses the pixels already
+on screen, and only the exposed strip of the canvas is painted. */
+    QwtPlotCanvas *canvas1 =
+        static_cast<QwtPlotCanvas *>(PowerManagementMonitorUi.qwtPlot1->canvas());
+    canvas1->setPaintAttribute(QwtPlotCanvas::BackingStore, false);
+    QwtPlotCanvas *canvas2 =
+        static_cast<QwtPlotCanvas *>(PowerManagementMonitorUi.qwtPlot2->canvas());
+    canvas2->setPaintAttribute(QwtPlotCanvas::BackingStore, false);
+    scrollError = 0;
+
     if (QwtPainter::isX11GraphicsSystem())
     {
 #if QT_VERSION < 0x050000
@@ -244,12 +266,19 @@ PowerManagementMonitorGui::PowerManagementMonitorGui(QTcpSocket* tcpSocket, QWid
 
     source1 = yDataB1Current;
     source2 = yDataB1Voltage;
+
+/* Read the telemetry ring periodically from its current end */
+    telemetryCursor = new TelemetryCursor(telemetry);
+    telemetryTimer = new QTimer(this);
+    connect(telemetryTimer, SIGNAL(timeout()), this, SLOT(onTelemetryTimeout()));
+    telemetryTimer->start(TELEMETRY_POLL_INTERVAL);
 }
 
 PowerManagementMonitorGui::~PowerManagementMonitorGui()
 {
     delete d_curve1;
     delete d_curve2;
+    delete telemetryCursor;
 }
 
 //-----------------------------------------------------------------------------
@@ -391,56 +420,68 @@ Assumes the entries alternate between current/voltage. */
 }
 
 //-----------------------------------------------------------------------------
-/** @brief Process a Message.
+/** @brief Read New Telemetry
+
+All samples written to the telemetry ring since the last read are processed.
+If the window has fallen more than a ring length behind, the oldest samples are
+skipped by the cursor rather than held back.
+*/
+
+void PowerManagementMonitorGui::onTelemetryTimeout()
+{
+    TelemetrySample sample;
+    while (telemetryCursor->read(sample)) processSample(sample);
+}
+
+//-----------------------------------------------------------------------------
+/** @brief Process a Telemetry Sample
 
-After a command is sent, response messages from the remote are passed here for
-processing. Appropriate fields on the form are updated.
+Current and voltage samples are added to the data arrays and the plots.
 
-@param QString entry: A csv string with identifier and FP current and voltage.
+@param[in] sample: decoded record with fixed point current and voltage.
 */
 
-void PowerManagementMonitorGui::onMessageReceived(const QString &entry)
+void PowerManagementMonitorGui::processSample(const TelemetrySample &sample)
 {
 /* Update plots.
 This makes an assumption that all quantities will be sent each time tick,
 and that the last in the set is module 1. Collect all data first then plot
 the selected series. Some data will come through that is ignored. */
-    QStringList breakdown = entry.split(",");
     float current = 0;
-    if (breakdown.size() > 1) current = breakdown[1].simplified().toFloat();
+    if (sample.fields > 0) current = sample.scaled(0);
     float voltage = 0;
-    if (breakdown.size() > 2) voltage = breakdown[2].simplified().toFloat();
+    if (sample.fields > 1) voltage = sample.scaled(1);
 /* xindex is proportional to time and continuously increases. To access the
 arrays, index is the modulo of xindex and wraps around the array bounds
 to form a circular buffer. NUMBER_POINTS is the array size. */
     int index = xindex % NUMBER_POINTS;
 /* Fill the data arrays */
-    if (breakdown[0].simplified() == "dB1")
+    if (sample.is(recordBattery,1))
     {
         yDataB1Current[index] = current;
         yDataB1Voltage[index] = voltage;
     }
-    else if (breakdown[0].simplified() == "dB2")
+    else if (sample.is(recordBattery,2))
     {
         yDataB2Current[index] = current;
         yDataB2Voltage[index] = voltage;
     }
-    else if (breakdown[0].simplified() == "dB3")
+    else if (sample.is(recordBattery,3))
     {
         yDataB3Current[index] = current;
         yDataB3Voltage[index] = voltage;
     }
-    else if (breakdown[0].simplified() == "dL1")
+    else if (sample.is(recordLoad,1))
     {
         yDataL1Current[index] = current;
         yDataL1Voltage[index] = voltage;
     }
-    else if (breakdown[0].simplified() == "dL2")
+    else if (sample.is(recordLoad,2))
     {
         yDataL2Current[index] = current;
         yDataL2Voltage[index] = voltage;
     }
-    else if (breakdown[0].simplified() == "dM1")
+    else if (sample.is(recordPanel,1))
     {
         yDataM1Current[index] = current;
         yDataM1Voltage[index] = voltage;
@@ -478,13 +519,41 @@ This only happens when the xoffset is zero and is being followed in real time. *
 This computes the index of the plot start in the data array, wipes the plot
 and replots from the old data.
 
+When the plot moves forward within its current span (as when following the
+data in real time) the canvas contents are scrolled instead, and only the
+exposed strip and the time axis are redrawn. A full replot is made if the
+scroll would need a fraction of a pixel that has accumulated to more than half
+a pixel, so that the reused pixels stay aligned with the grid.
+
 Global xSamples: the x-axis scale factor.
 
-@param int 
+@param int plotStartIndex: time index at the start of the plot.
+@param int plotEnd: number of time steps of data to plot.
 */
 void PowerManagementMonitorGui::replot(int plotStartIndex, int plotEnd)
 {
     int plotLength = VISIBLE_POINTS*xSamples;
+    int shift = plotStartIndex - (int)xRangeMin;
+    if ((shift > 0) && (shift < plotLength)
+                    && ((int)(xRangeMax - xRangeMin) == plotLength))
+    {
+        const QwtScaleMap map =
+            PowerManagementMonitorUi.qwtPlot1->canvasMap(QwtPlot::xBottom);
+        float dxExact = map.transform(plotStartIndex) - map.transform(xRangeMin);
+        int dx = qRound(dxExact);
+        if (qAbs(scrollError + dxExact - dx) < 0.5)
+        {
+            scrollError += dxExact - dx;
+            scrollPlot(PowerManagementMonitorUi.qwtPlot1, d_curve1, source1,
+                       plotStartIndex, plotEnd, dx);
+            scrollPlot(PowerManagementMonitorUi.qwtPlot2, d_curve2, source2,
+                       plotStartIndex, plotEnd, dx);
+            xRangeMin = (float)plotStartIndex;
+            xRangeMax = xRangeMin+plotLength;
+            return;
+        }
+    }
+    scrollError = 0;
     int dataStartIndex = plotStartIndex % NUMBER_POINTS;
     xRangeMin = (float)plotStartIndex;
     xRangeMax = xRangeMin+plotLength;
@@ -506,10 +575,45 @@ void PowerManagementMonitorGui::replot(int plotStartIndex, int plotEnd)
     }
     d_curve1->setSamples(points1);
     PowerManagementMonitorUi.qwtPlot1->replot();
-    PowerManagementMonitorUi.qwtPlot1->repaint();
     d_curve2->setSamples(points2);
     PowerManagementMonitorUi.qwtPlot2->replot();
-    PowerManagementMonitorUi.qwtPlot2->repaint();
+}
+
+//-----------------------------------------------------------------------------
+/** @brief Scroll a Display Graph
+
+The time axis is moved on and only its scale widget is repainted. Points that
+have left the plot are dropped from the curve and any new ones are added. The
+canvas contents are then blitted to the left, which causes Qt to paint only
+the exposed strip on the right.
+
+@param QwtPlot* plot: plot to be scrolled.
+@param QwtPlotCurve* curve: the plot's curve.
+@param float* source: data array feeding the curve.
+@param int plotStartIndex: time index at the new start of the plot.
+@param int plotEnd: number of time steps of data to plot.
+@param int dx: number of pixels to scroll.
+*/
+void PowerManagementMonitorGui::scrollPlot(QwtPlot *plot, QwtPlotCurve *curve,
+                        float *source, int plotStartIndex, int plotEnd, int dx)
+{
+    int plotLength = VISIBLE_POINTS*xSamples;
+    plot->setAxisScale(QwtPlot::xBottom, plotStartIndex, plotStartIndex+plotLength);
+    plot->updateAxes();
+    plot->axisWidget(QwtPlot::xBottom)->update();
+    CurveData *data = static_cast<CurveData *> (curve->data());
+    data->removeBefore(plotStartIndex);
+    int first = 0;
+    if (data->size() > 0)
+        first = (int)data->sample(data->size()-1).x() - plotStartIndex + xSamples;
+    int dataStartIndex = plotStartIndex % NUMBER_POINTS;
+    for (int i=first; i<plotEnd; i+=xSamples)
+    {
+        int index = (i+dataStartIndex) % NUMBER_POINTS;
+        data->append(QPointF(xData[index],source[index]));
+    }
+    QWidget *canvas = plot->canvas();
+    canvas->scroll(-dx, 0, canvas->contentsRect());
 }
 
 //-----------------------------------------------------------------------------
@@ -30,18 +30,23 @@
 #define _TTY_POSIX_
 
 #include "power-management.h"
+#include "power-management-telemetry.h"
 #include "ui_power-management-monitor.h"
 #include <QSerialPort>
 #include <QSerialPortInfo>
 #include <qwt_plot.h>
 #include <QDialog>
+#include <QTimer>
 #include <QtNetwork>
 #include <QTcpSocket>
 
 #define NUMBER_POINTS   600
 #define VISIBLE_POINTS  100
 #define JUMP             20
+/* Interval in ms between reads of the telemetry ring */
+#define TELEMETRY_POLL_INTERVAL 100
 
+class QwtPlot;
 class QwtPlotCurve;
 class QwtPlotDirectPainter;
 
@@ -55,13 +60,15 @@ class PowerManagementMonitorGui : public QDialog
     Q_OBJECT
 public:
 #ifdef SERIAL
-    PowerManagementMonitorGui(QSerialPort* socket, QWidget* parent = 0);
+    PowerManagementMonitorGui(QSerialPort* socket,
+                              const TelemetryRing* telemetry, QWidget* parent = 0);
 #else
-    PowerManagementMonitorGui(QTcpSocket* socket, QWidget* parent = 0);
+    PowerManagementMonitorGui(QTcpSocket* socket,
+                              const TelemetryRing* telemetry, QWidget* parent = 0);
 #endif
     ~PowerManagementMonitorGui();
 private slots:
-    void onMessageReceived(const QString &entry);
+    void onTelemetryTimeout();
     void on_sourceComboBox1_currentIndexChanged(int index);
     void on_offsetSlider1_valueChanged(int value);
     void on_scaleSlider1_valueChanged(int value);
@@ -79,7 +86,13 @@ private:
 #else
     QTcpSocket *socket;
 #endif
+    void processSample(const TelemetrySample &sample);
     void replot(int plotStartIndex, int plotEnd);
+    void scrollPlot(QwtPlot *plot, QwtPlotCurve *curve, float *source,
+                    int plotStartIndex, int plotEnd, int dx);
+    float scrollError;
+    TelemetryCursor *telemetryCursor;
+    QTimer *telemetryTimer;
     QwtPlotCurve *d_curve1, *d_curve2;
     QwtPlotDirectPainter *d_directPainter1, *d_directPainter2;
     int xoffset;
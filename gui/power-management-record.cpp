@@ -5,6 +5,13 @@ file on the attached medium, notably an SD card.
 
 The files on the card are displayed and a new one suggested.
 Recording is started and stopped, at which the file is closed.
+
+A remote file can be downloaded to a local file. The download is pipelined with
+a number of block requests outstanding, each response carrying its own offset so
+that blocks are written into a pre-sized local file in whatever order they
+arrive. Progress is saved alongside the local file so that a paused or
+interrupted download can be resumed, and the result is verified against a
+checksum computed by the remote unit.
 */
 /****************************************************************************
  *   Copyright (C) 2013 by Ken Sarkies                                      *
@@ -41,6 +48,8 @@ Recording is started and stopped, at which the file is closed.
 #include <QDateTime>
 #include <QDir>
 #include <QFile>
+#include <QFileDialog>
+#include <QSettings>
 #include <QDebug>
 #include <QStandardItemModel>
 #include <QtNetwork>
@@ -89,10 +98,21 @@ PowerManagementRecordGui::PowerManagementRecordGui(QTcpSocket* tcpSocket, QWidge
 // Send a command to refresh the directory
     refreshDirectory();
     writeFileHandle = 0xFF;
+    readFileHandle = 0xFF;
+    downloadFile = NULL;
+    downloading = false;
+    awaitingChecksum = false;
+    downloadTimer = new QTimer(this);
+    connect(downloadTimer, SIGNAL(timeout()), this, SLOT(onDownloadTimeout()));
 }
 
 PowerManagementRecordGui::~PowerManagementRecordGui()
 {
+    if (downloading)
+    {
+        saveDownloadState();
+        stopDownload();
+    }
 }
 
 //-----------------------------------------------------------------------------
@@ -121,19 +141,19 @@ void PowerManagementRecordGui::on_deleteButton_clicked()
 If a write file is not open the specified file is opened for writing. Response
 is a status that indicates if the file was opened/created and the recording
 started. This is processed later.
+
+If no name is given the remote opens a file named from the current date and
+time, in year and month directories.
 */
 
 void PowerManagementRecordGui::on_recordFileButton_clicked()
 {
     QString fileName = PowerManagementRecordUi.recordFileName->text();
-    if (fileName.length() > 0)
-    {
-        socket->write("fW");
-        socket->write(fileName.toLocal8Bit().data());
-        socket->write("\n\r");
-        requestRecordingStatus();
-        refreshDirectory();
-    }
+    socket->write("fW");
+    socket->write(fileName.toLocal8Bit().data());
+    socket->write("\n\r");
+    requestRecordingStatus();
+    refreshDirectory();
 }
 
 //-----------------------------------------------------------------------------
@@ -305,22 +325,60 @@ no directory name. */
             if (breakdown.size() <= 2) break;
             writeFileHandle = breakdown[2].toInt();
             writeFileOpen = (writeFileHandle < 255);
+// The write file name is only present if the write file is open
+            int readField = 3;
             if (writeFileOpen)
             {
                 PowerManagementRecordUi.recordFileButton->
                     setStyleSheet("background-color:lightgreen;");
-                PowerManagementRecordUi.recordFileName->setText(breakdown[3]);
+                if (breakdown.size() > 3)
+                    PowerManagementRecordUi.recordFileName->setText(breakdown[3]);
+                readField = 4;
             }
             else
                 PowerManagementRecordUi.recordFileButton->
                     setStyleSheet("background-color:lightpink;");
-            if (breakdown.size() <= 3) break;
-            readFileHandle = breakdown[3].toInt();
+            if (breakdown.size() <= readField) break;
+            readFileHandle = breakdown[readField].toInt();
             readFileOpen = (readFileHandle < 255);
-            if (readFileOpen)
-                 PowerManagementRecordUi.readFileName->setText(breakdown[3]);
+            if (readFileOpen && (breakdown.size() > readField+1))
+                 PowerManagementRecordUi.readFileName->setText(breakdown[readField+1]);
            break;
         }
+// Open a file for reading.
+        case 'R':
+        {
+            if (breakdown.size() <= 1) break;
+            readFileHandle = breakdown[1].toInt();
+            readFileOpen = (readFileHandle < 255);
+            if (readFileOpen)
+                PowerManagementRecordUi.readFileButton->
+                    setStyleSheet("background-color:lightgreen;");
+            else
+                PowerManagementRecordUi.readFileButton->
+                    setStyleSheet("background-color:lightpink;");
+            break;
+        }
+// Size and checksum of the remote read file, used to set up a download.
+        case 'K':
+        {
+            if (breakdown.size() <= 2) break;
+            if (! awaitingChecksum) break;
+            awaitingChecksum = false;
+            bool ok;
+            quint32 crc = breakdown[2].toUInt(&ok,16);
+            if (ok) startDownload(breakdown[1].toLongLong(),crc);
+            break;
+        }
+// Block of remote file data with its offset, data in hex.
+        case 'B':
+        {
+            if (breakdown.size() <= 1) break;
+            QByteArray data;
+            if (breakdown.size() > 2) data = QByteArray::fromHex(breakdown[2].toLatin1());
+            receiveBlock(breakdown[1].toLongLong(),data);
+            break;
+        }
 // Open a file for recording.
         case 'W':
         {
@@ -351,6 +409,12 @@ no directory name. */
             int status = breakdown[1].toInt();
             if ((status > 0) && (status < 20))
                 PowerManagementRecordUi.errorLabel->setText(errorText[status-1]);
+// A failed checksum request leaves the download unstarted.
+            if ((status > 0) && awaitingChecksum)
+            {
+                awaitingChecksum = false;
+                PowerManagementRecordUi.downloadStatusLabel->clear();
+            }
             break;
         }
     }
@@ -376,7 +440,8 @@ int PowerManagementRecordGui::extractValue(const QString &response)
 //-----------------------------------------------------------------------------
 /** @brief Slot to process Directory Entry Clicks.
 
-Display filename in edit box, or enter a directory and redisplay.
+Display filename in edit box, or enter a directory and redisplay. The path of
+the directory being shown is kept so that the full path of a file is given.
 */
 
 void PowerManagementRecordGui::onListItemClicked(const QModelIndex & index)
@@ -387,11 +452,20 @@ void PowerManagementRecordGui::onListItemClicked(const QModelIndex & index)
     QChar type = item->data().toChar();
     if (type == 'f')
     {
-        PowerManagementRecordUi.recordFileName->setText(fileName);
-        PowerManagementRecordUi.readFileName->setText(fileName);
+        PowerManagementRecordUi.recordFileName->setText(directoryPath+fileName);
+        PowerManagementRecordUi.readFileName->setText(directoryPath+fileName);
+    }
+    if ((type == 'd') && (fileName != "."))
+    {
+        if (fileName == "..")
+            directoryPath.truncate(directoryPath.lastIndexOf('/',-2)+1);
+        else
+            directoryPath += fileName + "/";
+        QString path = directoryPath;
+        if (path.isEmpty()) path = "/";
+        else path.chop(1);
+        socket->write(QString("fD%1\n\r").arg(path).toLocal8Bit().data());
     }
-    if (type == 'd')
-        socket->write(QString("fD%1\n\r").arg(fileName).toLocal8Bit().data());
 }
 
 //-----------------------------------------------------------------------------
@@ -426,6 +500,7 @@ one has been received.
 void PowerManagementRecordGui::refreshDirectory()
 {
     model->clear();
+    directoryPath.clear();
     socket->write("fd/\n\r");
 }
 
@@ -450,3 +525,382 @@ void PowerManagementRecordGui::getFreeSpace()
 }
 
 
+
+//-----------------------------------------------------------------------------
+/** @brief Open the Remote File for Reading.
+
+Any read file already open is closed first. The response gives the file handle
+which is processed later.
+*/
+
+void PowerManagementRecordGui::on_readFileButton_clicked()
+{
+    QString fileName = PowerManagementRecordUi.readFileName->text();
+    if (downloading)
+    {
+        PowerManagementRecordUi.errorLabel->setText("Download in progress");
+        return;
+    }
+    if (fileName.length() > 0)
+    {
+        if (readFileHandle < 0xFF)
+            socket->write(QString("fC%1\n\r").arg(readFileHandle)
+                                             .toLocal8Bit().data());
+        socket->write("fR");
+        socket->write(fileName.toLocal8Bit().data());
+        socket->write("\n\r");
+    }
+}
+
+//-----------------------------------------------------------------------------
+/** @brief Select the Local File to receive a Download.
+
+*/
+
+void PowerManagementRecordGui::on_localFileButton_clicked()
+{
+    QString fileName = QFileDialog::getSaveFileName(this,
+                        "Local File for Downloaded Records",
+                        PowerManagementRecordUi.readFileName->text(),
+                        "Record Files (*.txt *.csv *.dat);;All Files (*)",
+                        0, QFileDialog::DontConfirmOverwrite);
+    if (fileName.isEmpty()) return;
+    PowerManagementRecordUi.localFileName->setText(fileName);
+}
+
+//-----------------------------------------------------------------------------
+/** @brief Start or Resume a Download.
+
+The remote read file must be open. The remote unit is asked for the file size
+and checksum, and the download proper is started when the response arrives.
+*/
+
+void PowerManagementRecordGui::on_downloadButton_clicked()
+{
+    if (downloading || awaitingChecksum) return;
+    if (readFileHandle >= 0xFF)
+    {
+        PowerManagementRecordUi.errorLabel->setText("Remote file not open");
+        return;
+    }
+    if (PowerManagementRecordUi.localFileName->text().isEmpty())
+    {
+        PowerManagementRecordUi.errorLabel->setText("Local file not defined");
+        return;
+    }
+    PowerManagementRecordUi.errorLabel->clear();
+    downloadRemoteName = PowerManagementRecordUi.readFileName->text();
+    awaitingChecksum = true;
+    PowerManagementRecordUi.downloadStatusLabel->setText("Checking remote file");
+    socket->write(QString("fK%1\n\r").arg(readFileHandle).toLocal8Bit().data());
+}
+
+//-----------------------------------------------------------------------------
+/** @brief Pause a Download.
+
+The progress is saved so that the download can be resumed later.
+*/
+
+void PowerManagementRecordGui::on_pauseDownloadButton_clicked()
+{
+    if (! downloading) return;
+    saveDownloadState();
+    stopDownload();
+    PowerManagementRecordUi.downloadStatusLabel->setText("Paused");
+}
+
+//-----------------------------------------------------------------------------
+/** @brief Cancel a Download.
+
+The partial local file and its saved progress are discarded and the remote
+read file is closed.
+*/
+
+void PowerManagementRecordGui::on_cancelDownloadButton_clicked()
+{
+    awaitingChecksum = false;
+    QString localName = PowerManagementRecordUi.localFileName->text();
+    bool active = downloading;
+    stopDownload();
+    if (! localName.isEmpty() && QFile::exists(downloadStateFileName()))
+    {
+        QFile::remove(downloadStateFileName());
+        QFile::remove(localName);
+    }
+    else if (active) QFile::remove(localName);
+    if (readFileHandle < 0xFF)
+    {
+        socket->write(QString("fC%1\n\r").arg(readFileHandle).toLocal8Bit().data());
+        readFileHandle = 0xFF;
+        PowerManagementRecordUi.readFileButton->setStyleSheet("");
+    }
+    PowerManagementRecordUi.progressBar->setValue(0);
+    PowerManagementRecordUi.downloadStatusLabel->setText("Cancelled");
+}
+
+//-----------------------------------------------------------------------------
+/** @brief Set up a Download.
+
+The local file is pre-sized to the remote file size. If saved progress matches
+the remote file, blocks already received are skipped.
+
+@param[in] size Remote file size in bytes.
+@param[in] crc Remote file CRC-32 checksum.
+*/
+
+void PowerManagementRecordGui::startDownload(qint64 size, quint32 crc)
+{
+    QString localName = PowerManagementRecordUi.localFileName->text();
+    downloadSize = size;
+    downloadCrc = crc;
+    downloadBlocks = (size + DOWNLOAD_BLOCK_SIZE - 1)/DOWNLOAD_BLOCK_SIZE;
+    downloadBlockDone = QBitArray(downloadBlocks);
+    downloadBlocksDone = 0;
+    bool resume = loadDownloadState();
+    downloadFile = new QFile(localName);
+    QIODevice::OpenMode mode = QIODevice::ReadWrite;
+    if (! resume) mode |= QIODevice::Truncate;
+    if (! downloadFile->open(mode) || ! downloadFile->resize(size))
+    {
+        PowerManagementRecordUi.errorLabel->setText("Could not open the local file");
+        PowerManagementRecordUi.downloadStatusLabel->clear();
+        delete downloadFile;
+        downloadFile = NULL;
+        return;
+    }
+    downloadNextBlock = 0;
+    downloadInFlight.clear();
+    downloadSessionBytes = 0;
+    downloading = true;
+    downloadClock.start();
+    PowerManagementRecordUi.progressBar->setMaximum(qMax(downloadBlocks,1));
+    showDownloadProgress();
+    if (downloadBlocksDone >= downloadBlocks)
+    {
+        finishDownload();
+        return;
+    }
+    downloadTimer->start(500);
+    requestBlocks();
+}
+
+//-----------------------------------------------------------------------------
+/** @brief Issue Block Requests.
+
+Requests for blocks not yet received are sent until the window of outstanding
+requests is full.
+*/
+
+void PowerManagementRecordGui::requestBlocks()
+{
+    while (downloading && (downloadInFlight.size() < DOWNLOAD_WINDOW)
+                       && (downloadNextBlock < downloadBlocks))
+    {
+        int block = downloadNextBlock++;
+        if (downloadBlockDone.testBit(block)) continue;
+        qint64 offset = (qint64)block*DOWNLOAD_BLOCK_SIZE;
+        socket->write(QString("fB%1,%2\n\r").arg(readFileHandle).arg(offset)
+                                            .toLocal8Bit().data());
+        QElapsedTimer sent;
+        sent.start();
+        downloadInFlight.insert(offset,sent);
+    }
+}
+
+//-----------------------------------------------------------------------------
+/** @brief Store a Received Block.
+
+Blocks that were not requested, or that are of the wrong length, are ignored;
+the latter will be requested again when they time out.
+
+@param[in] offset Byte offset of the block in the file.
+@param[in] data Block contents.
+*/
+
+void PowerManagementRecordGui::receiveBlock(qint64 offset, const QByteArray &data)
+{
+    if (! downloading || ! downloadInFlight.contains(offset)) return;
+    if ((offset % DOWNLOAD_BLOCK_SIZE) != 0) return;
+    qint64 expected = qMin((qint64)DOWNLOAD_BLOCK_SIZE, downloadSize-offset);
+    if (data.size() != expected) return;
+    downloadInFlight.remove(offset);
+    int block = offset/DOWNLOAD_BLOCK_SIZE;
+    if (! downloadBlockDone.testBit(block))
+    {
+        if (! downloadFile->seek(offset) || (downloadFile->write(data) != data.size()))
+        {
+            PowerManagementRecordUi.errorLabel->setText("Error writing local file");
+            saveDownloadState();
+            stopDownload();
+            return;
+        }
+        downloadBlockDone.setBit(block);
+        downloadBlocksDone++;
+        downloadSessionBytes += data.size();
+    }
+    showDownloadProgress();
+    if (downloadBlocksDone >= downloadBlocks) finishDownload();
+    else requestBlocks();
+}
+
+//-----------------------------------------------------------------------------
+/** @brief Download Timer.
+
+Requests that have been outstanding for too long are sent again, and the
+progress is saved periodically.
+*/
+
+void PowerManagementRecordGui::onDownloadTimeout()
+{
+    if (! downloading) return;
+    QMutableHashIterator<qint64,QElapsedTimer> i(downloadInFlight);
+    while (i.hasNext())
+    {
+        i.next();
+        if (i.value().elapsed() > DOWNLOAD_TIMEOUT)
+        {
+            socket->write(QString("fB%1,%2\n\r").arg(readFileHandle).arg(i.key())
+                                                .toLocal8Bit().data());
+            i.value().restart();
+        }
+    }
+    saveDownloadState();
+    showDownloadProgress();
+}
+
+//-----------------------------------------------------------------------------
+/** @brief Complete a Download.
+
+The local file checksum is computed and compared with that of the remote file.
+The saved progress is discarded in either case as a mismatched file must be
+downloaded afresh. The remote read file is closed.
+*/
+
+void PowerManagementRecordGui::finishDownload()
+{
+    downloading = false;
+    downloadTimer->stop();
+    downloadInFlight.clear();
+    downloadFile->flush();
+    downloadFile->seek(0);
+    quint32 crc = 0xFFFFFFFF;
+    while (! downloadFile->atEnd())
+    {
+        QByteArray chunk = downloadFile->read(65536);
+        if (chunk.isEmpty()) break;
+        crc = crc32Update(crc,chunk.constData(),chunk.size());
+    }
+    crc ^= 0xFFFFFFFF;
+    downloadFile->close();
+    delete downloadFile;
+    downloadFile = NULL;
+    QFile::remove(downloadStateFileName());
+    showDownloadProgress();
+    if (crc == downloadCrc)
+        PowerManagementRecordUi.errorLabel->setText("Download complete, checksum verified");
+    else
+        PowerManagementRecordUi.errorLabel->setText("Download checksum error");
+    socket->write(QString("fC%1\n\r").arg(readFileHandle).toLocal8Bit().data());
+    readFileHandle = 0xFF;
+    PowerManagementRecordUi.readFileButton->setStyleSheet("");
+}
+
+//-----------------------------------------------------------------------------
+/** @brief Stop a Download.
+
+Outstanding requests are forgotten, so late responses are ignored.
+*/
+
+void PowerManagementRecordGui::stopDownload()
+{
+    downloading = false;
+    downloadTimer->stop();
+    downloadInFlight.clear();
+    if (downloadFile != NULL)
+    {
+        downloadFile->close();
+        delete downloadFile;
+        downloadFile = NULL;
+    }
+}
+
+//-----------------------------------------------------------------------------
+/** @brief Name of the File holding Download Progress.
+
+*/
+
+QString PowerManagementRecordGui::downloadStateFileName() const
+{
+    return PowerManagementRecordUi.localFileName->text() + ".part";
+}
+
+//-----------------------------------------------------------------------------
+/** @brief Save Download Progress.
+
+The remote file identity and a bitmap of blocks received are written next to
+the local file.
+*/
+
+void PowerManagementRecordGui::saveDownloadState()
+{
+    QByteArray bits((downloadBlocks+7)/8,0);
+    for (int i=0; i<downloadBlocks; i++)
+        if (downloadBlockDone.testBit(i)) bits[i/8] = bits[i/8] | (1 << (i%8));
+    QSettings state(downloadStateFileName(),QSettings::IniFormat);
+    state.setValue("remote",downloadRemoteName);
+    state.setValue("size",downloadSize);
+    state.setValue("crc",downloadCrc);
+    state.setValue("blocks",bits);
+    state.sync();
+}
+
+//-----------------------------------------------------------------------------
+/** @brief Load Download Progress.
+
+The saved progress is only used if it refers to the same remote file, unchanged,
+and the partial local file still exists.
+
+@returns true if progress was restored.
+*/
+
+bool PowerManagementRecordGui::loadDownloadState()
+{
+    if (! QFile::exists(downloadStateFileName())) return false;
+    if (! QFile::exists(PowerManagementRecordUi.localFileName->text())) return false;
+    QSettings state(downloadStateFileName(),QSettings::IniFormat);
+    if ((state.value("remote").toString() != downloadRemoteName) ||
+        (state.value("size").toLongLong() != downloadSize) ||
+        (state.value("crc").toUInt() != downloadCrc)) return false;
+    QByteArray bits = state.value("blocks").toByteArray();
+    if (bits.size() != (downloadBlocks+7)/8) return false;
+    for (int i=0; i<downloadBlocks; i++)
+    {
+        if (bits[i/8] & (1 << (i%8)))
+        {
+            downloadBlockDone.setBit(i);
+            downloadBlocksDone++;
+        }
+    }
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+/** @brief Show Download Progress, Throughput and Time Remaining.
+
+Throughput is measured over the current session only, so that resumed blocks do
+not inflate it.
+*/
+
+void PowerManagementRecordGui::showDownloadProgress()
+{
+    PowerManagementRecordUi.progressBar->setValue(downloadBlocksDone);
+    qint64 elapsed = downloadClock.elapsed();
+    double rate = 0;
+    if (elapsed > 0) rate = (double)downloadSessionBytes*1000/elapsed;
+    qint64 remaining = downloadSize - (qint64)downloadBlocksDone*DOWNLOAD_BLOCK_SIZE;
+    if (remaining < 0) remaining = 0;
+    QString eta = "--";
+    if (rate > 0) eta = QString("%1 s").arg(remaining/rate,0,'f',0);
+    PowerManagementRecordUi.downloadStatusLabel->
+        setText(QString("%1 kB/s  ETA %2").arg(rate/1000,0,'f',2).arg(eta));
+}
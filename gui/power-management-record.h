@@ -37,6 +37,18 @@
 #include <QStandardItemModel>
 #include <QtNetwork>
 #include <QTcpSocket>
+#include <QFile>
+#include <QBitArray>
+#include <QHash>
+#include <QTimer>
+#include <QElapsedTimer>
+
+//! Size of a remote file block; must match GET_BLOCK_SIZE in the firmware.
+#define DOWNLOAD_BLOCK_SIZE     32
+//! Number of block requests kept outstanding during a download.
+#define DOWNLOAD_WINDOW         6
+//! Time in ms after which an unanswered block request is sent again.
+#define DOWNLOAD_TIMEOUT        2000
 
 //-----------------------------------------------------------------------------
 /** @brief Power Management Recording Window.
@@ -63,6 +75,12 @@ private slots:
     void onListItemClicked(const QModelIndex & index);
     void on_registerButton_clicked();
     void on_closeButton_clicked();
+    void on_readFileButton_clicked();
+    void on_localFileButton_clicked();
+    void on_downloadButton_clicked();
+    void on_pauseDownloadButton_clicked();
+    void on_cancelDownloadButton_clicked();
+    void onDownloadTimeout();
 private:
 // User Interface object instance
     Ui::PowerManagementRecordDialog PowerManagementRecordUi;
@@ -83,7 +101,32 @@ private:
     QStandardItemModel *model;
     int row;
     bool directoryEnded;
+    QString directoryPath;
     bool nextDirectoryEntry;
+// Download management
+    void startDownload(qint64 size, quint32 crc);
+    void requestBlocks();
+    void receiveBlock(qint64 offset, const QByteArray &data);
+    void finishDownload();
+    void stopDownload();
+    void saveDownloadState();
+    bool loadDownloadState();
+    void showDownloadProgress();
+    QString downloadStateFileName() const;
+    QFile *downloadFile;
+    QString downloadRemoteName;
+    qint64 downloadSize;
+    quint32 downloadCrc;
+    int downloadBlocks;
+    int downloadNextBlock;
+    int downloadBlocksDone;
+    QBitArray downloadBlockDone;
+    QHash<qint64,QElapsedTimer> downloadInFlight;
+    QTimer *downloadTimer;
+    QElapsedTimer downloadClock;
+    qint64 downloadSessionBytes;
+    bool downloading;
+    bool awaitingChecksum;
 
 };
 
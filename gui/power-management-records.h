@@ -0,0 +1,339 @@
+/*       Power Management Record Decoders
+
+Header-only decoders for the comma separated records sent by the remote unit
+and stored in its recording files. These are shared by the GUI, the Beaglebone
+GUI and the data processing tool.
+
+Each record type is described in a constant schema table giving its code, the
+number of numeric fields, their fixed point scale and whether the code carries
+a device number. A decoder is instantiated for each table entry so that field
+counts are known at compile time, and the line is parsed in place without
+splitting it into strings.
+
+@date 18 October 2026
+*/
+
+/****************************************************************************
+ *   Copyright (C) 2013 by Ken Sarkies                                      *
+ *   ksarkies@internode.on.net                                              *
+ *                                                                          *
+ *   This file is part of Power Management GUI                              *
+ *                                                                          *
+ *   Power Management GUI is free software; you can redistribute it and/or  *
+ *   modify it under the terms of the GNU General Public License as         *
+ *   published by the Free Software Foundation; either version 2 of the     *
+ *   License, or (at your option) any later version.                        *
+ *                                                                          *
+ *   Power Management GUI is distributed in the hope that it will be useful,*
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the          *
+ *   GNU General Public License for more details.                           *
+ *                                                                          *
+ *   You should have received a copy of the GNU General Public License      *
+ *   along with Power Management GUI if not, write to the                   *
+ *   Free Software Foundation, Inc.,                                        *
+ *   51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.              *
+ ***************************************************************************/
+
+#ifndef POWER_MANAGEMENT_RECORDS_H
+#define POWER_MANAGEMENT_RECORDS_H
+
+#include <QString>
+#include <QDateTime>
+
+/* Largest number of numeric fields in any record */
+#define RECORD_MAX_FIELDS   2
+
+typedef enum {recordNone, recordTime, recordBattery, recordCharge,
+              recordOperational, recordLoad, recordPanel, recordTemperature,
+              recordControls, recordSwitches, recordIndicators, recordDecision,
+              recordDebug, recordCardErrors} RecordType;
+
+//-----------------------------------------------------------------------------
+/** @brief Record Schema
+
+prefix, code: the characters identifying the record.
+indexed: the code is followed by a device number 1-3.
+fields: number of numeric fields following the code.
+scale: fixed point scale of the numeric fields.
+text: the field is text rather than numeric (time record).
+
+dR carries the memory card CRC error count and the number of transfers that
+failed after retries. It is sent when these change and is not recorded.
+*/
+
+struct RecordSchema
+{
+    char prefix;
+    char code;
+    RecordType type;
+    bool indexed;
+    int fields;
+    float scale;
+    bool text;
+};
+
+static constexpr RecordSchema recordSchema[] =
+{
+    {'p','H',recordTime,        false,1,1,  true},
+    {'d','B',recordBattery,     true, 2,256,false},
+    {'d','C',recordCharge,      true, 1,256,false},
+    {'d','O',recordOperational, true, 1,1,  false},
+    {'d','L',recordLoad,        true, 2,256,false},
+    {'d','M',recordPanel,       true, 2,256,false},
+    {'d','T',recordTemperature, false,1,256,false},
+    {'d','D',recordControls,    false,1,1,  false},
+    {'d','s',recordSwitches,    false,1,1,  false},
+    {'d','S',recordSwitches,    false,1,1,  false},
+    {'d','I',recordIndicators,  false,1,1,  false},
+    {'d','d',recordDecision,    false,1,1,  false},
+    {'D',' ',recordDebug,       true, 2,1,  false},
+    {'d','R',recordCardErrors,  false,2,1,  false},
+};
+
+//-----------------------------------------------------------------------------
+/** @brief Bitfield Layouts
+
+Packed status words are described by shift and width.
+
+dO operational status: op state bits 0-1, fill state bits 2-3, charging
+phase bits 4-5, health bits 6-7.
+ds switch settings: battery allocated to load 1, load 2 and panel, 0 if none.
+dD controls: autotrack, recording, measurement and debug sends, charger
+algorithm, load avoidance and maintain isolation.
+*/
+
+struct BitField
+{
+    int shift;
+    int width;
+};
+
+static constexpr BitField operationalOp         = {0,2};
+static constexpr BitField operationalFill       = {2,2};
+static constexpr BitField operationalCharge     = {4,2};
+static constexpr BitField operationalHealth     = {6,2};
+static constexpr BitField switchLoad1           = {0,2};
+static constexpr BitField switchLoad2           = {2,2};
+static constexpr BitField switchPanel           = {4,2};
+static constexpr BitField controlAutoTrack      = {0,1};
+static constexpr BitField controlRecording      = {1,1};
+static constexpr BitField controlMeasurement    = {3,1};
+static constexpr BitField controlDebug          = {4,1};
+static constexpr BitField controlCharger        = {5,2};
+static constexpr BitField controlLoadAvoid      = {7,1};
+static constexpr BitField controlIsolation      = {8,1};
+
+inline constexpr int bitField(int value, BitField field)
+{
+    return (value >> field.shift) & ((1 << field.width) - 1);
+}
+
+/* Text for each state of the operational status fields */
+static const char* const opStateText[4] =
+                    {"Loaded", "Charge", "Isolate", "Missing"};
+static const char* const fillStateText[4] =
+                    {"Normal", "Low", "Critical", "Faulty"};
+static const char* const chargeStateText[4] =
+                    {"Bulk", "Absorp", "Float", "Rest"};
+static const char* const healthStateText[4] =
+                    {"Good", "Faulty", "Missing", "Weak"};
+
+//-----------------------------------------------------------------------------
+/** @brief Decoded Record
+
+The text field points into the line that was decoded and is only valid while
+that line is.
+*/
+
+struct PowerManagementRecord
+{
+    RecordType type;
+    char code[2];
+    int index;
+    int fields;
+    int value[RECORD_MAX_FIELDS];
+    float scale;
+    const char *text;
+    int textLength;
+
+/** @brief Test for a record type and (optionally) device number */
+    bool is(RecordType recordType, int device = 0) const
+    {
+        return (type == recordType) && ((device == 0) || (index == device));
+    }
+
+/** @brief Field value converted from fixed point */
+    float scaled(int n) const
+    {
+        return (float)value[n]/scale;
+    }
+
+/** @brief Time from the time record text field */
+    QDateTime time() const
+    {
+        return QDateTime::fromString(QString::fromLatin1(text,textLength),
+                                     Qt::ISODate);
+    }
+};
+
+//-----------------------------------------------------------------------------
+/** @brief Decode the Fields of a Record
+
+The schema entry is a template parameter so that each record type gets its own
+decoder with the field count fixed at compile time.
+
+@param[in] line: pointer to the character following the record code.
+@param[in] end: pointer past the end of the line.
+@param[out] record: decoded record.
+@returns true if the line matches the schema.
+*/
+
+template <int S>
+inline bool decodeRecordFields(const char *line, const char *end,
+                               PowerManagementRecord &record)
+{
+    static_assert(S >= 0, "Record not in the schema table");
+    constexpr RecordSchema schema = recordSchema[S];
+    static_assert(schema.fields <= RECORD_MAX_FIELDS, "Too many record fields");
+    if (schema.indexed)
+    {
+        if ((line >= end) || (*line < '1') || (*line > '9')) return false;
+        record.index = *line++ - '0';
+    }
+    record.type = schema.type;
+    record.scale = schema.scale;
+    for (int n = 0; n < schema.fields; n++)
+    {
+        while ((line < end) && (*line == ' ')) line++;
+        if ((line >= end) || (*line != ',')) break;
+        line++;
+        while ((line < end) && (*line == ' ')) line++;
+        if (schema.text)
+        {
+            const char *start = line;
+            while ((line < end) && (*line != ',') && (*line > ' ')) line++;
+            record.text = start;
+            record.textLength = line - start;
+        }
+        else
+        {
+            bool negative = false;
+            if ((line < end) && ((*line == '-') || (*line == '+')))
+                negative = (*line++ == '-');
+            if ((line >= end) || (*line < '0') || (*line > '9')) break;
+            int value = 0;
+            while ((line < end) && (*line >= '0') && (*line <= '9'))
+                value = value*10 + (*line++ - '0');
+            record.value[n] = negative ? -value : value;
+        }
+        record.fields++;
+    }
+    return true;
+}
+
+/* Pack the two code characters for dispatch */
+inline constexpr int recordKey(char prefix, char code)
+{
+    return ((unsigned char)prefix << 8) | (unsigned char)code;
+}
+
+/* Position of a record in the schema table, or -1 if it is not there. The
+decoder is chosen with this so that the table can be reordered freely; a
+record missing from the table fails to compile. */
+inline constexpr int schemaIndex(char prefix, char code, int i = 0)
+{
+    return (i >= (int)(sizeof(recordSchema)/sizeof(recordSchema[0]))) ? -1 :
+           ((recordSchema[i].prefix == prefix) && (recordSchema[i].code == code))
+                ? i : schemaIndex(prefix,code,i+1);
+}
+
+//-----------------------------------------------------------------------------
+/** @brief Decode a Record Line
+
+Leading whitespace is skipped. Unknown records return false with the type set
+to recordNone; the code characters are still available.
+
+@param[in] line: record text (need not be terminated).
+@param[in] length: number of characters in the line.
+@param[out] record: decoded record.
+@returns true if the record type is known.
+*/
+
+inline bool decodeRecord(const char *line, int length,
+                         PowerManagementRecord &record)
+{
+    const char *end = line + length;
+    while ((line < end) && (*line <= ' ')) line++;
+    record.type = recordNone;
+    record.code[0] = 0;
+    record.code[1] = 0;
+    record.index = 0;
+    record.fields = 0;
+    record.value[0] = 0;
+    record.value[1] = 0;
+    record.scale = 1;
+    record.text = line;
+    record.textLength = 0;
+    if (line >= end) return false;
+    record.code[0] = line[0];
+    if (line[0] == 'D')
+        return decodeRecordFields<schemaIndex('D',' ')>(line+1,end,record);
+    if (end - line < 2) return false;
+    record.code[1] = line[1];
+    switch (recordKey(line[0],line[1]))
+    {
+        case recordKey('p','H'):
+            return decodeRecordFields<schemaIndex('p','H')>(line+2,end,record);
+        case recordKey('d','B'):
+            return decodeRecordFields<schemaIndex('d','B')>(line+2,end,record);
+        case recordKey('d','C'):
+            return decodeRecordFields<schemaIndex('d','C')>(line+2,end,record);
+        case recordKey('d','O'):
+            return decodeRecordFields<schemaIndex('d','O')>(line+2,end,record);
+        case recordKey('d','L'):
+            return decodeRecordFields<schemaIndex('d','L')>(line+2,end,record);
+        case recordKey('d','M'):
+            return decodeRecordFields<schemaIndex('d','M')>(line+2,end,record);
+        case recordKey('d','T'):
+            return decodeRecordFields<schemaIndex('d','T')>(line+2,end,record);
+        case recordKey('d','D'):
+            return decodeRecordFields<schemaIndex('d','D')>(line+2,end,record);
+        case recordKey('d','s'):
+            return decodeRecordFields<schemaIndex('d','s')>(line+2,end,record);
+        case recordKey('d','S'):
+            return decodeRecordFields<schemaIndex('d','S')>(line+2,end,record);
+        case recordKey('d','I'):
+            return decodeRecordFields<schemaIndex('d','I')>(line+2,end,record);
+        case recordKey('d','d'):
+            return decodeRecordFields<schemaIndex('d','d')>(line+2,end,record);
+        case recordKey('d','R'):
+            return decodeRecordFields<schemaIndex('d','R')>(line+2,end,record);
+    }
+    return false;
+}
+
+//-----------------------------------------------------------------------------
+/** @brief Test the Identifier of a Record Line
+
+The identifier is the first field of the line, compared in place without
+copying. Surrounding whitespace is ignored.
+
+@param[in] line: record text (need not be terminated).
+@param[in] length: number of characters in the line.
+@param[in] identifier: terminated identifier to compare with.
+@returns true if the first field is the identifier.
+*/
+
+inline bool recordIdentifierIs(const char *line, int length,
+                               const char *identifier)
+{
+    const char *end = line + length;
+    while ((line < end) && (*line <= ' ')) line++;
+    while (*identifier != 0)
+        if ((line >= end) || (*line++ != *identifier++)) return false;
+    while ((line < end) && (*line != ',') && (*line <= ' ')) line++;
+    return (line >= end) || (*line == ',');
+}
+
+#endif
@@ -0,0 +1,191 @@
+/*       Power Management Telemetry Ring
+
+A fixed size ring of decoded telemetry records. The main window decodes each
+incoming line once and writes it here; each window that wants telemetry reads
+the ring through its own cursor, so nothing is copied or queued per consumer.
+
+There is a single producer. The producer never waits for consumers: a consumer
+that falls more than a ring length behind skips ahead to the oldest sample
+still held and counts what it missed. Each slot carries a sequence number so
+that a sample overwritten while being read is detected and discarded.
+
+@date 18 October 2026
+*/
+
+/****************************************************************************
+ *   Copyright (C) 2013 by Ken Sarkies                                      *
+ *   ksarkies@internode.on.net                                              *
+ *                                                                          *
+ *   This file is part of Power Management GUI                              *
+ *                                                                          *
+ *   Power Management GUI is free software; you can redistribute it and/or  *
+ *   modify it under the terms of the GNU General Public License as         *
+ *   published by the Free Software Foundation; either version 2 of the     *
+ *   License, or (at your option) any later version.                        *
+ *                                                                          *
+ *   Power Management GUI is distributed in the hope that it will be useful,*
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the          *
+ *   GNU General Public License for more details.                           *
+ *                                                                          *
+ *   You should have received a copy of the GNU General Public License      *
+ *   along with Power Management GUI if not, write to the                   *
+ *   Free Software Foundation, Inc.,                                        *
+ *   51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.              *
+ ***************************************************************************/
+
+#ifndef POWER_MANAGEMENT_TELEMETRY_H
+#define POWER_MANAGEMENT_TELEMETRY_H
+
+#include "power-management-records.h"
+#include <QtGlobal>
+#include <atomic>
+
+/* Number of samples held. Must be a power of two. */
+#define TELEMETRY_RING_SIZE     1024
+
+static_assert((TELEMETRY_RING_SIZE & (TELEMETRY_RING_SIZE-1)) == 0,
+              "Telemetry ring size must be a power of two");
+
+//-----------------------------------------------------------------------------
+/** @brief Telemetry Sample
+
+The numeric part of a decoded record. Text fields are not carried.
+*/
+
+struct TelemetrySample
+{
+    RecordType type;
+    int index;
+    int fields;
+    int value[RECORD_MAX_FIELDS];
+    float scale;
+
+/** @brief Test for a record type and (optionally) device number */
+    bool is(RecordType recordType, int device = 0) const
+    {
+        return (type == recordType) && ((device == 0) || (index == device));
+    }
+
+/** @brief Field value converted from fixed point */
+    float scaled(int n) const
+    {
+        return (float)value[n]/scale;
+    }
+};
+
+//-----------------------------------------------------------------------------
+/** @brief Telemetry Ring
+
+Written only by the owner (the main window). Positions count samples written
+since creation; a slot's sequence is its position plus one once the sample is
+complete, and zero while it is being written.
+*/
+
+class TelemetryRing
+{
+public:
+    TelemetryRing() : head(0)
+    {
+        for (int i = 0; i < TELEMETRY_RING_SIZE; i++)
+            slot[i].sequence.store(0,std::memory_order_relaxed);
+    }
+
+/** @brief Write a decoded record to the ring */
+    void write(const PowerManagementRecord &record)
+    {
+        quint64 position = head.load(std::memory_order_relaxed);
+        Slot &entry = slot[position & (TELEMETRY_RING_SIZE-1)];
+        entry.sequence.store(0,std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        entry.sample.type = record.type;
+        entry.sample.index = record.index;
+        entry.sample.fields = record.fields;
+        for (int n = 0; n < RECORD_MAX_FIELDS; n++)
+            entry.sample.value[n] = record.value[n];
+        entry.sample.scale = record.scale;
+        entry.sequence.store(position+1,std::memory_order_release);
+        head.store(position+1,std::memory_order_release);
+    }
+
+/** @brief Position that the next sample will be written to */
+    quint64 position() const
+    {
+        return head.load(std::memory_order_acquire);
+    }
+
+private:
+    friend class TelemetryCursor;
+    struct Slot
+    {
+        std::atomic<quint64> sequence;
+        TelemetrySample sample;
+    };
+    Slot slot[TELEMETRY_RING_SIZE];
+    std::atomic<quint64> head;
+};
+
+//-----------------------------------------------------------------------------
+/** @brief Telemetry Cursor
+
+Each consumer holds one of these. It starts at the current end of the ring so
+that only samples arriving after it was created are seen.
+*/
+
+class TelemetryCursor
+{
+public:
+    TelemetryCursor(const TelemetryRing *telemetryRing)
+        : ring(telemetryRing), next(telemetryRing->position()), skipped(0)
+    {
+    }
+
+/** @brief Read the next sample
+
+@param[out] sample: the sample read.
+@returns false if there are no more samples.
+*/
+    bool read(TelemetrySample &sample)
+    {
+        while (true)
+        {
+            quint64 head = ring->position();
+            if (next >= head) return false;
+/* Fallen behind: skip ahead to the oldest sample still held */
+            if (head - next > TELEMETRY_RING_SIZE)
+            {
+                skipped += head - TELEMETRY_RING_SIZE - next;
+                next = head - TELEMETRY_RING_SIZE;
+            }
+            const TelemetryRing::Slot &entry =
+                ring->slot[next & (TELEMETRY_RING_SIZE-1)];
+            quint64 sequence = entry.sequence.load(std::memory_order_acquire);
+            if (sequence == next+1)
+            {
+                sample = entry.sample;
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (entry.sequence.load(std::memory_order_relaxed) == sequence)
+                {
+                    next++;
+                    return true;
+                }
+            }
+/* Overwritten while reading; count it and move on */
+            skipped++;
+            next++;
+        }
+    }
+
+/** @brief Number of samples missed through falling behind */
+    quint64 missed() const
+    {
+        return skipped;
+    }
+
+private:
+    const TelemetryRing *ring;
+    quint64 next;
+    quint64 skipped;
+};
+
+#endif
@@ -34,4 +34,27 @@
 // Particular serial port to use
 #define SERIAL_PORT "/dev/ttyUSB0"
 
+#include <QtGlobal>
+
+//-----------------------------------------------------------------------------
+/** @brief Update a CRC-32 Checksum.
+
+This matches the checksum computed by the remote unit (reflected polynomial
+0xEDB88320). Initialise to 0xFFFFFFFF and invert the final value.
+*/
+
+inline quint32 crc32Update(quint32 crc, const char *data, qint64 length)
+{
+    for (qint64 i=0; i<length; i++)
+    {
+        crc ^= (quint8)data[i];
+        for (int bit=0; bit<8; bit++)
+        {
+            if (crc & 1) crc = (crc >> 1) ^ 0xEDB88320;
+            else crc >>= 1;
+        }
+    }
+    return crc;
+}
+
 #endif
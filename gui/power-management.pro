@@ -15,7 +15,7 @@ MOC_DIR         = moc
 UI_HEADERS_DIR  = ui
 UI_SOURCES_DIR  = ui
 LANGUAGE        = C++
-CONFIG          += qt warn_on release
+CONFIG          += qt warn_on release c++11
 QT              += network
 
 RESOURCES       = power-management-gui.qrc
@@ -28,6 +28,8 @@ HEADERS         += power-management-main.h
 HEADERS         += power-management-monitor.h
 HEADERS         += power-management-configure.h
 HEADERS         += power-management-record.h
+HEADERS         += power-management-records.h
+HEADERS         += power-management-telemetry.h
 SOURCES         += power-management.cpp
 SOURCES         += power-management-main.cpp
 SOURCES         += power-management-monitor.cpp